@@ -66,12 +66,20 @@
 
 #include <stdint.h>
 
+/* Number of virtual cores the POSIX port schedules tasks on, each one a host
+ * thread. More than one requires configUSE_POSIX_EVENT_HANDOFF. */
+#ifndef configNUMBER_OF_CORES
+#define configNUMBER_OF_CORES           1
+#endif
+
 #define configUSE_PREEMPTION            1
 #define configUSE_IDLE_HOOK             1
+#define configUSE_TICKLESS_IDLE         ( configNUMBER_OF_CORES == 1 )
 #define configUSE_TICK_HOOK             0
 #define configTICK_RATE_HZ              ( ( TickType_t ) 1000 )
 #define configMINIMAL_STACK_SIZE        ( ( unsigned short ) 4 ) /* This can be made smaller if required. */
-#define configTOTAL_HEAP_SIZE           ( ( size_t ) ( 32 * 1024 ) )
+#define configTOTAL_HEAP_SIZE           ( ( size_t ) ( 1024 * 1024 ) ) /* Only enforced by heap_pool.c. */
+#define configHEAP_POOL_MAXIMUM_SLABS   256 /* Slabs per heap_pool.c size class, blocks beyond come from malloc(). */
 #define configMAX_TASK_NAME_LEN         ( 16 )
 #define configUSE_TRACE_FACILITY        1
 #define configUSE_16_BIT_TICKS          0
@@ -85,6 +93,7 @@
 #define configCHECK_FOR_STACK_OVERFLOW  0 /* Do not use this option on the PC port. */
 #define configUSE_APPLICATION_TASK_TAG  1
 #define configQUEUE_REGISTRY_SIZE       0
+#define configUSE_ZERO_COPY_QUEUES      1
 #define configMAX_SYSCALL_INTERRUPT_PRIORITY    1
 
 #define configMAX_PRIORITIES        ( 10 )
@@ -107,5 +116,6 @@ extern void vMainQueueSendPassed(void);
 #define traceQUEUE_SEND( pxQueue ) vMainQueueSendPassed()
 
 #define configGENERATE_RUN_TIME_STATS       1
+#define configRUN_TIME_COUNTER_TYPE         uint64_t
 
 #endif /* FREERTOS_CONFIG_H */
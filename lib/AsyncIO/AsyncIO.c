@@ -27,8 +27,13 @@
 #include <mqueue.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <unistd.h>
@@ -36,6 +41,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "AsyncIO.h"
 
@@ -43,309 +49,1985 @@
     fprintf(stderr, "[ERRNO: %s] %s:%d -> %s\n", strerror(errno),          \
             __FILE__, __LINE__, __func__);
 
-void *aIOTCPHandler(void *conn);
+/** Number of ready fds the reactor takes from the kernel per epoll_wait */
+#define AIO_REACTOR_EVENTS 64
+
+/** Initial sizes of the connection registry, both grow by doubling */
+#define AIO_REGISTRY_FDS 64
+#define AIO_REGISTRY_KEY_BUCKETS 16
+
+/** Initial size of an outbound TCP send queue, grown up to
+ * AIO_SOCKET_QUEUE_SIZE */
+#define AIO_SOCKET_QUEUE_MIN 1024
+
+/** Number of puts the reactor sends before it looks at other events again */
+#define AIO_OUTBOX_PASS 64
 
 typedef enum {
     NONE = 0,
     SOCKET,
     MSG_QUEUE,
+    OUTBOUND,
     SERIAL,
     NO_OF_CONN_TYPES
 } aIO_conn_e;
 
+struct aIO_tcp_client;
+
+/** Clients of a TCP socket, protected by the socket's lock */
+typedef struct {
+    aIO_tcp_callbacks_t callbacks;
+    unsigned int max_clients;
+    unsigned int clients;
+    int accept_paused;
+    int closing;
+    struct aIO_tcp_client *client_list;
+    pthread_cond_t all_closed;
+} aIO_tcp_server_t;
+
+/** Per datagram buffers of a UDP socket, filled by one recvmmsg */
+typedef struct {
+    struct mmsghdr msgs[AIO_UDP_BATCH];
+    struct iovec iovs[AIO_UDP_BATCH];
+    aIO_datagram_t datagrams[AIO_UDP_BATCH];
+} aIO_udp_ring_t;
+
 typedef struct {
     int fd;
     aIO_socket_e type;
     struct sockaddr_in addr;
+    aIO_tcp_server_t tcp;
+    aIO_udp_ring_t *ring;
+    aIO_batch_callback_t batch_callback;
 } aIO_socket_t;
 
 typedef struct {
     mqd_t fd;
+    /** Write end used by aIOMessageQueuePut for queues of this process */
+    mqd_t put_fd;
     char *name;
-    struct sigevent ev;
 } aIO_mq_t;
 
+/** A connection kept open by aIOSocketPut for one destination, only used by
+ * the reactor */
+typedef struct {
+    int fd;
+    aIO_socket_e protocol;
+    struct sockaddr_in addr;
+    /** Set once data was sent, only then is a failed connection retried */
+    int established;
+    /** TCP bytes not sent yet, from queue + queue_start on */
+    char *queue;
+    size_t queue_start;
+    size_t queue_len;
+    size_t queue_size;
+} aIO_outbound_t;
+
 typedef struct {
     //TODO
 } aIO_serial_t;
 
-typedef union {
-    aIO_socket_t socket;
-    aIO_mq_t mq;
-    aIO_serial_t tty;
-} aIO_attr;
+typedef union {
+    aIO_socket_t socket;
+    aIO_mq_t mq;
+    aIO_outbound_t out;
+    aIO_serial_t tty;
+} aIO_attr;
+
+typedef struct aIO {
+    aIO_conn_e type;
+
+    aIO_attr attr;
+    size_t buffer_size;
+    char *buffer;
+
+    pthread_t thread;
+
+    void (*callback)(size_t, char *, void *);
+    void *args;
+
+    /** Held by the registry and by everyone using the connection outside of
+     * it, protected by the registry's lock. The last one frees it. */
+    unsigned int refs;
+    atomic_int closing;
+    struct aIO *key_next;
+
+    pthread_mutex_t lock;
+} aIO_t;
+
+typedef struct aIO_worker {
+    int epoll_fd;
+    int wake_fd;
+    pthread_t thread;
+    unsigned int clients;
+
+    /** Shared by all clients of the worker, grown to the largest buffer size
+     * of their sockets */
+    char *buffer;
+    size_t buffer_size;
+} aIO_worker_t;
+
+typedef struct aIO_tcp_client {
+    int fd;
+    void *state;
+    struct aIO *server;
+    aIO_worker_t *worker;
+
+    struct aIO_tcp_client *prev;
+    struct aIO_tcp_client *next;
+} aIO_tcp_client_t;
+
+/** Open connections indexed by their fd. Message queues are also hashed by
+ * name and outbound connections by destination. The lock is only held to
+ * look a connection up and take a reference. */
+static struct {
+    aIO_t **fds;
+    size_t fd_slots;
+    aIO_t **keys;
+    size_t key_buckets;
+    size_t key_count;
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+} aIO_registry = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                   .released = PTHREAD_COND_INITIALIZER
+                 };
+
+/** The reactor thread waits on a single epoll instance for all connections,
+ * the eventfd is only used to stop it and the timerfd ends the coalescing
+ * window of aIOUDPPut */
+static struct {
+    int epoll_fd;
+    int wake_fd;
+    int timer_fd;
+    int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+} aIO_reactor = { .epoll_fd = -1,
+                  .wake_fd = -1,
+                  .timer_fd = -1,
+                  .lock = PTHREAD_MUTEX_INITIALIZER
+                };
+
+/** Data passed to aIOSocketPut or aIOUDPPut, waiting to be taken by the
+ * reactor. Port in network order. */
+typedef struct aIO_socket_put {
+    struct aIO_socket_put *next;
+    aIO_socket_e protocol;
+    int batched;
+    in_addr_t s_addr;
+    in_port_t port;
+    size_t size;
+    char data[];
+} aIO_socket_put_t;
+
+/** aIOSocketPut and aIOUDPPut push onto the outbox with a compare and swap
+ * and the put that finds it empty wakes the reactor through the eventfd, so
+ * tasks never take a lock that the reactor holds. The lock only serialises
+ * the sides that take puts off the outbox. */
+static struct {
+    _Atomic(aIO_socket_put_t *) head;
+    /** Bytes put that were neither handed to the kernel nor dropped yet,
+     * including the TCP send queues, bounded by AIO_SOCKET_QUEUE_SIZE */
+    atomic_size_t bytes;
+    atomic_int ready;
+    atomic_int flush;
+    atomic_int fd;
+    aIO_socket_put_t *pending;
+    aIO_socket_put_t *pending_tail;
+    int flushing;
+    pthread_mutex_t lock;
+} aIO_outbox = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** Called once put bytes were sent or dropped */
+static void aIOReleaseUnsent(size_t size)
+{
+    atomic_fetch_sub_explicit(&aIO_outbox.bytes, size, memory_order_relaxed);
+}
+
+/** Datagrams passed to aIOUDPPut, sent together from a single socket. Only
+ * used with the outbox's lock held, the slots point into the puts. */
+static struct {
+    int fd;
+    unsigned int count;
+    struct mmsghdr msgs[AIO_UDP_BATCH];
+    struct iovec iovs[AIO_UDP_BATCH];
+    struct sockaddr_in addrs[AIO_UDP_BATCH];
+    aIO_socket_put_t *puts[AIO_UDP_BATCH];
+} aIO_udp_out = { .fd = -1 };
+
+/** Set while the reactor thread calls back for a connection */
+static __thread int aIO_dispatching;
+/** Set on the TCP worker threads, which call back for the clients */
+static __thread int aIO_serving;
+
+/** TCP clients are spread over a fixed number of workers, each waiting on an
+ * epoll instance of its own for the clients it serves */
+static struct {
+    aIO_worker_t workers[AIO_TCP_WORKERS];
+    int running;
+    pthread_mutex_t lock;
+} aIO_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int aIOConnFd(aIO_t *conn)
+{
+    switch (conn->type) {
+        case MSG_QUEUE:
+            return (int)conn->attr.mq.fd;
+        case OUTBOUND:
+            return conn->attr.out.fd;
+        default:
+            return conn->attr.socket.fd;
+    }
+}
+
+/** FNV-1a */
+static size_t aIOHashBytes(size_t hash, const void *bytes, size_t len)
+{
+    const unsigned char *byte = (const unsigned char *)bytes;
+
+    while (len--) {
+        hash = (hash ^ *byte++) * 16777619u;
+    }
+
+    return hash;
+}
+
+static size_t aIOHashName(const char *name)
+{
+    return aIOHashBytes(2166136261u, name, strlen(name));
+}
+
+static size_t aIOHashDest(aIO_socket_e protocol, in_addr_t s_addr,
+                          in_port_t port)
+{
+    size_t hash = aIOHashBytes(2166136261u, &protocol, sizeof(protocol));
+
+    hash = aIOHashBytes(hash, &s_addr, sizeof(s_addr));
+    return aIOHashBytes(hash, &port, sizeof(port));
+}
+
+static size_t aIOHashConn(aIO_t *conn)
+{
+    if (conn->type == MSG_QUEUE) {
+        return aIOHashName(conn->attr.mq.name);
+    }
+
+    return aIOHashDest(conn->attr.out.protocol,
+                       conn->attr.out.addr.sin_addr.s_addr,
+                       conn->attr.out.addr.sin_port);
+}
+
+/** Must be called with the registry's lock held */
+static aIO_t *aIOFindMQ(const char *name)
+{
+    aIO_t *conn;
+
+    if (aIO_registry.key_buckets == 0) {
+        return NULL;
+    }
+
+    for (conn = aIO_registry.keys[aIOHashName(name) &
+                                  (aIO_registry.key_buckets - 1)];
+         conn; conn = conn->key_next)
+        if (conn->type == MSG_QUEUE && !strcmp(conn->attr.mq.name, name)) {
+            return conn;
+        }
+
+    return NULL;
+}
+
+/** Must be called with the registry's lock held, port in network order */
+static aIO_t *aIOFindOutbound(aIO_socket_e protocol, in_addr_t s_addr,
+                              in_port_t port)
+{
+    aIO_t *conn;
+
+    if (aIO_registry.key_buckets == 0) {
+        return NULL;
+    }
+
+    for (conn = aIO_registry.keys[aIOHashDest(protocol, s_addr, port) &
+                                  (aIO_registry.key_buckets - 1)];
+         conn; conn = conn->key_next)
+        if (conn->type == OUTBOUND && conn->attr.out.protocol == protocol &&
+            conn->attr.out.addr.sin_addr.s_addr == s_addr &&
+            conn->attr.out.addr.sin_port == port) {
+            return conn;
+        }
+
+    return NULL;
+}
+
+/** Must be called with the registry's lock held */
+static int aIOGrowKeyBuckets(void)
+{
+    size_t buckets = aIO_registry.key_buckets ?
+                     2 * aIO_registry.key_buckets :
+                     AIO_REGISTRY_KEY_BUCKETS;
+    aIO_t **keys = (aIO_t **)calloc(buckets, sizeof(aIO_t *));
+    aIO_t *conn;
+    size_t i, bucket;
+
+    if (keys == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < aIO_registry.key_buckets; i++)
+        while ((conn = aIO_registry.keys[i]) != NULL) {
+            aIO_registry.keys[i] = conn->key_next;
+            bucket = aIOHashConn(conn) & (buckets - 1);
+            conn->key_next = keys[bucket];
+            keys[bucket] = conn;
+        }
+
+    free(aIO_registry.keys);
+    aIO_registry.keys = keys;
+    aIO_registry.key_buckets = buckets;
+
+    return 0;
+}
+
+/** Must be called with the registry's lock held */
+static int aIOInsertKey(aIO_t *conn)
+{
+    size_t bucket;
+
+    if (aIO_registry.key_count >= aIO_registry.key_buckets &&
+        aIOGrowKeyBuckets()) {
+        fprintf(stderr, "Failed to grow AIO registry\n");
+        return -1;
+    }
+
+    bucket = aIOHashConn(conn) & (aIO_registry.key_buckets - 1);
+    conn->key_next = aIO_registry.keys[bucket];
+    aIO_registry.keys[bucket] = conn;
+    aIO_registry.key_count++;
+
+    return 0;
+}
+
+/** Must be called with the registry's lock held */
+static int aIOGrowFds(int fd)
+{
+    size_t slots = aIO_registry.fd_slots ? aIO_registry.fd_slots :
+                   AIO_REGISTRY_FDS;
+    aIO_t **fds;
+
+    while (slots <= (size_t)fd) {
+        slots *= 2;
+    }
+
+    fds = (aIO_t **)realloc(aIO_registry.fds, slots * sizeof(aIO_t *));
+    if (fds == NULL) {
+        return -1;
+    }
+    memset(fds + aIO_registry.fd_slots, 0,
+           (slots - aIO_registry.fd_slots) * sizeof(aIO_t *));
+
+    aIO_registry.fds = fds;
+    aIO_registry.fd_slots = slots;
+
+    return 0;
+}
+
+static int aIORegister(aIO_t *conn)
+{
+    int fd = aIOConnFd(conn);
+    int ret = -1;
+
+    pthread_mutex_lock(&aIO_registry.lock);
+
+    if ((size_t)fd >= aIO_registry.fd_slots && aIOGrowFds(fd)) {
+        fprintf(stderr, "Failed to grow AIO registry\n");
+        goto out;
+    }
+
+    if (conn->type == MSG_QUEUE) {
+        if (aIOFindMQ(conn->attr.mq.name)) {
+            fprintf(stderr, "MQ '%s' is already open\n", conn->attr.mq.name);
+            goto out;
+        }
+        if (aIOInsertKey(conn)) {
+            goto out;
+        }
+    }
+
+    aIO_registry.fds[fd] = conn;
+    conn->refs = 1;
+
+    ret = 0;
+out:
+    pthread_mutex_unlock(&aIO_registry.lock);
+    return ret;
+}
+
+/** Must be called with the registry's lock held */
+static void aIOUnregister(aIO_t *conn)
+{
+    int fd = aIOConnFd(conn);
+    aIO_t **iterator;
+
+    if ((size_t)fd < aIO_registry.fd_slots &&
+        aIO_registry.fds[fd] == conn) {
+        aIO_registry.fds[fd] = NULL;
+    }
+
+    if ((conn->type == MSG_QUEUE || conn->type == OUTBOUND) &&
+        aIO_registry.key_buckets) {
+        for (iterator = &aIO_registry.keys[aIOHashConn(conn) &
+                                           (aIO_registry.key_buckets - 1)];
+             *iterator; iterator = &(*iterator)->key_next)
+            if (*iterator == conn) {
+                *iterator = conn->key_next;
+                aIO_registry.key_count--;
+                break;
+            }
+    }
+}
+
+/** Returns the connection registered for fd with a reference taken, which
+ * keeps it from being freed until aIORelease */
+static aIO_t *aIOAcquire(int fd)
+{
+    aIO_t *conn = NULL;
+
+    pthread_mutex_lock(&aIO_registry.lock);
+    if ((size_t)fd < aIO_registry.fd_slots) {
+        conn = aIO_registry.fds[fd];
+    }
+    if (conn) {
+        conn->refs++;
+    }
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    return conn;
+}
+
+static void aIOFreeConn(aIO_t *conn);
+
+static void aIORelease(aIO_t *conn)
+{
+    unsigned int refs;
+
+    pthread_mutex_lock(&aIO_registry.lock);
+    refs = --conn->refs;
+    if (refs) {
+        pthread_cond_broadcast(&aIO_registry.released);
+    }
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    if (refs == 0) {
+        aIOFreeConn(conn);
+    }
+}
+
+static void aIOReceiveUDP(aIO_t *conn)
+{
+    aIO_udp_ring_t *ring = conn->attr.socket.ring;
+    int count, i;
+
+    /** Edge triggered, the socket must be drained until it would block or
+     * a callback closed the connection */
+    while (!atomic_load(&conn->closing)) {
+        for (i = 0; i < AIO_UDP_BATCH; i++) {
+            ring->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+
+        count = recvmmsg(conn->attr.socket.fd, ring->msgs, AIO_UDP_BATCH, 0,
+                         NULL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                PRINT_CHECK;
+            }
+            return;
+        }
+
+        for (i = 0; i < count; i++) {
+            ring->datagrams[i].recv_size = ring->msgs[i].msg_len;
+            ring->datagrams[i].buffer[ring->msgs[i].msg_len] = '\0';
+        }
+
+        if (conn->attr.socket.batch_callback) {
+            (conn->attr.socket.batch_callback)(ring->datagrams, count,
+                                               conn->args);
+            continue;
+        }
+
+        for (i = 0; i < count && !atomic_load(&conn->closing); i++)
+            if (conn->callback)
+                (conn->callback)(ring->datagrams[i].recv_size,
+                                 ring->datagrams[i].buffer, conn->args);
+    }
+}
+
+static int aIORearm(int fd);
+
+/** Must be called with the server's lock held */
+static void aIOUnlinkTCPClient(aIO_tcp_server_t *tcp, aIO_tcp_client_t *client)
+{
+    if (client->prev) {
+        client->prev->next = client->next;
+    }
+    else {
+        tcp->client_list = client->next;
+    }
+    if (client->next) {
+        client->next->prev = client->prev;
+    }
+    tcp->clients--;
+}
+
+static void aIOCloseTCPClient(aIO_tcp_client_t *client)
+{
+    aIO_t *server = client->server;
+    aIO_tcp_server_t *tcp = &server->attr.socket.tcp;
+
+    pthread_mutex_lock(&aIO_pool.lock);
+    if (client->worker->epoll_fd != -1) {
+        epoll_ctl(client->worker->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    }
+    client->worker->clients--;
+    pthread_mutex_unlock(&aIO_pool.lock);
+
+    if (tcp->callbacks.close) {
+        (tcp->callbacks.close)(client->state);
+    }
+
+    /** The fd is only closed with the lock held so that a closing server
+     * never shuts down an fd number that was already reused */
+    pthread_mutex_lock(&server->lock);
+    close(client->fd);
+    aIOUnlinkTCPClient(tcp, client);
+    if (tcp->accept_paused && !tcp->closing) {
+        tcp->accept_paused = 0;
+        aIORearm(server->attr.socket.fd);
+    }
+    if (tcp->closing && tcp->clients == 0) {
+        pthread_cond_broadcast(&tcp->all_closed);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    free(client);
+}
+
+static void aIOServeTCPClient(aIO_tcp_client_t *client)
+{
+    aIO_worker_t *worker = client->worker;
+    aIO_t *server = client->server;
+    size_t size = server->buffer_size;
+    ssize_t read_size;
+    char *buffer;
+
+    if (worker->buffer_size < size) {
+        buffer = (char *)realloc(worker->buffer, size + 1);
+        if (buffer == NULL) {
+            fprintf(stderr, "Failed to grow TCP worker buffer\n");
+            PRINT_CHECK;
+            aIOCloseTCPClient(client);
+            return;
+        }
+        worker->buffer = buffer;
+        worker->buffer_size = size;
+    }
+
+    /** Level triggered and a single read per wakeup, so the clients of a
+     * worker take turns and unread data is left to TCP flow control */
+    read_size = recv(client->fd, worker->buffer, size, 0);
+    if (read_size > 0) {
+        worker->buffer[read_size] = '\0';
+        if (server->attr.socket.tcp.callbacks.data)
+            (server->attr.socket.tcp.callbacks.data)(read_size,
+                    worker->buffer, client->state);
+        return;
+    }
+
+    if (read_size < 0 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+
+    aIOCloseTCPClient(client);
+}
+
+static void *aIOWorkerThread(void *args)
+{
+    aIO_worker_t *worker = (aIO_worker_t *)args;
+    struct epoll_event events[AIO_REACTOR_EVENTS];
+    int ready, i;
+
+    aIO_serving = 1;
+
+    while (1) {
+        ready = epoll_wait(worker->epoll_fd, events, AIO_REACTOR_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PRINT_CHECK;
+            return NULL;
+        }
+
+        for (i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL) {
+                return NULL;
+            }
+            aIOServeTCPClient((aIO_tcp_client_t *)events[i].data.ptr);
+        }
+    }
+}
+
+static int aIOStartWorker(aIO_worker_t *worker)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    sigset_t all_signals, old_signals;
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd == -1) {
+        fprintf(stderr, "Failed to create TCP worker epoll instance\n");
+        goto error_epoll;
+    }
+
+    worker->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (worker->wake_fd == -1) {
+        fprintf(stderr, "Failed to create TCP worker wake eventfd\n");
+        goto error_eventfd;
+    }
+
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &ev)) {
+        fprintf(stderr, "Failed to register TCP worker wake eventfd\n");
+        goto error_thread;
+    }
+
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    if (pthread_create(&worker->thread, NULL, aIOWorkerThread, worker)) {
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        fprintf(stderr, "Failed to create TCP worker thread\n");
+        goto error_thread;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    worker->clients = 0;
+
+    return 0;
+
+error_thread:
+    close(worker->wake_fd);
+error_eventfd:
+    close(worker->epoll_fd);
+error_epoll:
+    worker->wake_fd = -1;
+    worker->epoll_fd = -1;
+    PRINT_CHECK;
+    return -1;
+}
+
+static void aIOStopWorkers(unsigned int count)
+{
+    uint64_t quit = 1;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        aIO_worker_t *worker = &aIO_pool.workers[i];
+
+        if (write(worker->wake_fd, &quit, sizeof(quit)) < 0) {
+            PRINT_CHECK;
+        }
+        else if (!pthread_equal(pthread_self(), worker->thread)) {
+            pthread_join(worker->thread, NULL);
+        }
+        else {
+            pthread_detach(worker->thread);
+        }
+
+        close(worker->wake_fd);
+        close(worker->epoll_fd);
+        worker->wake_fd = -1;
+        worker->epoll_fd = -1;
+        free(worker->buffer);
+        worker->buffer = NULL;
+        worker->buffer_size = 0;
+    }
+}
+
+/** Must be called with the pool's lock held */
+static int aIOStartPool(void)
+{
+    unsigned int i;
+
+    if (aIO_pool.running) {
+        return 0;
+    }
+
+    for (i = 0; i < AIO_TCP_WORKERS; i++) {
+        if (aIOStartWorker(&aIO_pool.workers[i])) {
+            aIOStopWorkers(i);
+            return -1;
+        }
+    }
+
+    aIO_pool.running = 1;
+
+    return 0;
+}
+
+static int aIOPoolRunning(void)
+{
+    int running;
+
+    pthread_mutex_lock(&aIO_pool.lock);
+    running = aIO_pool.running;
+    pthread_mutex_unlock(&aIO_pool.lock);
+
+    return running;
+}
+
+static void aIOStopPool(void)
+{
+    int running;
+
+    /** Workers closing a client take the lock, it can not be held while
+     * waiting for them */
+    pthread_mutex_lock(&aIO_pool.lock);
+    running = aIO_pool.running;
+    aIO_pool.running = 0;
+    pthread_mutex_unlock(&aIO_pool.lock);
+
+    if (running) {
+        aIOStopWorkers(AIO_TCP_WORKERS);
+    }
+}
+
+/** Hands a client to the worker serving the fewest clients, the worker may
+ * start serving and even close it before this returns */
+static int aIOAssignWorker(aIO_tcp_client_t *client)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP,
+                              .data.ptr = client
+                            };
+    aIO_worker_t *worker;
+    unsigned int i;
+    int ret = -1;
+
+    pthread_mutex_lock(&aIO_pool.lock);
+
+    if (!aIO_pool.running) {
+        goto out;
+    }
+
+    worker = &aIO_pool.workers[0];
+    for (i = 1; i < AIO_TCP_WORKERS; i++)
+        if (aIO_pool.workers[i].clients < worker->clients) {
+            worker = &aIO_pool.workers[i];
+        }
+
+    client->worker = worker;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client->fd, &ev)) {
+        PRINT_CHECK;
+        goto out;
+    }
+    worker->clients++;
+
+    ret = 0;
+out:
+    pthread_mutex_unlock(&aIO_pool.lock);
+    return ret;
+}
+
+static void aIOAcceptTCP(aIO_t *conn)
+{
+    aIO_tcp_server_t *tcp = &conn->attr.socket.tcp;
+    aIO_tcp_client_t *client;
+    int client_fd;
+
+    while (!tcp->closing && !atomic_load(&conn->closing)) {
+        /** Further connections wait in the backlog, the listening socket
+         * is re-armed once a client closed */
+        if (tcp->clients >= tcp->max_clients) {
+            tcp->accept_paused = 1;
+            return;
+        }
+
+        client_fd = accept4(conn->attr.socket.fd, NULL, NULL,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                PRINT_CHECK;
+            }
+            return;
+        }
+
+        client = (aIO_tcp_client_t *)calloc(1, sizeof(aIO_tcp_client_t));
+        if (client == NULL) {
+            fprintf(stderr, "Failed to allocate TCP client\n");
+            PRINT_CHECK;
+            close(client_fd);
+            continue;
+        }
+        client->fd = client_fd;
+        client->server = conn;
+        client->state = tcp->callbacks.connect ?
+                        (tcp->callbacks.connect)(conn->args) :
+                        conn->args;
+
+        client->next = tcp->client_list;
+        if (client->next) {
+            client->next->prev = client;
+        }
+        tcp->client_list = client;
+        tcp->clients++;
+
+        if (aIOAssignWorker(client)) {
+            fprintf(stderr, "Failed to hand TCP client to a worker\n");
+            if (tcp->callbacks.close) {
+                (tcp->callbacks.close)(client->state);
+            }
+            aIOUnlinkTCPClient(tcp, client);
+            close(client_fd);
+            free(client);
+        }
+    }
+}
+
+/** Disconnects all clients of a TCP socket and waits for their close
+ * callbacks. Once the pool is stopped they are closed right here. Must not be
+ * called from a worker while the pool runs, aIOCloseConn refuses that. */
+static void aIOCloseTCPClients(aIO_t *server)
+{
+    aIO_tcp_server_t *tcp = &server->attr.socket.tcp;
+    aIO_tcp_client_t *client;
+    int running = aIOPoolRunning();
+
+    pthread_mutex_lock(&server->lock);
+    tcp->closing = 1;
+    if (running) {
+        /** The workers see the shutdown as the client disconnecting */
+        for (client = tcp->client_list; client; client = client->next) {
+            shutdown(client->fd, SHUT_RDWR);
+        }
+        while (tcp->clients) {
+            pthread_cond_wait(&tcp->all_closed, &server->lock);
+        }
+    }
+    else {
+        while ((client = tcp->client_list) != NULL) {
+            pthread_mutex_unlock(&server->lock);
+            aIOCloseTCPClient(client);
+            pthread_mutex_lock(&server->lock);
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_cond_destroy(&tcp->all_closed);
+}
+
+static void aIOReceiveMQ(aIO_t *conn)
+{
+    ssize_t bytes_read;
+
+    while (!atomic_load(&conn->closing)) {
+        bytes_read = mq_receive(conn->attr.mq.fd, conn->buffer,
+                                conn->buffer_size, NULL);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                fprintf(stderr, "Failed to receive from MQ '%s'\n",
+                        conn->attr.mq.name);
+                PRINT_CHECK;
+            }
+            return;
+        }
+
+        conn->buffer[bytes_read] = '\0';
+        if (conn->callback)
+            (conn->callback)(bytes_read, conn->buffer, conn->args);
+    }
+}
+
+static void aIOServiceOutbound(aIO_t *conn);
+static void aIOProcessOutbox(void);
+static void aIOEndUDPWindow(void);
+static void aIOCloseOutbox(void);
+
+static void aIODispatch(aIO_t *conn)
+{
+    pthread_mutex_lock(&conn->lock);
+
+    switch (conn->type) {
+        case SOCKET:
+            if (conn->attr.socket.type == UDP) {
+                aIOReceiveUDP(conn);
+            }
+            else {
+                aIOAcceptTCP(conn);
+            }
+            break;
+        case MSG_QUEUE:
+            aIOReceiveMQ(conn);
+            break;
+        case OUTBOUND:
+            aIOServiceOutbound(conn);
+            break;
+        default:
+            break;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void *aIOReactorThread(void *args)
+{
+    struct epoll_event events[AIO_REACTOR_EVENTS];
+    uint64_t expirations;
+    aIO_t *conn;
+    int ready, i;
+
+    while (1) {
+        ready = epoll_wait(aIO_reactor.epoll_fd, events,
+                           AIO_REACTOR_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PRINT_CHECK;
+            return NULL;
+        }
+
+        for (i = 0; i < ready; i++) {
+            if (events[i].data.fd == aIO_reactor.wake_fd) {
+                return NULL;
+            }
+            if (events[i].data.fd == aIO_outbox.fd) {
+                aIOProcessOutbox();
+                continue;
+            }
+            if (events[i].data.fd == aIO_reactor.timer_fd) {
+                if (read(aIO_reactor.timer_fd, &expirations,
+                         sizeof(expirations)) > 0) {
+                    aIOEndUDPWindow();
+                }
+                continue;
+            }
+            /** A connection closed since epoll_wait returned is no longer
+             * found, its fd might already belong to a new connection which
+             * then just finds nothing to read */
+            conn = aIOAcquire(events[i].data.fd);
+            if (conn) {
+                aIO_dispatching = 1;
+                aIODispatch(conn);
+                aIO_dispatching = 0;
+                aIORelease(conn);
+            }
+        }
+    }
+}
+
+static int aIOStartReactor(void)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    sigset_t all_signals, old_signals;
+
+    aIO_reactor.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (aIO_reactor.epoll_fd == -1) {
+        fprintf(stderr, "Failed to create AIO epoll instance\n");
+        goto error_epoll;
+    }
+
+    aIO_reactor.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (aIO_reactor.wake_fd == -1) {
+        fprintf(stderr, "Failed to create AIO wake eventfd\n");
+        goto error_eventfd;
+    }
+
+    ev.data.fd = aIO_reactor.wake_fd;
+    if (epoll_ctl(aIO_reactor.epoll_fd, EPOLL_CTL_ADD, aIO_reactor.wake_fd,
+                  &ev)) {
+        fprintf(stderr, "Failed to register AIO wake eventfd\n");
+        goto error_timerfd;
+    }
+
+    aIO_reactor.timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                          TFD_CLOEXEC | TFD_NONBLOCK);
+    if (aIO_reactor.timer_fd == -1) {
+        fprintf(stderr, "Failed to create AIO timerfd\n");
+        goto error_timerfd;
+    }
+
+    ev.data.fd = aIO_reactor.timer_fd;
+    if (epoll_ctl(aIO_reactor.epoll_fd, EPOLL_CTL_ADD, aIO_reactor.timer_fd,
+                  &ev)) {
+        fprintf(stderr, "Failed to register AIO timerfd\n");
+        goto error_thread;
+    }
+
+    /** The reactor, and the TCP handlers it creates, inherit a mask with
+     * all signals blocked so that no signal of the FreeRTOS port or of the
+     * application is ever delivered to them */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    if (pthread_create(&aIO_reactor.thread, NULL, aIOReactorThread, NULL)) {
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        fprintf(stderr, "Failed to create AIO reactor thread\n");
+        goto error_thread;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    aIO_reactor.running = 1;
+
+    return 0;
+
+error_thread:
+    close(aIO_reactor.timer_fd);
+    aIO_reactor.timer_fd = -1;
+error_timerfd:
+    close(aIO_reactor.wake_fd);
+    aIO_reactor.wake_fd = -1;
+error_eventfd:
+    close(aIO_reactor.epoll_fd);
+    aIO_reactor.epoll_fd = -1;
+error_epoll:
+    PRINT_CHECK;
+    return -1;
+}
+
+static void aIOStopReactor(void)
+{
+    uint64_t quit = 1;
+    int running;
+
+    /** A dispatch can wait for a worker that waits for the lock, so it is
+     * not held while waiting for the reactor */
+    pthread_mutex_lock(&aIO_reactor.lock);
+    running = aIO_reactor.running;
+    aIO_reactor.running = 0;
+    pthread_mutex_unlock(&aIO_reactor.lock);
+
+    if (!running) {
+        return;
+    }
+
+    if (write(aIO_reactor.wake_fd, &quit, sizeof(quit)) < 0) {
+        PRINT_CHECK;
+    }
+    /** A callback calling exit() runs the atexit handlers on the reactor
+     * thread itself, which then must not wait for itself */
+    else if (!pthread_equal(pthread_self(), aIO_reactor.thread)) {
+        pthread_join(aIO_reactor.thread, NULL);
+    }
+    else {
+        pthread_detach(aIO_reactor.thread);
+    }
+
+    close(aIO_reactor.timer_fd);
+    close(aIO_reactor.wake_fd);
+    close(aIO_reactor.epoll_fd);
+    aIO_reactor.timer_fd = -1;
+    aIO_reactor.wake_fd = -1;
+    aIO_reactor.epoll_fd = -1;
+}
+
+/** Adds a registered connection's fd to the reactor, starting the reactor when
+ * the first connection is opened. Edge triggered, so the dispatch functions
+ * read until the fd would block. */
+static int aIOWatch(int fd, uint32_t events)
+{
+    struct epoll_event ev = { .events = events | EPOLLET, .data.fd = fd };
+    int ret = -1;
+
+    pthread_mutex_lock(&aIO_reactor.lock);
+
+    if (!aIO_reactor.running && aIOStartReactor()) {
+        goto out;
+    }
+
+    if (epoll_ctl(aIO_reactor.epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        fprintf(stderr, "Failed to add fd %d to the AIO reactor\n", fd);
+        PRINT_CHECK;
+        goto out;
+    }
+
+    ret = 0;
+out:
+    pthread_mutex_unlock(&aIO_reactor.lock);
+    return ret;
+}
+
+static void aIOUnwatch(int fd)
+{
+    pthread_mutex_lock(&aIO_reactor.lock);
+    if (aIO_reactor.running) {
+        epoll_ctl(aIO_reactor.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    pthread_mutex_unlock(&aIO_reactor.lock);
+}
+
+/** Modifying an edge triggered fd makes epoll check it again, so events that
+ * were already signalled but not handled are reported once more */
+static int aIORearm(int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.fd = fd };
+    int ret = -1;
+
+    pthread_mutex_lock(&aIO_reactor.lock);
+    if (aIO_reactor.running) {
+        ret = epoll_ctl(aIO_reactor.epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    pthread_mutex_unlock(&aIO_reactor.lock);
+
+    return ret;
+}
+
+/** Must be called with the connection's lock held */
+static void aIODisconnectOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+
+    if (out->fd == -1) {
+        return;
+    }
+
+    pthread_mutex_lock(&aIO_registry.lock);
+    if ((size_t)out->fd < aIO_registry.fd_slots &&
+        aIO_registry.fds[out->fd] == conn) {
+        aIO_registry.fds[out->fd] = NULL;
+    }
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    if (out->protocol == TCP) {
+        aIOUnwatch(out->fd);
+    }
+    close(out->fd);
+    out->fd = -1;
+}
+
+/** Must be called with the connection's lock held. A TCP connection is
+ * established in the background, the reactor sends what was queued until
+ * then once the socket becomes writable. */
+static int aIOConnectOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+    char s_addr[INET_ADDRSTRLEN];
+    const int one = 1;
+    int fd;
+
+    fd = socket(AF_INET, (out->protocol == TCP ? SOCK_STREAM : SOCK_DGRAM) |
+                SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to create %s socket\n",
+                out->protocol == TCP ? "TCP" : "UDP");
+        goto error_socket;
+    }
+
+    /** Puts are usually small and already sent as soon as possible */
+    if (out->protocol == TCP) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (connect(fd, (struct sockaddr *)&out->addr, sizeof(out->addr)) &&
+        errno != EINPROGRESS) {
+        fprintf(stderr, "Connecting to %s:%d failed\n",
+                inet_ntop(AF_INET, &out->addr.sin_addr, s_addr,
+                          sizeof(s_addr)),
+                ntohs(out->addr.sin_port));
+        goto error_connect;
+    }
+
+    /** Not registered any more once aIOCloseConn started closing it */
+    pthread_mutex_lock(&aIO_registry.lock);
+    if (atomic_load(&conn->closing) ||
+        ((size_t)fd >= aIO_registry.fd_slots && aIOGrowFds(fd))) {
+        pthread_mutex_unlock(&aIO_registry.lock);
+        goto error_connect;
+    }
+    aIO_registry.fds[fd] = conn;
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    out->fd = fd;
+
+    if (out->protocol == TCP && aIOWatch(fd, EPOLLIN | EPOLLOUT)) {
+        aIODisconnectOutbound(conn);
+        return -1;
+    }
+
+    return 0;
+
+error_connect:
+    close(fd);
+error_socket:
+    PRINT_CHECK;
+    return -1;
+}
+
+/** Sends queued bytes until the socket would block, must be called with the
+ * connection's lock held. Returns -1 if the connection failed. */
+static int aIOFlushOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+    ssize_t sent;
+
+    while (out->queue_len) {
+        sent = send(out->fd, out->queue + out->queue_start, out->queue_len,
+                    MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            return -1;
+        }
+
+        out->established = 1;
+        out->queue_start += sent;
+        out->queue_len -= sent;
+        aIOReleaseUnsent(sent);
+    }
+
+    out->queue_start = 0;
+    return 0;
+}
+
+/** Appends to the send queue, which only grows as far as it has to */
+static int aIOQueueOutbound(aIO_outbound_t *out, const char *buffer,
+                            size_t size)
+{
+    size_t queue_size = out->queue_size ? out->queue_size :
+                        AIO_SOCKET_QUEUE_MIN;
+    char *queue;
+
+    if (out->queue_start + out->queue_len + size > out->queue_size &&
+        out->queue_len) {
+        memmove(out->queue, out->queue + out->queue_start, out->queue_len);
+    }
+    if (out->queue_start + out->queue_len + size > out->queue_size) {
+        out->queue_start = 0;
+    }
+
+    if (out->queue_len + size > out->queue_size) {
+        while (queue_size < out->queue_len + size) {
+            queue_size *= 2;
+        }
+
+        queue = (char *)realloc(out->queue, queue_size);
+        if (queue == NULL) {
+            return -1;
+        }
+        out->queue = queue;
+        out->queue_size = queue_size;
+    }
+
+    memcpy(out->queue + out->queue_start + out->queue_len, buffer, size);
+    out->queue_len += size;
+
+    return 0;
+}
+
+/** Must be called with the connection's lock held. A connection that already
+ * carried data is connected again once to send what is still queued, if that
+ * fails as well the queued bytes are dropped. */
+static int aIORecoverOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+    int established = out->established;
+
+    aIODisconnectOutbound(conn);
+    out->established = 0;
+
+    if (out->queue_len == 0) {
+        return 0;
+    }
+
+    if (established && !aIOConnectOutbound(conn) &&
+        !aIOFlushOutbound(conn)) {
+        return 0;
+    }
+
+    fprintf(stderr, "Dropping %zu bytes to port %d\n", out->queue_len,
+            ntohs(out->addr.sin_port));
+    aIODisconnectOutbound(conn);
+    aIOReleaseUnsent(out->queue_len);
+    out->queue_start = 0;
+    out->queue_len = 0;
+
+    return -1;
+}
+
+/** Called from the reactor once an outbound TCP connection is established,
+ * can take more data or was closed */
+static void aIOServiceOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+    char discard[256];
+    ssize_t ret;
+
+    if (out->fd == -1) {
+        return;
+    }
+
+    /** Nothing is expected back, reading only tells if the peer closed the
+     * connection or it failed */
+    while ((ret = recv(out->fd, discard, sizeof(discard), 0)) > 0)
+        ;
+
+    if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                     errno != EINTR) || aIOFlushOutbound(conn)) {
+        aIORecoverOutbound(conn);
+    }
+}
+
+/** Sends what can still be sent within a second before the connection is
+ * closed */
+static void aIODrainOutbound(aIO_t *conn)
+{
+    aIO_outbound_t *out = &conn->attr.out;
+    struct timeval timeout = { .tv_sec = 1 };
+
+    fcntl(out->fd, F_SETFL, fcntl(out->fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(out->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (aIOFlushOutbound(conn) || out->queue_len) {
+        fprintf(stderr, "Dropping %zu bytes to port %d\n", out->queue_len,
+                ntohs(out->addr.sin_port));
+    }
+}
+
+static void aIOFreeConn(aIO_t *conn)
+{
+    switch (conn->type) {
+        case SOCKET:
+            printf("Deinit socket %d\n",
+                   ntohs(conn->attr.socket.addr.sin_port));
+            if (conn->attr.socket.type == TCP) {
+                aIOCloseTCPClients(conn);
+            }
+            free(conn->attr.socket.ring);
+            if (close(conn->attr.socket.fd)) {
+                fprintf(stderr, "Failed to close socket\n");
+                PRINT_CHECK;
+            }
+            break;
+        case MSG_QUEUE:
+            printf("Deinit MQ %s\n", conn->attr.mq.name);
+            mq_close(conn->attr.mq.put_fd);
+            mq_close(conn->attr.mq.fd);
+            mq_unlink(conn->attr.mq.name);
+            free(conn->attr.mq.name);
+            break;
+        case OUTBOUND:
+            if (conn->attr.out.fd != -1) {
+                if (conn->attr.out.queue_len) {
+                    aIODrainOutbound(conn);
+                }
+                close(conn->attr.out.fd);
+            }
+            aIOReleaseUnsent(conn->attr.out.queue_len);
+            free(conn->attr.out.queue);
+            break;
+        default:
+            break;
+    }
+
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
+}
+
+void aIOCloseConn(aIO_handle_t conn)
+{
+    if (conn == NULL) {
+        fprintf(stderr, "Trying to close a NULL connection\n");
+        PRINT_CHECK;
+        return;
+    }
+
+    aIO_t *del = (aIO_t *)conn;
+
+    /** A worker would wait for the clients of the socket to be closed, among
+     * them possibly the client whose callback it is running */
+    if (aIO_serving && del->type == SOCKET && del->attr.socket.type == TCP &&
+        aIOPoolRunning()) {
+        fprintf(stderr, "TCP sockets can not be closed from a TCP client "
+                "callback\n");
+        return;
+    }
+
+    pthread_mutex_lock(&aIO_registry.lock);
+    if (atomic_exchange(&del->closing, 1)) {
+        pthread_mutex_unlock(&aIO_registry.lock);
+        fprintf(stderr, "Connection is already being closed\n");
+        return;
+    }
+    aIOUnregister(del);
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    aIOUnwatch(aIOConnFd(del));
+
+    /** The reactor dispatches one connection at a time, if a callback closes
+     * a connection that is in use it can only be the one being dispatched,
+     * which is freed once the callback returned. Everybody else waits until
+     * no callback runs any more. */
+    if (!aIO_dispatching) {
+        pthread_mutex_lock(&aIO_registry.lock);
+        while (del->refs > 1) {
+            pthread_cond_wait(&aIO_registry.released, &aIO_registry.lock);
+        }
+        pthread_mutex_unlock(&aIO_registry.lock);
+    }
+
+    aIORelease(del);
+}
+
+void aIODeinit(void)
+{
+    aIO_t *conn;
+    size_t fd;
+
+    aIOCloseOutbox();
+    aIOStopReactor();
+    aIOStopPool();
+
+    for (fd = 0; fd < aIO_registry.fd_slots; fd++) {
+        pthread_mutex_lock(&aIO_registry.lock);
+        conn = aIO_registry.fds[fd];
+        pthread_mutex_unlock(&aIO_registry.lock);
+
+        if (conn) {
+            aIOCloseConn((aIO_handle_t)conn);
+        }
+    }
+
+    /** Outbound connections that are not connected have no fd */
+    for (;;) {
+        conn = NULL;
+        pthread_mutex_lock(&aIO_registry.lock);
+        for (fd = 0; conn == NULL && fd < aIO_registry.key_buckets; fd++) {
+            conn = aIO_registry.keys[fd];
+        }
+        pthread_mutex_unlock(&aIO_registry.lock);
+
+        if (conn == NULL) {
+            break;
+        }
+        aIOCloseConn((aIO_handle_t)conn);
+    }
+
+    pthread_mutex_lock(&aIO_registry.lock);
+    free(aIO_registry.fds);
+    free(aIO_registry.keys);
+    aIO_registry.fds = NULL;
+    aIO_registry.keys = NULL;
+    aIO_registry.fd_slots = 0;
+    aIO_registry.key_buckets = 0;
+    aIO_registry.key_count = 0;
+    pthread_mutex_unlock(&aIO_registry.lock);
+}
+
+aIO_t *createAsyncIO(aIO_conn_e type, size_t buffer_size,
+                     void (*callback)(size_t, char *, void *), void *args)
+{
+    aIO_t *ret = (aIO_t *)calloc(1, sizeof(aIO_t));
+
+    if (ret == NULL) {
+        fprintf(stderr, "Failed to create AIO");
+        PRINT_CHECK;
+        goto err_aio;
+    }
+
+    ret->buffer_size = buffer_size;
+    /** One extra byte so received data can always be null terminated */
+    ret->buffer = (char *)calloc(ret->buffer_size + 1, sizeof(char));
+    if (ret->buffer == NULL) {
+        fprintf(stderr, "Failed to allocate AIO buffer");
+        PRINT_CHECK;
+        goto err_buffer;
+    }
+
+    ret->type = type;
+    ret->callback = callback;
+    ret->args = args;
+
+    if (pthread_mutex_init(&ret->lock, NULL)) {
+        fprintf(stderr, "Failed to init AIO mutex");
+        PRINT_CHECK;
+        goto err_mutex;
+    }
+
+    return ret;
+
+err_mutex:
+    free(ret->buffer);
+err_buffer:
+    free(ret);
+err_aio:
+    return NULL;
+}
+
+int aIOMessageQueuePut(char *mq_name, char *buffer)
+{
+    mqd_t mq;
+    aIO_t *conn;
+    int ret = 0;
+    char *full_name = calloc(strlen(mq_name) + 2, sizeof(char));
+    strcpy(full_name + 1, mq_name);
+    full_name[0] = '/';
+
+    /** Queues opened by this process keep a write descriptor open */
+    pthread_mutex_lock(&aIO_registry.lock);
+    conn = aIOFindMQ(full_name);
+    if (conn) {
+        conn->refs++;
+    }
+    pthread_mutex_unlock(&aIO_registry.lock);
+
+    if (conn) {
+        mq = conn->attr.mq.put_fd;
+    }
+    else {
+        mq = mq_open(full_name, O_WRONLY);
+    }
+
+    free(full_name);
+
+    if ((mqd_t) - 1 == mq) {
+        printf("Unable to open MQ '%s'\n", mq_name);
+        return -1;
+    }
+
+    if (-1 == mq_send(mq, buffer, strlen(buffer), 0)) {
+        printf("Unable to send to MQ: %s, errno: %d\n", mq_name, errno);
+        ret = -1;
+    }
+    else {
+        printf("Sent to MQ: %s\n", mq_name);
+    }
+
+    if (conn) {
+        aIORelease(conn);
+    }
+    else {
+        mq_close(mq);
+    }
+
+    return ret;
+}
+
+/** Returns the outbound connection to a destination with a reference taken,
+ * creating it on first use. Port in network order. */
+static aIO_t *aIOGetOutbound(aIO_socket_e protocol, in_addr_t s_addr,
+                             in_port_t port)
+{
+    aIO_t *conn;
+
+    pthread_mutex_lock(&aIO_registry.lock);
+
+    conn = aIOFindOutbound(protocol, s_addr, port);
+    if (conn == NULL) {
+        conn = createAsyncIO(OUTBOUND, 0, NULL, NULL);
+        if (conn == NULL) {
+            goto out;
+        }
+
+        conn->attr.out.fd = -1;
+        conn->attr.out.protocol = protocol;
+        conn->attr.out.addr.sin_family = AF_INET;
+        conn->attr.out.addr.sin_addr.s_addr = s_addr;
+        conn->attr.out.addr.sin_port = port;
+
+        if (aIOInsertKey(conn)) {
+            pthread_mutex_destroy(&conn->lock);
+            free(conn->buffer);
+            free(conn);
+            conn = NULL;
+            goto out;
+        }
+        conn->refs = 1;
+    }
+
+    conn->refs++;
+out:
+    pthread_mutex_unlock(&aIO_registry.lock);
+    return conn;
+}
+
+/** Called from the reactor with a put taken off the outbox, TCP data that
+ * is queued stays counted as unsent until it leaves the queue */
+static void aIOSendPut(aIO_socket_put_t *put)
+{
+    size_t unsent = put->size;
+    aIO_t *conn;
+    aIO_outbound_t *out;
+
+    conn = aIOGetOutbound(put->protocol, put->s_addr, put->port);
+    if (conn == NULL) {
+        fprintf(stderr, "Dropping %zu bytes to port %d\n", put->size,
+                ntohs(put->port));
+        aIOReleaseUnsent(unsent);
+        return;
+    }
+    out = &conn->attr.out;
+
+    pthread_mutex_lock(&conn->lock);
+
+    if (out->fd == -1 && aIOConnectOutbound(conn)) {
+        goto out;
+    }
+
+    /** A connected UDP socket reports an error, e.g. from an earlier ICMP port
+     * unreachable, on the next send. The datagram is sent once more on a new
+     * socket then. */
+    if (put->protocol == UDP) {
+        if (send(out->fd, put->data, put->size, 0) < 0) {
+            aIODisconnectOutbound(conn);
+            if (aIOConnectOutbound(conn) ||
+                send(out->fd, put->data, put->size, 0) < 0) {
+                fprintf(stderr, "Sending to port %d failed\n",
+                        ntohs(put->port));
+                PRINT_CHECK;
+            }
+        }
+        goto out;
+    }
+
+    if (aIOQueueOutbound(out, put->data, put->size)) {
+        fprintf(stderr, "Failed to queue data to port %d\n",
+                ntohs(put->port));
+        goto out;
+    }
+    unsent = 0;
+
+    if (aIOFlushOutbound(conn)) {
+        aIORecoverOutbound(conn);
+    }
+
+out:
+    pthread_mutex_unlock(&conn->lock);
+    aIORelease(conn);
+    aIOReleaseUnsent(unsent);
+}
+
+/** Must be called with the outbox's lock held */
+static void aIOSendUDPPuts(void)
+{
+    unsigned int sent = 0, i;
+    int ret;
+
+    while (sent < aIO_udp_out.count) {
+        ret = sendmmsg(aIO_udp_out.fd, &aIO_udp_out.msgs[sent],
+                       aIO_udp_out.count - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /** sendmmsg stops at the first datagram that can not be sent,
+             * it is dropped and the rest still sent */
+            fprintf(stderr, "Sending UDP datagram to port %" PRIu16
+                    " failed\n",
+                    ntohs(aIO_udp_out.addrs[sent].sin_port));
+            PRINT_CHECK;
+            ret = 1;
+        }
+        sent += ret;
+    }
+
+    for (i = 0; i < aIO_udp_out.count; i++) {
+        aIOReleaseUnsent(aIO_udp_out.puts[i]->size);
+        free(aIO_udp_out.puts[i]);
+    }
+    aIO_udp_out.count = 0;
+}
+
+/** Ends the coalescing window after AIO_UDP_COALESCE_US, only called from
+ * the reactor */
+static int aIOArmUDPFlush(void)
+{
+    struct itimerspec window = {
+        .it_value.tv_sec = AIO_UDP_COALESCE_US / 1000000,
+        .it_value.tv_nsec = (AIO_UDP_COALESCE_US % 1000000) * 1000
+    };
 
-typedef struct aIO {
-    aIO_conn_e type;
+    return timerfd_settime(aIO_reactor.timer_fd, 0, &window, NULL);
+}
 
-    aIO_attr attr;
-    size_t buffer_size;
-    char *buffer;
+/** Takes over a put from aIOUDPPut into the batch, must be called with the
+ * outbox's lock held */
+static void aIOBatchUDPPut(aIO_socket_put_t *put)
+{
+    unsigned int slot;
+
+    if (aIO_udp_out.fd == -1) {
+        aIO_udp_out.fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (aIO_udp_out.fd == -1) {
+            fprintf(stderr, "Failed to create UDP socket, dropping %zu bytes "
+                    "to port %d\n", put->size, ntohs(put->port));
+            PRINT_CHECK;
+            aIOReleaseUnsent(put->size);
+            free(put);
+            return;
+        }
+    }
 
-    pthread_t thread;
+    slot = aIO_udp_out.count;
+    aIO_udp_out.puts[slot] = put;
 
-    void (*callback)(size_t, char *, void *);
-    void *args;
-    struct aIO *next;
+    aIO_udp_out.iovs[slot].iov_base = put->data;
+    aIO_udp_out.iovs[slot].iov_len = put->size;
 
-    pthread_mutex_t lock;
-} aIO_t;
+    aIO_udp_out.addrs[slot].sin_family = AF_INET;
+    aIO_udp_out.addrs[slot].sin_addr.s_addr = put->s_addr;
+    aIO_udp_out.addrs[slot].sin_port = put->port;
 
-typedef struct {
-    int client_fd;
-    size_t buffer_size;
+    aIO_udp_out.msgs[slot].msg_hdr.msg_name = &aIO_udp_out.addrs[slot];
+    aIO_udp_out.msgs[slot].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    aIO_udp_out.msgs[slot].msg_hdr.msg_iov = &aIO_udp_out.iovs[slot];
+    aIO_udp_out.msgs[slot].msg_hdr.msg_iovlen = 1;
 
-    void (*callback)(size_t, char *, void *);
-    void *args;
-} aIO_tcp_client;
+    aIO_udp_out.count++;
 
-aIO_t head = { .type = NONE, .lock = PTHREAD_MUTEX_INITIALIZER };
-pthread_cond_t aIO_quit_conn = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t aIO_quit_lock = PTHREAD_MUTEX_INITIALIZER;
+    if (aIO_udp_out.count == AIO_UDP_BATCH) {
+        aIOSendUDPPuts();
+    }
+}
 
-aIO_t *getLastConnection(void)
+/** Must be called with the outbox's lock held. Sends up to
+ * AIO_OUTBOX_PASS puts and wakes the reactor again for the rest, so that
+ * receiving is not held up by a burst of puts. closing sends all of them
+ * and the datagrams without waiting for the coalescing window to end. */
+static void aIOSendOutbox(int closing)
 {
-    aIO_t *iterator;
+    aIO_socket_put_t *put, *next, *puts = NULL, *tail = NULL;
+    unsigned int windowed = aIO_udp_out.count, sent;
+    uint64_t count = 1;
 
-    for (iterator = &head; iterator->next; iterator = iterator->next) {
-        ;
+    if (aIO_outbox.fd != -1 &&
+        read(aIO_outbox.fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        PRINT_CHECK;
     }
 
-    return iterator;
-}
+    /** aIOUDPFlush sets the flag after its datagrams were pushed, so they are
+     * taken off the outbox below */
+    if (atomic_exchange_explicit(&aIO_outbox.flush, 0, memory_order_acquire)) {
+        aIO_outbox.flushing = 1;
+    }
 
-static aIO_t *findConnection(aIO_conn_e type, void *arg)
-{
-    aIO_t *prev = &head;
-    aIO_t *curr;
+    /** Taken last in first out, reversed to send them in order */
+    put = atomic_exchange_explicit(&aIO_outbox.head, NULL,
+                                   memory_order_acquire);
+    while (put) {
+        next = put->next;
+        put->next = puts;
+        puts = put;
+        if (tail == NULL) {
+            tail = put;
+        }
+        put = next;
+    }
 
-    pthread_mutex_lock(&prev->lock);
-    while ((curr = prev->next) != NULL) {
-        pthread_mutex_lock(&curr->lock);
-        switch (type) {
-            case SOCKET:
-                if (curr->type == type) {
-                    if (curr->attr.socket.fd == *(int *)arg) {
-                        pthread_mutex_unlock(&prev->lock);
-                        pthread_mutex_unlock(&curr->lock);
-                        return curr;
-                    }
-                }
-                break;
-            //TODO
-            case MSG_QUEUE:
-            case SERIAL:
-            case NONE:
-            default:
-                pthread_mutex_unlock(&prev->lock);
-                pthread_mutex_unlock(&curr->lock);
-                return NULL;
+    if (puts) {
+        if (aIO_outbox.pending) {
+            aIO_outbox.pending_tail->next = puts;
         }
-        pthread_mutex_unlock(&prev->lock);
-        prev = curr;
+        else {
+            aIO_outbox.pending = puts;
+        }
+        aIO_outbox.pending_tail = tail;
     }
-    pthread_mutex_unlock(&prev->lock);
-    return NULL;
-}
 
-//TODO move this into functions that are calable such that connections can be
-//closed during runtime
+    for (sent = 0; aIO_outbox.pending && (closing || sent < AIO_OUTBOX_PASS);
+         sent++) {
+        put = aIO_outbox.pending;
+        aIO_outbox.pending = put->next;
+        if (put->batched) {
+            aIOBatchUDPPut(put);
+        }
+        else {
+            aIOSendPut(put);
+            free(put);
+        }
+    }
 
-void aIOCloseConn(aIO_handle_t conn)
-{
-    if (conn == NULL) {
-        fprintf(stderr, "Trying to close a NULL connection\n");
-        PRINT_CHECK;
+    if (aIO_outbox.pending) {
+        if (write(aIO_outbox.fd, &count, sizeof(count)) < 0) {
+            PRINT_CHECK;
+        }
+    }
+    else if (aIO_udp_out.count == 0) {
+        aIO_outbox.flushing = 0;
         return;
     }
 
-    aIO_t *del = (aIO_t *)conn;
+    /** The window is started by the first datagram of a batch, without a
+     * timer to end it the datagrams are sent right away */
+    if (aIO_udp_out.count &&
+        (closing || aIO_outbox.flushing || AIO_UDP_COALESCE_US == 0 ||
+         (windowed == 0 && aIOArmUDPFlush()))) {
+        aIOSendUDPPuts();
+    }
 
-    switch (del->type) {
-        case SOCKET:
-            printf("Deinit socket %d\n",
-                   ntohs(del->attr.socket.addr.sin_port));
-            if (close(del->attr.socket.fd)) {
-                fprintf(stderr, "Failed to close socket\n");
-                PRINT_CHECK;
-                return;
-            }
-            free(del->buffer);
-            free(del);
-            break;
-        case MSG_QUEUE:
-            printf("Deinit MQ %s\n", del->attr.mq.name);
-            mq_close(del->attr.mq.fd);
-            mq_unlink(del->attr.mq.name);
-            free(del->attr.mq.name);
-            free(del->buffer);
-            free(del);
-            break;
-        default:
-            break;
+    if (aIO_outbox.pending == NULL) {
+        aIO_outbox.flushing = 0;
     }
 }
 
-void aIODeinit(void)
+static void aIOProcessOutbox(void)
 {
-    aIO_t *iterator;
+    pthread_mutex_lock(&aIO_outbox.lock);
+    aIOSendOutbox(0);
+    pthread_mutex_unlock(&aIO_outbox.lock);
+}
 
-    if (head.next) {
-        for (iterator = head.next; iterator;) {
-            aIO_t *del = iterator;
-            iterator = iterator->next;
-            aIOCloseConn((aIO_handle_t)del);
-        }
+static void aIOEndUDPWindow(void)
+{
+    pthread_mutex_lock(&aIO_outbox.lock);
+    if (aIO_udp_out.count) {
+        aIOSendUDPPuts();
     }
+    pthread_mutex_unlock(&aIO_outbox.lock);
 }
 
-aIO_t *createAsyncIO(aIO_conn_e type, size_t buffer_size,
-                     void (*callback)(size_t, char *, void *), void *args)
+/** Sets the outbox up on the first put, which starts the reactor if needed */
+static int aIOOpenOutbox(void)
 {
-    aIO_t *ret = (aIO_t *)calloc(1, sizeof(aIO_t));
+    int ret = 0;
 
-    if (ret == NULL) {
-        fprintf(stderr, "Failed to create AIO");
-        PRINT_CHECK;
-        goto err_aio;
+    pthread_mutex_lock(&aIO_outbox.lock);
+
+    if (atomic_load_explicit(&aIO_outbox.ready, memory_order_acquire)) {
+        goto out;
     }
 
-    ret->buffer_size = buffer_size;
-    ret->buffer = (char *)calloc(ret->buffer_size, sizeof(char));
-    if (ret->buffer == NULL) {
-        fprintf(stderr, "Failed to allocate AIO buffer");
+    aIO_outbox.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (aIO_outbox.fd == -1) {
+        fprintf(stderr, "Failed to create AIO outbox eventfd\n");
         PRINT_CHECK;
-        goto err_buffer;
+        ret = -1;
+        goto out;
     }
 
-    ret->type = type;
-    ret->callback = callback;
-    ret->args = args;
-
-    if (pthread_mutex_init(&ret->lock, NULL)) {
-        fprintf(stderr, "Failed to init AIO mutex");
-        PRINT_CHECK;
-        goto err_mutex;
+    if (aIOWatch(aIO_outbox.fd, EPOLLIN)) {
+        close(aIO_outbox.fd);
+        aIO_outbox.fd = -1;
+        ret = -1;
+        goto out;
     }
 
+    atomic_store_explicit(&aIO_outbox.ready, 1, memory_order_release);
+out:
+    pthread_mutex_unlock(&aIO_outbox.lock);
     return ret;
-
-err_mutex:
-    free(ret->buffer);
-err_buffer:
-    free(ret);
-err_aio:
-    return NULL;
 }
 
-static void aIOMQSigHandler(union sigval sv)
+/** Sends what is still waiting in the outbox before it is closed */
+static void aIOCloseOutbox(void)
 {
-    aIO_t *conn = (aIO_t *)sv.sival_ptr;
+    pthread_mutex_lock(&aIO_outbox.lock);
 
-    ssize_t bytes_read = mq_receive(conn->attr.mq.fd, conn->buffer,
-                                    conn->buffer_size, NULL);
+    aIOSendOutbox(1);
 
-    if (bytes_read > 0) {
-        (conn->callback)(bytes_read, conn->buffer, conn->args);
+    if (aIO_outbox.fd != -1) {
+        aIOUnwatch(aIO_outbox.fd);
+        close(aIO_outbox.fd);
+        aIO_outbox.fd = -1;
     }
-
-    /** reprime MQ notifications */
-    if (mq_notify(conn->attr.mq.fd, &conn->attr.mq.ev)) {
-        fprintf(stderr, "Failed to notify MQ '%s'", conn->attr.mq.name);
-        PRINT_CHECK;
+    if (aIO_udp_out.fd != -1) {
+        close(aIO_udp_out.fd);
+        aIO_udp_out.fd = -1;
     }
+    atomic_store_explicit(&aIO_outbox.ready, 0, memory_order_release);
+
+    pthread_mutex_unlock(&aIO_outbox.lock);
 }
 
-int aIOMessageQueuePut(char *mq_name, char *buffer)
+/** Pushes a copy of the data onto the outbox, the put that finds it empty
+ * wakes the reactor */
+static int aIOPostPut(aIO_socket_e protocol, int batched, char *s_addr,
+                      in_port_t port, char *buffer, size_t buffer_size)
 {
-    mqd_t mq;
-    char *full_name = calloc(strlen(mq_name) + 2, sizeof(char));
-    strcpy(full_name + 1, mq_name);
-    full_name[0] = '/';
-
-    mq = mq_open(full_name, O_WRONLY);
-
-    free(full_name);
+    aIO_socket_put_t *put, *head;
+    uint64_t wake = 1;
 
-    if ((mqd_t) - 1 == mq) {
-        printf("Unable to open MQ '%s'\n", mq_name);
+    if (!atomic_load_explicit(&aIO_outbox.ready, memory_order_acquire) &&
+        aIOOpenOutbox()) {
         return -1;
     }
 
-    if (-1 == mq_send(mq, buffer, strlen(buffer), 0)) {
-        printf("Unable to send to MQ: %s, errno: %d\n", mq_name, errno);
-        goto error_send;
+    /** Bounds the data that was not sent yet, for all destinations */
+    if (atomic_fetch_add_explicit(&aIO_outbox.bytes, buffer_size,
+                                  memory_order_relaxed) + buffer_size >
+        AIO_SOCKET_QUEUE_SIZE) {
+        fprintf(stderr, "Send queue to %s:%d is full\n",
+                (s_addr) ? s_addr : "localhost", port);
+        goto error_full;
     }
-    else {
-        printf("Sent to MQ: %s\n", mq_name);
+
+    put = (aIO_socket_put_t *)malloc(sizeof(aIO_socket_put_t) + buffer_size);
+    if (put == NULL) {
+        fprintf(stderr, "Failed to queue data to %s:%d\n",
+                (s_addr) ? s_addr : "localhost", port);
+        goto error_full;
     }
 
-    mq_close(mq);
+    put->protocol = protocol;
+    put->batched = batched;
+    put->s_addr = s_addr ? inet_addr(s_addr) : 0;
+    put->port = htons(port);
+    put->size = buffer_size;
+    memcpy(put->data, buffer, buffer_size);
+
+    head = atomic_load_explicit(&aIO_outbox.head, memory_order_relaxed);
+    do {
+        put->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&aIO_outbox.head, &head,
+             put, memory_order_release,
+             memory_order_relaxed));
+
+    if (head == NULL && write(aIO_outbox.fd, &wake, sizeof(wake)) < 0) {
+        PRINT_CHECK;
+    }
 
     return 0;
 
-error_send:
-    mq_close(mq);
+error_full:
+    atomic_fetch_sub_explicit(&aIO_outbox.bytes, buffer_size,
+                              memory_order_relaxed);
     return -1;
 }
 
 int aIOSocketPut(aIO_socket_e protocol, char *s_addr, in_port_t port,
                  char *buffer, size_t buffer_size)
 {
-    int fd;
-    struct sockaddr_in server = { .sin_addr.s_addr =
-            s_addr ? inet_addr(s_addr) : 0,
-            .sin_family = AF_INET,
-             .sin_port = htons(port)
-    };
-
-    switch (protocol) {
-        case TCP:
-            if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-                fprintf(stderr, "Failed to create TCP socket %s:%d\n",
-                        s_addr, port);
-                goto error_create_socket;
-            }
-            break;
-        case UDP:
-            if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-                fprintf(stderr, "Failed to create UDP socket %s:%d\n",
-                        s_addr, port);
-                goto error_create_socket;
-            }
-            break;
-        default:
-            return -1;
+    if (protocol != TCP && protocol != UDP) {
+        return -1;
     }
 
-    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
-        if (errno == EINTR || errno == EALREADY) {
-            printf("Connection to port %" PRIu16
-                   " interrupted, port is busy\n",
-                   (uint16_t)port);
-            return 0;
-        }
-
-        fprintf(stderr, "Connecting to %s:%d failed\n",
-                (s_addr) ? s_addr : "localhost", port);
-        goto error_connect;
-    }
+    return aIOPostPut(protocol, 0, s_addr, port, buffer, buffer_size);
+}
 
-    if (send(fd, buffer, buffer_size, 0) < 0) {
-        fprintf(stderr, "Sending to %s:%d failed\n", s_addr, port);
-        goto error_send;
-    }
+int aIOUDPPut(char *s_addr, in_port_t port, char *buffer, size_t buffer_size)
+{
+    return aIOPostPut(UDP, 1, s_addr, port, buffer, buffer_size);
+}
 
-    close(fd);
+void aIOUDPFlush(void)
+{
+    uint64_t wake = 1;
 
-    return 0;
+    if (!atomic_load_explicit(&aIO_outbox.ready, memory_order_acquire)) {
+        return;
+    }
 
-error_send:
-error_connect:
-    close(fd);
-error_create_socket:
-    PRINT_CHECK;
-    return -1;
+    atomic_store_explicit(&aIO_outbox.flush, 1, memory_order_release);
+    if (write(aIO_outbox.fd, &wake, sizeof(wake)) < 0) {
+        PRINT_CHECK;
+    }
 }
 
 aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
@@ -353,17 +2035,15 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
                                  void (*callback)(size_t, char *, void *),
                                  void *args)
 {
-    aIO_t *conn = getLastConnection();
-
-    conn->next = createAsyncIO(MSG_QUEUE, max_msg_size, callback, args);
-    if (conn->next == NULL) {
+    aIO_t *conn = createAsyncIO(MSG_QUEUE, max_msg_size, callback, args);
+    if (conn == NULL) {
         fprintf(stderr, "Failed to allocate MQ IO for MQ '%s'\n", name);
         goto error_IO;
     }
 
-    pthread_mutex_lock(&conn->next->lock);
+    pthread_mutex_lock(&conn->lock);
 
-    aIO_mq_t *mq = &conn->next->attr.mq;
+    aIO_mq_t *mq = &conn->attr.mq;
 
     size_t str_len = strlen(name);
 
@@ -375,18 +2055,22 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
     strcpy(mq->name + 1, name);
     mq->name[0] = '/';
 
+    /** Opening it again would make both connections compete for messages */
+    pthread_mutex_lock(&aIO_registry.lock);
+    if (aIOFindMQ(mq->name)) {
+        pthread_mutex_unlock(&aIO_registry.lock);
+        fprintf(stderr, "MQ '%s' is already open\n", name);
+        goto error_open;
+    }
+    pthread_mutex_unlock(&aIO_registry.lock);
+
     struct mq_attr attr;
-    union sigval sv;
 
     /** Attributes of MQ used in mq_open*/
     attr.mq_maxmsg = max_msg_num < MQ_MAXMSG ? max_msg_num : MQ_MAXMSG;
     attr.mq_msgsize = max_msg_size < MQ_MSGSIZE ? max_msg_size : MQ_MSGSIZE;
     attr.mq_curmsgs = 0;
 
-    /** sigval struct that is passed to handler. sival_ptr is used to pass pointer  */
-    /**     to structure containing MQ information */
-    sv.sival_ptr = conn->next;
-
     /** Create MQ */
     if (-1 == (mq->fd = mq_open(mq->name, O_CREAT | O_RDONLY | O_NONBLOCK,
                                 0644, &attr))) {
@@ -394,113 +2078,93 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
         goto error_open;
     }
 
-    /** sigevent needed to enable to passing of si_value to the handler */
-    conn->next->attr.mq.ev.sigev_notify = SIGEV_THREAD;
-    mq->ev.sigev_signo = SIGIO;
-    mq->ev.sigev_value = sv;
-    /** used by SIGEV_THREAD */
-    mq->ev.sigev_notify_function = aIOMQSigHandler;
-    mq->ev.sigev_notify_attributes = NULL;
+    if (-1 == (mq->put_fd = mq_open(mq->name, O_WRONLY))) {
+        fprintf(stderr, "Couldn't open MQ '%s' for writing\n", mq->name);
+        goto error_put;
+    }
 
-    if (mq_notify(mq->fd, &mq->ev)) {
-        fprintf(stderr, "Failed to notify MQ '%s'\n", mq->name);
-        goto error_notify;
+    if (aIORegister(conn)) {
+        goto error_register;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
+
+    /** On Linux a mqd_t is a file descriptor and can be polled */
+    if (aIOWatch(mq->fd, EPOLLIN)) {
+        fprintf(stderr, "Failed to watch MQ '%s'\n", mq->name);
+        aIOCloseConn((aIO_handle_t)conn);
+        return NULL;
+    }
 
-    printf("MQ '%s' opened and notified\n", name);
+    printf("MQ '%s' opened and watched\n", name);
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
-error_notify:
+error_register:
+    mq_close(mq->put_fd);
+error_put:
+    mq_close(mq->fd);
+    mq_unlink(mq->name);
 error_open:
     free(mq->name);
 error_name:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     return NULL;
 }
 
-static void aIOSocketSigHandler(int signal, siginfo_t *info, void *context)
+static aIO_handle_t aIOOpenUDP(char *s_addr, in_port_t port,
+                               size_t buffer_size,
+                               void (*callback)(size_t, char *, void *),
+                               aIO_batch_callback_t batch_callback,
+                               void *args)
 {
-    ssize_t read_size;
-    int server_fd = info->si_fd;
-    aIO_t *conn = findConnection(SOCKET, &server_fd);
-
+    aIO_t *conn = createAsyncIO(SOCKET, buffer_size, callback, args);
     if (conn == NULL) {
-        fprintf(stderr, "Failed to find connection");
-        PRINT_CHECK;
-        return;
-    }
-
-    pthread_mutex_lock(&conn->lock);
-
-    switch (conn->attr.socket.type) {
-        case UDP:
-            while ((read_size = recv(server_fd, conn->buffer,
-                                     conn->buffer_size, 0)) > 0) {
-                conn->buffer[read_size <= conn->buffer_size ?
-                                       read_size :
-                                       conn->buffer_size] = '\0';
-                if (conn->callback)
-                    (conn->callback)(read_size, conn->buffer,
-                                     conn->args);
-            }
-            break;
-        case TCP: {
-            int client_fd;
-            struct sockaddr_in client;
-            socklen_t client_size = sizeof(struct sockaddr_in);
-            while ((client_fd =
-                        accept(server_fd, (struct sockaddr *)&client,
-                               &client_size)) > 0) {
-                pthread_t handler_thread;
-                aIO_tcp_client *new_client = (aIO_tcp_client *)calloc(1,
-                                             sizeof(aIO_tcp_client));
-                new_client->client_fd = client_fd;
-                new_client->buffer_size = conn->buffer_size;
-                new_client->callback = conn->callback;
-                new_client->args = conn->args;
-
-                if (pthread_create(&handler_thread, NULL, aIOTCPHandler,
-                                   (void *)new_client)) {
-                    fprintf(stderr,
-                            "Failed to create TCP handler thread");
-                    PRINT_CHECK;
-                    free(new_client);
-                    return;
-                }
-            }
-        } break;
-        default:
-            break;
-    }
-
-    pthread_mutex_unlock(&conn->lock);
-}
-
-aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
-                              void (*callback)(size_t, char *, void *),
-                              void *args)
-{
-    aIO_t *conn = getLastConnection();
-
-    conn->next = createAsyncIO(SOCKET, buffer_size, callback, args);
-    if (conn->next == NULL) {
         fprintf(stderr,
                 "Failed to allocate UDP IO on port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_IO;
     }
 
-    conn->next->attr.socket.type = UDP;
+    conn->attr.socket.type = UDP;
+    conn->attr.socket.batch_callback = batch_callback;
 
-    pthread_mutex_lock(&conn->next->lock);
+    pthread_mutex_lock(&conn->lock);
+
+    aIO_socket_t *s_udp = &conn->attr.socket;
+    char *slots;
+    unsigned int i;
+
+    /** The connection's buffer is split into one slot per datagram */
+    slots = (char *)realloc(conn->buffer, AIO_UDP_BATCH * (buffer_size + 1));
+    if (slots == NULL) {
+        fprintf(stderr, "Failed to allocate UDP buffers on port %" PRIu16
+                "\n",
+                (uint16_t)port);
+        goto error_ring;
+    }
+    conn->buffer = slots;
 
-    aIO_socket_t *s_udp = &conn->next->attr.socket;
+    s_udp->ring = (aIO_udp_ring_t *)calloc(1, sizeof(aIO_udp_ring_t));
+    if (s_udp->ring == NULL) {
+        fprintf(stderr, "Failed to allocate UDP buffers on port %" PRIu16
+                "\n",
+                (uint16_t)port);
+        goto error_ring;
+    }
+    for (i = 0; i < AIO_UDP_BATCH; i++) {
+        s_udp->ring->datagrams[i].buffer = slots + i * (buffer_size + 1);
+        s_udp->ring->iovs[i].iov_base = s_udp->ring->datagrams[i].buffer;
+        s_udp->ring->iovs[i].iov_len = buffer_size;
+        s_udp->ring->msgs[i].msg_hdr.msg_iov = &s_udp->ring->iovs[i];
+        s_udp->ring->msgs[i].msg_hdr.msg_iovlen = 1;
+        s_udp->ring->msgs[i].msg_hdr.msg_name =
+            &s_udp->ring->datagrams[i].addr;
+    }
 
     s_udp->addr.sin_family = AF_INET;
     s_udp->addr.sin_addr.s_addr =
@@ -518,35 +2182,16 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
     printf("Opened socket on port %" PRIu16 " with FD: %d\n", port,
            s_udp->fd);
 
-    struct sigaction act = { 0 };
     int fs;
 
-    act.sa_flags = SA_SIGINFO | SA_RESTART;
-    act.sa_sigaction = aIOSocketSigHandler;
-    sigfillset(&act.sa_mask);
-    sigdelset(&act.sa_mask, SIGIO);
-    if (sigaction(SIGIO, &act, NULL) < 0) {
-        fprintf(stderr,
-                "Setting sigaction for UDP socket on port %" PRIu16
-                " failed\n",
-                (uint16_t)port);
-        goto error_fcntl;
-    }
-
-    if ((fs = fcntl(s_udp->fd, F_GETFL)) == 0) {
+    if ((fs = fcntl(s_udp->fd, F_GETFL)) == -1) {
         fprintf(stderr, "Failed getting fd status\n");
         goto error_fcntl;
     }
-    fs |= O_ASYNC | O_NONBLOCK;
-    if (-1 == fcntl(s_udp->fd, F_SETFL, fs)) {
+    if (-1 == fcntl(s_udp->fd, F_SETFL, fs | O_NONBLOCK)) {
         fprintf(stderr, "Failed to set fd status\n");
         goto error_fcntl;
     }
-    fcntl(s_udp->fd, F_SETSIG, SIGIO);
-    if (-1 == fcntl(s_udp->fd, F_SETOWN, getpid())) {
-        fprintf(stderr, "Failed to set thread owner\n");
-        goto error_fcntl;
-    }
 
     if (bind(s_udp->fd, (struct sockaddr *)&s_udp->addr,
              sizeof(s_udp->addr)) < 0) {
@@ -556,63 +2201,73 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         goto error_fcntl;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    if (aIORegister(conn)) {
+        goto error_fcntl;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+
+    if (aIOWatch(s_udp->fd, EPOLLIN)) {
+        aIOCloseConn((aIO_handle_t)conn);
+        return NULL;
+    }
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
 error_fcntl:
     close(s_udp->fd);
 error_socket:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    free(s_udp->ring);
+error_ring:
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     return NULL;
 }
 
-void *aIOTCPHandler(void *conn)
+aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
+                              void (*callback)(size_t, char *, void *),
+                              void *args)
 {
-    ssize_t read_size;
-    aIO_tcp_client *client = (aIO_tcp_client *)conn;
-    int client_fd = client->client_fd;
-    char *buffer = (char *)calloc(client->buffer_size, sizeof(char));
-    if (buffer == NULL) {
-        fprintf(stderr, "Failed to handle TCP\n");
-        PRINT_CHECK;
-        return NULL;
-    }
-
-    while ((read_size = recv(client_fd, buffer, client->buffer_size, 0)))
-        if (client->callback) {
-            (client->callback)(read_size, buffer, client->args);
-        }
-
-    close(client_fd);
-    free(buffer);
-    free((aIO_tcp_client *)conn);
-
-    return NULL;
+    return aIOOpenUDP(s_addr, port, buffer_size, callback, NULL, args);
 }
 
-aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
-                              void (*callback)(size_t, char *, void *),
-                              void *args)
+aIO_handle_t aIOOpenUDPSocketBatch(char *s_addr, in_port_t port,
+                                   size_t buffer_size,
+                                   aIO_batch_callback_t callback, void *args)
 {
-    aIO_t *conn = getLastConnection();
+    return aIOOpenUDP(s_addr, port, buffer_size, NULL, callback, args);
+}
 
-    conn->next = createAsyncIO(SOCKET, buffer_size, callback, args);
-    if (conn->next == NULL) {
+aIO_handle_t aIOOpenTCPServer(char *s_addr, in_port_t port, size_t buffer_size,
+                              const aIO_tcp_callbacks_t *callbacks,
+                              unsigned int max_clients, void *args)
+{
+    aIO_t *conn = createAsyncIO(SOCKET, buffer_size,
+                               callbacks ? callbacks->data : NULL, args);
+    if (conn == NULL) {
         fprintf(stderr,
                 "Failed to allocate TCP IO on port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_IO;
     }
 
-    conn->next->attr.socket.type = TCP;
+    conn->attr.socket.type = TCP;
+
+    pthread_mutex_lock(&conn->lock);
 
-    pthread_mutex_lock(&conn->next->lock);
+    aIO_socket_t *s_tcp = &conn->attr.socket;
 
-    aIO_socket_t *s_tcp = &conn->next->attr.socket;
+    if (callbacks) {
+        s_tcp->tcp.callbacks = *callbacks;
+    }
+    s_tcp->tcp.max_clients = max_clients ? max_clients : AIO_TCP_MAX_CLIENTS;
+    if (pthread_cond_init(&s_tcp->tcp.all_closed, NULL)) {
+        fprintf(stderr, "Failed to init TCP client condition\n");
+        goto error_cond;
+    }
 
     s_tcp->addr.sin_family = AF_INET;
     s_tcp->addr.sin_addr.s_addr = s_addr ? inet_addr(s_addr) : INADDR_ANY;
@@ -634,40 +2289,21 @@ aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         fprintf(stderr,
                 "Failed to set socket options on port %" PRIu16 "\n",
                 (uint16_t)port);
-        goto error_socket;
+        goto error_fcntl;
     }
 
     printf("Opened socket on port %d with FD: %d\n", port, s_tcp->fd);
 
-    struct sigaction act = { 0 };
     int fs;
 
-    act.sa_flags = SA_SIGINFO | SA_RESTART;
-    act.sa_sigaction = aIOSocketSigHandler;
-    sigfillset(&act.sa_mask);
-    sigdelset(&act.sa_mask, SIGIO);
-    if (sigaction(SIGIO, &act, NULL) < 0) {
-        fprintf(stderr,
-                "Setting sigaction for TCP socket on port %" PRIu16
-                " failed\n",
-                (uint16_t)port);
-        goto error_fcntl;
-    }
-
-    if ((fs = fcntl(s_tcp->fd, F_GETFL)) == 0) {
+    if ((fs = fcntl(s_tcp->fd, F_GETFL)) == -1) {
         fprintf(stderr, "Failed getting fd status\n");
         goto error_fcntl;
     }
-    fs |= O_ASYNC | O_NONBLOCK;
-    if (-1 == fcntl(s_tcp->fd, F_SETFL, fs)) {
+    if (-1 == fcntl(s_tcp->fd, F_SETFL, fs | O_NONBLOCK)) {
         fprintf(stderr, "Failed to set fd status\n");
         goto error_fcntl;
     }
-    fcntl(s_tcp->fd, F_SETSIG, SIGIO);
-    if (-1 == fcntl(s_tcp->fd, F_SETOWN, getpid())) {
-        fprintf(stderr, "Failed to set thread owner\n");
-        goto error_fcntl;
-    }
 
     if (bind(s_tcp->fd, (struct sockaddr *)&s_tcp->addr,
              sizeof(s_tcp->addr)) < 0) {
@@ -677,23 +2313,52 @@ aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
         goto error_fcntl;
     }
 
-    if (listen(s_tcp->fd, 1) < 0) {
+    if (listen(s_tcp->fd, SOMAXCONN) < 0) {
         fprintf(stderr, "Failed to listen on TCP port %" PRIu16 "\n",
                 (uint16_t)port);
         goto error_fcntl;
     }
 
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_mutex_lock(&aIO_pool.lock);
+    if (aIOStartPool()) {
+        pthread_mutex_unlock(&aIO_pool.lock);
+        fprintf(stderr, "Failed to start the TCP worker pool\n");
+        goto error_fcntl;
+    }
+    pthread_mutex_unlock(&aIO_pool.lock);
+
+    if (aIORegister(conn)) {
+        goto error_fcntl;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+
+    if (aIOWatch(s_tcp->fd, EPOLLIN)) {
+        aIOCloseConn((aIO_handle_t)conn);
+        return NULL;
+    }
 
-    return (aIO_handle_t)conn->next;
+    return (aIO_handle_t)conn;
 
 error_fcntl:
     close(s_tcp->fd);
 error_socket:
-    free(conn->next);
-    conn->next = NULL;
-    pthread_mutex_unlock(&conn->next->lock);
+    pthread_cond_destroy(&s_tcp->tcp.all_closed);
+error_cond:
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn->buffer);
+    free(conn);
 error_IO:
     PRINT_CHECK;
     return NULL;
 }
+
+aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
+                              void (*callback)(size_t, char *, void *),
+                              void *args)
+{
+    aIO_tcp_callbacks_t callbacks = { .data = callback };
+
+    return aIOOpenTCPServer(s_addr, port, buffer_size, &callbacks, 0, args);
+}
@@ -41,12 +41,58 @@
  * to the socket associated to the IO stream, passing the received packet buffer
  * to the user-defined callback.
  *
+ * All connections are watched by a single reactor thread using epoll(7) that
+ * is started when the first connection is opened. Callbacks are called from
+ * this thread, not from a signal handler, one after another. A callback that
+ * blocks delays the callbacks of every other connection. TCP clients are
+ * served by a fixed pool of AIO_TCP_WORKERS worker threads, each client by
+ * one worker for as long as it is connected, so their callbacks can run in
+ * parallel to the reactor's and to those of clients on other workers.
+ *
  * @{
  */
 
 #define MQ_MAXMSG 256
 #define MQ_MSGSIZE 256
 
+/**
+ * @brief Number of worker threads serving the clients of all TCP sockets
+ */
+#ifndef AIO_TCP_WORKERS
+#define AIO_TCP_WORKERS 4
+#endif
+
+/**
+ * @brief Default limit of clients connected to one TCP socket at a time
+ */
+#ifndef AIO_TCP_MAX_CLIENTS
+#define AIO_TCP_MAX_CLIENTS 256
+#endif
+
+/**
+ * @brief Number of datagrams received or sent with one system call
+ */
+#ifndef AIO_UDP_BATCH
+#define AIO_UDP_BATCH 32
+#endif
+
+/**
+ * @brief Longest time in microseconds a datagram passed to aIOUDPPut waits
+ * for further datagrams to be sent with, 0 to send each right away
+ */
+#ifndef AIO_UDP_COALESCE_US
+#define AIO_UDP_COALESCE_US 1000
+#endif
+
+/**
+ * @brief Most bytes passed to aIOSocketPut and aIOUDPPut that were not sent
+ * yet, for all destinations together. This includes TCP data waiting for its
+ * connection to take it. A put that would exceed it fails.
+ */
+#ifndef AIO_SOCKET_QUEUE_SIZE
+#define AIO_SOCKET_QUEUE_SIZE 65536
+#endif
+
 /**
  * @brief Handle used to reference and opened asyncronour communications channel
  */
@@ -60,18 +106,73 @@ typedef enum { UDP, TCP } aIO_socket_e;
 /**
  * @brief Callback for an asynchronous IO connection
  *
+ * Received data is always followed by a null terminator in buffer, which is
+ * only valid until the callback returns.
+ *
  * @param recv_size The number of bytes received
  * @param buffer Buffer containing the received data
  * @param args Args passed in during the creation of the connection
  */
 typedef void (*aIO_callback_t)(size_t recv_size, char *buffer, void *args);
 
+/**
+ * @brief A datagram received by a UDP socket
+ */
+typedef struct {
+    size_t recv_size; /**< Number of bytes received */
+    char *buffer; /**< Received data, followed by a null terminator */
+    struct sockaddr_in addr; /**< Address the datagram was sent from */
+} aIO_datagram_t;
+
+/**
+ * @brief Callback for the datagrams a UDP socket received at once
+ *
+ * @param datagrams The datagrams, in the order they were received. Their
+ * buffers are only valid until the callback returns.
+ * @param count Number of datagrams, at most AIO_UDP_BATCH
+ * @param args Args passed in during the creation of the connection
+ */
+typedef void (*aIO_batch_callback_t)(aIO_datagram_t *datagrams,
+                                     unsigned int count, void *args);
+
+/**
+ * @brief Lifecycle callbacks of the clients of a TCP socket
+ *
+ * Each member may be NULL.
+ */
+typedef struct {
+    /**
+     * @brief Called on the reactor thread when a client connected, before
+     * any of its data is passed on
+     *
+     * @param args Args passed in during the creation of the TCP socket
+     * @return The state of the client, passed to its data and close
+     * callbacks. Without a connect callback args is used.
+     */
+    void *(*connect)(void *args);
+    /**
+     * @brief Called on the client's worker thread for received data
+     *
+     * While it runs no further data of the client is read. Once the
+     * socket's receive buffer is full the TCP window closes and the sender
+     * is slowed down to the rate the callback can keep up with.
+     */
+    aIO_callback_t data;
+    /**
+     * @brief Called once the client disconnected or its socket was closed,
+     * the state can be freed here
+     *
+     * @param state The state returned by the connect callback
+     */
+    void (*close)(void *state);
+} aIO_tcp_callbacks_t;
+
 
 /**
  * @brief Function that closes all open connections
  *
- * Calling this function will close all connection and free all allocated reources
- * used by those connections. Use in conjunction with `atexit` to automatically
+ * Calling this function will stop the reactor thread, close all connection and
+ * free all allocated reources used by those connections. Use in conjunction with `atexit` to automatically
  * free all resources when exiting the program via normal methods (eg. SIGINT).
  */
 void aIODeinit(void);
@@ -79,9 +180,17 @@ void aIODeinit(void);
 /**
  * @brief Closes a connection and frees all resources used by that connection
  *
+ * Once this returns no callback of the connection runs any more, unless it
+ * was called from the connection's own callback, which may close its
+ * connection. The connection is then freed when the callback returns.
+ *
+ * Closing a TCP socket disconnects all of its clients and waits for their
+ * close callbacks. TCP client callbacks run on the worker threads, a TCP
+ * socket closed from one of them is not closed and an error is printed.
+ *
  * @param conn Handle to the connection that is to be closed
  */
-void aIOCloseConn(aIO_handle_t conn); //TODO
+void aIOCloseConn(aIO_handle_t conn);
 
 /**
  * @brief Sends the data stored in buffer to the message queue with the provided
@@ -99,16 +208,63 @@ int aIOMessageQueuePut(char *mq_name, char *buffer);
 /**
  * @brief Send the data stored in buffer to the socket described by s_addr and port
  *
+ * The data is copied and handed to the AsyncIO reactor, which opens the
+ * connection to each destination on the first put and keeps it open for the
+ * following ones. Puts are sent in order. TCP data that the connection can not
+ * take yet, e.g. while it is still being established, stays queued. If a
+ * connection that already carried data fails it is opened once more to send
+ * what is still queued. Connection and send errors are reported on stderr by
+ * the reactor. Connections are closed by aIODeinit, which waits up to a second
+ * for queued data to be sent.
+ *
+ * Apart from setting up on the first call, no lock is taken that the reactor
+ * also holds, so a task calling this can be suspended at any point.
+ *
  * @param protocol Either UDP or TCP, @see aIO_socket_e
  * @param s_addr IP address of target client in IPv4 numbers-and-dots notation.
  * eg. 127.0.0.1. NULL for localhost/loopback.
  * @param port Port
- * @param buffer Reference to data to be sent
+ * @param buffer Reference to data to be sent, it is copied
  * @param buffer_size Length of the data to be send in bytes
- * @return returns 0 on success; on error, -1 is returned.
+ * @return returns 0 once the data is queued for the reactor. This does not
+ * mean it is delivered, failures to connect or send are not reported to the
+ * caller, only on stderr, and the data is dropped. -1 is returned if the data
+ * can not be queued, e.g. if more than AIO_SOCKET_QUEUE_SIZE bytes would not
+ * be sent yet.
  */
 int aIOSocketPut(aIO_socket_e protocol, char *s_addr, in_port_t port,
                  char *buffer, size_t buffer_size);
+
+/**
+ * @brief Queues a UDP datagram to be sent from a socket kept open for all
+ * datagrams
+ *
+ * The datagram is copied and handed to the AsyncIO reactor like the data of
+ * aIOSocketPut, no lock is taken that the reactor also holds. The reactor
+ * sends queued datagrams together with one sendmmsg(2) call once
+ * AIO_UDP_BATCH datagrams are queued or AIO_UDP_COALESCE_US microseconds
+ * after the first of them was queued, whatever comes first. This trades a
+ * little latency for far fewer system calls when many small datagrams are
+ * sent.
+ *
+ * @param s_addr IP address of target client in IPv4 numbers-and-dots notation.
+ * eg. 127.0.0.1. NULL for localhost/loopback.
+ * @param port Port
+ * @param buffer Reference to data to be sent, it is copied
+ * @param buffer_size Length of the data to be send in bytes
+ * @return returns 0 once the datagram is queued for the reactor. This does
+ * not mean it is delivered, send failures are not reported to the caller,
+ * only on stderr. -1 is returned if the datagram can not be queued, e.g. if
+ * more than AIO_SOCKET_QUEUE_SIZE bytes would not be sent yet.
+ */
+int aIOUDPPut(char *s_addr, in_port_t port, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Has the reactor send all datagrams queued by aIOUDPPut right away
+ *
+ * Returns without waiting for them to be sent.
+ */
+void aIOUDPFlush(void);
 /**
  * @brief Open a POSIX message queue
  *
@@ -123,7 +279,8 @@ int aIOSocketPut(aIO_socket_e protocol, char *s_addr, in_port_t port,
  * using MQ_MSGSIZE.
  * @param callback A callback function that is called and passed the received data.
  * @param args Args to be passed to the connection's callback function args Args to be passed to the connection's callback function
- * @return Handle to the created connection, or NULL
+ * @return Handle to the created connection, or NULL. Also NULL if the message
+ * queue is already open in this process.
  */
 aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
                                  long max_msg_size, aIO_callback_t callback,
@@ -143,6 +300,25 @@ aIO_handle_t aIOOpenMessageQueue(char *name, long max_msg_num,
 aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
                               aIO_callback_t callback, void *args);
 
+/**
+ * @brief Opens a UDP socket enpoint that passes the datagrams received
+ * together to one callback
+ *
+ * Up to AIO_UDP_BATCH datagrams are received with a single recvmmsg(2) call,
+ * each into a buffer of its own.
+ *
+ * @param s_addr IP address of target client in IPv4 numbers-and-dots notation.
+ * eg. 127.0.0.1. NULL for localhost/loopback.
+ * @param port Port to open the socket on
+ * @param buffer_size Number of bytes to be reserved for each datagram
+ * @param callback Callback triggered with the datagrams received at once
+ * @param args Args passed to the specified callback
+ * @return Handle to the created connection, or NULL
+ */
+aIO_handle_t aIOOpenUDPSocketBatch(char *s_addr, in_port_t port,
+                                   size_t buffer_size,
+                                   aIO_batch_callback_t callback, void *args);
+
 /**
  * @brief Opens a socket enpoint
  *
@@ -157,5 +333,29 @@ aIO_handle_t aIOOpenUDPSocket(char *s_addr, in_port_t port, size_t buffer_size,
 aIO_handle_t aIOOpenTCPSocket(char *s_addr, in_port_t port, size_t buffer_size,
                               aIO_callback_t callback, void *args);
 
+/**
+ * @brief Opens a TCP socket enpoint with callbacks for the lifecycle of each
+ * client
+ *
+ * Clients are accepted on the reactor thread and handed to the least busy
+ * worker of the pool. Once max_clients clients are connected no further
+ * connections are accepted, they wait in the socket's backlog until a client
+ * disconnects.
+ *
+ * @param s_addr IP address of target client in IPv4 numbers-and-dots notation.
+ * eg. 127.0.0.1. NULL for localhost/loopback.
+ * @param port Port to open the socket on
+ * @param buffer_size Maximum number of bytes passed to one data callback
+ * @param callbacks Callbacks for connecting, received data and closing
+ * clients, @see aIO_tcp_callbacks_t
+ * @param max_clients Maximum number of clients connected at once, 0 for
+ * AIO_TCP_MAX_CLIENTS
+ * @param args Args passed to the connect callback
+ * @return Handle to the created connection, or NULL
+ */
+aIO_handle_t aIOOpenTCPServer(char *s_addr, in_port_t port, size_t buffer_size,
+                              const aIO_tcp_callbacks_t *callbacks,
+                              unsigned int max_clients, void *args);
+
 /** @} */
 #endif
@@ -100,6 +100,11 @@ extern "C" {
 /* Basic FreeRTOS definitions. */
 #include "projdefs.h"
 
+/* Must be defaulted before the port layer, which is built around it. */
+#ifndef configNUMBER_OF_CORES
+#define configNUMBER_OF_CORES 1
+#endif
+
 /* Definitions specific to the port being used. */
 #include "portable.h"
 
@@ -662,6 +667,12 @@ task that attempted the write. */
 #define configGENERATE_RUN_TIME_STATS 0
 #endif
 
+#ifndef configRUN_TIME_COUNTER_TYPE
+/* Defaults to uint32_t for backward compatibility, but can be overridden in
+FreeRTOSConfig.h if uint32_t is too restrictive, e.g. for a fast time base. */
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
 #if ( configGENERATE_RUN_TIME_STATS == 1 )
 
 #ifndef portCONFIGURE_TIMER_FOR_RUN_TIME_STATS
@@ -720,6 +731,25 @@ task that attempted the write. */
 #define configUSE_QUEUE_SETS 0
 #endif
 
+#ifndef configUSE_ZERO_COPY_QUEUES
+#define configUSE_ZERO_COPY_QUEUES 0
+#endif
+
+/* Identifies a task waiting on a stream buffer. A port that gives
+notifications from outside the kernel later may use a value that can not
+match a task created after the waiting one was deleted, and then defines all
+of these. */
+#ifndef portNOTIFY_TARGET_TYPE
+#define portNOTIFY_TARGET_TYPE TaskHandle_t
+#define portNOTIFY_TARGET_NONE NULL
+#define portGET_NOTIFY_TARGET() xTaskGetCurrentTaskHandle()
+#define portNOTIFY_GIVE( xTarget ) ( ( void ) xTaskNotifyGive( ( xTarget ) ) )
+#endif
+
+#ifndef portNOTIFY_GIVE_FROM_ISR
+#define portNOTIFY_GIVE_FROM_ISR( xTarget, pxHigherPriorityTaskWoken ) vTaskNotifyGiveFromISR( ( xTarget ), ( pxHigherPriorityTaskWoken ) )
+#endif
+
 #ifndef portTASK_USES_FLOATING_POINT
 #define portTASK_USES_FLOATING_POINT()
 #endif
@@ -933,7 +963,7 @@ typedef struct xSTATIC_TCB {
     void            *pvDummy15[ configNUM_THREAD_LOCAL_STORAGE_POINTERS ];
 #endif
 #if ( configGENERATE_RUN_TIME_STATS == 1 )
-    uint32_t        ulDummy16;
+    configRUN_TIME_COUNTER_TYPE ulDummy16;
 #endif
 #if ( configUSE_NEWLIB_REENTRANT == 1 )
     struct  _reent  xDummy17;
@@ -945,6 +975,10 @@ typedef struct xSTATIC_TCB {
 #if( ( configSUPPORT_STATIC_ALLOCATION == 1 ) && ( configSUPPORT_DYNAMIC_ALLOCATION == 1 ) )
     uint8_t         uxDummy20;
 #endif
+#if( configNUMBER_OF_CORES > 1 )
+    BaseType_t      xDummy21;
+    UBaseType_t     uxDummy22;
+#endif
 
 } StaticTask_t;
 
@@ -987,6 +1021,11 @@ typedef struct xSTATIC_QUEUE {
     uint8_t ucDummy9;
 #endif
 
+#if ( configUSE_ZERO_COPY_QUEUES == 1 )
+    void *pvDummy10;
+    UBaseType_t uxDummy11;
+#endif
+
 } StaticQueue_t;
 typedef StaticQueue_t StaticSemaphore_t;
 
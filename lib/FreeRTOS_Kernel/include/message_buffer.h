@@ -0,0 +1,90 @@
+/*
+ * Message buffers pass variable length messages from a single sender to a
+ * single receiver.  They are stream buffers that store the length of every
+ * message in front of it and only ever send or receive whole messages, see
+ * stream_buffer.h for how they are safe without a critical section.
+ *
+ * Each message takes sizeof( size_t ) bytes of the buffer for its length in
+ * addition to its own size.
+ */
+
+#ifndef MESSAGE_BUFFER_H
+#define MESSAGE_BUFFER_H
+
+#ifndef INC_FREERTOS_H
+#error "include FreeRTOS.h" must appear in source files before "include message_buffer.h"
+#endif
+
+#include "stream_buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type by which message buffers are referenced.
+ */
+typedef void * MessageBufferHandle_t;
+
+/*
+ * Creates a new message buffer of xBufferSizeBytes bytes using dynamically
+ * allocated memory.  Returns NULL if there was not enough heap memory.
+ */
+#define xMessageBufferCreate( xBufferSizeBytes ) ( MessageBufferHandle_t ) xStreamBufferGenericCreate( ( xBufferSizeBytes ), ( size_t ) 0, pdTRUE )
+
+/*
+ * Sends a message from a task, blocking for up to xTicksToWait ticks until
+ * there is space for all of it.  Returns xDataLengthBytes if the message was
+ * sent and 0 otherwise, a message is never sent in part.  Empty messages are
+ * not supported, a send of zero bytes stores nothing, returns 0 straight away
+ * and notifies no one.
+ */
+#define xMessageBufferSend( xMessageBuffer, pvTxData, xDataLengthBytes, xTicksToWait ) xStreamBufferSend( ( StreamBufferHandle_t ) ( xMessageBuffer ), ( pvTxData ), ( xDataLengthBytes ), ( xTicksToWait ) )
+
+/*
+ * A version of xMessageBufferSend() that never blocks and can be used from an
+ * interrupt, a signal handler or a thread that is not a task.
+ *
+ * Example usage, passing the datagrams an AsyncIO handler receives to a task:
+   <pre>
+ void vUDPHandler( size_t xReadSize, char *pcBuffer, void *pvArgs )
+ {
+	if( xMessageBufferSendFromISR( ( MessageBufferHandle_t ) pvArgs, pcBuffer, xReadSize, NULL ) != xReadSize )
+	{
+		// The task fell behind, the datagram is dropped.
+	}
+ }
+   </pre>
+ */
+#define xMessageBufferSendFromISR( xMessageBuffer, pvTxData, xDataLengthBytes, pxHigherPriorityTaskWoken ) xStreamBufferSendFromISR( ( StreamBufferHandle_t ) ( xMessageBuffer ), ( pvTxData ), ( xDataLengthBytes ), ( pxHigherPriorityTaskWoken ) )
+
+/*
+ * Receives the next message into a task, blocking for up to xTicksToWait
+ * ticks until there is one.  Returns the length of the message, or 0 if the
+ * block time expired or the message is larger than xBufferLengthBytes, in
+ * which case it is left in the buffer.
+ */
+#define xMessageBufferReceive( xMessageBuffer, pvRxData, xBufferLengthBytes, xTicksToWait ) xStreamBufferReceive( ( StreamBufferHandle_t ) ( xMessageBuffer ), ( pvRxData ), ( xBufferLengthBytes ), ( xTicksToWait ) )
+
+/*
+ * A version of xMessageBufferReceive() that never blocks and can be used from
+ * an interrupt, a signal handler or a thread that is not a task.
+ */
+#define xMessageBufferReceiveFromISR( xMessageBuffer, pvRxData, xBufferLengthBytes, pxHigherPriorityTaskWoken ) xStreamBufferReceiveFromISR( ( StreamBufferHandle_t ) ( xMessageBuffer ), ( pvRxData ), ( xBufferLengthBytes ), ( pxHigherPriorityTaskWoken ) )
+
+/*
+ * Deletes a message buffer, see vStreamBufferDelete().
+ */
+#define vMessageBufferDelete( xMessageBuffer ) vStreamBufferDelete( ( StreamBufferHandle_t ) ( xMessageBuffer ) )
+
+/*
+ * Returns the number of bytes that can be written without blocking, the
+ * longest message that fits is sizeof( size_t ) bytes shorter.
+ */
+#define xMessageBufferSpacesAvailable( xMessageBuffer ) xStreamBufferSpacesAvailable( ( StreamBufferHandle_t ) ( xMessageBuffer ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESSAGE_BUFFER_H */
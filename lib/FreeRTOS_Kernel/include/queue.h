@@ -1782,6 +1782,171 @@ QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t xQueueSet, const Tic
  */
 QueueSetMemberHandle_t xQueueSelectFromSetFromISR(QueueSetHandle_t xQueueSet) PRIVILEGED_FUNCTION;
 
+/*
+ * Posts up to uxItemCount items to the back of a queue in one critical section.
+ * The items are copied from the consecutive array pvItems.  The call blocks
+ * only while the queue is full, once there is space for at least one item as
+ * many items as fit are posted and their number is returned, the caller posts
+ * the rest with another call.  Tasks waiting to receive are unblocked for the
+ * whole batch, and the calling task yields at most once.
+ *
+ * Mutexes cannot be given with this function.
+ *
+ * Example usage:
+   <pre>
+ uint32_t ulValues[ 16 ];
+ UBaseType_t uxSent = 0;
+
+	while( uxSent < 16 )
+	{
+		uxSent += xQueueSendMultiple( xQueue, &( ulValues[ uxSent ] ), 16 - uxSent, portMAX_DELAY );
+	}
+   </pre>
+ *
+ * @param xQueue The handle to the queue on which the items are to be posted.
+ *
+ * @param pvItems A pointer to the first of the items, each of the item size
+ * the queue was created with.
+ *
+ * @param uxItemCount The number of items in pvItems.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block waiting
+ * for space to become available on the queue, should it already be full.
+ *
+ * @return The number of items posted, 0 if the queue stayed full until the
+ * block time expired.
+ */
+UBaseType_t xQueueSendMultiple(QueueHandle_t xQueue, const void * const pvItems, const UBaseType_t uxItemCount, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * Receives up to uxMaxItems items from a queue in one critical section.  The
+ * call blocks only while the queue is empty, it then copies the items that are
+ * waiting, oldest first, into the consecutive array pvBuffer.  Tasks waiting
+ * to send are unblocked for the whole batch, and the calling task yields at
+ * most once.
+ *
+ * Mutexes cannot be taken with this function.
+ *
+ * @param xQueue The handle to the queue from which the items are to be
+ * received.
+ *
+ * @param pvBuffer Pointer to the buffer into which the received items are
+ * copied, it must have room for uxMaxItems items.
+ *
+ * @param uxMaxItems The maximum number of items to receive.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block waiting
+ * for an item to receive should the queue be empty at the time of the call.
+ *
+ * @return The number of items received, 0 if the queue stayed empty until the
+ * block time expired.
+ */
+UBaseType_t xQueueReceiveMultiple(QueueHandle_t xQueue, void * const pvBuffer, const UBaseType_t uxMaxItems, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * Zero copy queues pass large items between tasks by reference instead of by
+ * copy.  Each one owns a fixed pool of equally sized buffers.  A sender loans
+ * a buffer from the pool with pvQueueLoanBuffer(), fills it in place and
+ * queues it with xQueueSendLoan(), which hands the buffer over to the queue.
+ * The receiver obtains the buffer with xQueueReceiveLoan(), uses it in place
+ * and gives it back with vQueueReturnBuffer().  Only the pointer is copied on
+ * the way, whatever the size of the buffer.
+ *
+ * Note 1:  A buffer belongs to whoever loaned or received it until it is sent
+ * or returned.  If xQueueSendLoan() fails the buffer still belongs to the
+ * sender, which must send it again or return it.
+ *
+ * Note 2:  The pool is shared by the buffers waiting in the queue and the ones
+ * held by senders and receivers, so uxBufferCount should be at least
+ * uxQueueLength plus the number of buffers held at once.
+ *
+ * Note 3:  Deleting the queue with vQueueDelete() frees the pool, buffers that
+ * are still on loan included.
+ *
+ * configUSE_ZERO_COPY_QUEUES must be set to 1 in FreeRTOSConfig.h for the
+ * zero copy queue functions to be available.
+ *
+ * @param uxQueueLength The maximum number of buffers the queue can hold.
+ *
+ * @param uxBufferSize The size, in bytes, of each buffer in the pool.
+ *
+ * @param uxBufferCount The number of buffers in the pool.
+ *
+ * @return If the queue and its pool are created successfully then a handle to
+ * the queue is returned.  Otherwise NULL is returned.
+ */
+QueueHandle_t xQueueCreateZeroCopy(const UBaseType_t uxQueueLength, const UBaseType_t uxBufferSize, const UBaseType_t uxBufferCount) PRIVILEGED_FUNCTION;
+
+/*
+ * Loans a free buffer from the pool of a zero copy queue.
+ *
+ * @param xQueue The handle of a queue created with xQueueCreateZeroCopy().
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for a buffer to be returned to the pool, should it be empty.
+ *
+ * @return A buffer of at least the size given to xQueueCreateZeroCopy(), or
+ * NULL if none became free before the block time expired.
+ */
+void *pvQueueLoanBuffer(QueueHandle_t xQueue, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * A version of pvQueueLoanBuffer() that can be used from an ISR.
+ */
+void *pvQueueLoanBufferFromISR(QueueHandle_t xQueue, BaseType_t * const pxHigherPriorityTaskWoken) PRIVILEGED_FUNCTION;
+
+/*
+ * Posts a loaned buffer to the back of a zero copy queue.  On success the
+ * buffer belongs to the queue and must no longer be accessed by the sender.
+ *
+ * @param xQueue The handle of the queue the buffer was loaned from.
+ *
+ * @param pvBuffer A buffer returned by pvQueueLoanBuffer() or
+ * xQueueReceiveLoan() on the same queue.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for space to become available on the queue, should it be full.
+ *
+ * @return pdTRUE if the buffer was queued, otherwise errQUEUE_FULL.
+ */
+BaseType_t xQueueSendLoan(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * A version of xQueueSendLoan() that can be used from an ISR.
+ */
+BaseType_t xQueueSendLoanFromISR(QueueHandle_t xQueue, void *pvBuffer, BaseType_t * const pxHigherPriorityTaskWoken) PRIVILEGED_FUNCTION;
+
+/*
+ * Receives a buffer from a zero copy queue.  The buffer belongs to the
+ * receiver until it is given back with vQueueReturnBuffer() or sent on with
+ * xQueueSendLoan().
+ *
+ * @param xQueue The handle of a queue created with xQueueCreateZeroCopy().
+ *
+ * @param ppvBuffer Pointer to where the address of the received buffer is
+ * written.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for a buffer should the queue be empty.
+ *
+ * @return pdTRUE if a buffer was received, otherwise pdFALSE.
+ */
+BaseType_t xQueueReceiveLoan(QueueHandle_t xQueue, void **ppvBuffer, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * Returns a loaned or received buffer to the pool of a zero copy queue.
+ *
+ * @param xQueue The handle of the queue the buffer was loaned from.
+ *
+ * @param pvBuffer The buffer being returned.
+ */
+void vQueueReturnBuffer(QueueHandle_t xQueue, void *pvBuffer) PRIVILEGED_FUNCTION;
+
+/*
+ * A version of vQueueReturnBuffer() that can be used from an ISR.
+ */
+void vQueueReturnBufferFromISR(QueueHandle_t xQueue, void *pvBuffer, BaseType_t * const pxHigherPriorityTaskWoken) PRIVILEGED_FUNCTION;
+
 /* Not public API functions. */
 void vQueueWaitForMessageRestricted(QueueHandle_t xQueue, TickType_t xTicksToWait, const BaseType_t xWaitIndefinitely) PRIVILEGED_FUNCTION;
 BaseType_t xQueueGenericReset(QueueHandle_t xQueue, BaseType_t xNewQueue) PRIVILEGED_FUNCTION;
@@ -0,0 +1,161 @@
+/*
+ * Stream buffers pass a stream of bytes from a single sender to a single
+ * receiver, message buffers built on them pass variable length messages.
+ *
+ * Neither side enters a critical section. The read and write positions are
+ * C11 atomics, the sender publishes the bytes it wrote with a release store
+ * and the receiver hands the space back the same way, so sending or
+ * receiving without blocking is wait free. That makes the ...FromISR()
+ * functions safe to call from signal handlers and threads that are not
+ * tasks, such as the AsyncIO handlers or the SDL event thread, which may
+ * run in parallel to the task on the other side.
+ *
+ * A task blocked on a buffer waits for a direct to task notification, which
+ * the other side gives when it made enough data or space available. This
+ * kernel has a single notification value per task, which the buffer shares
+ * with the application: a wait on a buffer consumes any notification given to
+ * the task for another reason, and a notification the buffer gives just as a
+ * wait times out stays pending and ends the task's next notification wait
+ * early. A task that sends to or receives from a buffer with a block time
+ * must therefore not use direct to task notifications for anything else.
+ * Sending and receiving without blocking does not touch the notification
+ * value of the calling task.
+ *
+ * There must only ever be one sender and one receiver at a time. Several
+ * writers or readers have to serialise their access themselves, e.g. with a
+ * mutex or by sending from a single handler.
+ */
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#ifndef INC_FREERTOS_H
+#error "include FreeRTOS.h" must appear in source files before "include stream_buffer.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type by which stream buffers are referenced.  For example, a call to
+ * xStreamBufferCreate() returns an StreamBufferHandle_t variable that can
+ * then be used as a parameter to xStreamBufferSend(), xStreamBufferReceive(),
+ * etc.
+ */
+typedef void * StreamBufferHandle_t;
+
+/*
+ * Creates a new stream buffer using dynamically allocated memory.
+ *
+ * @param xBufferSizeBytes The total number of bytes the stream buffer will be
+ * able to hold at any one time.
+ *
+ * @param xTriggerLevelBytes The number of bytes that must be in the stream
+ * buffer before a task that is blocked on it waiting for data is moved out of
+ * the blocked state.  A trigger level of 0 is taken as 1, a trigger level
+ * larger than the buffer as the size of the buffer.
+ *
+ * @return The handle of the created stream buffer, or NULL if there was not
+ * enough heap memory available.
+ */
+#define xStreamBufferCreate( xBufferSizeBytes, xTriggerLevelBytes ) xStreamBufferGenericCreate( ( xBufferSizeBytes ), ( xTriggerLevelBytes ), pdFALSE )
+
+/*
+ * Deletes a stream buffer that was created with xStreamBufferCreate().  No
+ * task may be blocked on the buffer and no handler may still use it.
+ */
+void vStreamBufferDelete(StreamBufferHandle_t xStreamBuffer) PRIVILEGED_FUNCTION;
+
+/*
+ * Sends bytes to a stream buffer from a task.  As many bytes as fit are
+ * copied into the buffer.  If there is not enough space for all of them the
+ * calling task blocks for up to xTicksToWait ticks until there is, and then
+ * copies as many as fit.  A task sending more than the buffer size minus the
+ * trigger level only waits for that much space, so it can not block a
+ * receiver that waits for the trigger level.
+ *
+ * Example usage:
+   <pre>
+ size_t xSent = 0;
+
+	while( xSent < sizeof( ucData ) )
+	{
+		xSent += xStreamBufferSend( xStreamBuffer, &( ucData[ xSent ] ), sizeof( ucData ) - xSent, portMAX_DELAY );
+	}
+   </pre>
+ *
+ * @param xStreamBuffer The handle of the stream buffer to send to.
+ *
+ * @param pvTxData A pointer to the bytes to copy into the buffer.
+ *
+ * @param xDataLengthBytes The number of bytes to copy.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block waiting
+ * for enough space to become available.
+ *
+ * @return The number of bytes written, which is less than xDataLengthBytes if
+ * the block time expired before there was space for all of them.  Sending
+ * zero bytes writes nothing, returns 0 and notifies no one.
+ */
+size_t xStreamBufferSend(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * A version of xStreamBufferSend() that never blocks and can be used from an
+ * interrupt, a signal handler or a thread that is not a task.  Bytes that do
+ * not fit are dropped, the return value tells how many were written.
+ *
+ * *pxHigherPriorityTaskWoken is set to pdTRUE if the receiving task has to
+ * run before the interrupt exits, it may be NULL.  On the POSIX port the
+ * receiver is notified once the running task takes the tick signal, the flag
+ * is left unchanged then.
+ */
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes, BaseType_t *const pxHigherPriorityTaskWoken) PRIVILEGED_FUNCTION;
+
+/*
+ * Receives bytes from a stream buffer into a task.  If fewer bytes than the
+ * trigger level are in the buffer the calling task blocks for up to
+ * xTicksToWait ticks until there are, once the block time expired the bytes
+ * that are available are returned.
+ *
+ * @param xStreamBuffer The handle of the stream buffer to receive from.
+ *
+ * @param pvRxData A pointer to the buffer the bytes are copied into.
+ *
+ * @param xBufferLengthBytes The size of pvRxData, the most bytes received in
+ * one call.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block waiting
+ * for data.
+ *
+ * @return The number of bytes received, 0 if the buffer stayed empty until
+ * the block time expired.
+ */
+size_t xStreamBufferReceive(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait) PRIVILEGED_FUNCTION;
+
+/*
+ * A version of xStreamBufferReceive() that never blocks and can be used from
+ * an interrupt, a signal handler or a thread that is not a task.
+ */
+size_t xStreamBufferReceiveFromISR(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes, BaseType_t *const pxHigherPriorityTaskWoken) PRIVILEGED_FUNCTION;
+
+/*
+ * Returns the number of bytes that can be read from the stream buffer.  For a
+ * message buffer this includes the length stored with each message.
+ */
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t xStreamBuffer) PRIVILEGED_FUNCTION;
+
+/*
+ * Returns the number of bytes that can be written to the stream buffer
+ * without blocking.
+ */
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t xStreamBuffer) PRIVILEGED_FUNCTION;
+
+/* Not public API functions. */
+StreamBufferHandle_t xStreamBufferGenericCreate(size_t xBufferSizeBytes, size_t xTriggerLevelBytes, BaseType_t xIsMessageBuffer) PRIVILEGED_FUNCTION;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_BUFFER_H */
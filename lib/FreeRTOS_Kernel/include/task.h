@@ -166,7 +166,7 @@ typedef struct xTASK_STATUS {
     eTaskState eCurrentState;       /* The state in which the task existed when the structure was populated. */
     UBaseType_t uxCurrentPriority;  /* The priority at which the task was running (may be inherited) when the structure was populated. */
     UBaseType_t uxBasePriority;     /* The priority to which the task will return if the task's current priority has been inherited to avoid unbounded priority inversion when obtaining a mutex.  Only valid if configUSE_MUTEXES is defined as 1 in FreeRTOSConfig.h. */
-    uint32_t ulRunTimeCounter;      /* The total run time allocated to the task so far, as defined by the run time stats clock.  See http://www.freertos.org/rtos-run-time-stats.html.  Only valid when configGENERATE_RUN_TIME_STATS is defined as 1 in FreeRTOSConfig.h. */
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter; /* The total run time allocated to the task so far, as defined by the run time stats clock.  See http://www.freertos.org/rtos-run-time-stats.html.  Only valid when configGENERATE_RUN_TIME_STATS is defined as 1 in FreeRTOSConfig.h. */
     StackType_t *pxStackBase;       /* Points to the lowest address of the task's stack area. */
     uint16_t usStackHighWaterMark;  /* The minimum amount of stack space that has remained for the task since the task was created.  The closer this value is to zero the closer the task has come to overflowing its stack. */
 } TaskStatus_t;
@@ -1422,6 +1422,39 @@ BaseType_t xTaskCallApplicationTaskHook(TaskHandle_t xTask, void *pvParameter) P
  */
 TaskHandle_t xTaskGetIdleTaskHandle(void) PRIVILEGED_FUNCTION;
 
+#if ( configNUMBER_OF_CORES > 1 )
+
+/* Core affinity mask that allows a task to run on any core. */
+#define tskNO_AFFINITY  ( ( UBaseType_t ) -1 )
+
+/**
+ * Only available if configNUMBER_OF_CORES is greater than 1.
+ *
+ * Restricts the task referenced by xTask to the cores whose bits are set in
+ * uxCoreAffinityMask, bit 0 being core 0.  Passing NULL as xTask sets the
+ * affinity of the calling task.  A task running on a core it is no longer
+ * allowed on is moved off that core straight away.  Tasks are created with
+ * tskNO_AFFINITY.
+ */
+void vTaskCoreAffinitySet(const TaskHandle_t xTask, UBaseType_t uxCoreAffinityMask) PRIVILEGED_FUNCTION;
+
+/**
+ * Only available if configNUMBER_OF_CORES is greater than 1.
+ *
+ * Returns the core affinity mask of the task referenced by xTask, or of the
+ * calling task if xTask is NULL.
+ */
+UBaseType_t vTaskCoreAffinityGet(const TaskHandle_t xTask) PRIVILEGED_FUNCTION;
+
+/**
+ * Only available if configNUMBER_OF_CORES is greater than 1.
+ *
+ * Returns the handle of the task running on core xCoreID.
+ */
+TaskHandle_t xTaskGetCurrentTaskHandleForCore(BaseType_t xCoreID) PRIVILEGED_FUNCTION;
+
+#endif /* configNUMBER_OF_CORES */
+
 /**
  * configUSE_TRACE_FACILITY must be defined as 1 in FreeRTOSConfig.h for
  * uxTaskGetSystemState() to be available.
@@ -1519,7 +1552,7 @@ TaskHandle_t xTaskGetIdleTaskHandle(void) PRIVILEGED_FUNCTION;
     }
     </pre>
  */
-UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize, uint32_t *const pulTotalRunTime) PRIVILEGED_FUNCTION;
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize, configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime) PRIVILEGED_FUNCTION;
 
 /**
  * task. h
@@ -58,10 +58,13 @@
 #include <sched.h>
 #include <signal.h>
 #include <errno.h>
-#include <sys/time.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <linux/futex.h>
 #include <time.h>
-#include <sys/times.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <limits.h>
@@ -72,20 +75,69 @@
 /*-----------------------------------------------------------*/
 
 #define MAX_NUMBER_OF_TASKS (_POSIX_THREAD_THREADS_MAX)
-/*-----------------------------------------------------------*/
 
-/* Parameters to pass to the newly created pthread. */
-typedef struct XPARAMS {
-    pdTASK_CODE pxCode;
-    void *pvParams;
-} xParams;
+/* A notification target holds the thread slot plus one in its low bits and
+ * the generation of the slot above them. */
+#define NOTIFY_SLOT_BITS 16
+#if (MAX_NUMBER_OF_TASKS >= (1 << NOTIFY_SLOT_BITS))
+#error "MAX_NUMBER_OF_TASKS does not fit a notification target"
+#endif
+#define NOTIFY_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define NOTIFY_WORDS \
+    ((MAX_NUMBER_OF_TASKS + NOTIFY_WORD_BITS - 1) / NOTIFY_WORD_BITS)
+
+/* The TCB's top of stack holds the task's thread state, not a stack pointer. */
+#if (configCHECK_FOR_STACK_OVERFLOW > 0)
+#error "configCHECK_FOR_STACK_OVERFLOW is not supported by the Posix port"
+#endif
+
+/* Cores are handed between task threads the same way a single CPU is in the
+ * event handoff mode. */
+#if (configNUMBER_OF_CORES > 1)
+#if (configUSE_POSIX_EVENT_HANDOFF == 0)
+#error "configNUMBER_OF_CORES > 1 requires configUSE_POSIX_EVENT_HANDOFF"
+#endif
+#if (configUSE_TICKLESS_IDLE == 1)
+#error "configUSE_TICKLESS_IDLE is not supported with configNUMBER_OF_CORES > 1"
+#endif
+#endif
+/*-----------------------------------------------------------*/
 
 /* Each task maintains its own interrupt status in the critical nesting variable. */
 typedef struct THREAD_SUSPENSIONS {
     pthread_t hThread;
     xTaskHandle hTask;
     unsigned portBASE_TYPE uxCriticalNesting;
+    /* Advanced when the task in the slot is deleted, so a notification target
+     * taken before can not match the next task, see ullPortGetNotifyTarget(). */
+    uint64_t ullGeneration;
+    /* Generation plus one a notification from outside the kernel is pending
+     * for, see vPortNotifyGiveFromThread(). */
+    uint64_t ullNotifyGeneration;
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+    /* Futex word the thread parks on, set to 1 to hand it the CPU. */
+    int iWake;
+    /* Set before waking a parked thread that has to terminate. */
+    volatile portBASE_TYPE xExit;
+#endif
+#if (configNUMBER_OF_CORES > 1)
+    /* The core the thread runs on, or ran on last. */
+    volatile portLONG lCore;
+#endif
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    /* Run-time accounting since the last snapshot, in nanoseconds. */
+    uint64_t ullRunTime;
+    uint64_t ullLongestSlice;
+    unsigned long ulSwitches;
+#endif
 } xThreadState;
+
+/* Parameters to pass to the newly created pthread. */
+typedef struct XPARAMS {
+    pdTASK_CODE pxCode;
+    void *pvParams;
+    xThreadState *pxThreadState;
+} xParams;
 /*-----------------------------------------------------------*/
 
 static xThreadState *pxThreads;
@@ -94,6 +146,9 @@ static pthread_attr_t xThreadAttributes;
 static pthread_mutex_t xSuspendResumeThreadMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t xSingleThreadMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_t hMainThread = (pthread_t)NULL;
+static pthread_t hTickThread;
+static pthread_mutex_t xTickMutex = PTHREAD_MUTEX_INITIALIZER;
+static int iTickTimer = -1;
 /*-----------------------------------------------------------*/
 
 static volatile portBASE_TYPE xSentinel = 0;
@@ -101,26 +156,100 @@ static volatile portBASE_TYPE xSchedulerEnd = pdFALSE;
 static volatile portBASE_TYPE xInterruptsEnabled = pdTRUE;
 static volatile portBASE_TYPE xServicingTick = pdFALSE;
 static volatile portBASE_TYPE xPendYield = pdFALSE;
-static volatile portLONG lIndexOfLastAddedTask = 0;
 static volatile unsigned portBASE_TYPE uxCriticalNesting;
+/* Ticks counted by the tick thread that the kernel has not processed yet. */
+static unsigned portBASE_TYPE uxPendingTicks = 0;
+/* Set once a slot has its bit in ulNotifyPending set. */
+static portBASE_TYPE xNotificationsPending = pdFALSE;
+static unsigned long ulNotifyPending[NOTIFY_WORDS];
+static volatile unsigned long ulMissedTicks = 0;
+/* Tick k is due at ullTickEpoch + k periods, guarded by xTickMutex. */
+static uint64_t ullTickEpoch = 0;
+static uint64_t ullTicksAccounted = 0;
+#if (configUSE_TICKLESS_IDLE == 1)
+/* Set while the idle task sleeps with the tick timer stopped. */
+static volatile portBASE_TYPE xTicksSuppressed = pdFALSE;
+/* Futex word the sleeping idle task waits on. */
+static int iSleepWake = 0;
+#endif
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+/* The only thread allowed to execute kernel code. */
+static xThreadState *volatile pxRunningThread = NULL;
+#endif
+#if (configNUMBER_OF_CORES > 1)
+/* The thread running on each core, and whether the core has to reschedule. */
+static xThreadState *volatile pxCoreThreads[configNUMBER_OF_CORES];
+static volatile portBASE_TYPE xCoreYieldPending[configNUMBER_OF_CORES];
+/* Guards the kernel data, owned by one thread at a time and recursive. */
+static void *volatile pvKernelLockOwner = NULL;
+/* A core is emulated by the task thread running on it, so the interrupt
+ * mask, critical nesting and kernel lock count follow the task. */
+static __thread xThreadState *pxThisThread = NULL;
+static __thread volatile portBASE_TYPE xCoreInterruptsEnabled = pdTRUE;
+static __thread unsigned portBASE_TYPE uxKernelLockCount = 0;
+static __thread unsigned portBASE_TYPE uxThreadCriticalNesting = 0;
+#endif
+#if (configGENERATE_RUN_TIME_STATS == 1)
+static uint64_t ullRunTimeEpoch = 0;
+static uint64_t ullLastSnapshot = 0;
+/* The task currently being charged for CPU time on each core, when its slice
+ * started and up to when it has been charged. */
+static xThreadState *pxSliceThread[configNUMBER_OF_CORES];
+static xTaskHandle hSliceTask[configNUMBER_OF_CORES];
+static uint64_t ullSliceStart[configNUMBER_OF_CORES];
+static uint64_t ullSliceAccounted[configNUMBER_OF_CORES];
+#endif
 /*-----------------------------------------------------------*/
 
 /*
  * Setup the timer to generate the tick interrupts.
  */
 static void prvSetupTimerInterrupt(void);
+static void *prvTickThread(void *pvParams);
+static uint64_t prvGetMonotonicTime(void);
+static void prvArmTickTimer(uint64_t ullDeadline, uint64_t ullInterval);
+static unsigned portBASE_TYPE prvAccountTicks(void);
+static portBASE_TYPE prvProcessPendingInterrupts(void);
+static portBASE_TYPE prvInterruptsPending(void);
+static void prvInterruptRunningThread(void);
+#if (configUSE_TICKLESS_IDLE == 1)
+static void prvSleepUntil(uint64_t ullWakeTime);
+static void prvWakeFromSleep(void);
+#endif
 static void *prvWaitForStart(void *pvParams);
 static void prvSuspendSignalHandler(int sig);
 static void prvResumeSignalHandler(int sig);
 static void prvSetupSignalsAndSchedulerPolicy(void);
+static portLONG prvGetFreeThreadState(void);
+static xThreadState *prvGetThreadState(xTaskHandle hTask);
+static xThreadState *prvFindThreadState(xTaskHandle hTask);
+static xThreadState *prvResolveNotifyTarget(uint64_t ullTarget);
+static void prvRetireNotifyTarget(xThreadState *pxThreadState);
+static void prvDeleteThread(void *pvThreadState);
+#if (configUSE_POSIX_EVENT_HANDOFF == 0)
 static void prvSuspendThread(pthread_t xThreadId);
 static void prvResumeThread(pthread_t xThreadId);
-static pthread_t prvGetThreadHandle(xTaskHandle hTask);
-static portLONG prvGetFreeThreadState(void);
-static void prvSetTaskCriticalNesting(pthread_t xThreadId,
-                                      unsigned portBASE_TYPE uxNesting);
-static unsigned portBASE_TYPE prvGetTaskCriticalNesting(pthread_t xThreadId);
-static void prvDeleteThread(void *xThreadId);
+#else
+static void prvParkThread(xThreadState *pxThreadState);
+static void prvWakeThread(xThreadState *pxThreadState);
+#if (configNUMBER_OF_CORES == 1)
+static void prvSwitchThread(xThreadState *pxThreadToSuspend,
+                            xThreadState *pxThreadToResume);
+#endif
+static void prvReleaseThreadState(xThreadState *pxThreadState);
+#endif
+#if (configNUMBER_OF_CORES > 1)
+static void prvAcquireKernelLock(void);
+static void prvReleaseKernelLock(void);
+static void prvEnterKernel(portBASE_TYPE xInterruptsWereEnabled);
+static portBASE_TYPE prvCoreNeedsService(void);
+static void prvServiceCore(portBASE_TYPE xYieldRequested);
+#endif
+#if (configGENERATE_RUN_TIME_STATS == 1)
+static void prvResetRunTimeStats(xThreadState *pxThreadState);
+static void prvAccountSlice(portLONG lCore, uint64_t ullNow);
+static void prvSwitchSlice(portLONG lCore, xTaskHandle hTask);
+#endif
 /*-----------------------------------------------------------*/
 
 /*
@@ -143,6 +272,7 @@ portSTACK_TYPE *pxPortInitialiseStack(portSTACK_TYPE *pxTopOfStack,
 {
     /* Should actually keep this struct on the stack. */
     xParams *pxThisThreadParams = pvPortMalloc(sizeof(xParams));
+    portLONG lIndex;
 
     (void)pthread_once(&hSigSetupThread, prvSetupSignalsAndSchedulerPolicy);
 
@@ -161,13 +291,36 @@ portSTACK_TYPE *pxPortInitialiseStack(portSTACK_TYPE *pxTopOfStack,
 
     vPortEnterCritical();
 
-    lIndexOfLastAddedTask = prvGetFreeThreadState();
+    lIndex = prvGetFreeThreadState();
+    pxThisThreadParams->pxThreadState = &pxThreads[lIndex];
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    prvResetRunTimeStats(&pxThreads[lIndex]);
+#endif
 
+    /* The task runs on the pthread's stack, so the top of stack kept in the
+     * TCB holds the task's thread state instead. */
+    pxTopOfStack = (portSTACK_TYPE *)&pxThreads[lIndex];
+
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+    /* The new thread parks on its futex word straight away, so there is no
+     * need to wait for it to reach a suspended state. */
+    pxThreads[lIndex].iWake = 0;
+    pxThreads[lIndex].xExit = pdFALSE;
+#if (configNUMBER_OF_CORES > 1)
+    pxThreads[lIndex].lCore = 0;
+#endif
+    if (0 != pthread_create(&(pxThreads[lIndex].hThread),
+                            &xThreadAttributes, prvWaitForStart,
+                            (void *)pxThisThreadParams)) {
+        pxTopOfStack = 0;
+    }
+    vPortExitCritical();
+#else
     /* Create the new pThread. */
     if (0 == pthread_mutex_lock(&xSingleThreadMutex)) {
         xSentinel = 0;
         if (0 !=
-            pthread_create(&(pxThreads[lIndexOfLastAddedTask].hThread),
+            pthread_create(&(pxThreads[lIndex].hThread),
                            &xThreadAttributes, prvWaitForStart,
                            (void *)pxThisThreadParams)) {
             /* Thread create failed, signal the failure */
@@ -180,11 +333,35 @@ portSTACK_TYPE *pxPortInitialiseStack(portSTACK_TYPE *pxTopOfStack,
             ;
         vPortExitCritical();
     }
+#endif
 
     return pxTopOfStack;
 }
 /*-----------------------------------------------------------*/
 
+#if (configNUMBER_OF_CORES > 1)
+void vPortStartFirstTask(void)
+{
+    xThreadState *pxThreadState;
+    portLONG lCore;
+
+    /* The kernel selected a task for every core. */
+    for (lCore = 0; lCore < configNUMBER_OF_CORES; lCore++) {
+        pxThreadState =
+            prvGetThreadState(xTaskGetCurrentTaskHandleForCore(lCore));
+        pxThreadState->lCore = lCore;
+        pxCoreThreads[lCore] = pxThreadState;
+#if (configGENERATE_RUN_TIME_STATS == 1)
+        prvSwitchSlice(lCore, pxThreadState->hTask);
+#endif
+    }
+
+    /* Start the first tasks. */
+    for (lCore = 0; lCore < configNUMBER_OF_CORES; lCore++) {
+        prvWakeThread(pxCoreThreads[lCore]);
+    }
+}
+#else
 void vPortStartFirstTask(void)
 {
     /* Initialise the critical nesting count ready for the first task. */
@@ -193,9 +370,19 @@ void vPortStartFirstTask(void)
     /* Start the first task. */
     vPortEnableInterrupts();
 
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    vPortTaskSwitchedIn(xTaskGetCurrentTaskHandle());
+#endif
+
     /* Start the first task. */
-    prvResumeThread(prvGetThreadHandle(xTaskGetCurrentTaskHandle()));
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+    pxRunningThread = prvGetThreadState(xTaskGetCurrentTaskHandle());
+    prvWakeThread(pxRunningThread);
+#else
+    prvResumeThread(prvGetThreadState(xTaskGetCurrentTaskHandle())->hThread);
+#endif
 }
+#endif
 /*-----------------------------------------------------------*/
 
 /*
@@ -238,6 +425,10 @@ portBASE_TYPE xPortStartScheduler(void)
     }
 
     printf("Cleaning Up, Exiting.\n");
+    /* The tick timer may be stopped, do not wait for another expiry. */
+    (void)pthread_cancel(hTickThread);
+    (void)pthread_join(hTickThread, NULL);
+    close(iTickTimer);
     /* Cleanup the mutexes */
     /** xResult = pthread_mutex_destroy( &xSuspendResumeThreadMutex ); */
     pthread_mutex_destroy(&xSuspendResumeThreadMutex);
@@ -256,19 +447,33 @@ void vPortEndScheduler(void)
     /** portBASE_TYPE xResult; */
     for (xNumberOfThreads = 0; xNumberOfThreads < MAX_NUMBER_OF_TASKS;
          xNumberOfThreads++) {
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+        /* Parked threads terminate themselves once woken with xExit set. */
+        if ((pthread_t)NULL != pxThreads[xNumberOfThreads].hThread &&
+            !pthread_equal(pthread_self(),
+                           pxThreads[xNumberOfThreads].hThread)) {
+            pxThreads[xNumberOfThreads].xExit = pdTRUE;
+            prvWakeThread(&pxThreads[xNumberOfThreads]);
+        }
+#else
         if ((pthread_t)NULL != pxThreads[xNumberOfThreads].hThread) {
             /* Kill all of the threads, they are in the detached state. */
             pthread_cancel(pxThreads[xNumberOfThreads].hThread);
             /** xResult = pthread_cancel( pxThreads[ xNumberOfThreads ].hThread ); */
         }
+#endif
     }
 
     /* Signal the scheduler to exit its loop. */
     xSchedulerEnd = pdTRUE;
+#if (configUSE_TICKLESS_IDLE == 1)
+    prvWakeFromSleep();
+#endif
     (void)pthread_kill(hMainThread, SIG_RESUME);
 }
 /*-----------------------------------------------------------*/
 
+#if (configNUMBER_OF_CORES == 1)
 void vPortYieldFromISR(void)
 {
     /* Calling Yield from a Interrupt/Signal handler often doesn't work because the
@@ -276,6 +481,10 @@ void vPortYieldFromISR(void)
      * simply indicate that a yield is required soon.
      */
     xPendYield = pdTRUE;
+#if (configUSE_TICKLESS_IDLE == 1)
+    /* The interrupt ends a tickless sleep early. */
+    prvWakeFromSleep();
+#endif
 }
 /*-----------------------------------------------------------*/
 
@@ -305,29 +514,59 @@ void vPortExitCritical(void)
 }
 /*-----------------------------------------------------------*/
 
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+void vPortYield(void)
+{
+    xThreadState *pxThreadToSuspend;
+    xThreadState *pxThreadToResume;
+
+    /* Only the running thread executes kernel code, masking the tick is all
+     * the locking that is required. */
+    vPortDisableInterrupts();
+
+    pxThreadToSuspend = prvGetThreadState(xTaskGetCurrentTaskHandle());
+
+    /* Catch up on ticks that were held off, they may unblock tasks. */
+    prvProcessPendingInterrupts();
+
+    vTaskSwitchContext();
+
+    pxThreadToResume = prvGetThreadState(xTaskGetCurrentTaskHandle());
+    if (pxThreadToSuspend != pxThreadToResume && pxThreadToSuspend &&
+        pxThreadToResume) {
+        /* Remember and switch the critical nesting. */
+        pxThreadToSuspend->uxCriticalNesting = uxCriticalNesting;
+        uxCriticalNesting = pxThreadToResume->uxCriticalNesting;
+        /* Switch tasks, returns once this task is handed the CPU again. */
+        prvSwitchThread(pxThreadToSuspend, pxThreadToResume);
+    }
+    else if (uxCriticalNesting == 0) {
+        /* Yielding to self */
+        vPortEnableInterrupts();
+    }
+}
+#else
 void vPortYield(void)
 {
-    pthread_t xTaskToSuspend;
-    pthread_t xTaskToResume = 0;
+    xThreadState *pxThreadToSuspend;
+    xThreadState *pxThreadToResume;
 
     if (0 == pthread_mutex_lock(&xSingleThreadMutex)) {
-        xTaskToSuspend =
-            prvGetThreadHandle(xTaskGetCurrentTaskHandle());
+        pxThreadToSuspend = prvGetThreadState(xTaskGetCurrentTaskHandle());
+
+        /* Catch up on ticks and notifications that were held off. */
+        prvProcessPendingInterrupts();
 
         vTaskSwitchContext();
 
-        TaskHandle_t task_handle = xTaskGetCurrentTaskHandle();
-        xTaskToResume = prvGetThreadHandle(task_handle);
-        /** xTaskToResume = prvGetThreadHandle( xTaskGetCurrentTaskHandle() ); */
-        if (xTaskToSuspend != xTaskToResume && xTaskToResume) {
+        pxThreadToResume = prvGetThreadState(xTaskGetCurrentTaskHandle());
+        if (pxThreadToSuspend != pxThreadToResume && pxThreadToResume) {
             /* Remember and switch the critical nesting. */
-            prvSetTaskCriticalNesting(xTaskToSuspend,
-                                      uxCriticalNesting);
-            uxCriticalNesting =
-                prvGetTaskCriticalNesting(xTaskToResume);
+            pxThreadToSuspend->uxCriticalNesting = uxCriticalNesting;
+            uxCriticalNesting = pxThreadToResume->uxCriticalNesting;
             /* Switch tasks. */
-            prvResumeThread(xTaskToResume);
-            prvSuspendThread(xTaskToSuspend);
+            prvResumeThread(pxThreadToResume->hThread);
+            prvSuspendThread(pxThreadToSuspend->hThread);
         }
         else {
             /* Yielding to self */
@@ -335,6 +574,7 @@ void vPortYield(void)
         }
     }
 }
+#endif
 /*-----------------------------------------------------------*/
 
 void vPortDisableInterrupts(void)
@@ -362,6 +602,286 @@ void vPortClearInterruptMask(portBASE_TYPE xMask)
     xInterruptsEnabled = xMask;
 }
 /*-----------------------------------------------------------*/
+#else
+void vPortYieldFromISR(void)
+{
+    /* The interrupted task switches once the handler returns. */
+    vPortYieldCore(xPortGetCoreID());
+}
+/*-----------------------------------------------------------*/
+
+void vPortYieldCore(BaseType_t xCoreID)
+{
+    xThreadState *pxThreadState;
+
+    /* The flag is set first, a thread taking over the core after the read
+     * below is certain to see it. */
+    __atomic_store_n(&xCoreYieldPending[xCoreID], pdTRUE, __ATOMIC_SEQ_CST);
+    pxThreadState = __atomic_load_n(&pxCoreThreads[xCoreID],
+                                    __ATOMIC_SEQ_CST);
+
+    /* Interrupt the core, including this one to leave a signal handler. */
+    if (NULL != pxThreadState && (pthread_t)NULL != pxThreadState->hThread) {
+        (void)pthread_kill(pxThreadState->hThread, SIG_TICK);
+    }
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortGetCoreID(void)
+{
+    /* Threads that are not tasks act as interrupts on the first core. */
+    return pxThisThread ? pxThisThread->lCore : 0;
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnterCritical(void)
+{
+    portBASE_TYPE xInterruptsWereEnabled = xCoreInterruptsEnabled;
+
+    vPortDisableInterrupts();
+    prvEnterKernel(xInterruptsWereEnabled);
+    uxThreadCriticalNesting++;
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCritical(void)
+{
+    /* Check for unmatched exits. */
+    if (uxThreadCriticalNesting > 0) {
+        uxThreadCriticalNesting--;
+        prvReleaseKernelLock();
+
+        /* Switches held off in the critical section happen now. */
+        if (uxThreadCriticalNesting == 0) {
+            vPortEnableInterrupts();
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield(void)
+{
+    /* Yields from other threads are passed to the core they act on. */
+    if (NULL == pxThisThread) {
+        vPortYieldCore(0);
+        return;
+    }
+
+    prvServiceCore(pdTRUE);
+}
+/*-----------------------------------------------------------*/
+
+void vPortDisableInterrupts(void)
+{
+    xCoreInterruptsEnabled = pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnableInterrupts(void)
+{
+    xCoreInterruptsEnabled = pdTRUE;
+
+    /* Take the interrupts that were held off. */
+    if (NULL != pxThisThread && 0 == uxKernelLockCount &&
+        pdFALSE != prvCoreNeedsService()) {
+        prvServiceCore(pdFALSE);
+    }
+}
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE xPortSetInterruptMask(void)
+{
+    portBASE_TYPE xReturn = xCoreInterruptsEnabled;
+
+    xCoreInterruptsEnabled = pdFALSE;
+    prvEnterKernel(xReturn);
+    return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortClearInterruptMask(portBASE_TYPE xMask)
+{
+    prvReleaseKernelLock();
+    if (pdFALSE != xMask) {
+        vPortEnableInterrupts();
+    }
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortSetCoreInterruptMask(void)
+{
+    portBASE_TYPE xReturn = xCoreInterruptsEnabled;
+
+    xCoreInterruptsEnabled = pdFALSE;
+    return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortClearCoreInterruptMask(BaseType_t xMask)
+{
+    if (pdFALSE != xMask) {
+        vPortEnableInterrupts();
+    }
+}
+/*-----------------------------------------------------------*/
+
+void vPortTakeKernelLock(void)
+{
+    portBASE_TYPE xInterruptsWereEnabled = xCoreInterruptsEnabled;
+
+    /* The core must not be serviced between taking the lock and counting
+     * it, interrupts are masked just for that. */
+    xCoreInterruptsEnabled = pdFALSE;
+    prvEnterKernel(xInterruptsWereEnabled);
+    xCoreInterruptsEnabled = xInterruptsWereEnabled;
+}
+/*-----------------------------------------------------------*/
+
+void vPortGiveKernelLock(void)
+{
+    prvReleaseKernelLock();
+}
+/*-----------------------------------------------------------*/
+
+void prvAcquireKernelLock(void)
+{
+    void *pvExpected;
+
+    if (0 != uxKernelLockCount) {
+        uxKernelLockCount++;
+        return;
+    }
+
+    /* The lock count is thread local, its address identifies the owner. */
+    for (;;) {
+        pvExpected = NULL;
+        if (__atomic_compare_exchange_n(&pvKernelLockOwner, &pvExpected,
+                                        (void *)&uxKernelLockCount, pdFALSE,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        sched_yield();
+    }
+    uxKernelLockCount = 1;
+}
+/*-----------------------------------------------------------*/
+
+void prvReleaseKernelLock(void)
+{
+    if (0 == uxKernelLockCount) {
+        return;
+    }
+
+    if (0 == --uxKernelLockCount) {
+        __atomic_store_n(&pvKernelLockOwner, NULL, __ATOMIC_RELEASE);
+    }
+}
+/*-----------------------------------------------------------*/
+
+void prvEnterKernel(portBASE_TYPE xInterruptsWereEnabled)
+{
+    prvAcquireKernelLock();
+
+    /* Another core may have removed this task from its core, e.g. deleted
+     * it, before the request to reschedule was taken. The task must switch
+     * out before it touches the kernel data. */
+    while (NULL != pxThisThread && pdTRUE == xInterruptsWereEnabled &&
+           1 == uxKernelLockCount &&
+           pdFALSE != __atomic_load_n(
+               &xCoreYieldPending[pxThisThread->lCore], __ATOMIC_SEQ_CST)) {
+        prvReleaseKernelLock();
+        prvServiceCore(pdFALSE);
+        prvAcquireKernelLock();
+    }
+}
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE prvCoreNeedsService(void)
+{
+    return pdFALSE != __atomic_load_n(&xCoreYieldPending[pxThisThread->lCore],
+                                      __ATOMIC_SEQ_CST) ||
+           pdFALSE != prvInterruptsPending();
+}
+/*-----------------------------------------------------------*/
+
+void prvServiceCore(portBASE_TYPE xYieldRequested)
+{
+    xThreadState *pxThreadToSuspend = pxThisThread;
+    xThreadState *pxThreadToResume;
+    portBASE_TYPE xInterruptsWereEnabled;
+    portLONG lCore;
+
+    if (NULL == pxThreadToSuspend) {
+        return;
+    }
+
+    xInterruptsWereEnabled = xCoreInterruptsEnabled;
+    xCoreInterruptsEnabled = pdFALSE;
+
+    /* Inside a critical section or with the scheduler suspended the switch
+     * is pended until the lock is given back. */
+    if (0 != uxKernelLockCount) {
+        if (pdTRUE == xYieldRequested) {
+            __atomic_store_n(&xCoreYieldPending[pxThreadToSuspend->lCore],
+                             pdTRUE, __ATOMIC_SEQ_CST);
+        }
+        xCoreInterruptsEnabled = xInterruptsWereEnabled;
+        return;
+    }
+
+    for (;;) {
+        prvAcquireKernelLock();
+        lCore = pxThreadToSuspend->lCore;
+
+        if (pdFALSE != __atomic_exchange_n(&xCoreYieldPending[lCore], pdFALSE,
+                                           __ATOMIC_SEQ_CST)) {
+            xYieldRequested = pdTRUE;
+        }
+
+        /* Catch up on ticks, whichever core gets to them first. */
+        if (pdFALSE != prvProcessPendingInterrupts()) {
+            xYieldRequested = pdTRUE;
+        }
+
+        if (pdTRUE == xYieldRequested) {
+            xYieldRequested = pdFALSE;
+            vTaskSwitchContext();
+            pxThreadToResume = prvGetThreadState(
+                                   xTaskGetCurrentTaskHandleForCore(lCore));
+
+            if (pxThreadToResume != pxThreadToSuspend) {
+                pxThreadToResume->lCore = lCore;
+                __atomic_store_n(&pxCoreThreads[lCore], pxThreadToResume,
+                                 __ATOMIC_SEQ_CST);
+                prvWakeThread(pxThreadToResume);
+                prvReleaseKernelLock();
+
+                /* The task was deleted while it was running. */
+                if (pdTRUE == pxThreadToSuspend->xExit) {
+                    prvReleaseThreadState(pxThreadToSuspend);
+                    pthread_exit((void *)1);
+                }
+
+                /* Returns once a core selects this task again, which may
+                 * be a different core. */
+                prvParkThread(pxThreadToSuspend);
+                continue;
+            }
+        }
+
+        prvReleaseKernelLock();
+        xCoreInterruptsEnabled = xInterruptsWereEnabled;
+
+        /* Work may have arrived while the lock was held. */
+        if (pdTRUE != xInterruptsWereEnabled ||
+            pdFALSE == prvCoreNeedsService()) {
+            break;
+        }
+        xCoreInterruptsEnabled = pdFALSE;
+    }
+}
+/*-----------------------------------------------------------*/
+#endif
 
 /*
  * Setup the systick timer to generate the tick interrupts at the required
@@ -369,62 +889,472 @@ void vPortClearInterruptMask(portBASE_TYPE xMask)
  */
 void prvSetupTimerInterrupt(void)
 {
-    struct itimerval itimer, oitimer;
-    portTickType xMicroSeconds = portTICK_RATE_MICROSECONDS;
+    iTickTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (-1 == iTickTimer) {
+        printf("Create Timer problem.\n");
+        return;
+    }
 
-    /* Initialise the structure with the current timer information. */
-    if (0 == getitimer(TIMER_TYPE, &itimer)) {
-        /* Set the interval between timer events. */
-        itimer.it_interval.tv_sec = 0;
-        itimer.it_interval.tv_usec = xMicroSeconds;
+    /* The first deadline is absolute, every following one is a whole period
+     * after the previous deadline so the tick does not drift under load. */
+    ullTickEpoch = prvGetMonotonicTime();
+    prvArmTickTimer(ullTickEpoch + portTICK_PERIOD_NANOSECONDS,
+                    portTICK_PERIOD_NANOSECONDS);
 
-        /* Set the current count-down. */
-        itimer.it_value.tv_sec = 0;
-        itimer.it_value.tv_usec = xMicroSeconds;
+    /* Inherits the fully blocked signal mask of the scheduler thread. */
+    if (0 != pthread_create(&hTickThread, NULL, prvTickThread, NULL)) {
+        printf("Tick Thread problem.\n");
+    }
+}
+/*-----------------------------------------------------------*/
 
-        /* Set-up the timer interrupt. */
-        if (0 != setitimer(TIMER_TYPE, &itimer, &oitimer)) {
-            printf("Set Timer problem.\n");
+void *prvTickThread(void *pvParams)
+{
+    uint64_t ullExpirations;
+    unsigned portBASE_TYPE uxTicks;
+
+    while (pdTRUE != xSchedulerEnd) {
+        if (sizeof(ullExpirations) !=
+            read(iTickTimer, &ullExpirations, sizeof(ullExpirations))) {
+            continue;
         }
+
+        pthread_mutex_lock(&xTickMutex);
+#if (configUSE_TICKLESS_IDLE == 1)
+        /* An expiry raced the idle task stopping the timer, the idle task
+         * accounts for the ticks it sleeps through itself. */
+        if (pdTRUE == xTicksSuppressed) {
+            pthread_mutex_unlock(&xTickMutex);
+            continue;
+        }
+#endif
+        uxTicks = prvAccountTicks();
+        pthread_mutex_unlock(&xTickMutex);
+
+        if (0 == uxTicks) {
+            continue;
+        }
+
+        /* Each tick past the first is a deadline this thread was too late
+         * for, the kernel still gets to see every one of them. */
+        ulMissedTicks += uxTicks - 1;
+        __atomic_add_fetch(&uxPendingTicks, uxTicks, __ATOMIC_RELAXED);
+
+        prvInterruptRunningThread();
     }
-    else {
-        printf("Get Timer problem.\n");
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+void prvInterruptRunningThread(void)
+{
+    xThreadState *pxThreadToTick;
+
+    /* Only the running task is interrupted, not SDL or AsyncIO threads,
+     * and the interrupt is serviced on its thread so it cannot race the task
+     * entering a critical section. With several cores the first one takes
+     * the interrupts and passes time slices on to the others. A task that
+     * switched out meanwhile has the signal blocked until it runs again. */
+#if (configNUMBER_OF_CORES > 1)
+    pxThreadToTick = pxCoreThreads[0];
+#elif (configUSE_POSIX_EVENT_HANDOFF == 1)
+    pxThreadToTick = pxRunningThread;
+#else
+    pxThreadToTick = prvGetThreadState(xTaskGetCurrentTaskHandle());
+#endif
+    if (NULL != pxThreadToTick) {
+        (void)pthread_kill(pxThreadToTick->hThread, SIG_TICK);
+    }
+}
+/*-----------------------------------------------------------*/
+
+uint64_t ullPortGetNotifyTarget(void)
+{
+    xThreadState *pxThreadState =
+        prvGetThreadState(xTaskGetCurrentTaskHandle());
+
+    return (__atomic_load_n(&pxThreadState->ullGeneration, __ATOMIC_RELAXED)
+            << NOTIFY_SLOT_BITS) | (uint64_t)(pxThreadState - pxThreads + 1);
+}
+/*-----------------------------------------------------------*/
+
+xThreadState *prvResolveNotifyTarget(uint64_t ullTarget)
+{
+    uint64_t ullSlot = ullTarget & ((1ULL << NOTIFY_SLOT_BITS) - 1);
+
+    if (0 == ullSlot || ullSlot > MAX_NUMBER_OF_TASKS) {
+        return NULL;
     }
+    return &pxThreads[ullSlot - 1];
 }
 /*-----------------------------------------------------------*/
 
+void prvRetireNotifyTarget(xThreadState *pxThreadState)
+{
+    if (NULL != pxThreadState) {
+        __atomic_add_fetch(&pxThreadState->ullGeneration, 1, __ATOMIC_RELEASE);
+    }
+}
+/*-----------------------------------------------------------*/
+
+void vPortNotifyGive(uint64_t ullTarget)
+{
+    xThreadState *pxThreadState = prvResolveNotifyTarget(ullTarget);
+    xTaskHandle hTask = (xTaskHandle)NULL;
+
+    /* With the scheduler suspended the task can not be deleted between the
+     * check and the notification. */
+    vTaskSuspendAll();
+    if (NULL != pxThreadState &&
+        __atomic_load_n(&pxThreadState->ullGeneration, __ATOMIC_ACQUIRE) ==
+        ullTarget >> NOTIFY_SLOT_BITS) {
+        hTask = pxThreadState->hTask;
+    }
+    if ((xTaskHandle)NULL != hTask) {
+        (void)xTaskNotifyGive(hTask);
+    }
+    (void)xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+void vPortNotifyGiveFromThread(uint64_t ullTarget)
+{
+    xThreadState *pxThreadState = prvResolveNotifyTarget(ullTarget);
+    uint64_t ullPending = ullTarget >> NOTIFY_SLOT_BITS;
+    uint64_t ullCurrent;
+    unsigned long ulBit;
+    portLONG lIndex;
+
+    if (NULL == pxThreadState) {
+        return;
+    }
+
+    /* Async-signal-safe and lock free. Only ever raised, so a notification
+     * for a task deleted meanwhile can not replace one for the next task in
+     * the slot. The kernel compares it with the slot's generation when the
+     * running task takes the interrupt. */
+    ullCurrent = __atomic_load_n(&pxThreadState->ullNotifyGeneration,
+                                 __ATOMIC_RELAXED);
+    while (ullCurrent < ullPending + 1 &&
+           !__atomic_compare_exchange_n(&pxThreadState->ullNotifyGeneration,
+                                        &ullCurrent, ullPending + 1, pdTRUE,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    lIndex = pxThreadState - pxThreads;
+    ulBit = 1UL << (lIndex % NOTIFY_WORD_BITS);
+    __atomic_fetch_or(&ulNotifyPending[lIndex / NOTIFY_WORD_BITS], ulBit,
+                      __ATOMIC_SEQ_CST);
+
+    /* One interrupt serves every notification pended until it is taken. */
+    if (pdFALSE == __atomic_exchange_n(&xNotificationsPending, pdTRUE,
+                                       __ATOMIC_SEQ_CST)) {
+        prvInterruptRunningThread();
+#if (configUSE_TICKLESS_IDLE == 1)
+        prvWakeFromSleep();
+#endif
+    }
+}
+/*-----------------------------------------------------------*/
+
+uint64_t prvGetMonotonicTime(void)
+{
+    struct timespec xNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + xNow.tv_nsec;
+}
+/*-----------------------------------------------------------*/
+
+void prvArmTickTimer(uint64_t ullDeadline, uint64_t ullInterval)
+{
+    struct itimerspec xTimerSpec;
+
+    /* A zero deadline stops the timer. */
+    xTimerSpec.it_value.tv_sec = ullDeadline / 1000000000ULL;
+    xTimerSpec.it_value.tv_nsec = ullDeadline % 1000000000ULL;
+    xTimerSpec.it_interval.tv_sec = ullInterval / 1000000000ULL;
+    xTimerSpec.it_interval.tv_nsec = ullInterval % 1000000000ULL;
+
+    if (0 != timerfd_settime(iTickTimer, TFD_TIMER_ABSTIME, &xTimerSpec,
+                             NULL)) {
+        printf("Set Timer problem.\n");
+    }
+}
+/*-----------------------------------------------------------*/
+
+unsigned portBASE_TYPE prvAccountTicks(void)
+{
+    uint64_t ullTicksDue = (prvGetMonotonicTime() - ullTickEpoch) /
+                           portTICK_PERIOD_NANOSECONDS;
+    unsigned portBASE_TYPE uxTicks = 0;
+
+    /* Ticks are derived from the clock rather than counted, so ticks can
+     * never be lost or counted twice whoever accounts for them. */
+    if (ullTicksDue > ullTicksAccounted) {
+        uxTicks = ullTicksDue - ullTicksAccounted;
+        ullTicksAccounted = ullTicksDue;
+    }
+
+    return uxTicks;
+}
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE prvProcessPendingInterrupts(void)
+{
+    unsigned portBASE_TYPE uxTicks =
+        __atomic_exchange_n(&uxPendingTicks, 0, __ATOMIC_RELAXED);
+    portBASE_TYPE xSwitchRequired = pdFALSE;
+    xThreadState *pxThreadState;
+    uint64_t ullPending;
+    unsigned long ulPending;
+    portLONG lWord, lIndex;
+
+    while (uxTicks--) {
+        if (pdFALSE != xTaskIncrementTick()) {
+            xSwitchRequired = pdTRUE;
+        }
+    }
+
+    /* Notifications from other threads, a task deleted in the meantime has
+     * advanced the generation of its slot and is not notified any more. */
+    if (pdFALSE != __atomic_exchange_n(&xNotificationsPending, pdFALSE,
+                                       __ATOMIC_SEQ_CST)) {
+        for (lWord = 0; lWord < NOTIFY_WORDS; lWord++) {
+            ulPending = __atomic_exchange_n(&ulNotifyPending[lWord], 0,
+                                            __ATOMIC_ACQUIRE);
+            while (0 != ulPending) {
+                lIndex = lWord * NOTIFY_WORD_BITS + __builtin_ctzl(ulPending);
+                ulPending &= ulPending - 1;
+
+                pxThreadState = &pxThreads[lIndex];
+                ullPending = __atomic_exchange_n(
+                                 &pxThreadState->ullNotifyGeneration, 0,
+                                 __ATOMIC_ACQUIRE);
+                if (0 != ullPending &&
+                    ullPending - 1 == pxThreadState->ullGeneration &&
+                    (xTaskHandle)NULL != pxThreadState->hTask) {
+                    vTaskNotifyGiveFromISR(pxThreadState->hTask,
+                                           &xSwitchRequired);
+                }
+            }
+        }
+    }
+
+    return xSwitchRequired;
+}
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE prvInterruptsPending(void)
+{
+    return 0 != __atomic_load_n(&uxPendingTicks, __ATOMIC_RELAXED) ||
+           pdFALSE != __atomic_load_n(&xNotificationsPending,
+                                      __ATOMIC_SEQ_CST);
+}
+/*-----------------------------------------------------------*/
+
+unsigned long ulPortGetMissedTicks(void)
+{
+    return ulMissedTicks;
+}
+/*-----------------------------------------------------------*/
+
+#if (configUSE_TICKLESS_IDLE == 1)
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime)
+{
+    eSleepModeStatus eSleepStatus;
+    uint64_t ullWakeTime = 0;
+    unsigned portBASE_TYPE uxTicks;
+    TickType_t xTicksToStep;
+
+    /* Called by the idle task with the scheduler suspended. */
+    vPortEnterCritical();
+    pthread_mutex_lock(&xTickMutex);
+
+    /* Ticks and notifications that were not processed yet are pending
+     * interrupts. */
+    eSleepStatus = eTaskConfirmSleepModeStatus();
+    if (eAbortSleep == eSleepStatus || pdFALSE != prvInterruptsPending()) {
+        pthread_mutex_unlock(&xTickMutex);
+        vPortExitCritical();
+        return;
+    }
+
+    /* Stop the tick, the tick thread blocks until it is restarted. */
+    prvArmTickTimer(0, 0);
+    iSleepWake = 0;
+    __atomic_store_n(&xTicksSuppressed, pdTRUE, __ATOMIC_SEQ_CST);
+
+    /* Without a task waiting on a timeout only an interrupt ends the sleep. */
+    if (eStandardSleep == eSleepStatus) {
+        ullWakeTime = ullTickEpoch + (ullTicksAccounted + xExpectedIdleTime) *
+                      portTICK_PERIOD_NANOSECONDS;
+    }
+    pthread_mutex_unlock(&xTickMutex);
+
+    configPRE_SLEEP_PROCESSING(xExpectedIdleTime);
+    /* A notification pended before the sleep was announced found nothing
+     * to wake. */
+    if (xExpectedIdleTime > 0 && pdFALSE == prvInterruptsPending()) {
+        prvSleepUntil(ullWakeTime);
+    }
+    configPOST_SLEEP_PROCESSING(xExpectedIdleTime);
+
+    pthread_mutex_lock(&xTickMutex);
+    xTicksSuppressed = pdFALSE;
+    uxTicks = prvAccountTicks();
+
+    /* Step to just before the unblock time, the remaining ticks go through
+     * xTaskIncrementTick so the woken tasks are moved to the ready list. */
+    xTicksToStep = uxTicks;
+    if (xTicksToStep >= xExpectedIdleTime) {
+        xTicksToStep = xExpectedIdleTime - 1;
+    }
+    vTaskStepTick(xTicksToStep);
+    for (uxTicks -= xTicksToStep; uxTicks > 0; uxTicks--) {
+        xTaskIncrementTick();
+    }
+
+    /* Restart the tick on the original period boundaries. */
+    prvArmTickTimer(ullTickEpoch + (ullTicksAccounted + 1) *
+                    portTICK_PERIOD_NANOSECONDS,
+                    portTICK_PERIOD_NANOSECONDS);
+    pthread_mutex_unlock(&xTickMutex);
+
+    vPortExitCritical();
+}
+/*-----------------------------------------------------------*/
+
+void prvSleepUntil(uint64_t ullWakeTime)
+{
+    struct timespec xWakeTime;
+
+    xWakeTime.tv_sec = ullWakeTime / 1000000000ULL;
+    xWakeTime.tv_nsec = ullWakeTime % 1000000000ULL;
+
+    /* The futex timeout is an absolute CLOCK_MONOTONIC time. */
+    while (0 == __atomic_load_n(&iSleepWake, __ATOMIC_ACQUIRE)) {
+        if (-1 == syscall(SYS_futex, &iSleepWake, FUTEX_WAIT_BITSET_PRIVATE,
+                          0, ullWakeTime ? &xWakeTime : NULL, NULL,
+                          FUTEX_BITSET_MATCH_ANY) &&
+            ETIMEDOUT == errno) {
+            break;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void prvWakeFromSleep(void)
+{
+    /* Async-signal-safe, interrupts are emulated with signal handlers. */
+    if (pdTRUE == __atomic_load_n(&xTicksSuppressed, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&iSleepWake, 1, __ATOMIC_RELEASE);
+        (void)syscall(SYS_futex, &iSleepWake, FUTEX_WAKE_PRIVATE, 1, NULL,
+                      NULL, 0);
+    }
+}
+/*-----------------------------------------------------------*/
+#endif
+
+#if (configNUMBER_OF_CORES > 1)
 void vPortSystemTickHandler(int sig)
 {
-    pthread_t xTaskToSuspend;
-    pthread_t xTaskToResume;
+    xThreadState *pxThreadState = pxThisThread;
+    int iSavedErrno = errno;
+
+    /* A thread that was signalled just before it switched out has nothing to
+     * service, held off work is taken when interrupts are enabled again. */
+    if (NULL != pxThreadState &&
+        pxCoreThreads[pxThreadState->lCore] == pxThreadState &&
+        pdTRUE == xCoreInterruptsEnabled && 0 == uxKernelLockCount &&
+        pdFALSE != prvCoreNeedsService()) {
+        prvServiceCore(pdFALSE);
+    }
+
+    errno = iSavedErrno;
+}
+#elif (configUSE_POSIX_EVENT_HANDOFF == 1)
+void vPortSystemTickHandler(int sig)
+{
+    xThreadState *pxThreadToSuspend = pxRunningThread;
+    xThreadState *pxThreadToResume;
+
+    if (NULL == pxThreadToSuspend) {
+        return;
+    }
+
+    /* The task switched away before the tick arrived, only the running
+     * thread may service it. */
+    if (!pthread_equal(pthread_self(), pxThreadToSuspend->hThread)) {
+        (void)pthread_kill(pxThreadToSuspend->hThread, SIG_TICK);
+        return;
+    }
+
+    /* Already caught up by a yield. */
+    if (pdFALSE == prvInterruptsPending()) {
+        return;
+    }
+
+    /* Held off ticks stay pending until the next yield or tick. */
+    if (pdTRUE != xInterruptsEnabled) {
+        xPendYield = pdTRUE;
+        return;
+    }
+
+    vPortDisableInterrupts();
+
+    /* Tick Increment. */
+    prvProcessPendingInterrupts();
+
+    /* Select Next Task. */
+#if (configUSE_PREEMPTION == 1)
+    vTaskSwitchContext();
+#endif
+    pxThreadToResume = prvGetThreadState(xTaskGetCurrentTaskHandle());
+
+    if (pxThreadToSuspend != pxThreadToResume && pxThreadToResume) {
+        /* Remember and switch the critical nesting. */
+        pxThreadToSuspend->uxCriticalNesting = uxCriticalNesting;
+        uxCriticalNesting = pxThreadToResume->uxCriticalNesting;
+        /* The preempted task parks inside the handler until resumed. */
+        prvSwitchThread(pxThreadToSuspend, pxThreadToResume);
+    }
+    else {
+        vPortEnableInterrupts();
+    }
+}
+#else
+void vPortSystemTickHandler(int sig)
+{
+    xThreadState *pxThreadToSuspend;
+    xThreadState *pxThreadToResume;
 
     if ((pdTRUE == xInterruptsEnabled) && (pdTRUE != xServicingTick)) {
         if (0 == pthread_mutex_trylock(&xSingleThreadMutex)) {
             xServicingTick = pdTRUE;
 
-            xTaskToSuspend =
-                prvGetThreadHandle(xTaskGetCurrentTaskHandle());
-            /* Tick Increment. */
-            xTaskIncrementTick();
+            pxThreadToSuspend =
+                prvGetThreadState(xTaskGetCurrentTaskHandle());
+            /* Tick Increment, including the ticks that were held off. */
+            prvProcessPendingInterrupts();
 
             /* Select Next Task. */
 #if (configUSE_PREEMPTION == 1)
             vTaskSwitchContext();
 #endif
-            xTaskToResume =
-                prvGetThreadHandle(xTaskGetCurrentTaskHandle());
+            pxThreadToResume =
+                prvGetThreadState(xTaskGetCurrentTaskHandle());
 
             /* The only thread that can process this tick is the running thread. */
-            if (xTaskToSuspend != xTaskToResume) {
+            if (pxThreadToSuspend != pxThreadToResume) {
                 /* Remember and switch the critical nesting. */
-                prvSetTaskCriticalNesting(xTaskToSuspend,
-                                          uxCriticalNesting);
-                uxCriticalNesting = prvGetTaskCriticalNesting(
-                                        xTaskToResume);
+                pxThreadToSuspend->uxCriticalNesting = uxCriticalNesting;
+                uxCriticalNesting = pxThreadToResume->uxCriticalNesting;
                 /* Resume next task. */
-                prvResumeThread(xTaskToResume);
+                prvResumeThread(pxThreadToResume->hThread);
                 /* Suspend the current task. */
-                prvSuspendThread(xTaskToSuspend);
+                prvSuspendThread(pxThreadToSuspend->hThread);
             }
             else {
                 /* Release the lock as we are Resuming. */
@@ -440,24 +1370,80 @@ void vPortSystemTickHandler(int sig)
         xPendYield = pdTRUE;
     }
 }
+#endif
 /*-----------------------------------------------------------*/
 
+#if (configNUMBER_OF_CORES > 1)
 void vPortForciblyEndThread(void *pxTaskToDelete)
 {
-    xTaskHandle hTaskToDelete = (xTaskHandle)pxTaskToDelete;
+    xThreadState *pxThreadToDelete =
+        prvFindThreadState((xTaskHandle)pxTaskToDelete);
+
+    if (NULL == pxThreadToDelete) {
+        return;
+    }
+    prvRetireNotifyTarget(pxThreadToDelete);
+
+    /* A task still running on a core is switched out by the kernel and
+     * terminates instead of parking, waking it here would make it leave the
+     * core without a thread. A parked thread terminates straight away. */
+    pxThreadToDelete->xExit = pdTRUE;
+    if (pxCoreThreads[pxThreadToDelete->lCore] != pxThreadToDelete) {
+        prvWakeThread(pxThreadToDelete);
+    }
+}
+#elif (configUSE_POSIX_EVENT_HANDOFF == 1)
+void vPortForciblyEndThread(void *pxTaskToDelete)
+{
+    xThreadState *pxThreadToDelete =
+        prvFindThreadState((xTaskHandle)pxTaskToDelete);
+    xThreadState *pxThreadToResume;
+
+    if (NULL == pxThreadToDelete) {
+        return;
+    }
+    prvRetireNotifyTarget(pxThreadToDelete);
+
+    if (pthread_equal(pthread_self(), pxThreadToDelete->hThread)) {
+        /* This is a suicidal thread, need to select a different task to run. */
+        vTaskSwitchContext();
+        pxThreadToResume = prvGetThreadState(xTaskGetCurrentTaskHandle());
+
+        uxCriticalNesting = pxThreadToResume->uxCriticalNesting;
+        prvReleaseThreadState(pxThreadToDelete);
+
+        /* Hand over the CPU and commit suicide. */
+        pxRunningThread = pxThreadToResume;
+        prvWakeThread(pxThreadToResume);
+        pthread_exit((void *)1);
+    }
+    else {
+        /* The thread is parked, wake it so that it terminates itself. */
+        pxThreadToDelete->xExit = pdTRUE;
+        prvWakeThread(pxThreadToDelete);
+    }
+}
+#else
+void vPortForciblyEndThread(void *pxTaskToDelete)
+{
+    xThreadState *pxThreadToDelete =
+        prvFindThreadState((xTaskHandle)pxTaskToDelete);
     pthread_t xTaskToDelete;
     pthread_t xTaskToResume;
     /** portBASE_TYPE xResult; */
 
+    prvRetireNotifyTarget(pxThreadToDelete);
     if (0 == pthread_mutex_lock(&xSingleThreadMutex)) {
-        xTaskToDelete = prvGetThreadHandle(hTaskToDelete);
-        xTaskToResume = prvGetThreadHandle(xTaskGetCurrentTaskHandle());
+        xTaskToDelete = pxThreadToDelete ? pxThreadToDelete->hThread :
+                        (pthread_t)NULL;
+        xTaskToResume =
+            prvGetThreadState(xTaskGetCurrentTaskHandle())->hThread;
 
         if (xTaskToResume == xTaskToDelete) {
             /* This is a suicidal thread, need to select a different task to run. */
             vTaskSwitchContext();
             xTaskToResume =
-                prvGetThreadHandle(xTaskGetCurrentTaskHandle());
+                prvGetThreadState(xTaskGetCurrentTaskHandle())->hThread;
         }
 
         if (pthread_self() != xTaskToDelete) {
@@ -484,6 +1470,7 @@ void vPortForciblyEndThread(void *pxTaskToDelete)
         }
     }
 }
+#endif
 /*-----------------------------------------------------------*/
 
 void *prvWaitForStart(void *pvParams)
@@ -491,13 +1478,24 @@ void *prvWaitForStart(void *pvParams)
     xParams *pxParams = (xParams *)pvParams;
     pdTASK_CODE pvCode = pxParams->pxCode;
     void *pParams = pxParams->pvParams;
+    xThreadState *pxThreadState = pxParams->pxThreadState;
     vPortFree(pvParams);
 
-    pthread_cleanup_push(prvDeleteThread, (void *)pthread_self());
+    pthread_cleanup_push(prvDeleteThread, (void *)pxThreadState);
 
+#if (configNUMBER_OF_CORES > 1)
+    pxThisThread = pxThreadState;
+    xCoreInterruptsEnabled = pdFALSE;
+    prvParkThread(pxThreadState);
+    /* Take what was pended on the core while the task was starting. */
+    vPortEnableInterrupts();
+#elif (configUSE_POSIX_EVENT_HANDOFF == 1)
+    prvParkThread(pxThreadState);
+#else
     if (0 == pthread_mutex_lock(&xSingleThreadMutex)) {
         prvSuspendThread(pthread_self());
     }
+#endif
 
     pvCode(pParams);
 
@@ -536,6 +1534,7 @@ void prvSuspendSignalHandler(int sig)
 }
 /*-----------------------------------------------------------*/
 
+#if (configUSE_POSIX_EVENT_HANDOFF == 0)
 void prvSuspendThread(pthread_t xThreadId)
 {
     portBASE_TYPE xResult = pthread_mutex_lock(&xSuspendResumeThreadMutex);
@@ -550,6 +1549,7 @@ void prvSuspendThread(pthread_t xThreadId)
     }
 }
 /*-----------------------------------------------------------*/
+#endif
 
 void prvResumeSignalHandler(int sig)
 {
@@ -560,6 +1560,7 @@ void prvResumeSignalHandler(int sig)
 }
 /*-----------------------------------------------------------*/
 
+#if (configUSE_POSIX_EVENT_HANDOFF == 0)
 void prvResumeThread(pthread_t xThreadId)
 {
     /** portBASE_TYPE xResult; */
@@ -573,6 +1574,7 @@ void prvResumeThread(pthread_t xThreadId)
     }
 }
 /*-----------------------------------------------------------*/
+#endif
 
 void prvSetupSignalsAndSchedulerPolicy(void)
 {
@@ -595,6 +1597,16 @@ void prvSetupSignalsAndSchedulerPolicy(void)
         pxThreads[lIndex].hThread = (pthread_t)NULL;
         pxThreads[lIndex].hTask = (xTaskHandle)NULL;
         pxThreads[lIndex].uxCriticalNesting = 0;
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+        pxThreads[lIndex].iWake = 0;
+        pxThreads[lIndex].xExit = pdFALSE;
+#endif
+#if (configNUMBER_OF_CORES > 1)
+        pxThreads[lIndex].lCore = 0;
+#endif
+#if (configGENERATE_RUN_TIME_STATS == 1)
+        prvResetRunTimeStats(&pxThreads[lIndex]);
+#endif
     }
 
     sigsuspendself.sa_flags = 0;
@@ -622,20 +1634,104 @@ void prvSetupSignalsAndSchedulerPolicy(void)
 }
 /*-----------------------------------------------------------*/
 
-pthread_t prvGetThreadHandle(xTaskHandle hTask)
+xThreadState *prvGetThreadState(xTaskHandle hTask)
+{
+    /* pxTopOfStack is the first member of the TCB, see pxPortInitialiseStack. */
+    portSTACK_TYPE *pxTopOfStack = *(portSTACK_TYPE **)hTask;
+
+    return (xThreadState *)pxTopOfStack;
+}
+/*-----------------------------------------------------------*/
+
+xThreadState *prvFindThreadState(xTaskHandle hTask)
 {
-    pthread_t hThread = (pthread_t)NULL;
     portLONG lIndex;
+
+    /* Deleted tasks may already have their TCB freed, so it cannot be
+     * dereferenced. Deletion is rare enough for a scan. */
     for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
-        if (pxThreads[lIndex].hTask == hTask) {
-            hThread = pxThreads[lIndex].hThread;
-            break;
+        if (__atomic_load_n(&pxThreads[lIndex].hTask, __ATOMIC_ACQUIRE) ==
+            hTask) {
+            return &pxThreads[lIndex];
         }
     }
-    return hThread;
+    return NULL;
 }
 /*-----------------------------------------------------------*/
 
+#if (configUSE_POSIX_EVENT_HANDOFF == 1)
+
+void prvParkThread(xThreadState *pxThreadState)
+{
+    portBASE_TYPE xExit;
+
+    /* Only async-signal-safe calls, the tick handler parks preempted tasks. */
+    while (0 == __atomic_exchange_n(&pxThreadState->iWake, 0,
+                                    __ATOMIC_ACQUIRE)) {
+        (void)syscall(SYS_futex, &pxThreadState->iWake,
+                      FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+
+    xExit = pxThreadState->xExit;
+#if (configNUMBER_OF_CORES > 1)
+    /* Deleted after it was handed a core, the task terminates when it is
+     * switched out again. */
+    if (pxCoreThreads[pxThreadState->lCore] == pxThreadState) {
+        xExit = pdFALSE;
+    }
+#endif
+
+    if (pdTRUE == xExit) {
+        prvReleaseThreadState(pxThreadState);
+        pthread_exit((void *)1);
+    }
+
+#if (configNUMBER_OF_CORES == 1)
+    /* Need to set the interrupts based on the task's critical nesting. */
+    if (uxCriticalNesting == 0) {
+        vPortEnableInterrupts();
+    }
+    else {
+        vPortDisableInterrupts();
+    }
+#endif
+}
+/*-----------------------------------------------------------*/
+
+void prvWakeThread(xThreadState *pxThreadState)
+{
+    __atomic_store_n(&pxThreadState->iWake, 1, __ATOMIC_RELEASE);
+    (void)syscall(SYS_futex, &pxThreadState->iWake, FUTEX_WAKE_PRIVATE, 1,
+                  NULL, NULL, 0);
+}
+/*-----------------------------------------------------------*/
+
+#if (configNUMBER_OF_CORES == 1)
+void prvSwitchThread(xThreadState *pxThreadToSuspend,
+                     xThreadState *pxThreadToResume)
+{
+    /* Interrupts stay disabled until the resumed thread has left its park,
+     * stray ticks are forwarded to it in the meantime. */
+    pxRunningThread = pxThreadToResume;
+    prvWakeThread(pxThreadToResume);
+    prvParkThread(pxThreadToSuspend);
+}
+#endif
+/*-----------------------------------------------------------*/
+
+void prvReleaseThreadState(xThreadState *pxThreadState)
+{
+    pxThreadState->hTask = (xTaskHandle)NULL;
+    pxThreadState->uxCriticalNesting = 0;
+    pxThreadState->iWake = 0;
+    pxThreadState->xExit = pdFALSE;
+    /* Clearing the handle frees the slot, do it last. */
+    __atomic_store_n(&pxThreadState->hThread, (pthread_t)NULL,
+                     __ATOMIC_RELEASE);
+}
+/*-----------------------------------------------------------*/
+#endif
+
 portLONG prvGetFreeThreadState(void)
 {
     portLONG lIndex;
@@ -655,90 +1751,151 @@ portLONG prvGetFreeThreadState(void)
 }
 /*-----------------------------------------------------------*/
 
-void prvSetTaskCriticalNesting(pthread_t xThreadId,
-                               unsigned portBASE_TYPE uxNesting)
+void prvDeleteThread(void *pvThreadState)
 {
-    portLONG lIndex;
-    for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
-        if (pxThreads[lIndex].hThread == xThreadId) {
-            pxThreads[lIndex].uxCriticalNesting = uxNesting;
-            break;
+    xThreadState *pxThreadState = (xThreadState *)pvThreadState;
+
+    /* The slot may already have been released and reused. */
+    if (pthread_equal(pxThreadState->hThread, pthread_self())) {
+        pxThreadState->hThread = (pthread_t)NULL;
+        pxThreadState->hTask = (xTaskHandle)NULL;
+        if (pxThreadState->uxCriticalNesting > 0) {
+            uxCriticalNesting = 0;
+            vPortEnableInterrupts();
         }
+        pxThreadState->uxCriticalNesting = 0;
     }
 }
 /*-----------------------------------------------------------*/
 
-unsigned portBASE_TYPE prvGetTaskCriticalNesting(pthread_t xThreadId)
+void vPortAddTaskHandle(void *pxTaskHandle)
 {
-    unsigned portBASE_TYPE uxNesting = 0;
-    portLONG lIndex;
-    for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
-        if (pxThreads[lIndex].hThread == xThreadId) {
-            uxNesting = pxThreads[lIndex].uxCriticalNesting;
-            break;
-        }
+    xThreadState *pxThreadState = prvGetThreadState((xTaskHandle)pxTaskHandle);
+
+    if (NULL != pxThreadState) {
+        pxThreadState->hTask = (xTaskHandle)pxTaskHandle;
     }
-    return uxNesting;
 }
 /*-----------------------------------------------------------*/
 
-void prvDeleteThread(void *xThreadId)
+#if (configGENERATE_RUN_TIME_STATS == 1)
+void vPortConfigureRunTimeStats(void)
 {
-    portLONG lIndex;
-    for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
-        if (pxThreads[lIndex].hThread == (pthread_t)xThreadId) {
-            pxThreads[lIndex].hThread = (pthread_t)NULL;
-            pxThreads[lIndex].hTask = (xTaskHandle)NULL;
-            if (pxThreads[lIndex].uxCriticalNesting > 0) {
-                uxCriticalNesting = 0;
-                vPortEnableInterrupts();
-            }
-            pxThreads[lIndex].uxCriticalNesting = 0;
-            break;
-        }
+    ullRunTimeEpoch = prvGetMonotonicTime();
+    ullLastSnapshot = ullRunTimeEpoch;
+}
+/*-----------------------------------------------------------*/
+
+uint64_t ullPortGetRunTimeNs(void)
+{
+    return prvGetMonotonicTime() - ullRunTimeEpoch;
+}
+/*-----------------------------------------------------------*/
+
+void prvResetRunTimeStats(xThreadState *pxThreadState)
+{
+    pxThreadState->ullRunTime = 0;
+    pxThreadState->ullLongestSlice = 0;
+    pxThreadState->ulSwitches = 0;
+}
+/*-----------------------------------------------------------*/
+
+void prvAccountSlice(portLONG lCore, uint64_t ullNow)
+{
+    xThreadState *pxThreadState = pxSliceThread[lCore];
+
+    /* The task may have been deleted and its slot released since it was
+     * switched in. */
+    if ((NULL == pxThreadState) ||
+        (pxThreadState->hTask != hSliceTask[lCore])) {
+        return;
+    }
+
+    pxThreadState->ullRunTime += ullNow - ullSliceAccounted[lCore];
+    ullSliceAccounted[lCore] = ullNow;
+    if (ullNow - ullSliceStart[lCore] > pxThreadState->ullLongestSlice) {
+        pxThreadState->ullLongestSlice = ullNow - ullSliceStart[lCore];
     }
 }
 /*-----------------------------------------------------------*/
 
-void vPortAddTaskHandle(void *pxTaskHandle)
+void prvSwitchSlice(portLONG lCore, xTaskHandle hTask)
 {
-    portLONG lIndex;
+    uint64_t ullNow;
 
-    pxThreads[lIndexOfLastAddedTask].hTask = (xTaskHandle)pxTaskHandle;
-    for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
-        if (pxThreads[lIndex].hThread ==
-            pxThreads[lIndexOfLastAddedTask].hThread) {
-            if (pxThreads[lIndex].hTask !=
-                pxThreads[lIndexOfLastAddedTask].hTask) {
-                pxThreads[lIndex].hThread = (pthread_t)NULL;
-                pxThreads[lIndex].hTask = NULL;
-                pxThreads[lIndex].uxCriticalNesting = 0;
-            }
-        }
+    /* The kernel reselected the task that was already running. */
+    if (hTask == hSliceTask[lCore]) {
+        return;
     }
+
+    ullNow = prvGetMonotonicTime();
+    prvAccountSlice(lCore, ullNow);
+
+    pxSliceThread[lCore] = prvGetThreadState(hTask);
+    hSliceTask[lCore] = hTask;
+    ullSliceStart[lCore] = ullNow;
+    ullSliceAccounted[lCore] = ullNow;
+    pxSliceThread[lCore]->ulSwitches++;
 }
 /*-----------------------------------------------------------*/
 
-void vPortFindTicksPerSecond(void)
+void vPortTaskSwitchedIn(void *pxTaskHandle)
 {
-    /* Needs to be reasonably high for accuracy. */
-    unsigned long ulTicksPerSecond = sysconf(_SC_CLK_TCK);
-    printf("Timer Resolution for Run TimeStats is %ld ticks per second.\n",
-           ulTicksPerSecond);
+    prvSwitchSlice(portGET_CORE_ID(), (xTaskHandle)pxTaskHandle);
 }
 /*-----------------------------------------------------------*/
 
-unsigned long ulPortGetTimerValue(void)
+unsigned portBASE_TYPE uxPortGetTaskStatsSnapshot(xPortTaskStats *pxStats,
+        unsigned portBASE_TYPE uxArraySize, uint64_t *pullPeriod)
 {
-    struct tms xTimes;
-    unsigned long ulTotalTime = times(&xTimes);
-    /* Return the application code times.
-     * The timer only increases when the application code is actually running
-     * which means that the total execution times should add up to 100%.
-     */
-    return (unsigned long)xTimes.tms_utime;
+    xThreadState *pxThreadState;
+    unsigned portBASE_TYPE uxCount = 0;
+    uint64_t ullNow, ullPeriod;
+    portLONG lIndex;
+
+    vPortEnterCritical();
+
+    ullNow = prvGetMonotonicTime();
+    for (lIndex = 0; lIndex < configNUMBER_OF_CORES; lIndex++) {
+        prvAccountSlice(lIndex, ullNow);
+        /* Slices still running are split at the snapshot. */
+        ullSliceStart[lIndex] = ullNow;
+    }
+
+    ullPeriod = ullNow - ullLastSnapshot;
+    ullLastSnapshot = ullNow;
+
+    for (lIndex = 0; lIndex < MAX_NUMBER_OF_TASKS; lIndex++) {
+        pxThreadState = &pxThreads[lIndex];
+        if ((xTaskHandle)NULL == pxThreadState->hTask) {
+            continue;
+        }
+
+        if (uxCount < uxArraySize) {
+            pxStats[uxCount].pvTask = pxThreadState->hTask;
+            strncpy(pxStats[uxCount].pcTaskName,
+                    pcTaskGetName(pxThreadState->hTask),
+                    configMAX_TASK_NAME_LEN - 1);
+            pxStats[uxCount].pcTaskName[configMAX_TASK_NAME_LEN - 1] = '\0';
+            pxStats[uxCount].ullRunTime = pxThreadState->ullRunTime;
+            pxStats[uxCount].ullLongestSlice =
+                pxThreadState->ullLongestSlice;
+            pxStats[uxCount].ulSwitches = pxThreadState->ulSwitches;
+            pxStats[uxCount].fCpuPercent = ullPeriod ?
+                                           100.0f * pxThreadState->ullRunTime / ullPeriod : 0.0f;
+            uxCount++;
+        }
+
+        prvResetRunTimeStats(pxThreadState);
+    }
+
+    vPortExitCritical();
+
+    if (pullPeriod) {
+        *pullPeriod = ullPeriod;
+    }
 
-    /* Should check ulTotalTime for being clock_t max minus 1. */
-    (void)ulTotalTime;
+    return uxCount;
 }
+#endif /* configGENERATE_RUN_TIME_STATS */
 /*-----------------------------------------------------------*/
@@ -105,6 +105,7 @@ not need to be guarded with a critical section. */
 #define portSTACK_GROWTH                ( -1 )
 #define portTICK_PERIOD_MS              ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
 #define portTICK_PERIOD_MICROSECONDS        ( ( TickType_t ) 1000000 / configTICK_RATE_HZ )
+#define portTICK_PERIOD_NANOSECONDS     ( ( uint64_t ) 1000000000ULL / configTICK_RATE_HZ )
 #define portBYTE_ALIGNMENT              4
 #define portREMOVE_STATIC_QUALIFIER
 /*-----------------------------------------------------------*/
@@ -159,25 +160,115 @@ extern void vPortForciblyEndThread(void *pxTaskToDelete);
 extern void vPortAddTaskHandle(void *pxTaskHandle);
 #define traceTASK_CREATE( pxNewTCB )            vPortAddTaskHandle( pxNewTCB )
 
+/* Set to 1 to park every task thread on its own futex and hand the CPU over
+ * directly on a context switch instead of suspending threads with signals.
+ * Linux only. */
+#ifndef configUSE_POSIX_EVENT_HANDOFF
+#define configUSE_POSIX_EVENT_HANDOFF 0
+#endif
+
+/* With more than one core every core runs its own task on its own thread.
+ * The kernel lists are guarded by a spinlock that critical sections and
+ * scheduler suspension hold, interrupts are masked per thread and a core is
+ * made to reschedule by sending SIG_TICK to the thread running on it. */
+#if (configNUMBER_OF_CORES > 1)
+extern BaseType_t xPortGetCoreID(void);
+extern void vPortYieldCore(BaseType_t xCoreID);
+extern void vPortTakeKernelLock(void);
+extern void vPortGiveKernelLock(void);
+extern BaseType_t xPortSetCoreInterruptMask(void);
+extern void vPortClearCoreInterruptMask(BaseType_t xMask);
+
+#define portGET_CORE_ID()                   xPortGetCoreID()
+#define portYIELD_CORE( xCoreID )           vPortYieldCore( xCoreID )
+#define portGET_KERNEL_LOCK()               vPortTakeKernelLock()
+#define portRELEASE_KERNEL_LOCK()           vPortGiveKernelLock()
+
+/* Masks the calling core only, returning the previous state. */
+#undef portSET_INTERRUPT_MASK
+#undef portCLEAR_INTERRUPT_MASK
+#undef portDISABLE_INTERRUPTS
+#undef portENABLE_INTERRUPTS
+#define portSET_INTERRUPT_MASK()            xPortSetCoreInterruptMask()
+#define portCLEAR_INTERRUPT_MASK( x )       vPortClearCoreInterruptMask( x )
+#define portDISABLE_INTERRUPTS()            vPortDisableInterrupts()
+#define portENABLE_INTERRUPTS()             vPortEnableInterrupts()
+#else
+#define portGET_CORE_ID()                   0
+#endif
+
 /* Posix Signal definitions that can be changed or read as appropriate. */
 #define SIG_SUSPEND                 SIGUSR1
 #define SIG_RESUME                  SIGUSR2
 
-/* Enable the following hash defines to make use of the real-time tick where time progresses at real-time. */
+/* The tick is generated by a dedicated thread waiting on a CLOCK_MONOTONIC
+ * timerfd. SIG_TICK is sent to the running task, which services the tick and
+ * the notifications pended by other threads. */
 #define SIG_TICK                    SIGALRM
-#define TIMER_TYPE                  ITIMER_REAL
-/* Enable the following hash defines to make use of the process tick where time progresses only when the process is executing.
-#define SIG_TICK                    SIGVTALRM
-#define TIMER_TYPE                  ITIMER_VIRTUAL      */
-/* Enable the following hash defines to make use of the profile tick where time progresses when the process or system calls are executing.
-#define SIG_TICK                    SIGPROF
-#define TIMER_TYPE                  ITIMER_PROF */
-
-/* Make use of times(man 2) to gather run-time statistics on the tasks. */
-extern void vPortFindTicksPerSecond(void);
-#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    vPortFindTicksPerSecond()       /* Nothing to do because the timer is already present. */
-extern unsigned long ulPortGetTimerValue(void);
-#define portGET_RUN_TIME_COUNTER_VALUE()            ulPortGetTimerValue()           /* Query the System time stats for this process. */
+
+/* Signal handlers and threads that are not tasks, such as the AsyncIO
+ * handlers, must not enter the kernel themselves. The notification is given
+ * once the running task takes SIG_TICK, the caller never blocks. The task may
+ * be deleted by then and a new one created at the same address, so it is
+ * identified by its thread slot and the generation of the slot instead. */
+#define portNOTIFY_TARGET_TYPE      uint64_t
+#define portNOTIFY_TARGET_NONE      ( ( uint64_t ) 0 )
+extern uint64_t ullPortGetNotifyTarget(void);
+extern void vPortNotifyGive(uint64_t ullTarget);
+extern void vPortNotifyGiveFromThread(uint64_t ullTarget);
+#define portGET_NOTIFY_TARGET()     ullPortGetNotifyTarget()
+#define portNOTIFY_GIVE( xTarget )  vPortNotifyGive( xTarget )
+#define portNOTIFY_GIVE_FROM_ISR( xTarget, pxHigherPriorityTaskWoken ) \
+    ( ( void ) ( pxHigherPriorityTaskWoken ), vPortNotifyGiveFromThread( xTarget ) )
+
+/* Number of tick deadlines the tick thread woke up too late for. */
+extern unsigned long ulPortGetMissedTicks(void);
+
+/* Stop the tick and sleep the host thread while every task is blocked. */
+#if (configUSE_TICKLESS_IDLE == 1)
+extern void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime);
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime ) vPortSuppressTicksAndSleep( xExpectedIdleTime )
+#endif
+
+/* Run-time statistics are taken from CLOCK_MONOTONIC at every context switch.
+ * The counter is in nanoseconds if configRUN_TIME_COUNTER_TYPE is 64 bit wide
+ * and in microseconds otherwise, where it wraps after about 71 minutes. */
+#if (configGENERATE_RUN_TIME_STATS == 1)
+extern void vPortConfigureRunTimeStats(void);
+extern uint64_t ullPortGetRunTimeNs(void);
+extern void vPortTaskSwitchedIn(void *pxTaskHandle);
+
+#define portRUN_TIME_COUNTER_DIVIDER \
+    ((sizeof(configRUN_TIME_COUNTER_TYPE) < sizeof(uint64_t)) ? 1000ULL : 1ULL)
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    vPortConfigureRunTimeStats()
+#define portGET_RUN_TIME_COUNTER_VALUE() \
+    ((configRUN_TIME_COUNTER_TYPE)(ullPortGetRunTimeNs() / portRUN_TIME_COUNTER_DIVIDER))
+#define traceTASK_SWITCHED_IN()                     vPortTaskSwitchedIn( pxCurrentTCB )
+
+/* Per task statistics for the period between two snapshots. */
+typedef struct xPORT_TASK_STATS {
+    void *pvTask;
+    char pcTaskName[configMAX_TASK_NAME_LEN];
+    /* Time spent in the Running state, in nanoseconds. */
+    uint64_t ullRunTime;
+    /* Longest time the task ran without being switched out, in nanoseconds. */
+    uint64_t ullLongestSlice;
+    /* Number of times the task was switched in. */
+    unsigned long ulSwitches;
+    /* Share of the period spent in the Running state. */
+    float fCpuPercent;
+} xPortTaskStats;
+
+/* Fills pxStats with up to uxArraySize entries covering the time since the
+ * previous call and returns how many were written. The length of the period in
+ * nanoseconds is stored in pullPeriod if it is not NULL. */
+extern unsigned portBASE_TYPE uxPortGetTaskStatsSnapshot(xPortTaskStats *pxStats,
+        unsigned portBASE_TYPE uxArraySize, uint64_t *pullPeriod);
+#endif
+
+/* The run time counter may be 64 bit wide, which unsigned long is not on
+ * every host, so run time stats are printed as unsigned long long. */
+#define portLLU_PRINTF_SPECIFIER_REQUIRED
 
 #ifdef __cplusplus
 }
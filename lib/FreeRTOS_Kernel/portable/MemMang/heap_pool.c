@@ -0,0 +1,537 @@
+/*
+ * Implementation of pvPortMalloc() and vPortFree() that serves the common
+ * kernel object sizes from size class pools.
+ *
+ * Every size class carves its blocks out of slabs obtained from malloc() and
+ * keeps the freed blocks on a lock free list, so allocating or freeing a TCB,
+ * a queue, a semaphore, a timer or a list item neither suspends the scheduler
+ * nor enters malloc(). Only growing a pool by a slab and blocks larger than
+ * the largest class, such as task stacks, go to malloc() with the scheduler
+ * suspended, as heap_3.c does for every block.
+ *
+ * A class grows to at most configHEAP_POOL_MAXIMUM_SLABS slabs. Once a class
+ * is full, further blocks of its size come from malloc() like the large ones,
+ * so running out of slabs never fails an allocation. vPortGetHeapStats()
+ * reports how often that happened.
+ *
+ * The bytes handed out, headers included, are limited to
+ * configTOTAL_HEAP_SIZE to simulate the memory of a target. Blocks kept in
+ * the pools count as free.
+ *
+ * See heap_3.c for the plain malloc() wrapper.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#if( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
+#error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
+#endif
+
+/* A limit of 0 leaves the heap bounded by the host only. */
+#define heapMAXIMUM_SIZE        ( ( ( size_t ) configTOTAL_HEAP_SIZE > 0 ) ? \
+                                  ( size_t ) configTOTAL_HEAP_SIZE : ( size_t ) SIZE_MAX )
+
+/* Blocks are aligned for any host type, not just portBYTE_ALIGNMENT. */
+#define heapALIGNMENT           ( ( size_t ) 16 )
+#define heapALIGN( x )          ( ( ( x ) + heapALIGNMENT - 1 ) & ~( heapALIGNMENT - 1 ) )
+
+/* Slabs a size class can grow to, the table of slabs is part of the class.
+The index of every block must fit in a free list head, which prvHeapInit()
+asserts. */
+#ifndef configHEAP_POOL_MAXIMUM_SLABS
+#define configHEAP_POOL_MAXIMUM_SLABS 256
+#endif
+
+/* Slabs hold a power of two number of blocks, so finding a block by its
+index is a shift and a mask. */
+#define heapSLAB_SIZE           ( ( size_t ) 16 * 1024 )
+#define heapMINIMUM_SLAB_SHIFT  ( 3 )
+#define heapMAXIMUM_SLABS       ( configHEAP_POOL_MAXIMUM_SLABS )
+#define heapMAXIMUM_CLASS_SIZE  ( ( size_t ) 1024 )
+#define heapMAXIMUM_CLASSES     ( 24 )
+#define heapLARGE_CLASS         ( ( uint16_t ) 0xffff )
+
+/* A free list head holds the index of the first block plus one in its lower
+bits and a tag in its upper bits. Only taking a block off the list changes
+the tag, which is enough to catch a head that was taken and put back, and
+makes the tag the number of blocks handed out from the list. */
+#define heapHEAD_INDEX_BITS     ( 24 )
+#define heapHEAD_INDEX( x )     ( ( uint32_t ) ( ( x ) & ( ( 1ULL << heapHEAD_INDEX_BITS ) - 1 ) ) )
+#define heapHEAD( ullTag, ulIndex ) ( ( ( uint64_t ) ( ullTag ) << heapHEAD_INDEX_BITS ) | ( ulIndex ) )
+#define heapHEAD_TAG( x )       ( ( uint64_t ) ( x ) >> heapHEAD_INDEX_BITS )
+
+typedef struct A_BLOCK_HEADER {
+    size_t xBlockSize;      /* Charged against the heap, header included. */
+    uint16_t usClass;       /* Size class, heapLARGE_CLASS for blocks from malloc(). */
+    uint16_t usPad;
+    uint32_t ulIndex;       /* Position of the block within its class. */
+} BlockHeader_t;
+
+#define heapHEADER_SIZE         heapALIGN( sizeof( BlockHeader_t ) )
+
+typedef struct A_SIZE_CLASS {
+    size_t xSize;           /* Largest request served, excluding the header. */
+    size_t xBlockSize;
+    uint32_t ulSlabShift;   /* Blocks per slab as a power of two. */
+    volatile uint32_t ulSlabs;
+    uint8_t *volatile pucSlabs[ heapMAXIMUM_SLABS ];
+    volatile uint64_t ullFreeHead;
+    /* Blocks handed out by prvGrowClass() without going through the list. */
+    volatile size_t xSlabAllocations;
+} SizeClass_t;
+/*-----------------------------------------------------------*/
+
+static void prvHeapInit(void);
+static void prvAddClass(size_t xSize);
+static SizeClass_t *prvClassFor(size_t xWantedSize);
+static BlockHeader_t *prvBlockAt(SizeClass_t *pxClass, uint32_t ulIndex);
+static BlockHeader_t *prvPopBlock(SizeClass_t *pxClass);
+static void prvPushBlocks(SizeClass_t *pxClass, BlockHeader_t *pxFirst,
+                          BlockHeader_t *pxLast);
+static BlockHeader_t *prvGrowClass(SizeClass_t *pxClass);
+static size_t prvCountFreeBlocks(SizeClass_t *pxClass, uint32_t ulBlocks);
+static BaseType_t prvReserveBytes(size_t xBlockSize);
+static void prvReleaseBytes(size_t xBlockSize);
+/*-----------------------------------------------------------*/
+
+static SizeClass_t xClasses[ heapMAXIMUM_CLASSES ];
+static UBaseType_t uxClassCount = 0;
+/* Maps a request rounded up to heapALIGNMENT to the smallest class that fits. */
+static uint8_t ucClassLookup[ heapMAXIMUM_CLASS_SIZE / heapALIGNMENT + 1 ];
+static volatile BaseType_t xHeapInitialised = pdFALSE;
+
+static volatile size_t xBytesInUse = 0;
+static volatile size_t xMinimumEverFreeBytes = heapMAXIMUM_SIZE;
+/* Blocks from malloc(), the pooled ones are counted by their class. These
+are only updated with the scheduler suspended. */
+static volatile size_t xLargeAllocations = 0;
+static volatile size_t xLargeFrees = 0;
+/* Pool sized blocks that came from malloc() as their class was full. */
+static volatile size_t xPoolOverflows = 0;
+/*-----------------------------------------------------------*/
+
+void *pvPortMalloc(size_t xWantedSize)
+{
+    SizeClass_t *pxClass;
+    BlockHeader_t *pxBlock = NULL;
+    size_t xBlockSize;
+    void *pvReturn = NULL;
+
+    if (xHeapInitialised == pdFALSE) {
+        vTaskSuspendAll();
+        {
+            prvHeapInit();
+        }
+        xTaskResumeAll();
+    }
+
+    if (xWantedSize == (size_t) 0 || xWantedSize > heapMAXIMUM_SIZE - heapHEADER_SIZE) {
+        goto out;
+    }
+
+    pxClass = prvClassFor(xWantedSize);
+    xBlockSize = pxClass ? pxClass->xBlockSize : heapALIGN(xWantedSize + heapHEADER_SIZE);
+
+    if (prvReserveBytes(xBlockSize) == pdFALSE) {
+        goto out;
+    }
+
+    if (pxClass) {
+        /* Fast path, no lock and no malloc(). */
+        pxBlock = prvPopBlock(pxClass);
+        if (pxBlock == NULL) {
+            pxBlock = prvGrowClass(pxClass);
+        }
+    }
+
+    /* Large blocks, and blocks of a class that can not grow any more, are
+    tagged as large so vPortFree() hands them back to free(). */
+    if (pxBlock == NULL &&
+        (pxClass == NULL ||
+         __atomic_load_n(&pxClass->ulSlabs, __ATOMIC_RELAXED) >= heapMAXIMUM_SLABS)) {
+        vTaskSuspendAll();
+        {
+            pxBlock = (BlockHeader_t *) malloc(xBlockSize);
+            if (pxBlock) {
+                __atomic_store_n(&xLargeAllocations, xLargeAllocations + 1, __ATOMIC_RELAXED);
+                if (pxClass) {
+                    __atomic_store_n(&xPoolOverflows, xPoolOverflows + 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+        xTaskResumeAll();
+
+        if (pxBlock) {
+            pxBlock->xBlockSize = xBlockSize;
+            pxBlock->usClass = heapLARGE_CLASS;
+            pxBlock->ulIndex = 0;
+        }
+    }
+
+    if (pxBlock == NULL) {
+        prvReleaseBytes(xBlockSize);
+        goto out;
+    }
+
+    pvReturn = (uint8_t *) pxBlock + heapHEADER_SIZE;
+
+out:
+    traceMALLOC(pvReturn, xWantedSize);
+
+#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+    {
+        if (pvReturn == NULL) {
+            extern void vApplicationMallocFailedHook(void);
+            vApplicationMallocFailedHook();
+        }
+    }
+#endif
+
+    return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortFree(void *pv)
+{
+    BlockHeader_t *pxBlock;
+    size_t xBlockSize;
+
+    if (pv == NULL) {
+        return;
+    }
+
+    pxBlock = (BlockHeader_t *) ((uint8_t *) pv - heapHEADER_SIZE);
+    xBlockSize = pxBlock->xBlockSize;
+    traceFREE(pv, xBlockSize);
+
+    if (pxBlock->usClass == heapLARGE_CLASS) {
+        vTaskSuspendAll();
+        {
+            free(pxBlock);
+            __atomic_store_n(&xLargeFrees, xLargeFrees + 1, __ATOMIC_RELAXED);
+        }
+        xTaskResumeAll();
+    }
+    else {
+        configASSERT(pxBlock->usClass < uxClassCount);
+        prvPushBlocks(&xClasses[ pxBlock->usClass ], pxBlock, pxBlock);
+    }
+
+    prvReleaseBytes(xBlockSize);
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return heapMAXIMUM_SIZE - __atomic_load_n(&xBytesInUse, __ATOMIC_RELAXED);
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+    return __atomic_load_n(&xMinimumEverFreeBytes, __ATOMIC_RELAXED);
+}
+/*-----------------------------------------------------------*/
+
+void vPortInitialiseBlocks(void)
+{
+    /* This just exists to keep the linker quiet. */
+}
+/*-----------------------------------------------------------*/
+
+void vPortGetHeapStats(HeapStats_t *pxHeapStats)
+{
+    SizeClass_t *pxClass;
+    size_t xAllocations, xInUse, xFreeBlocks;
+    uint32_t ulBlocks;
+    UBaseType_t ux;
+
+    pxHeapStats->xAvailableHeapSpaceInBytes = xPortGetFreeHeapSize();
+    pxHeapStats->xSizeOfLargestFreeBlockInBytes = 0;
+    pxHeapStats->xSizeOfSmallestFreeBlockInBytes = 0;
+    pxHeapStats->xNumberOfFreeBlocks = 0;
+    pxHeapStats->xMinimumEverFreeBytesRemaining = xPortGetMinimumEverFreeHeapSize();
+    pxHeapStats->xMaximumSlabsPerPool = heapMAXIMUM_SLABS;
+    pxHeapStats->xNumberOfFullPools = 0;
+    pxHeapStats->xNumberOfPoolOverflows = __atomic_load_n(&xPoolOverflows, __ATOMIC_RELAXED);
+
+    /* As heap_4.c does, the free lists are walked with the scheduler
+    suspended. The pooled blocks are not counted as they are allocated and
+    freed, a block in use is one that was carved and is not on its list.
+    Other cores keep allocating, so the result is approximate there. */
+    vTaskSuspendAll();
+    {
+        pxHeapStats->xNumberOfSuccessfulAllocations = xLargeAllocations;
+        pxHeapStats->xNumberOfSuccessfulFrees = xLargeFrees;
+
+        /* The classes are sorted by size. */
+        for (ux = 0; ux < uxClassCount; ux++) {
+            pxClass = &xClasses[ ux ];
+            ulBlocks = __atomic_load_n(&pxClass->ulSlabs, __ATOMIC_ACQUIRE) << pxClass->ulSlabShift;
+            xAllocations = (size_t) heapHEAD_TAG(__atomic_load_n(&pxClass->ullFreeHead,
+                                                                 __ATOMIC_ACQUIRE)) +
+                           pxClass->xSlabAllocations;
+            xFreeBlocks = prvCountFreeBlocks(pxClass, ulBlocks);
+            xInUse = ulBlocks - xFreeBlocks;
+
+            if ((ulBlocks >> pxClass->ulSlabShift) >= heapMAXIMUM_SLABS) {
+                pxHeapStats->xNumberOfFullPools++;
+            }
+
+            pxHeapStats->xNumberOfSuccessfulAllocations += xAllocations;
+            pxHeapStats->xNumberOfSuccessfulFrees += xAllocations > xInUse ? xAllocations - xInUse : 0;
+
+            if (xFreeBlocks == 0) {
+                continue;
+            }
+
+            if (pxHeapStats->xNumberOfFreeBlocks == 0) {
+                pxHeapStats->xSizeOfSmallestFreeBlockInBytes = pxClass->xSize;
+            }
+            pxHeapStats->xSizeOfLargestFreeBlockInBytes = pxClass->xSize;
+            pxHeapStats->xNumberOfFreeBlocks += xFreeBlocks;
+        }
+    }
+    (void) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+void prvAddClass(size_t xSize)
+{
+    UBaseType_t ux, uxInsert;
+    SizeClass_t *pxClass;
+
+    xSize = heapALIGN(xSize);
+    if (xSize > heapMAXIMUM_CLASS_SIZE || uxClassCount == heapMAXIMUM_CLASSES) {
+        return;
+    }
+
+    /* Keep the classes sorted, without duplicates. */
+    for (uxInsert = 0; uxInsert < uxClassCount; uxInsert++) {
+        if (xClasses[ uxInsert ].xSize == xSize) {
+            return;
+        }
+        if (xClasses[ uxInsert ].xSize > xSize) {
+            break;
+        }
+    }
+    for (ux = uxClassCount; ux > uxInsert; ux--) {
+        xClasses[ ux ] = xClasses[ ux - 1 ];
+    }
+    uxClassCount++;
+
+    pxClass = &xClasses[ uxInsert ];
+    pxClass->xSize = xSize;
+    pxClass->xBlockSize = xSize + heapHEADER_SIZE;
+    pxClass->ulSlabShift = heapMINIMUM_SLAB_SHIFT;
+    while (((size_t) 2 << pxClass->ulSlabShift) * pxClass->xBlockSize <= heapSLAB_SIZE) {
+        pxClass->ulSlabShift++;
+    }
+    pxClass->ulSlabs = 0;
+    pxClass->ullFreeHead = 0;
+    pxClass->xSlabAllocations = 0;
+}
+/*-----------------------------------------------------------*/
+
+void prvHeapInit(void)
+{
+    size_t xSize;
+    UBaseType_t ux;
+
+    if (xHeapInitialised != pdFALSE) {
+        return;
+    }
+
+    /* An exact fit for the kernel objects, semaphores and mutexes are queues
+    without storage. */
+    prvAddClass(sizeof(ListItem_t));
+    prvAddClass(sizeof(StaticQueue_t));
+    prvAddClass(sizeof(StaticTask_t));
+#if( configUSE_TIMERS == 1 )
+    prvAddClass(sizeof(StaticTimer_t));
+#endif
+
+    /* Everything else is rounded up to at most a quarter more. */
+    for (xSize = 32; xSize <= heapMAXIMUM_CLASS_SIZE; xSize += xSize / 4) {
+        prvAddClass(xSize);
+    }
+    prvAddClass(heapMAXIMUM_CLASS_SIZE);
+
+    for (ux = 0, xSize = 0; xSize <= heapMAXIMUM_CLASS_SIZE; xSize += heapALIGNMENT) {
+        while (xClasses[ ux ].xSize < xSize) {
+            ux++;
+        }
+        ucClassLookup[ xSize / heapALIGNMENT ] = (uint8_t) ux;
+    }
+
+    /* Every block index must fit in a free list head. */
+    for (ux = 0; ux < uxClassCount; ux++) {
+        configASSERT(((uint64_t) heapMAXIMUM_SLABS << xClasses[ ux ].ulSlabShift) <
+                     (1ULL << heapHEAD_INDEX_BITS));
+    }
+
+    __atomic_store_n(&xHeapInitialised, pdTRUE, __ATOMIC_RELEASE);
+}
+/*-----------------------------------------------------------*/
+
+SizeClass_t *prvClassFor(size_t xWantedSize)
+{
+    if (xWantedSize > heapMAXIMUM_CLASS_SIZE) {
+        return NULL;
+    }
+
+    return &xClasses[ ucClassLookup[ heapALIGN(xWantedSize) / heapALIGNMENT ] ];
+}
+/*-----------------------------------------------------------*/
+
+BlockHeader_t *prvBlockAt(SizeClass_t *pxClass, uint32_t ulIndex)
+{
+    uint8_t *pucSlab = __atomic_load_n(&pxClass->pucSlabs[ ulIndex >> pxClass->ulSlabShift ],
+                                       __ATOMIC_ACQUIRE);
+    uint32_t ulMask = ((uint32_t) 1 << pxClass->ulSlabShift) - 1;
+
+    return (BlockHeader_t *)(pucSlab + (ulIndex & ulMask) * pxClass->xBlockSize);
+}
+/*-----------------------------------------------------------*/
+
+/* A free block links to the next one through the first word of its payload,
+which is only ever read while the slab exists, so a stale read is harmless
+and caught by the tag. */
+#define heapNEXT_FREE( pxBlock ) ( ( uint32_t * ) ( ( uint8_t * ) ( pxBlock ) + heapHEADER_SIZE ) )
+
+BlockHeader_t *prvPopBlock(SizeClass_t *pxClass)
+{
+    uint64_t ullHead, ullNewHead;
+    BlockHeader_t *pxBlock;
+
+    ullHead = __atomic_load_n(&pxClass->ullFreeHead, __ATOMIC_ACQUIRE);
+    do {
+        if (heapHEAD_INDEX(ullHead) == 0) {
+            return NULL;
+        }
+
+        pxBlock = prvBlockAt(pxClass, heapHEAD_INDEX(ullHead) - 1);
+        ullNewHead = heapHEAD(heapHEAD_TAG(ullHead) + 1,
+                              __atomic_load_n(heapNEXT_FREE(pxBlock), __ATOMIC_RELAXED));
+    } while (!__atomic_compare_exchange_n(&pxClass->ullFreeHead, &ullHead, ullNewHead,
+                                          pdFALSE, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    return pxBlock;
+}
+/*-----------------------------------------------------------*/
+
+void prvPushBlocks(SizeClass_t *pxClass, BlockHeader_t *pxFirst,
+                   BlockHeader_t *pxLast)
+{
+    uint64_t ullHead, ullNewHead;
+
+    ullHead = __atomic_load_n(&pxClass->ullFreeHead, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(heapNEXT_FREE(pxLast), heapHEAD_INDEX(ullHead), __ATOMIC_RELAXED);
+        ullNewHead = heapHEAD(heapHEAD_TAG(ullHead), pxFirst->ulIndex + 1);
+    } while (!__atomic_compare_exchange_n(&pxClass->ullFreeHead, &ullHead, ullNewHead,
+                                          pdFALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+/*-----------------------------------------------------------*/
+
+BlockHeader_t *prvGrowClass(SizeClass_t *pxClass)
+{
+    BlockHeader_t *pxBlock = NULL, *pxPrevious = NULL;
+    uint32_t ulBlocks = (uint32_t) 1 << pxClass->ulSlabShift;
+    uint8_t *pucSlab;
+    uint32_t ulSlab, ul;
+
+    vTaskSuspendAll();
+    {
+        /* Another thread may have grown the class in the meantime. */
+        pxBlock = prvPopBlock(pxClass);
+
+        if (pxBlock == NULL && pxClass->ulSlabs < heapMAXIMUM_SLABS) {
+            pucSlab = (uint8_t *) malloc(ulBlocks * pxClass->xBlockSize);
+
+            if (pucSlab) {
+                ulSlab = pxClass->ulSlabs;
+                for (ul = 0; ul < ulBlocks; ul++) {
+                    pxBlock = (BlockHeader_t *)(pucSlab + ul * pxClass->xBlockSize);
+                    pxBlock->xBlockSize = pxClass->xBlockSize;
+                    pxBlock->usClass = (uint16_t)(pxClass - xClasses);
+                    pxBlock->ulIndex = (ulSlab << pxClass->ulSlabShift) + ul;
+                    if (ul > 1) {
+                        *heapNEXT_FREE(pxPrevious) = pxBlock->ulIndex + 1;
+                    }
+                    pxPrevious = pxBlock;
+                }
+
+                __atomic_store_n(&pxClass->pucSlabs[ ulSlab ], pucSlab, __ATOMIC_RELEASE);
+                __atomic_store_n(&pxClass->ulSlabs, ulSlab + 1, __ATOMIC_RELAXED);
+
+                /* The first block is handed out, the rest goes to the pool. */
+                pxBlock = (BlockHeader_t *) pucSlab;
+                __atomic_store_n(&pxClass->xSlabAllocations, pxClass->xSlabAllocations + 1,
+                                 __ATOMIC_RELAXED);
+                prvPushBlocks(pxClass, (BlockHeader_t *)(pucSlab + pxClass->xBlockSize),
+                              pxPrevious);
+            }
+        }
+    }
+    xTaskResumeAll();
+
+    return pxBlock;
+}
+/*-----------------------------------------------------------*/
+
+size_t prvCountFreeBlocks(SizeClass_t *pxClass, uint32_t ulBlocks)
+{
+    uint32_t ulIndex = heapHEAD_INDEX(__atomic_load_n(&pxClass->ullFreeHead, __ATOMIC_ACQUIRE));
+    size_t xCount = 0;
+
+    /* A block taken off the list by another core may hold anything, so the
+    walk stops at an index out of range or at the number of blocks. */
+    while (ulIndex != 0 && ulIndex <= ulBlocks && xCount < ulBlocks) {
+        xCount++;
+        ulIndex = __atomic_load_n(heapNEXT_FREE(prvBlockAt(pxClass, ulIndex - 1)),
+                                  __ATOMIC_RELAXED);
+    }
+
+    return xCount;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t prvReserveBytes(size_t xBlockSize)
+{
+    size_t xInUse = __atomic_load_n(&xBytesInUse, __ATOMIC_RELAXED);
+    size_t xFree, xMinimum;
+
+    do {
+        if (xBlockSize > heapMAXIMUM_SIZE - xInUse) {
+            return pdFALSE;
+        }
+    } while (!__atomic_compare_exchange_n(&xBytesInUse, &xInUse, xInUse + xBlockSize,
+                                          pdFALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    xFree = heapMAXIMUM_SIZE - (xInUse + xBlockSize);
+    xMinimum = __atomic_load_n(&xMinimumEverFreeBytes, __ATOMIC_RELAXED);
+    while (xFree < xMinimum &&
+           !__atomic_compare_exchange_n(&xMinimumEverFreeBytes, &xMinimum, xFree,
+                                        pdFALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+void prvReleaseBytes(size_t xBlockSize)
+{
+    __atomic_sub_fetch(&xBytesInUse, xBlockSize, __ATOMIC_RELAXED);
+}
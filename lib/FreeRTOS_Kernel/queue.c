@@ -166,6 +166,11 @@ typedef struct QueueDefinition {
     uint8_t ucQueueType;
 #endif
 
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+    struct QueueDefinition *pxBufferPool; /*< Queue of the buffers not on loan when the structure is used as a zero copy queue, NULL otherwise. */
+    UBaseType_t uxBufferSize; /*< The size of each buffer in the pool, rounded up to portBYTE_ALIGNMENT. */
+#endif
+
 } xQUEUE;
 
 /* The old xQUEUE name is maintained above then typedefed to the new Queue_t
@@ -239,6 +244,17 @@ prvCopyDataToQueue(Queue_t *const pxQueue, const void *pvItemToQueue,
 static void prvCopyDataFromQueue(Queue_t *const pxQueue,
                                  void *const pvBuffer) PRIVILEGED_FUNCTION;
 
+/*
+ * Copies a number of items to the back of a queue, or out of the front of a
+ * queue, with at most two calls to memcpy().  The caller makes sure there is
+ * enough space, or enough items.
+ */
+static void prvCopyItemsToQueue(Queue_t *const pxQueue,
+                                const int8_t *pcItems,
+                                const UBaseType_t uxCount) PRIVILEGED_FUNCTION;
+static void prvCopyItemsFromQueue(Queue_t *const pxQueue, int8_t *pcBuffer,
+                                  const UBaseType_t uxCount) PRIVILEGED_FUNCTION;
+
 #if (configUSE_QUEUE_SETS == 1)
 /*
      * Checks to see if a queue is a member of a queue set, and if so, notifies
@@ -488,6 +504,13 @@ static void prvInitialiseNewQueue(const UBaseType_t uxQueueLength,
     }
 #endif /* configUSE_QUEUE_SETS */
 
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+    {
+        pxNewQueue->pxBufferPool = NULL;
+        pxNewQueue->uxBufferSize = (UBaseType_t)0;
+    }
+#endif /* configUSE_ZERO_COPY_QUEUES */
+
     traceQUEUE_CREATE(pxNewQueue);
 }
 /*-----------------------------------------------------------*/
@@ -1464,6 +1487,248 @@ BaseType_t xQueueGenericReceive(QueueHandle_t xQueue, void *const pvBuffer,
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t xQueueSendMultiple(QueueHandle_t xQueue, const void *const pvItems,
+                               const UBaseType_t uxItemCount,
+                               TickType_t xTicksToWait)
+{
+    BaseType_t xEntryTimeSet = pdFALSE, xYieldRequired;
+    TimeOut_t xTimeOut;
+    UBaseType_t uxCount, ux;
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+
+    configASSERT(pxQueue);
+    configASSERT(!((pvItems == NULL) &&
+                   (pxQueue->uxItemSize != (UBaseType_t)0U)));
+    configASSERT(pxQueue->uxQueueType != queueQUEUE_IS_MUTEX);
+#if ((INCLUDE_xTaskGetSchedulerState == 1) || (configUSE_TIMERS == 1))
+    {
+        configASSERT(!(
+                         (xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED) &&
+                         (xTicksToWait != 0)));
+    }
+#endif
+
+    if (uxItemCount == (UBaseType_t)0) {
+        return 0;
+    }
+
+    /* As xQueueGenericSend(), but as many of the items as fit are copied in
+    one go once there is room for at least one. */
+    for (;;) {
+        taskENTER_CRITICAL();
+        {
+            if (pxQueue->uxMessagesWaiting < pxQueue->uxLength) {
+                uxCount = pxQueue->uxLength - pxQueue->uxMessagesWaiting;
+                if (uxCount > uxItemCount) {
+                    uxCount = uxItemCount;
+                }
+
+                traceQUEUE_SEND(pxQueue);
+                prvCopyItemsToQueue(pxQueue, (const int8_t *)pvItems, uxCount);
+                xYieldRequired = pdFALSE;
+
+#if (configUSE_QUEUE_SETS == 1)
+                if (pxQueue->pxQueueSetContainer != NULL) {
+                    /* The queue set holds an event per item. */
+                    for (ux = 0; ux < uxCount; ux++) {
+                        if (prvNotifyQueueSetContainer(
+                                pxQueue, queueSEND_TO_BACK) != pdFALSE) {
+                            xYieldRequired = pdTRUE;
+                        }
+                    }
+                }
+                else
+#endif /* configUSE_QUEUE_SETS */
+                {
+                    /* Each item can satisfy one waiting task, the yield is
+                    left until they have all been unblocked. */
+                    for (ux = 0; (ux < uxCount) &&
+                         (listLIST_IS_EMPTY(&(
+                                                pxQueue->xTasksWaitingToReceive)) ==
+                          pdFALSE);
+                         ux++) {
+                        if (xTaskRemoveFromEventList(&(
+                                                         pxQueue->xTasksWaitingToReceive)) !=
+                            pdFALSE) {
+                            xYieldRequired = pdTRUE;
+                        }
+                    }
+                }
+
+                if (xYieldRequired != pdFALSE) {
+                    queueYIELD_IF_USING_PREEMPTION();
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+
+                taskEXIT_CRITICAL();
+                return uxCount;
+            }
+            else {
+                if (xTicksToWait == (TickType_t)0) {
+                    taskEXIT_CRITICAL();
+                    traceQUEUE_SEND_FAILED(pxQueue);
+                    return 0;
+                }
+                else if (xEntryTimeSet == pdFALSE) {
+                    vTaskSetTimeOutState(&xTimeOut);
+                    xEntryTimeSet = pdTRUE;
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        vTaskSuspendAll();
+        prvLockQueue(pxQueue);
+
+        if (xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) == pdFALSE) {
+            if (prvIsQueueFull(pxQueue) != pdFALSE) {
+                traceBLOCKING_ON_QUEUE_SEND(pxQueue);
+                vTaskPlaceOnEventList(&(pxQueue->xTasksWaitingToSend),
+                                      xTicksToWait);
+                prvUnlockQueue(pxQueue);
+                if (xTaskResumeAll() == pdFALSE) {
+                    portYIELD_WITHIN_API();
+                }
+            }
+            else {
+                /* Try again. */
+                prvUnlockQueue(pxQueue);
+                (void)xTaskResumeAll();
+            }
+        }
+        else {
+            prvUnlockQueue(pxQueue);
+            (void)xTaskResumeAll();
+
+            traceQUEUE_SEND_FAILED(pxQueue);
+            return 0;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t xQueueReceiveMultiple(QueueHandle_t xQueue, void *const pvBuffer,
+                                  const UBaseType_t uxMaxItems,
+                                  TickType_t xTicksToWait)
+{
+    BaseType_t xEntryTimeSet = pdFALSE, xYieldRequired;
+    TimeOut_t xTimeOut;
+    UBaseType_t uxCount, ux;
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+
+    configASSERT(pxQueue);
+    configASSERT(!((pvBuffer == NULL) &&
+                   (pxQueue->uxItemSize != (UBaseType_t)0U)));
+    configASSERT(pxQueue->uxQueueType != queueQUEUE_IS_MUTEX);
+#if ((INCLUDE_xTaskGetSchedulerState == 1) || (configUSE_TIMERS == 1))
+    {
+        configASSERT(!(
+                         (xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED) &&
+                         (xTicksToWait != 0)));
+    }
+#endif
+
+    if (uxMaxItems == (UBaseType_t)0) {
+        return 0;
+    }
+
+    /* As xQueueGenericReceive(), but everything that is waiting, up to
+    uxMaxItems, is copied out in one go. */
+    for (;;) {
+        taskENTER_CRITICAL();
+        {
+            if (pxQueue->uxMessagesWaiting > (UBaseType_t)0) {
+                uxCount = pxQueue->uxMessagesWaiting;
+                if (uxCount > uxMaxItems) {
+                    uxCount = uxMaxItems;
+                }
+
+                traceQUEUE_RECEIVE(pxQueue);
+                prvCopyItemsFromQueue(pxQueue, (int8_t *)pvBuffer, uxCount);
+                xYieldRequired = pdFALSE;
+
+                /* Each freed space can satisfy one waiting task. */
+                for (ux = 0; (ux < uxCount) &&
+                     (listLIST_IS_EMPTY(&(pxQueue->xTasksWaitingToSend)) ==
+                      pdFALSE);
+                     ux++) {
+                    if (xTaskRemoveFromEventList(&(
+                                                     pxQueue->xTasksWaitingToSend)) !=
+                        pdFALSE) {
+                        xYieldRequired = pdTRUE;
+                    }
+                }
+
+                if (xYieldRequired != pdFALSE) {
+                    queueYIELD_IF_USING_PREEMPTION();
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+
+                taskEXIT_CRITICAL();
+                return uxCount;
+            }
+            else {
+                if (xTicksToWait == (TickType_t)0) {
+                    taskEXIT_CRITICAL();
+                    traceQUEUE_RECEIVE_FAILED(pxQueue);
+                    return 0;
+                }
+                else if (xEntryTimeSet == pdFALSE) {
+                    vTaskSetTimeOutState(&xTimeOut);
+                    xEntryTimeSet = pdTRUE;
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        vTaskSuspendAll();
+        prvLockQueue(pxQueue);
+
+        if (xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) == pdFALSE) {
+            if (prvIsQueueEmpty(pxQueue) != pdFALSE) {
+                traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue);
+                vTaskPlaceOnEventList(&(pxQueue->xTasksWaitingToReceive),
+                                      xTicksToWait);
+                prvUnlockQueue(pxQueue);
+                if (xTaskResumeAll() == pdFALSE) {
+                    portYIELD_WITHIN_API();
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+            else {
+                /* Try again. */
+                prvUnlockQueue(pxQueue);
+                (void)xTaskResumeAll();
+            }
+        }
+        else {
+            prvUnlockQueue(pxQueue);
+            (void)xTaskResumeAll();
+
+            if (prvIsQueueEmpty(pxQueue) != pdFALSE) {
+                traceQUEUE_RECEIVE_FAILED(pxQueue);
+                return 0;
+            }
+            else {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void *const pvBuffer,
                                 BaseType_t *const pxHigherPriorityTaskWoken)
 {
@@ -1660,6 +1925,15 @@ void vQueueDelete(QueueHandle_t xQueue)
     configASSERT(pxQueue);
     traceQUEUE_DELETE(pxQueue);
 
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+    {
+        /* The buffers go with the queue, the ones still on loan included. */
+        if (pxQueue->pxBufferPool != NULL) {
+            vQueueDelete(pxQueue->pxBufferPool);
+        }
+    }
+#endif /* configUSE_ZERO_COPY_QUEUES */
+
 #if (configQUEUE_REGISTRY_SIZE > 0)
     {
         vQueueUnregisterQueue(pxQueue);
@@ -1824,6 +2098,69 @@ static void prvCopyDataFromQueue(Queue_t *const pxQueue, void *const pvBuffer)
 }
 /*-----------------------------------------------------------*/
 
+static void prvCopyItemsToQueue(Queue_t *const pxQueue, const int8_t *pcItems,
+                                const UBaseType_t uxCount)
+{
+    size_t xBytes, xToTail;
+
+    /* This function is called from a critical section. */
+
+    if (pxQueue->uxItemSize != (UBaseType_t)0) {
+        xBytes = (size_t)uxCount * (size_t)pxQueue->uxItemSize;
+        xToTail = (size_t)(pxQueue->pcTail - pxQueue->pcWriteTo);
+
+        if (xBytes < xToTail) {
+            (void)memcpy((void *)pxQueue->pcWriteTo, pcItems, xBytes);
+            pxQueue->pcWriteTo += xBytes;
+        }
+        else {
+            /* The items wrap around the end of the storage area. */
+            (void)memcpy((void *)pxQueue->pcWriteTo, pcItems, xToTail);
+            (void)memcpy((void *)pxQueue->pcHead, pcItems + xToTail,
+                         xBytes - xToTail);
+            pxQueue->pcWriteTo = pxQueue->pcHead + (xBytes - xToTail);
+        }
+    }
+
+    pxQueue->uxMessagesWaiting += uxCount;
+}
+/*-----------------------------------------------------------*/
+
+static void prvCopyItemsFromQueue(Queue_t *const pxQueue, int8_t *pcBuffer,
+                                  const UBaseType_t uxCount)
+{
+    size_t xBytes, xToTail;
+    int8_t *pcFirst;
+
+    /* This function is called from a critical section. */
+
+    if (pxQueue->uxItemSize != (UBaseType_t)0) {
+        /* pcReadFrom points to the item read last. */
+        pcFirst = pxQueue->u.pcReadFrom + pxQueue->uxItemSize;
+        if (pcFirst >= pxQueue->pcTail) {
+            pcFirst = pxQueue->pcHead;
+        }
+
+        xBytes = (size_t)uxCount * (size_t)pxQueue->uxItemSize;
+        xToTail = (size_t)(pxQueue->pcTail - pcFirst);
+
+        if (xBytes <= xToTail) {
+            (void)memcpy(pcBuffer, (void *)pcFirst, xBytes);
+            pxQueue->u.pcReadFrom = pcFirst + xBytes - pxQueue->uxItemSize;
+        }
+        else {
+            (void)memcpy(pcBuffer, (void *)pcFirst, xToTail);
+            (void)memcpy(pcBuffer + xToTail, (void *)pxQueue->pcHead,
+                         xBytes - xToTail);
+            pxQueue->u.pcReadFrom =
+                pxQueue->pcHead + (xBytes - xToTail) - pxQueue->uxItemSize;
+        }
+    }
+
+    pxQueue->uxMessagesWaiting -= uxCount;
+}
+/*-----------------------------------------------------------*/
+
 static void prvUnlockQueue(Queue_t *const pxQueue)
 {
     /* THIS FUNCTION MUST BE CALLED WITH THE SCHEDULER SUSPENDED. */
@@ -2570,3 +2907,218 @@ static BaseType_t prvNotifyQueueSetContainer(const Queue_t *const pxQueue,
 }
 
 #endif /* configUSE_QUEUE_SETS */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+/* The buffers of a zero copy queue are stored behind the pointers of its
+pool, a loaned buffer must be one of them. */
+#define queueIS_POOL_BUFFER(pxPool, pv)                                        \
+    (((int8_t *)(pv) >= (pxPool)->pcTail) &&                                   \
+     ((int8_t *)(pv) < (pxPool)->pcTail + ((pxPool)->uxLength *               \
+                                             (pxPool)->uxBufferSize)) &&       \
+     ((((int8_t *)(pv) - (pxPool)->pcTail) % (pxPool)->uxBufferSize) == 0))
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if ((configUSE_ZERO_COPY_QUEUES == 1) &&                                      \
+     (configSUPPORT_DYNAMIC_ALLOCATION == 1))
+
+QueueHandle_t xQueueCreateZeroCopy(const UBaseType_t uxQueueLength,
+                                   const UBaseType_t uxBufferSize,
+                                   const UBaseType_t uxBufferCount)
+{
+    Queue_t *pxNewQueue;
+    Queue_t *pxPool;
+    UBaseType_t uxAlignedSize, ux;
+    void *pvBuffer;
+
+    configASSERT(uxBufferSize > (UBaseType_t)0);
+    configASSERT(uxBufferCount > (UBaseType_t)0);
+
+    /* Messages are queued as pointers to the buffers. */
+    pxNewQueue = (Queue_t *)xQueueGenericCreate(
+                     uxQueueLength, sizeof(void *), queueQUEUE_TYPE_BASE);
+
+    if (pxNewQueue == NULL) {
+        return NULL;
+    }
+
+    /* The pool is a queue of the pointers to the free buffers, followed by
+    the buffers themselves, so it is freed with a single vPortFree(). */
+    uxAlignedSize = (uxBufferSize + (UBaseType_t)portBYTE_ALIGNMENT_MASK) &
+                    ~((UBaseType_t)portBYTE_ALIGNMENT_MASK);
+    pxPool = (Queue_t *)pvPortMalloc(
+                 sizeof(Queue_t) +
+                 (size_t)uxBufferCount * (sizeof(void *) + uxAlignedSize));
+
+    if (pxPool == NULL) {
+        vQueueDelete(pxNewQueue);
+        return NULL;
+    }
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+    {
+        pxPool->ucStaticallyAllocated = pdFALSE;
+    }
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
+    prvInitialiseNewQueue(uxBufferCount, sizeof(void *),
+                          ((uint8_t *)pxPool) + sizeof(Queue_t),
+                          queueQUEUE_TYPE_BASE, pxPool);
+    pxPool->uxBufferSize = uxAlignedSize;
+
+    for (ux = (UBaseType_t)0; ux < uxBufferCount; ux++) {
+        pvBuffer = pxPool->pcTail + (ux * uxAlignedSize);
+        (void)xQueueGenericSend(pxPool, &pvBuffer, (TickType_t)0,
+                                queueSEND_TO_BACK);
+    }
+
+    pxNewQueue->pxBufferPool = pxPool;
+    pxNewQueue->uxBufferSize = uxAlignedSize;
+
+    return pxNewQueue;
+}
+
+#endif /* ( ( configUSE_ZERO_COPY_QUEUES == 1 ) && ( configSUPPORT_DYNAMIC_ALLOCATION == 1 ) ) */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+void *pvQueueLoanBuffer(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+    void *pvBuffer;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+
+    if (xQueueGenericReceive(pxQueue->pxBufferPool, &pvBuffer, xTicksToWait,
+                             pdFALSE) != pdPASS) {
+        pvBuffer = NULL;
+    }
+
+    return pvBuffer;
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+void *pvQueueLoanBufferFromISR(QueueHandle_t xQueue,
+                               BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+    void *pvBuffer;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+
+    if (xQueueReceiveFromISR(pxQueue->pxBufferPool, &pvBuffer,
+                             pxHigherPriorityTaskWoken) != pdPASS) {
+        pvBuffer = NULL;
+    }
+
+    return pvBuffer;
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+BaseType_t xQueueSendLoan(QueueHandle_t xQueue, void *pvBuffer,
+                          TickType_t xTicksToWait)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+    configASSERT(queueIS_POOL_BUFFER(pxQueue->pxBufferPool, pvBuffer));
+
+    return xQueueGenericSend(pxQueue, &pvBuffer, xTicksToWait,
+                             queueSEND_TO_BACK);
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+BaseType_t xQueueSendLoanFromISR(QueueHandle_t xQueue, void *pvBuffer,
+                                 BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+    configASSERT(queueIS_POOL_BUFFER(pxQueue->pxBufferPool, pvBuffer));
+
+    return xQueueGenericSendFromISR(pxQueue, &pvBuffer,
+                                    pxHigherPriorityTaskWoken,
+                                    queueSEND_TO_BACK);
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+BaseType_t xQueueReceiveLoan(QueueHandle_t xQueue, void **ppvBuffer,
+                             TickType_t xTicksToWait)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+    configASSERT(ppvBuffer);
+
+    return xQueueGenericReceive(pxQueue, ppvBuffer, xTicksToWait, pdFALSE);
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+void vQueueReturnBuffer(QueueHandle_t xQueue, void *pvBuffer)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+    BaseType_t xReturn;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+    configASSERT(queueIS_POOL_BUFFER(pxQueue->pxBufferPool, pvBuffer));
+
+    /* The pool holds every buffer, so there is always room to return one. */
+    xReturn = xQueueGenericSend(pxQueue->pxBufferPool, &pvBuffer,
+                                (TickType_t)0, queueSEND_TO_BACK);
+    configASSERT(xReturn == pdPASS);
+    (void)xReturn;
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
+/*-----------------------------------------------------------*/
+
+#if (configUSE_ZERO_COPY_QUEUES == 1)
+
+void vQueueReturnBufferFromISR(QueueHandle_t xQueue, void *pvBuffer,
+                               BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    Queue_t *const pxQueue = (Queue_t *)xQueue;
+    BaseType_t xReturn;
+
+    configASSERT(pxQueue);
+    configASSERT(pxQueue->pxBufferPool);
+    configASSERT(queueIS_POOL_BUFFER(pxQueue->pxBufferPool, pvBuffer));
+
+    xReturn = xQueueGenericSendFromISR(pxQueue->pxBufferPool, &pvBuffer,
+                                       pxHigherPriorityTaskWoken,
+                                       queueSEND_TO_BACK);
+    configASSERT(xReturn == pdPASS);
+    (void)xReturn;
+}
+
+#endif /* configUSE_ZERO_COPY_QUEUES */
@@ -0,0 +1,437 @@
+/*
+ * Single sender, single receiver stream and message buffers, see
+ * stream_buffer.h and message_buffer.h.
+ *
+ * The buffer keeps two free running byte counts.  Only the sender advances
+ * xHead and only the receiver advances xTail, their difference is the
+ * number of bytes held and their value modulo the buffer length is the
+ * position to write or read next.  A side loads the count of the other side
+ * with acquire semantics and stores its own with release semantics, which
+ * orders the copies against the count, so no lock is needed.
+ *
+ * A side that blocks stores its notification target, the task handle unless
+ * the port defines portNOTIFY_TARGET_TYPE, before it checks the buffer a
+ * last time, the other side checks for a waiting task after it stored its
+ * count.  Both use sequentially consistent accesses for this, so either the
+ * blocking side sees the new data or space, or the other side sees the
+ * task and notifies it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stream_buffer.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#if ( configUSE_TASK_NOTIFICATIONS != 1 )
+#error configUSE_TASK_NOTIFICATIONS must be set to 1 to build stream_buffer.c
+#endif
+
+#if ( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
+#error stream_buffer.c only supports dynamically allocated buffers
+#endif
+
+/* Message buffers store the length of each message in front of it. */
+#define sbBYTES_TO_STORE_MESSAGE_LENGTH ( sizeof( size_t ) )
+
+#define sbFLAGS_IS_MESSAGE_BUFFER       ( ( uint8_t ) 1 )
+
+typedef struct xSTREAM_BUFFER {
+    _Atomic size_t xHead;                           /* Bytes ever written, only advanced by the sender. */
+    _Atomic size_t xTail;                           /* Bytes ever read, only advanced by the receiver. */
+    size_t xLength;                                 /* Size of the storage area. */
+    size_t xTriggerLevelBytes;                      /* Bytes that unblock a waiting receiver. */
+    _Atomic(portNOTIFY_TARGET_TYPE) xTaskWaitingToReceive;
+    _Atomic(portNOTIFY_TARGET_TYPE) xTaskWaitingToSend;
+    uint8_t ucFlags;
+    uint8_t *pucBuffer;                             /* Storage area, follows the structure. */
+} StreamBuffer_t;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Copies xCount bytes between the storage area, starting at the free running
+ * position xPosition, and pucData, wrapping around the end of the storage.
+ */
+static void prvWriteBytes(StreamBuffer_t *const pxStreamBuffer, const uint8_t *pucData, size_t xCount, size_t xPosition) PRIVILEGED_FUNCTION;
+static void prvReadBytes(const StreamBuffer_t *const pxStreamBuffer, uint8_t *pucData, size_t xCount, size_t xPosition) PRIVILEGED_FUNCTION;
+
+/*
+ * Write or read as much as possible without blocking, return the number of
+ * payload bytes copied.
+ */
+static size_t prvWriteToBuffer(StreamBuffer_t *const pxStreamBuffer, const void *pvTxData, size_t xDataLengthBytes) PRIVILEGED_FUNCTION;
+static size_t prvReadFromBuffer(StreamBuffer_t *const pxStreamBuffer, void *pvRxData, size_t xBufferLengthBytes) PRIVILEGED_FUNCTION;
+
+/*
+ * Whether a send of xDataLengthBytes or a receive could complete without
+ * blocking.
+ */
+static BaseType_t prvCanSend(StreamBuffer_t *const pxStreamBuffer, size_t xDataLengthBytes) PRIVILEGED_FUNCTION;
+static BaseType_t prvCanReceive(StreamBuffer_t *const pxStreamBuffer) PRIVILEGED_FUNCTION;
+
+/*
+ * Takes the task waiting on the other side of the buffer if it can continue,
+ * the caller notifies it.
+ */
+static portNOTIFY_TARGET_TYPE prvTakeWaitingReceiver(StreamBuffer_t *const pxStreamBuffer) PRIVILEGED_FUNCTION;
+static portNOTIFY_TARGET_TYPE prvTakeWaitingSender(StreamBuffer_t *const pxStreamBuffer) PRIVILEGED_FUNCTION;
+
+/*-----------------------------------------------------------*/
+
+StreamBufferHandle_t xStreamBufferGenericCreate(size_t xBufferSizeBytes, size_t xTriggerLevelBytes, BaseType_t xIsMessageBuffer)
+{
+    StreamBuffer_t *pxStreamBuffer;
+
+    /* A message buffer must at least hold one byte long messages. */
+    if (xIsMessageBuffer != pdFALSE) {
+        configASSERT(xBufferSizeBytes > sbBYTES_TO_STORE_MESSAGE_LENGTH);
+        xTriggerLevelBytes = 1;
+    }
+    configASSERT(xBufferSizeBytes > 0);
+
+    if (xTriggerLevelBytes == (size_t)0) {
+        xTriggerLevelBytes = 1;
+    }
+    else if (xTriggerLevelBytes > xBufferSizeBytes) {
+        xTriggerLevelBytes = xBufferSizeBytes;
+    }
+
+    /* The storage area follows the structure in the same allocation. */
+    pxStreamBuffer = (StreamBuffer_t *)pvPortMalloc(sizeof(StreamBuffer_t) + xBufferSizeBytes);
+
+    if (pxStreamBuffer != NULL) {
+        atomic_init(&(pxStreamBuffer->xHead), (size_t)0);
+        atomic_init(&(pxStreamBuffer->xTail), (size_t)0);
+        pxStreamBuffer->xLength = xBufferSizeBytes;
+        pxStreamBuffer->xTriggerLevelBytes = xTriggerLevelBytes;
+        atomic_init(&(pxStreamBuffer->xTaskWaitingToReceive), portNOTIFY_TARGET_NONE);
+        atomic_init(&(pxStreamBuffer->xTaskWaitingToSend), portNOTIFY_TARGET_NONE);
+        pxStreamBuffer->ucFlags = (xIsMessageBuffer != pdFALSE) ? sbFLAGS_IS_MESSAGE_BUFFER : (uint8_t)0;
+        pxStreamBuffer->pucBuffer = (uint8_t *)(pxStreamBuffer + 1);
+    }
+
+    return (StreamBufferHandle_t)pxStreamBuffer;
+}
+/*-----------------------------------------------------------*/
+
+void vStreamBufferDelete(StreamBufferHandle_t xStreamBuffer)
+{
+    configASSERT(xStreamBuffer);
+    vPortFree(xStreamBuffer);
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferSend(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+    TimeOut_t xTimeOut;
+    portNOTIFY_TARGET_TYPE xTaskToNotify;
+    size_t xSent;
+
+    configASSERT(pxStreamBuffer);
+    configASSERT(pvTxData || (xDataLengthBytes == (size_t)0));
+
+    /* Nothing to send, and a message that can never fit, is not waited for. */
+    if ((xDataLengthBytes == (size_t)0) ||
+        (((pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER) != 0) &&
+         (xDataLengthBytes > (pxStreamBuffer->xLength - sbBYTES_TO_STORE_MESSAGE_LENGTH)))) {
+        return 0;
+    }
+
+    vTaskSetTimeOutState(&xTimeOut);
+
+    while ((xTicksToWait > (TickType_t)0) && (prvCanSend(pxStreamBuffer, xDataLengthBytes) == pdFALSE)) {
+        /* Announce the wait before the last check, see the top of the file. */
+        atomic_store(&(pxStreamBuffer->xTaskWaitingToSend), portGET_NOTIFY_TARGET());
+        if (prvCanSend(pxStreamBuffer, xDataLengthBytes) == pdFALSE) {
+            (void)ulTaskNotifyTake(pdTRUE, xTicksToWait);
+        }
+        atomic_store(&(pxStreamBuffer->xTaskWaitingToSend), portNOTIFY_TARGET_NONE);
+
+        if (xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) != pdFALSE) {
+            break;
+        }
+    }
+
+    xSent = prvWriteToBuffer(pxStreamBuffer, pvTxData, xDataLengthBytes);
+
+    if (xSent > (size_t)0) {
+        xTaskToNotify = prvTakeWaitingReceiver(pxStreamBuffer);
+        if (xTaskToNotify != portNOTIFY_TARGET_NONE) {
+            portNOTIFY_GIVE(xTaskToNotify);
+        }
+    }
+
+    return xSent;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t xStreamBuffer, const void *pvTxData, size_t xDataLengthBytes, BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+    portNOTIFY_TARGET_TYPE xTaskToNotify;
+    size_t xSent;
+
+    configASSERT(pxStreamBuffer);
+    configASSERT(pvTxData || (xDataLengthBytes == (size_t)0));
+
+    xSent = prvWriteToBuffer(pxStreamBuffer, pvTxData, xDataLengthBytes);
+
+    if (xSent > (size_t)0) {
+        xTaskToNotify = prvTakeWaitingReceiver(pxStreamBuffer);
+        if (xTaskToNotify != portNOTIFY_TARGET_NONE) {
+            portNOTIFY_GIVE_FROM_ISR(xTaskToNotify, pxHigherPriorityTaskWoken);
+        }
+    }
+
+    return xSent;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferReceive(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+    TimeOut_t xTimeOut;
+    portNOTIFY_TARGET_TYPE xTaskToNotify;
+    size_t xReceived;
+
+    configASSERT(pxStreamBuffer);
+    configASSERT(pvRxData || (xBufferLengthBytes == (size_t)0));
+
+    vTaskSetTimeOutState(&xTimeOut);
+
+    while ((xTicksToWait > (TickType_t)0) && (prvCanReceive(pxStreamBuffer) == pdFALSE)) {
+        /* Announce the wait before the last check, see the top of the file. */
+        atomic_store(&(pxStreamBuffer->xTaskWaitingToReceive), portGET_NOTIFY_TARGET());
+        if (prvCanReceive(pxStreamBuffer) == pdFALSE) {
+            (void)ulTaskNotifyTake(pdTRUE, xTicksToWait);
+        }
+        atomic_store(&(pxStreamBuffer->xTaskWaitingToReceive), portNOTIFY_TARGET_NONE);
+
+        if (xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) != pdFALSE) {
+            break;
+        }
+    }
+
+    xReceived = prvReadFromBuffer(pxStreamBuffer, pvRxData, xBufferLengthBytes);
+
+    if (xReceived > (size_t)0) {
+        xTaskToNotify = prvTakeWaitingSender(pxStreamBuffer);
+        if (xTaskToNotify != portNOTIFY_TARGET_NONE) {
+            portNOTIFY_GIVE(xTaskToNotify);
+        }
+    }
+
+    return xReceived;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferReceiveFromISR(StreamBufferHandle_t xStreamBuffer, void *pvRxData, size_t xBufferLengthBytes, BaseType_t *const pxHigherPriorityTaskWoken)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+    portNOTIFY_TARGET_TYPE xTaskToNotify;
+    size_t xReceived;
+
+    configASSERT(pxStreamBuffer);
+    configASSERT(pvRxData || (xBufferLengthBytes == (size_t)0));
+
+    xReceived = prvReadFromBuffer(pxStreamBuffer, pvRxData, xBufferLengthBytes);
+
+    if (xReceived > (size_t)0) {
+        xTaskToNotify = prvTakeWaitingSender(pxStreamBuffer);
+        if (xTaskToNotify != portNOTIFY_TARGET_NONE) {
+            portNOTIFY_GIVE_FROM_ISR(xTaskToNotify, pxHigherPriorityTaskWoken);
+        }
+    }
+
+    return xReceived;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t xStreamBuffer)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+    size_t xTail;
+
+    configASSERT(pxStreamBuffer);
+
+    /* The tail is read first, so the difference can not underflow. */
+    xTail = atomic_load_explicit(&(pxStreamBuffer->xTail), memory_order_acquire);
+    return atomic_load_explicit(&(pxStreamBuffer->xHead), memory_order_acquire) - xTail;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t xStreamBuffer)
+{
+    StreamBuffer_t *const pxStreamBuffer = (StreamBuffer_t *)xStreamBuffer;
+
+    configASSERT(pxStreamBuffer);
+
+    return pxStreamBuffer->xLength - xStreamBufferBytesAvailable(xStreamBuffer);
+}
+/*-----------------------------------------------------------*/
+
+static void prvWriteBytes(StreamBuffer_t *const pxStreamBuffer, const uint8_t *pucData, size_t xCount, size_t xPosition)
+{
+    size_t xOffset = xPosition % pxStreamBuffer->xLength;
+    size_t xFirst = pxStreamBuffer->xLength - xOffset;
+
+    if (xFirst > xCount) {
+        xFirst = xCount;
+    }
+
+    (void)memcpy(&(pxStreamBuffer->pucBuffer[xOffset]), pucData, xFirst);
+    (void)memcpy(pxStreamBuffer->pucBuffer, &(pucData[xFirst]), xCount - xFirst);
+}
+/*-----------------------------------------------------------*/
+
+static void prvReadBytes(const StreamBuffer_t *const pxStreamBuffer, uint8_t *pucData, size_t xCount, size_t xPosition)
+{
+    size_t xOffset = xPosition % pxStreamBuffer->xLength;
+    size_t xFirst = pxStreamBuffer->xLength - xOffset;
+
+    if (xFirst > xCount) {
+        xFirst = xCount;
+    }
+
+    (void)memcpy(pucData, &(pxStreamBuffer->pucBuffer[xOffset]), xFirst);
+    (void)memcpy(&(pucData[xFirst]), pxStreamBuffer->pucBuffer, xCount - xFirst);
+}
+/*-----------------------------------------------------------*/
+
+static size_t prvWriteToBuffer(StreamBuffer_t *const pxStreamBuffer, const void *pvTxData, size_t xDataLengthBytes)
+{
+    size_t xHead = atomic_load_explicit(&(pxStreamBuffer->xHead), memory_order_relaxed);
+    size_t xTail = atomic_load_explicit(&(pxStreamBuffer->xTail), memory_order_acquire);
+    size_t xSpace = pxStreamBuffer->xLength - (xHead - xTail);
+
+    if ((pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER) != 0) {
+        /* Whole messages only. An empty message is not stored, receiving it
+         * could not be told apart from a timeout. */
+        if ((xDataLengthBytes == (size_t)0) ||
+            (xSpace < (xDataLengthBytes + sbBYTES_TO_STORE_MESSAGE_LENGTH))) {
+            return 0;
+        }
+
+        prvWriteBytes(pxStreamBuffer, (const uint8_t *)&xDataLengthBytes, sbBYTES_TO_STORE_MESSAGE_LENGTH, xHead);
+        xHead += sbBYTES_TO_STORE_MESSAGE_LENGTH;
+    }
+    else if (xDataLengthBytes > xSpace) {
+        xDataLengthBytes = xSpace;
+    }
+
+    if (xDataLengthBytes > (size_t)0) {
+        prvWriteBytes(pxStreamBuffer, (const uint8_t *)pvTxData, xDataLengthBytes, xHead);
+    }
+
+    /* Publishes the bytes, and the length of a message with them. */
+    atomic_store_explicit(&(pxStreamBuffer->xHead), xHead + xDataLengthBytes, memory_order_release);
+
+    return xDataLengthBytes;
+}
+/*-----------------------------------------------------------*/
+
+static size_t prvReadFromBuffer(StreamBuffer_t *const pxStreamBuffer, void *pvRxData, size_t xBufferLengthBytes)
+{
+    size_t xTail = atomic_load_explicit(&(pxStreamBuffer->xTail), memory_order_relaxed);
+    size_t xHead = atomic_load_explicit(&(pxStreamBuffer->xHead), memory_order_acquire);
+    size_t xAvailable = xHead - xTail;
+    size_t xMessageLength;
+
+    if ((pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER) != 0) {
+        if (xAvailable == (size_t)0) {
+            return 0;
+        }
+
+        /* A message that does not fit stays in the buffer. */
+        prvReadBytes(pxStreamBuffer, (uint8_t *)&xMessageLength, sbBYTES_TO_STORE_MESSAGE_LENGTH, xTail);
+        if (xMessageLength > xBufferLengthBytes) {
+            return 0;
+        }
+
+        xTail += sbBYTES_TO_STORE_MESSAGE_LENGTH;
+        xAvailable = xMessageLength;
+    }
+    else if (xAvailable > xBufferLengthBytes) {
+        xAvailable = xBufferLengthBytes;
+    }
+
+    if (xAvailable > (size_t)0) {
+        prvReadBytes(pxStreamBuffer, (uint8_t *)pvRxData, xAvailable, xTail);
+    }
+
+    /* Hands the space back once the bytes were copied out. */
+    if (xAvailable > (size_t)0) {
+        atomic_store_explicit(&(pxStreamBuffer->xTail), xTail + xAvailable, memory_order_release);
+    }
+
+    return xAvailable;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvCanSend(StreamBuffer_t *const pxStreamBuffer, size_t xDataLengthBytes)
+{
+    size_t xHead = atomic_load(&(pxStreamBuffer->xHead));
+    size_t xSpace = pxStreamBuffer->xLength - (xHead - atomic_load(&(pxStreamBuffer->xTail)));
+
+    if ((pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER) != 0) {
+        xDataLengthBytes += sbBYTES_TO_STORE_MESSAGE_LENGTH;
+    }
+    else if (xDataLengthBytes > pxStreamBuffer->xLength - pxStreamBuffer->xTriggerLevelBytes + 1) {
+        /* A receiver waiting for the trigger level leaves at least this much
+         * space, waiting for more would never end. The rest is sent with
+         * another call. */
+        xDataLengthBytes = pxStreamBuffer->xLength - pxStreamBuffer->xTriggerLevelBytes + 1;
+    }
+
+    return (xSpace >= xDataLengthBytes) ? pdTRUE : pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvCanReceive(StreamBuffer_t *const pxStreamBuffer)
+{
+    size_t xTail = atomic_load(&(pxStreamBuffer->xTail));
+    size_t xAvailable = atomic_load(&(pxStreamBuffer->xHead)) - xTail;
+
+    /* Messages are published whole, any byte means there is one. */
+    return (xAvailable >= pxStreamBuffer->xTriggerLevelBytes) ? pdTRUE : pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static portNOTIFY_TARGET_TYPE prvTakeWaitingReceiver(StreamBuffer_t *const pxStreamBuffer)
+{
+    /* Orders the store of the head before the load of the waiting task. */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if ((atomic_load(&(pxStreamBuffer->xTaskWaitingToReceive)) == portNOTIFY_TARGET_NONE) ||
+        (prvCanReceive(pxStreamBuffer) == pdFALSE)) {
+        return portNOTIFY_TARGET_NONE;
+    }
+
+    return atomic_exchange(&(pxStreamBuffer->xTaskWaitingToReceive), portNOTIFY_TARGET_NONE);
+}
+/*-----------------------------------------------------------*/
+
+static portNOTIFY_TARGET_TYPE prvTakeWaitingSender(StreamBuffer_t *const pxStreamBuffer)
+{
+    /* Orders the store of the tail before the load of the waiting task. */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load(&(pxStreamBuffer->xTaskWaitingToSend)) == portNOTIFY_TARGET_NONE) {
+        return portNOTIFY_TARGET_NONE;
+    }
+
+    /* The sender checks again whether the space suffices. */
+    return atomic_exchange(&(pxStreamBuffer->xTaskWaitingToSend), portNOTIFY_TARGET_NONE);
+}
+/*-----------------------------------------------------------*/
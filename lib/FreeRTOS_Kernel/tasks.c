@@ -153,6 +153,14 @@ a statically allocated stack and a dynamically allocated TCB. */
 #define static
 #endif
 
+#if ( ( configNUMBER_OF_CORES > 1 ) && ( configUSE_PORT_OPTIMISED_TASK_SELECTION != 0 ) )
+#error configUSE_PORT_OPTIMISED_TASK_SELECTION must be 0 if configNUMBER_OF_CORES is greater than 1
+#endif
+
+#if ( ( configNUMBER_OF_CORES > 1 ) && ( configSUPPORT_STATIC_ALLOCATION == 1 ) )
+#error The idle tasks cannot be statically allocated if configNUMBER_OF_CORES is greater than 1
+#endif
+
 #if ( configUSE_PORT_OPTIMISED_TASK_SELECTION == 0 )
 
 /* If configUSE_PORT_OPTIMISED_TASK_SELECTION is 0 then task selection is
@@ -171,6 +179,13 @@ state task. */
 
 /*-----------------------------------------------------------*/
 
+#if ( configNUMBER_OF_CORES > 1 )
+
+/* Each core selects for itself, skipping the tasks running on other cores. */
+#define taskSELECT_HIGHEST_PRIORITY_TASK()  prvSelectHighestPriorityTask( portGET_CORE_ID() )
+
+#else
+
 #define taskSELECT_HIGHEST_PRIORITY_TASK()                                                          \
     {                                                                                                   \
         UBaseType_t uxTopPriority = uxTopReadyPriority;                                                     \
@@ -188,6 +203,8 @@ state task. */
         uxTopReadyPriority = uxTopPriority;                                                             \
     } /* taskSELECT_HIGHEST_PRIORITY_TASK */
 
+#endif /* configNUMBER_OF_CORES */
+
 /*-----------------------------------------------------------*/
 
 /* Define away taskRESET_READY_PRIORITY() and portRESET_READY_PRIORITY() as
@@ -330,7 +347,7 @@ typedef struct tskTaskControlBlock {
 #endif
 
 #if( configGENERATE_RUN_TIME_STATS == 1 )
-    uint32_t        ulRunTimeCounter;   /*< Stores the amount of time the task has spent in the Running state. */
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter; /*< Stores the amount of time the task has spent in the Running state. */
 #endif
 
 #if ( configUSE_NEWLIB_REENTRANT == 1 )
@@ -359,6 +376,11 @@ typedef struct tskTaskControlBlock {
     uint8_t ucDelayAborted;
 #endif
 
+#if ( configNUMBER_OF_CORES > 1 )
+    volatile BaseType_t xTaskRunState;  /*< The core the task is running on, or taskTASK_NOT_RUNNING. */
+    UBaseType_t     uxCoreAffinityMask; /*< Bit n is set if the task may run on core n. */
+#endif
+
 } tskTCB;
 
 /* The old tskTCB name is maintained above then typedefed to the new TCB_t name
@@ -368,8 +390,26 @@ typedef tskTCB TCB_t;
 /*lint -e956 A manual analysis and inspection has been used to determine which
 static variables must be declared volatile. */
 
+#if ( configNUMBER_OF_CORES == 1 )
+
 PRIVILEGED_DATA TCB_t *volatile pxCurrentTCB = NULL;
 
+#else
+
+/* xTaskRunState of a task that is not running on any core. */
+#define taskTASK_NOT_RUNNING    ( ( BaseType_t ) -1 )
+
+/* Bit of core xCoreID in a core affinity mask. */
+#define taskCORE_BIT( xCoreID ) ( ( UBaseType_t ) 1U << ( UBaseType_t ) ( xCoreID ) )
+
+PRIVILEGED_DATA TCB_t *volatile pxCurrentTCBs[ configNUMBER_OF_CORES ];
+
+/* The task running on the calling core.  The core of a thread only changes
+while its interrupts are enabled, so it is read with interrupts masked. */
+#define pxCurrentTCB    ( ( TCB_t * ) xTaskGetCurrentTaskHandle() )
+
+#endif /* configNUMBER_OF_CORES */
+
 /* Lists for ready and blocked tasks. --------------------*/
 PRIVILEGED_DATA static List_t pxReadyTasksLists[ configMAX_PRIORITIES ];/*< Prioritised ready tasks. */
 PRIVILEGED_DATA static List_t xDelayedTaskList1;                        /*< Delayed tasks. */
@@ -397,12 +437,21 @@ PRIVILEGED_DATA static volatile TickType_t xTickCount               = (TickType_
 PRIVILEGED_DATA static volatile UBaseType_t uxTopReadyPriority      = tskIDLE_PRIORITY;
 PRIVILEGED_DATA static volatile BaseType_t xSchedulerRunning        = pdFALSE;
 PRIVILEGED_DATA static volatile UBaseType_t uxPendedTicks           = (UBaseType_t) 0U;
+#if ( configNUMBER_OF_CORES == 1 )
 PRIVILEGED_DATA static volatile BaseType_t xYieldPending            = pdFALSE;
+#else
+PRIVILEGED_DATA static volatile BaseType_t xYieldPendings[ configNUMBER_OF_CORES ];
+#define xYieldPending   xYieldPendings[ portGET_CORE_ID() ]
+#endif
 PRIVILEGED_DATA static volatile BaseType_t xNumOfOverflows          = (BaseType_t) 0;
 PRIVILEGED_DATA static UBaseType_t uxTaskNumber                     = (UBaseType_t) 0U;
 PRIVILEGED_DATA static volatile TickType_t xNextTaskUnblockTime     = (TickType_t) 0U;   /* Initialised to portMAX_DELAY before the scheduler starts. */
 PRIVILEGED_DATA static TaskHandle_t xIdleTaskHandle                 = NULL;         /*< Holds the handle of the idle task.  The idle task is created automatically when the scheduler is started. */
 
+#if ( configNUMBER_OF_CORES > 1 )
+PRIVILEGED_DATA static TaskHandle_t xIdleTaskHandles[ configNUMBER_OF_CORES ];     /*< One idle task per core, xIdleTaskHandle is the first of them. */
+#endif
+
 /* Context switches are held pending while the scheduler is suspended.  Also,
 interrupts must not manipulate the xStateListItem of a TCB, or any of the
 lists the xStateListItem can be referenced from, if the scheduler is suspended.
@@ -415,8 +464,13 @@ PRIVILEGED_DATA static volatile UBaseType_t uxSchedulerSuspended    = (UBaseType
 
 #if ( configGENERATE_RUN_TIME_STATS == 1 )
 
-PRIVILEGED_DATA static uint32_t ulTaskSwitchedInTime = 0UL; /*< Holds the value of a timer/counter the last time a task was switched in. */
-PRIVILEGED_DATA static uint32_t ulTotalRunTime = 0UL;       /*< Holds the total amount of execution time as defined by the run time counter clock. */
+#if ( configNUMBER_OF_CORES == 1 )
+PRIVILEGED_DATA static configRUN_TIME_COUNTER_TYPE ulTaskSwitchedInTime = 0UL; /*< Holds the value of a timer/counter the last time a task was switched in. */
+#else
+PRIVILEGED_DATA static configRUN_TIME_COUNTER_TYPE ulTaskSwitchedInTimes[ configNUMBER_OF_CORES ];
+#define ulTaskSwitchedInTime    ulTaskSwitchedInTimes[ portGET_CORE_ID() ]
+#endif
+PRIVILEGED_DATA static configRUN_TIME_COUNTER_TYPE ulTotalRunTime = 0UL; /*< Holds the total amount of execution time as defined by the run time counter clock. */
 
 #endif
 
@@ -578,6 +632,30 @@ static void prvInitialiseNewTask(TaskFunction_t pxTaskCode,
  */
 static void prvAddNewTaskToReadyList(TCB_t *pxNewTCB) PRIVILEGED_FUNCTION;
 
+#if ( configNUMBER_OF_CORES > 1 )
+
+/*
+ * Selects the task core xCoreID runs next: the highest priority ready task
+ * that is allowed on the core and not already running on another core.
+ */
+static void prvSelectHighestPriorityTask(BaseType_t xCoreID) PRIVILEGED_FUNCTION;
+
+/*
+ * Called when pxTCB has become ready.  Finds the core running the lowest
+ * priority task below that of pxTCB and asks it to reschedule.  Returns pdTRUE
+ * if that is the calling core, in which case the caller yields as it would
+ * with a single core.
+ */
+static BaseType_t prvYieldForTask(TCB_t *pxTCB) PRIVILEGED_FUNCTION;
+
+/*
+ * Returns pdTRUE if a task other than an idle task is ready to run on core
+ * xCoreID at the priority of the task running there, but is not running.
+ */
+static BaseType_t prvTaskWaitingForCore(BaseType_t xCoreID) PRIVILEGED_FUNCTION;
+
+#endif /* configNUMBER_OF_CORES */
+
 /*-----------------------------------------------------------*/
 
 #if( configSUPPORT_STATIC_ALLOCATION == 1 )
@@ -912,6 +990,13 @@ static void prvInitialiseNewTask(TaskFunction_t pxTaskCode,
     }
 #endif
 
+#if ( configNUMBER_OF_CORES > 1 )
+    {
+        pxNewTCB->xTaskRunState = taskTASK_NOT_RUNNING;
+        pxNewTCB->uxCoreAffinityMask = tskNO_AFFINITY;
+    }
+#endif
+
     /* Initialize the TCB stack to look as if the task was already running,
     but had been interrupted by the scheduler.  The return address is set
     to the start of the task function. Once the stack has been initialised
@@ -944,6 +1029,18 @@ static void prvAddNewTaskToReadyList(TCB_t *pxNewTCB)
     taskENTER_CRITICAL();
     {
         uxCurrentNumberOfTasks++;
+#if ( configNUMBER_OF_CORES > 1 )
+        {
+            /* The tasks each core starts with are selected once they have
+            all been created, see vTaskStartScheduler(). */
+            if (uxCurrentNumberOfTasks == (UBaseType_t) 1) {
+                prvInitialiseTaskLists();
+            }
+            else {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+#else
         if (pxCurrentTCB == NULL) {
             /* There are no other tasks, or all the other tasks are in
             the suspended state - make this the current task. */
@@ -975,6 +1072,7 @@ static void prvAddNewTaskToReadyList(TCB_t *pxNewTCB)
                 mtCOVERAGE_TEST_MARKER();
             }
         }
+#endif /* configNUMBER_OF_CORES */
 
         uxTaskNumber++;
 
@@ -989,9 +1087,28 @@ static void prvAddNewTaskToReadyList(TCB_t *pxNewTCB)
         prvAddTaskToReadyList(pxNewTCB);
 
         portSETUP_TCB(pxNewTCB);
+
+#if ( configNUMBER_OF_CORES > 1 )
+        {
+            /* The new task preempts whichever core runs the lowest priority
+            task, the yield is taken when the critical section is left. */
+            if (xSchedulerRunning != pdFALSE) {
+                if (prvYieldForTask(pxNewTCB) != pdFALSE) {
+                    taskYIELD_IF_USING_PREEMPTION();
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+            else {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+#endif /* configNUMBER_OF_CORES */
     }
     taskEXIT_CRITICAL();
 
+#if ( configNUMBER_OF_CORES == 1 )
     if (xSchedulerRunning != pdFALSE) {
         /* If the created task is of a higher priority than the current task
         then it should run now. */
@@ -1005,6 +1122,7 @@ static void prvAddNewTaskToReadyList(TCB_t *pxNewTCB)
     else {
         mtCOVERAGE_TEST_MARKER();
     }
+#endif /* configNUMBER_OF_CORES */
 }
 /*-----------------------------------------------------------*/
 
@@ -1042,7 +1160,12 @@ void vTaskDelete(TaskHandle_t xTaskToDelete)
         not return. */
         uxTaskNumber++;
 
-        if (pxTCB == pxCurrentTCB) {
+#if ( configNUMBER_OF_CORES > 1 )
+        if (pxTCB->xTaskRunState != taskTASK_NOT_RUNNING)
+#else
+        if (pxTCB == pxCurrentTCB)
+#endif
+        {
             /* A task is deleting itself.  This cannot complete within the
             task itself, as a context switch to another task is required.
             Place the task in the termination list.  The idle task will
@@ -1061,6 +1184,19 @@ void vTaskDelete(TaskHandle_t xTaskToDelete)
             hence xYieldPending is used to latch that a context switch is
             required. */
             portPRE_TASK_DELETE_HOOK(pxTCB, &xYieldPending);
+
+#if ( configNUMBER_OF_CORES > 1 )
+            {
+                /* The task is running on another core, which has to switch
+                away from it before it can be cleaned up. */
+                if (pxTCB->xTaskRunState != portGET_CORE_ID()) {
+                    portYIELD_CORE(pxTCB->xTaskRunState);
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+#endif /* configNUMBER_OF_CORES */
         }
         else {
             --uxCurrentNumberOfTasks;
@@ -1216,10 +1352,17 @@ eTaskState eTaskGetState(TaskHandle_t xTask)
 
     configASSERT(pxTCB);
 
+#if ( configNUMBER_OF_CORES > 1 )
+    if (pxTCB->xTaskRunState != taskTASK_NOT_RUNNING) {
+        /* The task is running on this or on another core. */
+        eReturn = eRunning;
+    }
+#else
     if (pxTCB == pxCurrentTCB) {
         /* The task calling this function is querying its own state. */
         eReturn = eRunning;
     }
+#endif
     else {
         taskENTER_CRITICAL();
         {
@@ -1368,6 +1511,7 @@ void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
 #endif
 
         if (uxCurrentBasePriority != uxNewPriority) {
+#if ( configNUMBER_OF_CORES == 1 )
             /* The priority change may have readied a task of higher
             priority than the calling task. */
             if (uxNewPriority > uxCurrentBasePriority) {
@@ -1399,6 +1543,7 @@ void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
                 require a yield as the running task must be above the
                 new priority of the task being modified. */
             }
+#endif /* configNUMBER_OF_CORES */
 
             /* Remember the ready list the task might be referenced from
             before its uxPriority member is changed so the
@@ -1457,6 +1602,35 @@ void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
                 mtCOVERAGE_TEST_MARKER();
             }
 
+#if ( configNUMBER_OF_CORES > 1 )
+            {
+                if (pxTCB->xTaskRunState != taskTASK_NOT_RUNNING) {
+                    /* Setting the priority of a running task down means a
+                    task waiting for a core may now be of higher priority. */
+                    if (uxNewPriority < uxCurrentBasePriority) {
+                        if (pxTCB->xTaskRunState == portGET_CORE_ID()) {
+                            xYieldRequired = pdTRUE;
+                        }
+                        else {
+                            portYIELD_CORE(pxTCB->xTaskRunState);
+                        }
+                    }
+                    else {
+                        mtCOVERAGE_TEST_MARKER();
+                    }
+                }
+                else if ((uxNewPriority > uxCurrentBasePriority) &&
+                         (listIS_CONTAINED_WITHIN(&(pxReadyTasksLists[ pxTCB->uxPriority ]), &(pxTCB->xStateListItem)) != pdFALSE)) {
+                    /* A ready task raised above the task running on some
+                    core preempts it. */
+                    xYieldRequired = prvYieldForTask(pxTCB);
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+#endif /* configNUMBER_OF_CORES */
+
             if (xYieldRequired != pdFALSE) {
                 taskYIELD_IF_USING_PREEMPTION();
             }
@@ -1507,6 +1681,20 @@ void vTaskSuspend(TaskHandle_t xTaskToSuspend)
         }
 
         vListInsertEnd(&xSuspendedTaskList, &(pxTCB->xStateListItem));
+
+#if ( configNUMBER_OF_CORES > 1 )
+        {
+            /* A task running on another core stops once that core has
+            switched away from it. */
+            if ((pxTCB->xTaskRunState != taskTASK_NOT_RUNNING) &&
+                (pxTCB->xTaskRunState != portGET_CORE_ID())) {
+                portYIELD_CORE(pxTCB->xTaskRunState);
+            }
+            else {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+#endif /* configNUMBER_OF_CORES */
     }
     taskEXIT_CRITICAL();
 
@@ -1530,6 +1718,7 @@ void vTaskSuspend(TaskHandle_t xTaskToSuspend)
             portYIELD_WITHIN_API();
         }
         else {
+#if ( configNUMBER_OF_CORES == 1 )
             /* The scheduler is not running, but the task that was pointed
             to by pxCurrentTCB has just been suspended and pxCurrentTCB
             must be adjusted to point to a different task. */
@@ -1543,6 +1732,11 @@ void vTaskSuspend(TaskHandle_t xTaskToSuspend)
             else {
                 vTaskSwitchContext();
             }
+#else
+            /* No task runs on any core before the scheduler selects them
+            in vTaskStartScheduler(). */
+            mtCOVERAGE_TEST_MARKER();
+#endif /* configNUMBER_OF_CORES */
         }
     }
     else {
@@ -1616,7 +1810,12 @@ void vTaskResume(TaskHandle_t xTaskToResume)
                 prvAddTaskToReadyList(pxTCB);
 
                 /* We may have just resumed a higher priority task. */
-                if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+                if (prvYieldForTask(pxTCB) != pdFALSE)
+#else
+                if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority)
+#endif
+                {
                     /* This yield may not cause the task just resumed to run,
                     but will leave the lists in the correct state for the
                     next yield. */
@@ -1678,15 +1877,25 @@ BaseType_t xTaskResumeFromISR(TaskHandle_t xTaskToResume)
             if (uxSchedulerSuspended == (UBaseType_t) pdFALSE) {
                 /* Ready lists can be accessed so move the task from the
                 suspended list to the ready list directly. */
+#if ( configNUMBER_OF_CORES == 1 )
                 if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority) {
                     xYieldRequired = pdTRUE;
                 }
                 else {
                     mtCOVERAGE_TEST_MARKER();
                 }
+#endif
 
                 (void) uxListRemove(&(pxTCB->xStateListItem));
                 prvAddTaskToReadyList(pxTCB);
+
+#if ( configNUMBER_OF_CORES > 1 )
+                {
+                    /* Only the cores can be compared once the task is in
+                    its ready list. */
+                    xYieldRequired = prvYieldForTask(pxTCB);
+                }
+#endif
             }
             else {
                 /* The delayed or ready lists cannot be accessed so the task
@@ -1736,6 +1945,31 @@ void vTaskStartScheduler(void)
             xReturn = pdFAIL;
         }
     }
+#elif ( configNUMBER_OF_CORES > 1 )
+    {
+        BaseType_t xCoreID, x;
+        char cIdleName[ configMAX_TASK_NAME_LEN ];
+
+        /* Each core needs an idle task of its own to run when there is
+        nothing else to do.  They are named IDLE0, IDLE1, ... */
+        xReturn = pdPASS;
+        for (xCoreID = 0; (xCoreID < configNUMBER_OF_CORES) && (xReturn == pdPASS); xCoreID++) {
+            memcpy(cIdleName, "IDLE", 4);
+            x = 4;
+            if (xCoreID >= 10) {
+                cIdleName[ x++ ] = (char)('0' + (xCoreID / 10));
+            }
+            cIdleName[ x++ ] = (char)('0' + (xCoreID % 10));
+            cIdleName[ x ] = '\0';
+
+            xReturn = xTaskCreate(prvIdleTask,
+                                  cIdleName, configMINIMAL_STACK_SIZE,
+                                  (void *) NULL,
+                                  (tskIDLE_PRIORITY | portPRIVILEGE_BIT),
+                                  &xIdleTaskHandles[ xCoreID ]);  /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
+        }
+        xIdleTaskHandle = xIdleTaskHandles[ 0 ];
+    }
 #else
     {
         /* The Idle task is being created using dynamically allocated RAM. */
@@ -1778,6 +2012,18 @@ void vTaskStartScheduler(void)
         xSchedulerRunning = pdTRUE;
         xTickCount = (TickType_t) 0U;
 
+#if ( configNUMBER_OF_CORES > 1 )
+        {
+            BaseType_t xCoreID;
+
+            /* Now that every task exists each core picks the task it
+            starts with. */
+            for (xCoreID = 0; xCoreID < configNUMBER_OF_CORES; xCoreID++) {
+                prvSelectHighestPriorityTask(xCoreID);
+            }
+        }
+#endif /* configNUMBER_OF_CORES */
+
         /* If configGENERATE_RUN_TIME_STATS is defined then the following
         macro must be defined to configure the timer/counter used to generate
         the run time counter time base. */
@@ -1823,6 +2069,13 @@ void vTaskSuspendAll(void)
     BaseType_t.  Please read Richard Barry's reply in the following link to a
     post in the FreeRTOS support forum before reporting this as a bug! -
     http://goo.gl/wu4acr */
+#if ( configNUMBER_OF_CORES > 1 )
+    {
+        /* With several cores the other cores must be kept off the lists as
+        well, so the kernel lock is held until the scheduler is resumed. */
+        portGET_KERNEL_LOCK();
+    }
+#endif /* configNUMBER_OF_CORES */
     ++uxSchedulerSuspended;
 }
 /*----------------------------------------------------------*/
@@ -1914,7 +2167,12 @@ BaseType_t xTaskResumeAll(void)
 
                     /* If the moved task has a priority higher than the current
                     task then a yield must be performed. */
-                    if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+                    if (prvYieldForTask(pxTCB) != pdFALSE)
+#else
+                    if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority)
+#endif
+                    {
                         xYieldPending = pdTRUE;
                     }
                     else {
@@ -1974,6 +2232,14 @@ BaseType_t xTaskResumeAll(void)
         else {
             mtCOVERAGE_TEST_MARKER();
         }
+
+#if ( configNUMBER_OF_CORES > 1 )
+        {
+            /* Taken by vTaskSuspendAll(), the critical section still holds
+            the lock until the yield above has been taken. */
+            portRELEASE_KERNEL_LOCK();
+        }
+#endif /* configNUMBER_OF_CORES */
     }
     taskEXIT_CRITICAL();
 
@@ -2163,7 +2429,7 @@ TaskHandle_t xTaskGetHandle(const char *pcNameToQuery)   /*lint !e971 Unqualifie
 
 #if ( configUSE_TRACE_FACILITY == 1 )
 
-UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize, uint32_t *const pulTotalRunTime)
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize, configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime)
 {
     UBaseType_t uxTask = 0, uxQueue = configMAX_PRIORITIES;
 
@@ -2308,7 +2574,12 @@ BaseType_t xTaskAbortDelay(TaskHandle_t xTask)
                 /* Preemption is on, but a context switch should only be
                 performed if the unblocked task has a priority that is
                 equal to or higher than the currently executing task. */
-                if (pxTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+                if (prvYieldForTask(pxTCB) != pdFALSE)
+#else
+                if (pxTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+                {
                     /* Pend the yield to be performed when the scheduler
                     is unsuspended. */
                     xYieldPending = pdTRUE;
@@ -2417,7 +2688,12 @@ BaseType_t xTaskIncrementTick(void)
                         only be performed if the unblocked task has a
                         priority that is equal to or higher than the
                         currently executing task. */
-                        if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+                        if (prvYieldForTask(pxTCB) != pdFALSE)
+#else
+                        if (pxTCB->uxPriority >= pxCurrentTCB->uxPriority)
+#endif
+                        {
                             xSwitchRequired = pdTRUE;
                         }
                         else {
@@ -2434,12 +2710,36 @@ BaseType_t xTaskIncrementTick(void)
         writer has not explicitly turned time slicing off. */
 #if ( ( configUSE_PREEMPTION == 1 ) && ( configUSE_TIME_SLICING == 1 ) )
         {
+#if ( configNUMBER_OF_CORES > 1 )
+            BaseType_t x, xCoreID;
+
+            /* One core per tick hands its task over to a task of the same
+            priority that is waiting for a core.  The core to start looking
+            at rotates so every core gets its turn. */
+            for (x = 0; x < configNUMBER_OF_CORES; x++) {
+                xCoreID = (BaseType_t)((xConstTickCount + (TickType_t) x) % (TickType_t) configNUMBER_OF_CORES);
+                if (prvTaskWaitingForCore(xCoreID) != pdFALSE) {
+                    if (xCoreID == portGET_CORE_ID()) {
+                        xSwitchRequired = pdTRUE;
+                    }
+                    else {
+                        xYieldPendings[ xCoreID ] = pdTRUE;
+                        portYIELD_CORE(xCoreID);
+                    }
+                    break;
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+#else
             if (listCURRENT_LIST_LENGTH(&(pxReadyTasksLists[ pxCurrentTCB->uxPriority ])) > (UBaseType_t) 1) {
                 xSwitchRequired = pdTRUE;
             }
             else {
                 mtCOVERAGE_TEST_MARKER();
             }
+#endif /* configNUMBER_OF_CORES */
         }
 #endif /* ( ( configUSE_PREEMPTION == 1 ) && ( configUSE_TIME_SLICING == 1 ) ) */
 
@@ -2620,6 +2920,145 @@ void vTaskSwitchContext(void)
 }
 /*-----------------------------------------------------------*/
 
+#if ( configNUMBER_OF_CORES > 1 )
+
+static void prvSelectHighestPriorityTask(BaseType_t xCoreID)
+{
+    UBaseType_t uxTopPriority = uxTopReadyPriority;
+    BaseType_t xFoundTopPriority = pdFALSE;
+    UBaseType_t uxTasksToCheck;
+    List_t *pxReadyList;
+    TCB_t *pxTCB;
+
+    /* The task running on this core may be selected again. */
+    if (pxCurrentTCBs[ xCoreID ] != NULL) {
+        pxCurrentTCBs[ xCoreID ]->xTaskRunState = taskTASK_NOT_RUNNING;
+    }
+    else {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    for (;;) {
+        pxReadyList = &(pxReadyTasksLists[ uxTopPriority ]);
+
+        if (listLIST_IS_EMPTY(pxReadyList) == pdFALSE) {
+            /* uxTopReadyPriority tracks the highest priority that has ready
+            tasks, even if they are all running on other cores. */
+            if (xFoundTopPriority == pdFALSE) {
+                uxTopReadyPriority = uxTopPriority;
+                xFoundTopPriority = pdTRUE;
+            }
+
+            /* listGET_OWNER_OF_NEXT_ENTRY indexes through the list, so the
+            tasks of the same priority get an equal share of the cores.
+            Tasks running on another core or not allowed on this one are
+            skipped. */
+            for (uxTasksToCheck = listCURRENT_LIST_LENGTH(pxReadyList); uxTasksToCheck > (UBaseType_t) 0U; uxTasksToCheck--) {
+                listGET_OWNER_OF_NEXT_ENTRY(pxTCB, pxReadyList);
+
+                if ((pxTCB->xTaskRunState == taskTASK_NOT_RUNNING) &&
+                    ((pxTCB->uxCoreAffinityMask & taskCORE_BIT(xCoreID)) != 0U)) {
+                    pxTCB->xTaskRunState = xCoreID;
+                    pxCurrentTCBs[ xCoreID ] = pxTCB;
+                    return;
+                }
+            }
+        }
+
+        if (uxTopPriority == tskIDLE_PRIORITY) {
+            break;
+        }
+        --uxTopPriority;
+    }
+
+    /* There is an idle task for every core, so one is always found. */
+    configASSERT(pdFALSE);
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvYieldForTask(TCB_t *pxTCB)
+{
+    BaseType_t xLowestPriority = (BaseType_t) pxTCB->uxPriority;
+    BaseType_t xLowestPriorityCore = taskTASK_NOT_RUNNING;
+    BaseType_t xCorePriority, xCoreID;
+
+    if ((xSchedulerRunning == pdFALSE) || (pxTCB->xTaskRunState != taskTASK_NOT_RUNNING)) {
+        return pdFALSE;
+    }
+
+    for (xCoreID = 0; xCoreID < configNUMBER_OF_CORES; xCoreID++) {
+        if ((pxTCB->uxCoreAffinityMask & taskCORE_BIT(xCoreID)) == 0U) {
+            continue;
+        }
+
+        /* A core that reschedules anyway is preferred over one running a
+        task of the same priority. */
+        xCorePriority = (BaseType_t) pxCurrentTCBs[ xCoreID ]->uxPriority;
+        if (xYieldPendings[ xCoreID ] != pdFALSE) {
+            xCorePriority--;
+        }
+
+        if ((xCorePriority < xLowestPriority) ||
+            ((xCorePriority == xLowestPriority) && (xLowestPriorityCore != taskTASK_NOT_RUNNING) && (xCoreID == portGET_CORE_ID()))) {
+            xLowestPriority = xCorePriority;
+            xLowestPriorityCore = xCoreID;
+        }
+    }
+
+    if (xLowestPriorityCore == taskTASK_NOT_RUNNING) {
+        return pdFALSE;
+    }
+    else if (xLowestPriorityCore == portGET_CORE_ID()) {
+        return pdTRUE;
+    }
+    else {
+        xYieldPendings[ xLowestPriorityCore ] = pdTRUE;
+        portYIELD_CORE(xLowestPriorityCore);
+        return pdFALSE;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTaskWaitingForCore(BaseType_t xCoreID)
+{
+    List_t *pxReadyList = &(pxReadyTasksLists[ pxCurrentTCBs[ xCoreID ]->uxPriority ]);
+    const ListItem_t *pxEndMarker = listGET_END_MARKER(pxReadyList);
+    const ListItem_t *pxListItem;
+    BaseType_t xIdleTask;
+    TCB_t *pxTCB;
+
+    for (pxListItem = listGET_HEAD_ENTRY(pxReadyList); pxListItem != pxEndMarker; pxListItem = listGET_NEXT(pxListItem)) {
+        pxTCB = (TCB_t *) listGET_LIST_ITEM_OWNER(pxListItem);
+
+        if ((pxTCB->xTaskRunState != taskTASK_NOT_RUNNING) ||
+            ((pxTCB->uxCoreAffinityMask & taskCORE_BIT(xCoreID)) == 0U)) {
+            continue;
+        }
+
+        /* Swapping one idle task for another gains nothing. */
+        xIdleTask = pdFALSE;
+        if (pxTCB->uxPriority == tskIDLE_PRIORITY) {
+            BaseType_t x;
+
+            for (x = 0; x < configNUMBER_OF_CORES; x++) {
+                if ((TaskHandle_t) pxTCB == xIdleTaskHandles[ x ]) {
+                    xIdleTask = pdTRUE;
+                    break;
+                }
+            }
+        }
+
+        if (xIdleTask == pdFALSE) {
+            return pdTRUE;
+        }
+    }
+
+    return pdFALSE;
+}
+
+#endif /* configNUMBER_OF_CORES */
+/*-----------------------------------------------------------*/
+
 void vTaskPlaceOnEventList(List_t *const pxEventList, const TickType_t xTicksToWait)
 {
     configASSERT(pxEventList);
@@ -2725,7 +3164,13 @@ BaseType_t xTaskRemoveFromEventList(const List_t *const pxEventList)
         vListInsertEnd(&(xPendingReadyList), &(pxUnblockedTCB->xEventListItem));
     }
 
-    if (pxUnblockedTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+    /* A task held pending is given a core when the scheduler is resumed. */
+    if ((uxSchedulerSuspended == (UBaseType_t) pdFALSE) && (prvYieldForTask(pxUnblockedTCB) != pdFALSE))
+#else
+    if (pxUnblockedTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+    {
         /* Return true if the task removed from the event list has a higher
         priority than the calling task.  This allows the calling task to know if
         it should force a context switch now. */
@@ -2781,7 +3226,12 @@ BaseType_t xTaskRemoveFromUnorderedEventList(ListItem_t *pxEventListItem, const
     (void) uxListRemove(&(pxUnblockedTCB->xStateListItem));
     prvAddTaskToReadyList(pxUnblockedTCB);
 
-    if (pxUnblockedTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+    if (prvYieldForTask(pxUnblockedTCB) != pdFALSE)
+#else
+    if (pxUnblockedTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+    {
         /* Return true if the task removed from the event list has
         a higher priority than the calling task.  This allows
         the calling task to know if it should force a context
@@ -2949,8 +3399,9 @@ static portTASK_FUNCTION(prvIdleTask, pvParameters)
             A critical region is not required here as we are just reading from
             the list, and an occasional incorrect value will not matter.  If
             the ready list at the idle priority contains more than one task
-            then a task other than the idle task is ready to execute. */
-            if (listCURRENT_LIST_LENGTH(&(pxReadyTasksLists[ tskIDLE_PRIORITY ])) > (UBaseType_t) 1) {
+            then a task other than the idle task is ready to execute.  With
+            several cores there is an idle task per core. */
+            if (listCURRENT_LIST_LENGTH(&(pxReadyTasksLists[ tskIDLE_PRIORITY ])) > (UBaseType_t) configNUMBER_OF_CORES) {
                 taskYIELD();
             }
             else {
@@ -3157,13 +3608,35 @@ static void prvCheckTasksWaitingTermination(void)
 
                 taskENTER_CRITICAL();
                 {
+#if ( configNUMBER_OF_CORES > 1 )
+                    /* The idle task of another core may have cleaned up the
+                    task in the meantime, or the core the task deleted itself
+                    on has not switched away from it yet. */
+                    pxTCB = NULL;
+                    if (listLIST_IS_EMPTY(&xTasksWaitingTermination) == pdFALSE) {
+                        pxTCB = (TCB_t *) listGET_OWNER_OF_HEAD_ENTRY((&xTasksWaitingTermination));
+
+                        if (pxTCB->xTaskRunState != taskTASK_NOT_RUNNING) {
+                            pxTCB = NULL;
+                        }
+                    }
+
+                    if (pxTCB != NULL)
+#else
                     pxTCB = (TCB_t *) listGET_OWNER_OF_HEAD_ENTRY((&xTasksWaitingTermination));
-                    (void) uxListRemove(&(pxTCB->xStateListItem));
-                    --uxCurrentNumberOfTasks;
-                    --uxDeletedTasksWaitingCleanUp;
+#endif /* configNUMBER_OF_CORES */
+                    {
+                        (void) uxListRemove(&(pxTCB->xStateListItem));
+                        --uxCurrentNumberOfTasks;
+                        --uxDeletedTasksWaitingCleanUp;
+                    }
                 }
                 taskEXIT_CRITICAL();
 
+                if (pxTCB == NULL) {
+                    break;
+                }
+
                 prvDeleteTCB(pxTCB);
             }
             else {
@@ -3411,21 +3884,112 @@ static void prvResetNextTaskUnblockTime(void)
 }
 /*-----------------------------------------------------------*/
 
-#if ( ( INCLUDE_xTaskGetCurrentTaskHandle == 1 ) || ( configUSE_MUTEXES == 1 ) )
+#if ( ( INCLUDE_xTaskGetCurrentTaskHandle == 1 ) || ( configUSE_MUTEXES == 1 ) || ( configNUMBER_OF_CORES > 1 ) )
 
 TaskHandle_t xTaskGetCurrentTaskHandle(void)
 {
     TaskHandle_t xReturn;
 
-    /* A critical section is not required as this is not called from
-    an interrupt and the current TCB will always be the same for any
-    individual execution thread. */
-    xReturn = pxCurrentTCB;
+#if ( configNUMBER_OF_CORES > 1 )
+    {
+        UBaseType_t uxSavedInterruptStatus;
+
+        /* The calling task could be moved to another core between reading
+        the core ID and indexing with it if this core was interrupted. */
+        uxSavedInterruptStatus = portSET_INTERRUPT_MASK();
+        {
+            xReturn = pxCurrentTCBs[ portGET_CORE_ID() ];
+        }
+        portCLEAR_INTERRUPT_MASK(uxSavedInterruptStatus);
+    }
+#else
+    {
+        /* A critical section is not required as this is not called from
+        an interrupt and the current TCB will always be the same for any
+        individual execution thread. */
+        xReturn = pxCurrentTCB;
+    }
+#endif /* configNUMBER_OF_CORES */
 
     return xReturn;
 }
 
-#endif /* ( ( INCLUDE_xTaskGetCurrentTaskHandle == 1 ) || ( configUSE_MUTEXES == 1 ) ) */
+#endif /* ( ( INCLUDE_xTaskGetCurrentTaskHandle == 1 ) || ( configUSE_MUTEXES == 1 ) || ( configNUMBER_OF_CORES > 1 ) ) */
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCore(BaseType_t xCoreID)
+{
+    configASSERT((xCoreID >= 0) && (xCoreID < configNUMBER_OF_CORES));
+
+    return pxCurrentTCBs[ xCoreID ];
+}
+/*-----------------------------------------------------------*/
+
+void vTaskCoreAffinitySet(const TaskHandle_t xTask, UBaseType_t uxCoreAffinityMask)
+{
+    TCB_t *pxTCB;
+    BaseType_t xCoreID;
+
+    taskENTER_CRITICAL();
+    {
+        pxTCB = prvGetTCBFromHandle(xTask);
+        pxTCB->uxCoreAffinityMask = uxCoreAffinityMask;
+
+        if (xSchedulerRunning != pdFALSE) {
+            xCoreID = pxTCB->xTaskRunState;
+
+            if (xCoreID != taskTASK_NOT_RUNNING) {
+                /* Move the task off a core it is no longer allowed on. */
+                if ((uxCoreAffinityMask & taskCORE_BIT(xCoreID)) == 0U) {
+                    if (xCoreID == portGET_CORE_ID()) {
+                        taskYIELD_IF_USING_PREEMPTION();
+                    }
+                    else {
+                        portYIELD_CORE(xCoreID);
+                    }
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+            else if (listIS_CONTAINED_WITHIN(&(pxReadyTasksLists[ pxTCB->uxPriority ]), &(pxTCB->xStateListItem)) != pdFALSE) {
+                /* A ready task may be allowed on a core it could not use
+                before. */
+                if (prvYieldForTask(pxTCB) != pdFALSE) {
+                    taskYIELD_IF_USING_PREEMPTION();
+                }
+                else {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+            else {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+        else {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t vTaskCoreAffinityGet(const TaskHandle_t xTask)
+{
+    UBaseType_t uxCoreAffinityMask;
+
+    taskENTER_CRITICAL();
+    {
+        uxCoreAffinityMask = prvGetTCBFromHandle(xTask)->uxCoreAffinityMask;
+    }
+    taskEXIT_CRITICAL();
+
+    return uxCoreAffinityMask;
+}
+
+#endif /* configNUMBER_OF_CORES */
 /*-----------------------------------------------------------*/
 
 #if ( ( INCLUDE_xTaskGetSchedulerState == 1 ) || ( configUSE_TIMERS == 1 ) )
@@ -3488,6 +4052,14 @@ void vTaskPriorityInherit(TaskHandle_t const pxMutexHolder)
                 /* Inherit the priority before being moved into the new list. */
                 pxTCB->uxPriority = pxCurrentTCB->uxPriority;
                 prvAddTaskToReadyList(pxTCB);
+
+#if ( configNUMBER_OF_CORES > 1 )
+                {
+                    /* The calling task is about to block, but the holder
+                    may now also outrank the task on another core. */
+                    (void) prvYieldForTask(pxTCB);
+                }
+#endif /* configNUMBER_OF_CORES */
             }
             else {
                 /* Just inherit the priority. */
@@ -3757,7 +4329,7 @@ void vTaskGetRunTimeStats(char *pcWriteBuffer)
 {
     TaskStatus_t *pxTaskStatusArray;
     volatile UBaseType_t uxArraySize, x;
-    uint32_t ulTotalTime, ulStatsAsPercentage;
+    configRUN_TIME_COUNTER_TYPE ulTotalTime, ulStatsAsPercentage;
 
 #if( configUSE_TRACE_FACILITY != 1 )
     {
@@ -3824,9 +4396,13 @@ void vTaskGetRunTimeStats(char *pcWriteBuffer)
                 pcWriteBuffer = prvWriteNameToBuffer(pcWriteBuffer, pxTaskStatusArray[ x ].pcTaskName);
 
                 if (ulStatsAsPercentage > 0UL) {
-#ifdef portLU_PRINTF_SPECIFIER_REQUIRED
+#if defined( portLLU_PRINTF_SPECIFIER_REQUIRED )
                     {
-                        sprintf(pcWriteBuffer, "\t%lu\t\t%lu%%\r\n", pxTaskStatusArray[ x ].ulRunTimeCounter, ulStatsAsPercentage);
+                        sprintf(pcWriteBuffer, "\t%llu\t\t%llu%%\r\n", (unsigned long long) pxTaskStatusArray[ x ].ulRunTimeCounter, (unsigned long long) ulStatsAsPercentage);
+                    }
+#elif defined( portLU_PRINTF_SPECIFIER_REQUIRED )
+                    {
+                        sprintf(pcWriteBuffer, "\t%lu\t\t%lu%%\r\n", (unsigned long) pxTaskStatusArray[ x ].ulRunTimeCounter, (unsigned long) ulStatsAsPercentage);
                     }
 #else
                     {
@@ -3839,9 +4415,13 @@ void vTaskGetRunTimeStats(char *pcWriteBuffer)
                 else {
                     /* If the percentage is zero here then the task has
                     consumed less than 1% of the total run time. */
-#ifdef portLU_PRINTF_SPECIFIER_REQUIRED
+#if defined( portLLU_PRINTF_SPECIFIER_REQUIRED )
+                    {
+                        sprintf(pcWriteBuffer, "\t%llu\t\t<1%%\r\n", (unsigned long long) pxTaskStatusArray[ x ].ulRunTimeCounter);
+                    }
+#elif defined( portLU_PRINTF_SPECIFIER_REQUIRED )
                     {
-                        sprintf(pcWriteBuffer, "\t%lu\t\t<1%%\r\n", pxTaskStatusArray[ x ].ulRunTimeCounter);
+                        sprintf(pcWriteBuffer, "\t%lu\t\t<1%%\r\n", (unsigned long) pxTaskStatusArray[ x ].ulRunTimeCounter);
                     }
 #else
                     {
@@ -4111,7 +4691,12 @@ BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNot
             }
 #endif
 
-            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+            if (prvYieldForTask(pxTCB) != pdFALSE)
+#else
+            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+            {
                 /* The notified task has a priority above the currently
                 executing task so a yield is required. */
                 taskYIELD_IF_USING_PREEMPTION();
@@ -4219,7 +4804,14 @@ BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t xTaskToNotify, uint32_t ulValu
                 vListInsertEnd(&(xPendingReadyList), &(pxTCB->xEventListItem));
             }
 
-            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+            /* A task held pending is given a core when the scheduler is
+            resumed. */
+            if ((uxSchedulerSuspended == (UBaseType_t) pdFALSE) && (prvYieldForTask(pxTCB) != pdFALSE))
+#else
+            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+            {
                 /* The notified task has a priority above the currently
                 executing task so a yield is required. */
                 if (pxHigherPriorityTaskWoken != NULL) {
@@ -4302,7 +4894,14 @@ void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPrio
                 vListInsertEnd(&(xPendingReadyList), &(pxTCB->xEventListItem));
             }
 
-            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority) {
+#if ( configNUMBER_OF_CORES > 1 )
+            /* A task held pending is given a core when the scheduler is
+            resumed. */
+            if ((uxSchedulerSuspended == (UBaseType_t) pdFALSE) && (prvYieldForTask(pxTCB) != pdFALSE))
+#else
+            if (pxTCB->uxPriority > pxCurrentTCB->uxPriority)
+#endif
+            {
                 /* The notified task has a priority above the currently
                 executing task so a yield is required. */
                 if (pxHigherPriorityTaskWoken != NULL) {
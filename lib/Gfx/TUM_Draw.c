@@ -22,6 +22,10 @@
 @endverbatim
  */
 #include <limits.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
@@ -31,6 +35,8 @@
 
 #include <pthread.h>
 
+#include "FreeRTOS.h"
+
 #include "TUM_Draw.h"
 #include "TUM_Font.h"
 #include "TUM_Utils.h"
@@ -64,14 +70,35 @@ typedef enum {
     DRAW_IMAGE,
     DRAW_LOADED_IMAGE,
     DRAW_LOADED_IMAGE_CROP,
-    DRAW_SCALED_IMAGE,
     DRAW_ARROW,
 } draw_job_type_t;
 
+/**
+ * Loaded images are packed into shared atlas pages, such that images drawn
+ * one after another can be drawn from the same texture in a single batch.
+ * Pages are filled shelf by shelf, space is only reclaimed once all of a
+ * page's images have been freed.
+ */
+typedef struct atlas_page {
+    SDL_Surface *surf;
+    SDL_Texture *tex;
+    unsigned int tex_generation;
+    unsigned char dirty; // surf has changed since tex was updated
+    int shelf_x;
+    int shelf_y;
+    int shelf_h;
+    unsigned int image_count;
+    struct atlas_page *next;
+} atlas_page_t;
+
+#define ATLAS_PADDING 1
+
 typedef struct loaded_image {
     char *filename;
     FILE *file;
-    SDL_Texture *tex;
+    SDL_Texture *tex; // Only set if the image is not packed into an atlas
+    atlas_page_t *page;
+    SDL_Rect atlas_rect;
     SDL_RWops *ops;
     SDL_Surface *surf;
     int w;
@@ -88,6 +115,8 @@ typedef struct loaded_image_crop {
     loaded_image_t *image;
     int x;
     int y;
+    int w; // Size drawn on screen
+    int h;
     int c_x;
     int c_y;
     int c_w;
@@ -171,40 +200,38 @@ typedef struct line_data {
 } line_data_t;
 
 typedef struct poly_data {
-    coord_t *points;
-    unsigned int n;
+    unsigned int n; // Points are stored in the job's payload
     unsigned int colour;
 } poly_data_t;
 
 typedef struct triangle_data {
-    coord_t *points;
+    coord_t points[3];
     unsigned int colour;
 } triangle_data_t;
 
 typedef struct image_data {
-    char *filename;
-    SDL_Texture *tex;
+    loaded_image_t *img; // Referenced from the image cache
     signed short x;
     signed short y;
+    signed short w; // Size drawn on screen
+    signed short h;
 } image_data_t;
 
 typedef struct loaded_image_data {
     loaded_image_t *img;
     signed short x;
     signed short y;
+    signed short w; // Size drawn on screen
+    signed short h;
 } loaded_image_data_t;
 
-typedef struct scaled_image_data {
-    image_data_t image;
-    float scale;
-} scaled_image_data_t;
-
 typedef struct text_data {
-    char *str;
-    signed short x;
+    signed short x; // String is stored in the job's payload
     signed short y;
+    float scale_x;
+    float scale_y;
     unsigned int colour;
-    TTF_Font *font;
+    font_handle_t font;
 } text_data_t;
 
 typedef struct arrow_data {
@@ -229,19 +256,68 @@ union data_u {
     image_data_t image;
     loaded_image_data_t loaded_image;
     loaded_image_crop_t loaded_image_crop;
-    scaled_image_data_t scaled_image;
     text_data_t text;
     arrow_data_t arrow;
 };
 
+/**
+ * Draw jobs are stored back to back in contiguous blocks, each job is
+ * directly followed by its variable length payload (strings, points, etc).
+ * The size field holds the total size of the job including its payload,
+ * padded such that the next job is correctly aligned. The sequence number
+ * orders jobs submitted from different threads.
+ */
 typedef struct draw_job {
     draw_job_type_t type;
-    union data_u *data;
-
-    struct draw_job *next;
+    unsigned int size;
+    unsigned long seq;
+    union data_u data;
 } draw_job_t;
 
-draw_job_t job_list_head = { 0 };
+#define DRAW_JOB_ALIGN(SIZE)                                                   \
+    (((SIZE) + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1))
+#define DRAW_JOB_PAYLOAD(JOB) ((void *)((char *)(JOB) + sizeof(draw_job_t)))
+#define DRAW_JOB_BLOCK_SIZE (16 * 1024)
+
+typedef struct draw_job_block {
+    _Atomic(struct draw_job_block *) next;
+    atomic_size_t used; // Bytes reserved by the producer
+    size_t size;
+    _Alignas(max_align_t) char mem[];
+} draw_job_block_t;
+
+/**
+ * Each thread that submits draw jobs owns a producer, jobs are appended to
+ * the producer's chain of blocks without any locking. The producer makes
+ * jobs visible to tumDrawUpdateScreen() by increasing published_jobs, the
+ * consumer hands drained blocks back through returned_blocks.
+ */
+typedef struct draw_producer {
+    struct draw_producer *next;
+    atomic_int in_use;
+
+    // Producer side
+    draw_job_block_t *tail;
+    draw_job_block_t *free_blocks;
+    draw_job_t *last_job;
+    unsigned long reserved_jobs;
+    unsigned int batch_depth;
+    atomic_ulong published_jobs;
+    _Atomic(draw_job_block_t *) returned_blocks;
+
+    // Consumer side
+    draw_job_block_t *head;
+    size_t head_offset;
+    draw_job_block_t *drained_blocks; // Returned once the frame is drawn
+    unsigned long consumed_jobs;
+    unsigned long frame_jobs; // Jobs to be drawn in the current frame
+} draw_producer_t;
+
+static _Atomic(draw_producer_t *) draw_producers = NULL;
+static atomic_ulong draw_job_seq = 0;
+static pthread_key_t draw_producer_key;
+static pthread_once_t draw_producer_key_once = PTHREAD_ONCE_INIT;
+static __thread draw_producer_t *cur_producer = NULL;
 
 struct global_offsets {
     int x;
@@ -253,16 +329,147 @@ struct global_offsets global_offset = {
     .lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
+/**
+ * Each thread scopes its draw calls using its own stack of transforms. The
+ * current transform is applied when a job is submitted, such that drawing a
+ * job never has to synchronize with the thread that submitted it.
+ */
+typedef struct draw_transform {
+    float x;
+    float y;
+    float scale_x;
+    float scale_y;
+} draw_transform_t;
+
+static __thread draw_transform_t transforms[DRAW_TRANSFORM_STACK_DEPTH] = {
+    { .scale_x = 1, .scale_y = 1 },
+};
+static __thread unsigned int transform_depth = 0;
+
 pthread_mutex_t loaded_images_lock = PTHREAD_MUTEX_INITIALIZER;
 loaded_image_t loaded_images_list = { 0 };
+// Freed images whose pages and textures are released by the GL thread
+static loaded_image_t *retired_images = NULL; // Protected by loaded_images_lock
+static atlas_page_t *atlas_pages = NULL; // Protected by loaded_images_lock
+
+/**
+ * Consecutive image jobs are collected into a sprite batch. Sprites are
+ * grouped by texture, a sprite may join an earlier group of the same texture
+ * if it does not overlap any later group, keeping the drawn result the same.
+ * Each group is then drawn with a single call.
+ */
+typedef struct sprite {
+    SDL_Texture *tex;
+    SDL_Rect src;
+    SDL_Rect dst;
+    unsigned int group;
+} sprite_t;
+
+typedef struct sprite_group {
+    SDL_Texture *tex;
+    SDL_Rect bounds;
+    unsigned int count;
+    unsigned int first; // Index into the sorted sprites
+} sprite_group_t;
+
+static struct sprite_batch {
+    sprite_t *sprites;
+    sprite_t **sorted;
+    unsigned int count;
+    unsigned int size;
+    sprite_group_t *groups;
+    unsigned int group_count;
+    unsigned int group_size;
+    SDL_Vertex *vertices;
+    int *indices;
+} sprite_batch = { 0 };
+
+/**
+ * Images drawn by filename are loaded once and kept in a cache, ordered from
+ * most to least recently used. Pending draw jobs hold references to the
+ * cached images, only unreferenced images are evicted.
+ */
+typedef struct image_cache_entry {
+    char *filename;
+    loaded_image_t *img;
+    struct image_cache_entry *next;
+} image_cache_entry_t;
+
+static pthread_mutex_t image_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static image_cache_entry_t *image_cache = NULL;
+static unsigned int image_cache_count = 0;
 
 const int screen_height = SCREEN_HEIGHT;
 const int screen_width = SCREEN_WIDTH;
 
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
+static unsigned int renderer_generation = 0;
 SDL_GLContext context = NULL;
 
+// Only set in headless mode, the software renderer draws into the surface
+static SDL_Surface *headless_surface = NULL;
+
+static struct frame_capture {
+    tum_draw_capture_format_t format;
+    char *prefix;
+    unsigned int ring_size;
+    unsigned long frame;
+    SDL_Surface *surf; // Frames read back from a window's renderer
+} frame_capture = { 0 };
+
+/**
+ * The jobs of the frame being drawn in submission order. The jobs' memory
+ * and the references they hold are released once the frame is drawn.
+ */
+typedef struct frame_job {
+    draw_job_t *job;
+    SDL_Rect bounds; // Only used for damage tracking
+    uint64_t hash;
+} frame_job_t;
+
+/**
+ * The next job of each producer, kept as a min-heap ordered by the jobs'
+ * sequence numbers to merge the producers' jobs
+ */
+typedef struct frame_head {
+    draw_job_t *job;
+    draw_producer_t *producer;
+} frame_head_t;
+
+static struct draw_frame {
+    frame_job_t *jobs;
+    unsigned int count;
+    unsigned int size;
+    frame_head_t *heads;
+    unsigned int head_count;
+    unsigned int head_size;
+    int x_offset; // Global offset, captured once per frame
+    int y_offset;
+} draw_frame = { 0 };
+
+/**
+ * With damage tracking the screen is split into tiles of DAMAGE_TILE_SIZE
+ * pixels. Each tile's hash covers all jobs that touch the tile, only tiles
+ * whose hash changed since the previous frame are redrawn into the
+ * persistent render target, which is then copied to the screen.
+ */
+#define DAMAGE_PADDING 2 // Anti-aliased edges may exceed a job's bounds
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static struct damage_tracking {
+    atomic_int requested;
+    atomic_int invalidated; // Target no longer holds the previous frame
+    int tiles_x;
+    int tiles_y;
+    uint64_t *tile_hashes; // Hashes of the previous frame
+    uint64_t *new_hashes;
+    SDL_Rect *rects; // Damaged tiles merged into rectangles
+    SDL_Texture *target;
+    unsigned int target_generation;
+} damage = { 0 };
+
 char *error_message = NULL;
 
 static uint32_t SwapBytes(unsigned int x)
@@ -290,37 +497,262 @@ void setErrorMessage(char *msg)
     PRINT_ERROR("[SDL Error] %s\n" #msg, (char *)SDL_GetError(),           \
                 ##__VA_ARGS__)
 
-static draw_job_t *pushDrawJob(void)
+static draw_job_block_t *getDrawJobBlock(draw_producer_t *producer,
+        size_t required)
 {
-    draw_job_t *iterator;
-    draw_job_t *job = calloc(1, sizeof(draw_job_t));
-    if (job == NULL) {
+    draw_job_block_t *block;
+    size_t size = DRAW_JOB_BLOCK_SIZE;
+
+    if (producer->free_blocks == NULL)
+        producer->free_blocks = atomic_exchange_explicit(
+                                    &producer->returned_blocks, NULL,
+                                    memory_order_acquire);
+
+    while (producer->free_blocks) {
+        block = producer->free_blocks;
+        producer->free_blocks = atomic_load_explicit(
+                                    &block->next, memory_order_relaxed);
+        if (block->size >= required) {
+            goto reset;
+        }
+        free(block);
+    }
+
+    while (size < required) {
+        size *= 2;
+    }
+
+    block = malloc(sizeof(draw_job_block_t) + size);
+    if (block == NULL) {
+        PRINT_ERROR("Failed to allocate draw job block of %zu bytes",
+                    size);
         return NULL;
     }
+    block->size = size;
 
-    for (iterator = &job_list_head; iterator->next;
-         iterator = iterator->next)
-        ;
+reset:
+    atomic_init(&block->next, NULL);
+    atomic_init(&block->used, 0);
 
-    iterator->next = job;
+    return block;
+}
 
-    return job;
+static void releaseDrawJob(draw_job_t *job);
+
+static void vReleaseDrawProducer(void *arg)
+{
+    draw_producer_t *producer = (draw_producer_t *)arg;
+
+    // The thread might have exited while filling in its last job, the
+    // consumer skips it, so the references it took are put here
+    if (producer->reserved_jobs !=
+        atomic_load_explicit(&producer->published_jobs,
+                             memory_order_relaxed)) {
+        releaseDrawJob(producer->last_job);
+        producer->last_job->type = DRAW_NONE;
+        atomic_store_explicit(&producer->published_jobs,
+                              producer->reserved_jobs,
+                              memory_order_release);
+    }
+    producer->batch_depth = 0;
+
+    // Abandoned producers are drained by the consumer and later reused
+    atomic_store_explicit(&producer->in_use, 0, memory_order_release);
+}
+
+static void vCreateDrawProducerKey(void)
+{
+    pthread_key_create(&draw_producer_key, vReleaseDrawProducer);
 }
 
-static draw_job_t *popDrawJob(void)
+static draw_producer_t *getDrawProducer(void)
 {
-    draw_job_t *ret = job_list_head.next;
+    draw_producer_t *producer;
+    int expected;
 
-    if (ret) {
-        if (ret->next) {
-            job_list_head.next = ret->next;
+    if (cur_producer) {
+        return cur_producer;
+    }
+
+    pthread_once(&draw_producer_key_once, vCreateDrawProducerKey);
+
+    // Reuse a producer whose thread has exited
+    for (producer = atomic_load_explicit(&draw_producers,
+                                         memory_order_acquire);
+         producer; producer = producer->next) {
+        expected = 0;
+        if (atomic_compare_exchange_strong_explicit(
+                &producer->in_use, &expected, 1, memory_order_acquire,
+                memory_order_relaxed)) {
+            goto found;
         }
-        else {
-            job_list_head.next = NULL;
+    }
+
+    producer = calloc(1, sizeof(draw_producer_t));
+    if (producer == NULL) {
+        PRINT_ERROR("Failed to allocate draw producer");
+        return NULL;
+    }
+
+    producer->tail = getDrawJobBlock(producer, 0);
+    if (producer->tail == NULL) {
+        free(producer);
+        return NULL;
+    }
+    producer->head = producer->tail;
+    atomic_init(&producer->in_use, 1);
+
+    producer->next = atomic_load_explicit(&draw_producers,
+                                          memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+               &draw_producers, &producer->next, producer,
+               memory_order_release, memory_order_relaxed))
+        ;
+
+found:
+    pthread_setspecific(draw_producer_key, producer);
+    cur_producer = producer;
+
+    return producer;
+}
+
+/**
+ * Reserves space for a job and its payload in the calling thread's current
+ * block. The job is not seen by tumDrawUpdateScreen() until it is
+ * published with commitDrawJob().
+ */
+static draw_job_t *pushDrawJob(draw_job_type_t type, size_t payload_size)
+{
+    draw_producer_t *producer = getDrawProducer();
+    size_t job_size = DRAW_JOB_ALIGN(sizeof(draw_job_t) + payload_size);
+    draw_job_block_t *block;
+    size_t used;
+    draw_job_t *job;
+
+    if (producer == NULL) {
+        return NULL;
+    }
+
+    block = producer->tail;
+    used = atomic_load_explicit(&block->used, memory_order_relaxed);
+
+    if (used + job_size > block->size) {
+        block = getDrawJobBlock(producer, job_size);
+        if (block == NULL) {
+            return NULL;
         }
+        atomic_store_explicit(&producer->tail->next, block,
+                              memory_order_relaxed);
+        producer->tail = block;
+        used = 0;
     }
 
-    return ret;
+    job = (draw_job_t *)(block->mem + used);
+    memset(job, 0, sizeof(draw_job_t));
+    job->type = type;
+    job->size = job_size;
+    job->seq = atomic_fetch_add_explicit(&draw_job_seq, 1,
+                                         memory_order_relaxed);
+
+    atomic_store_explicit(&block->used, used + job_size,
+                          memory_order_relaxed);
+    producer->reserved_jobs++;
+    producer->last_job = job;
+
+    return job;
+}
+
+static int commitDrawJob(void)
+{
+    draw_producer_t *producer = cur_producer;
+
+    if (!producer->batch_depth)
+        atomic_store_explicit(&producer->published_jobs,
+                              producer->reserved_jobs,
+                              memory_order_release);
+
+    return 0;
+}
+
+/**
+ * Returns the next job of the producer that is part of the current frame,
+ * the job is only consumed once it is passed to consumeDrawJob(). Consumed
+ * jobs stay valid until returnDrawJobBlocks() is called.
+ */
+static draw_job_t *peekDrawJob(draw_producer_t *producer)
+{
+    draw_job_block_t *drained, *next;
+
+    if (producer->consumed_jobs == producer->frame_jobs) {
+        return NULL;
+    }
+
+    if (producer->head_offset >=
+        atomic_load_explicit(&producer->head->used, memory_order_relaxed)) {
+        drained = producer->head;
+        next = atomic_load_explicit(&drained->next, memory_order_relaxed);
+
+        atomic_store_explicit(&drained->next, producer->drained_blocks,
+                              memory_order_relaxed);
+        producer->drained_blocks = drained;
+
+        producer->head = next;
+        producer->head_offset = 0;
+    }
+
+    return (draw_job_t *)(producer->head->mem + producer->head_offset);
+}
+
+static void consumeDrawJob(draw_producer_t *producer, draw_job_t *job)
+{
+    producer->head_offset += job->size;
+    producer->consumed_jobs++;
+}
+
+/**
+ * Hands the drained blocks back to the producer for reuse
+ */
+static void returnDrawJobBlocks(draw_producer_t *producer)
+{
+    draw_job_block_t *first = producer->drained_blocks, *last, *returned;
+
+    if (first == NULL) {
+        return;
+    }
+
+    for (last = first;
+         atomic_load_explicit(&last->next, memory_order_relaxed);
+         last = atomic_load_explicit(&last->next, memory_order_relaxed))
+        ;
+
+    returned = atomic_load_explicit(&producer->returned_blocks,
+                                    memory_order_relaxed);
+    do {
+        atomic_store_explicit(&last->next, returned, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(
+                 &producer->returned_blocks, &returned, first,
+                 memory_order_release, memory_order_relaxed));
+
+    producer->drained_blocks = NULL;
+}
+
+void tumDrawBeginBatch(void)
+{
+    draw_producer_t *producer = getDrawProducer();
+
+    if (producer) {
+        producer->batch_depth++;
+    }
+}
+
+void tumDrawEndBatch(void)
+{
+    draw_producer_t *producer = cur_producer;
+
+    if (producer && producer->batch_depth)
+        if (!--producer->batch_depth) {
+            commitDrawJob();
+        }
 }
 
 static int _clearDisplay(unsigned int colour)
@@ -328,7 +760,15 @@ static int _clearDisplay(unsigned int colour)
     SDL_SetRenderDrawColor(renderer, (colour >> 16) & 0xFF,
                            (colour >> 8) & 0xFF, colour & 0xFF,
                            ALPHA_SOLID);
-    SDL_RenderClear(renderer);
+
+    // Clearing ignores the clip rect, damage tracking only clears tiles
+    if (SDL_RenderIsClipEnabled(renderer)) {
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_RenderFillRect(renderer, NULL);
+    }
+    else {
+        SDL_RenderClear(renderer);
+    }
 
     return 0;
 }
@@ -421,50 +861,168 @@ static int _drawTriangle(coord_t *points, int x_offset, int y_offset,
     return 0;
 }
 
-static SDL_Texture *loadImage(char *filename, SDL_Renderer *ren)
+static int fitAtlasPage(atlas_page_t *page, int w, int h, SDL_Rect *rect)
 {
-    SDL_Texture *tex =  IMG_LoadTexture(ren, tumUtilFindResourcePath(filename));
+    int y = page->shelf_y;
+
+    if (page->shelf_x + w > IMAGE_ATLAS_PAGE_SIZE) {
+        y += page->shelf_h;
+        if (y + h > IMAGE_ATLAS_PAGE_SIZE) {
+            return -1;
+        }
+        page->shelf_x = 0;
+        page->shelf_y = y;
+        page->shelf_h = 0;
+    }
+    else if (y + h > IMAGE_ATLAS_PAGE_SIZE) {
+        return -1;
+    }
 
-    return tex;
+    rect->x = page->shelf_x;
+    rect->y = page->shelf_y;
+
+    page->shelf_x += w + ATLAS_PADDING;
+    if (h + ATLAS_PADDING > page->shelf_h) {
+        page->shelf_h = h + ATLAS_PADDING;
+    }
+
+    return 0;
 }
 
-static int _renderCroppedImage(SDL_Texture *tex, SDL_Renderer *ren,
-                               signed short x, signed short y, signed short c_x,
-                               signed short c_y, int w, int h)
+/**
+ * Copies the image's surface into an atlas page, must be called with
+ * loaded_images_lock held.
+ */
+static int packAtlasImage(loaded_image_t *img)
 {
-    SDL_Rect src, dst;
-    src.x = c_x;
-    src.y = c_y;
-    src.w = w;
-    src.h = h;
-    dst.x = x;
-    dst.y = y;
-    dst.w = w;
-    dst.h = h;
-    return SDL_RenderCopy(ren, tex, &src, &dst);
+    SDL_Rect rect = { 0, 0, img->w, img->h };
+    atlas_page_t *page;
+
+    if (img->w > IMAGE_ATLAS_PAGE_SIZE || img->h > IMAGE_ATLAS_PAGE_SIZE) {
+        return -1;
+    }
+
+    for (page = atlas_pages; page; page = page->next)
+        if (!fitAtlasPage(page, img->w, img->h, &rect)) {
+            goto found;
+        }
+
+    page = calloc(1, sizeof(atlas_page_t));
+    if (page == NULL) {
+        PRINT_ERROR("Failed to allocate atlas page");
+        goto err_page;
+    }
+
+    page->surf = SDL_CreateRGBSurfaceWithFormat(0, IMAGE_ATLAS_PAGE_SIZE,
+                 IMAGE_ATLAS_PAGE_SIZE, 32,
+                 SDL_PIXELFORMAT_ARGB8888);
+    if (page->surf == NULL) {
+        PRINT_SDL_ERROR("Failed to create atlas page surface");
+        goto err_surf;
+    }
+
+    fitAtlasPage(page, img->w, img->h, &rect);
+
+    page->next = atlas_pages;
+    atlas_pages = page;
+
+found:
+    // Copy the image's alpha instead of blending it
+    SDL_SetSurfaceBlendMode(img->surf, SDL_BLENDMODE_NONE);
+    img->atlas_rect = rect;
+    if (SDL_BlitSurface(img->surf, NULL, page->surf, &rect)) {
+        PRINT_SDL_ERROR("Failed to copy image into atlas page");
+        return -1;
+    }
+
+    img->page = page;
+    page->image_count++;
+    page->dirty = 1;
+
+    return 0;
+
+err_surf:
+    free(page);
+err_page:
+    return -1;
 }
 
-static int _renderScaledImage(SDL_Texture *tex, SDL_Renderer *ren,
-                              signed short x, signed short y, int w, int h)
+/**
+ * Must be called with loaded_images_lock held, from the thread holding the GL
+ * context as the page's texture may be destroyed
+ */
+static void unpackAtlasImage(loaded_image_t *img)
 {
-    SDL_Rect dst;
-    dst.w = w;
-    dst.h = h;
-    dst.x = x;
-    dst.y = y;
-    return SDL_RenderCopy(ren, tex, NULL, &dst);
+    atlas_page_t **iterator;
+    atlas_page_t *page = img->page;
+
+    if (page == NULL || --page->image_count) {
+        return;
+    }
+
+    for (iterator = &atlas_pages; *iterator; iterator = &(*iterator)->next)
+        if (*iterator == page) {
+            *iterator = page->next;
+            break;
+        }
+
+    if (page->tex && page->tex_generation == renderer_generation) {
+        SDL_DestroyTexture(page->tex);
+    }
+    SDL_FreeSurface(page->surf);
+    free(page);
 }
 
-static int _getImageSize(char *filename, int *w, int *h)
+/**
+ * Returns the texture and source area from which the image is drawn, atlas
+ * page textures are (re)created and updated as needed on the GL thread.
+ */
+static SDL_Texture *getLoadedImageTexture(loaded_image_t *img, SDL_Rect *src)
 {
-    SDL_Texture *tex = loadImage(filename, renderer);
-    if (tex == NULL) {
-        return -1;
+    atlas_page_t *page = img->page;
+    SDL_Texture *ret;
+
+    if (page == NULL) {
+        src->x = 0;
+        src->y = 0;
+        src->w = img->w;
+        src->h = img->h;
+        return img->tex;
     }
-    SDL_QueryTexture(tex, NULL, NULL, w, h);
-    SDL_DestroyTexture(tex);
 
-    return 0;
+    pthread_mutex_lock(&loaded_images_lock);
+
+    // Page textures are lost when the renderer is recreated
+    if (page->tex == NULL || page->tex_generation != renderer_generation) {
+        page->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                      SDL_TEXTUREACCESS_STATIC,
+                                      IMAGE_ATLAS_PAGE_SIZE,
+                                      IMAGE_ATLAS_PAGE_SIZE);
+        if (page->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create atlas page texture");
+            goto err;
+        }
+        SDL_SetTextureBlendMode(page->tex, SDL_BLENDMODE_BLEND);
+        page->tex_generation = renderer_generation;
+        page->dirty = 1;
+    }
+
+    if (page->dirty) {
+        SDL_UpdateTexture(page->tex, NULL, page->surf->pixels,
+                          page->surf->pitch);
+        page->dirty = 0;
+    }
+
+    *src = img->atlas_rect;
+    ret = page->tex;
+
+    pthread_mutex_unlock(&loaded_images_lock);
+
+    return ret;
+
+err:
+    pthread_mutex_unlock(&loaded_images_lock);
+    return NULL;
 }
 
 animation_handle_t tumDrawAnimationCreate(image_handle_t spritesheet,
@@ -647,11 +1205,9 @@ static int freeLoadedImage(loaded_image_t **img)
             iterator->next = delete->next;
         }
 
-        SDL_FreeSurface(delete->surf);
-        SDL_RWclose(delete->ops);
-        SDL_DestroyTexture(delete->tex);
-        free(delete->filename);
-        free(delete);
+        // Atlas pages and textures may only be freed by the GL thread
+        delete->next = retired_images;
+        retired_images = delete;
         *img = (loaded_image_t *)NULL;
 
         ret = 0;
@@ -661,106 +1217,365 @@ static int freeLoadedImage(loaded_image_t **img)
     return ret;
 }
 
-static void vPutLoadedImage(image_handle_t img)
+/**
+ * Frees the images retired by freeLoadedImage(), must be called from the
+ * thread holding the GL context
+ */
+static void freeRetiredImages(void)
 {
-    loaded_image_t *loaded_img = (loaded_image_t *)img;
+    loaded_image_t *delete, *iterator;
 
-    loaded_img->ref_count--;
+    pthread_mutex_lock(&loaded_images_lock);
+    delete = retired_images;
+    retired_images = NULL;
+    for (iterator = delete; iterator; iterator = iterator->next) {
+        unpackAtlasImage(iterator);
+    }
+    pthread_mutex_unlock(&loaded_images_lock);
 
-    if (loaded_img->pending_free && !loaded_img->ref_count) {
-        freeLoadedImage((loaded_image_t **)&img);
+    if (delete == NULL) {
+        return;
     }
-}
 
-int xDrawLoadedImageCropped(loaded_image_t *img, SDL_Renderer *ren,
-                            signed short x, signed short y, signed short c_x,
-                            signed short c_y, signed short c_w,
-                            signed short c_h)
-{
-    return _renderCroppedImage(img->tex, ren, x, y, c_x, c_y, c_w, c_h);
+    // A new image at the same address would hash identically
+    atomic_store(&damage.invalidated, 1);
+
+    while (delete) {
+        loaded_image_t *next = delete->next;
+
+        SDL_FreeSurface(delete->surf);
+        SDL_RWclose(delete->ops);
+        if (delete->tex) {
+            SDL_DestroyTexture(delete->tex);
+        }
+        free(delete->filename);
+        free(delete);
+        delete = next;
+    }
 }
 
-int xDrawLoadedImage(loaded_image_t *img, SDL_Renderer *ren, signed short x,
-                     signed short y)
+static void vGetLoadedImage(image_handle_t img)
 {
-    return _renderScaledImage(img->tex, ren, x, y, img->w * img->scale,
-                              img->h * img->scale);
+    pthread_mutex_lock(&loaded_images_lock);
+    ((loaded_image_t *)img)->ref_count++;
+    pthread_mutex_unlock(&loaded_images_lock);
 }
 
-static int _drawScaledImage(SDL_Texture *tex, SDL_Renderer *ren, signed short x,
-                            signed short y, float scale)
+static void vPutLoadedImage(image_handle_t img)
 {
-    int w, h;
-    SDL_QueryTexture(tex, NULL, NULL, &w, &h);
-    if (!w || !h) {
-        return -1;
-    }
-
-    if (_renderScaledImage(tex, ren, x, y, w * scale, h * scale)) {
-        return -1;
-    }
+    loaded_image_t *loaded_img = (loaded_image_t *)img;
+    int free_img;
 
-    SDL_DestroyTexture(tex);
+    pthread_mutex_lock(&loaded_images_lock);
+    loaded_img->ref_count--;
+    free_img = loaded_img->pending_free && !loaded_img->ref_count;
+    pthread_mutex_unlock(&loaded_images_lock);
 
-    return 0;
+    if (free_img) {
+        freeLoadedImage((loaded_image_t **)&img);
+    }
 }
 
-static int _drawImage(SDL_Texture *tex, SDL_Renderer *ren, signed short x,
-                      signed short y)
+static int isSpriteJob(draw_job_type_t type)
 {
-    return _drawScaledImage(tex, ren, x, y, 1);
+    switch (type) {
+        case DRAW_IMAGE:
+        case DRAW_LOADED_IMAGE:
+        case DRAW_LOADED_IMAGE_CROP:
+            return 1;
+        default:
+            return 0;
+    }
 }
 
-static int _drawText(char *string, signed short x, signed short y,
-                     unsigned int colour, TTF_Font *font)
-{
-    SDL_Color color = { RED_PORTION(colour), GREEN_PORTION(colour),
-                        BLUE_PORTION(colour), ZERO_ALPHA
-                      };
-    SDL_Surface *surface = TTF_RenderText_Solid(font, string, color);
-    tumFontPutFont(font);
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_Rect dst = { 0 };
-    SDL_QueryTexture(texture, NULL, NULL, &dst.w, &dst.h);
-    dst.x = x;
-    dst.y = y;
-    SDL_RenderCopy(renderer, texture, NULL, &dst);
-    SDL_DestroyTexture(texture);
-    SDL_FreeSurface(surface);
+static int growSpriteBatch(void)
+{
+    unsigned int size = sprite_batch.size ? sprite_batch.size * 2 : 64;
+    sprite_t *sprites;
+    sprite_t **sorted;
+    SDL_Vertex *vertices;
+    int *indices;
+
+    sprites = realloc(sprite_batch.sprites, size * sizeof(sprite_t));
+    if (sprites == NULL) {
+        goto err;
+    }
+    sprite_batch.sprites = sprites;
+
+    sorted = realloc(sprite_batch.sorted, size * sizeof(sprite_t *));
+    if (sorted == NULL) {
+        goto err;
+    }
+    sprite_batch.sorted = sorted;
+
+    vertices = realloc(sprite_batch.vertices, size * 4 * sizeof(SDL_Vertex));
+    if (vertices == NULL) {
+        goto err;
+    }
+    sprite_batch.vertices = vertices;
+
+    indices = realloc(sprite_batch.indices, size * 6 * sizeof(int));
+    if (indices == NULL) {
+        goto err;
+    }
+    sprite_batch.indices = indices;
+
+    sprite_batch.size = size;
 
     return 0;
+
+err:
+    PRINT_ERROR("Failed to grow sprite batch to %u sprites", size);
+    return -1;
 }
 
-static int _getTextSize(char *string, int *width, int *height)
+static sprite_group_t *getSpriteGroup(SDL_Texture *tex, SDL_Rect *dst)
 {
-    SDL_Color color = { 0 };
-    TTF_Font *font = tumFontGetCurFont();
-    SDL_Surface *surface = TTF_RenderText_Solid(font, string, color);
-    tumFontPutFont(font);
-    if (surface == NULL) {
-        goto err_surface;
+    sprite_group_t *groups;
+    unsigned int i;
+
+    for (i = sprite_batch.group_count; i--;) {
+        if (sprite_batch.groups[i].tex == tex) {
+            SDL_UnionRect(&sprite_batch.groups[i].bounds, dst,
+                          &sprite_batch.groups[i].bounds);
+            return &sprite_batch.groups[i];
+        }
+        // Moving the sprite past an overlapping group would change the result
+        if (SDL_HasIntersection(&sprite_batch.groups[i].bounds, dst)) {
+            break;
+        }
+    }
+
+    if (sprite_batch.group_count == sprite_batch.group_size) {
+        groups = realloc(sprite_batch.groups,
+                         (sprite_batch.group_size * 2 + 8) *
+                         sizeof(sprite_group_t));
+        if (groups == NULL) {
+            PRINT_ERROR("Failed to grow sprite groups");
+            return NULL;
+        }
+        sprite_batch.groups = groups;
+        sprite_batch.group_size = sprite_batch.group_size * 2 + 8;
     }
 
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    if (texture == NULL) {
-        goto err_texture;
+    groups = &sprite_batch.groups[sprite_batch.group_count++];
+    groups->tex = tex;
+    groups->bounds = *dst;
+    groups->count = 0;
+
+    return groups;
+}
+
+/**
+ * Adds a loaded image to the sprite batch, the job's reference to the image
+ * is held until the frame is drawn. crop is relative to the image, NULL for
+ * the entire image.
+ */
+static int batchLoadedImage(loaded_image_t *img, SDL_Rect *crop, int x,
+                            int y, int w, int h)
+{
+    sprite_group_t *group;
+    sprite_t *sprite;
+    SDL_Rect src;
+    SDL_Texture *tex = getLoadedImageTexture(img, &src);
+
+    if (tex == NULL) {
+        return -1;
     }
 
-    if (SDL_QueryTexture(texture, NULL, NULL, width, height)) {
-        goto err_query;
+    if (sprite_batch.count == sprite_batch.size)
+        if (growSpriteBatch()) {
+            return -1;
+        }
+
+    sprite = &sprite_batch.sprites[sprite_batch.count];
+    sprite->tex = tex;
+    sprite->src = src;
+    if (crop) {
+        sprite->src.x += crop->x;
+        sprite->src.y += crop->y;
+        sprite->src.w = crop->w;
+        sprite->src.h = crop->h;
+    }
+    sprite->dst.x = x;
+    sprite->dst.y = y;
+    sprite->dst.w = w;
+    sprite->dst.h = h;
+
+    group = getSpriteGroup(tex, &sprite->dst);
+    if (group == NULL) {
+        return -1;
     }
+    sprite->group = group - sprite_batch.groups;
+    group->count++;
 
-    SDL_DestroyTexture(texture);
-    SDL_FreeSurface(surface);
+    sprite_batch.count++;
 
     return 0;
+}
 
-err_query:
-    SDL_DestroyTexture(texture);
-err_texture:
-    SDL_FreeSurface(surface);
-err_surface:
-    return -1;
+static int drawSpriteGroup(sprite_group_t *group)
+{
+    sprite_t **sprites = &sprite_batch.sorted[group->first];
+    unsigned int i;
+    int ret = 0;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    SDL_Vertex *vertices = sprite_batch.vertices;
+    int *indices = sprite_batch.indices;
+    SDL_Color white = { MAX_8_BIT, MAX_8_BIT, MAX_8_BIT, ALPHA_SOLID };
+    float tex_w, tex_h;
+    int w, h;
+
+    if (SDL_QueryTexture(group->tex, NULL, NULL, &w, &h)) {
+        return -1;
+    }
+    tex_w = w;
+    tex_h = h;
+
+    for (i = 0; i < group->count; i++) {
+        SDL_Rect *src = &sprites[i]->src;
+        SDL_Rect *dst = &sprites[i]->dst;
+        SDL_Vertex *v = &vertices[i * 4];
+        int *idx = &indices[i * 6];
+
+        v[0].position.x = dst->x;
+        v[0].position.y = dst->y;
+        v[0].tex_coord.x = src->x / tex_w;
+        v[0].tex_coord.y = src->y / tex_h;
+        v[1].position.x = dst->x + dst->w;
+        v[1].position.y = dst->y;
+        v[1].tex_coord.x = (src->x + src->w) / tex_w;
+        v[1].tex_coord.y = src->y / tex_h;
+        v[2].position.x = dst->x + dst->w;
+        v[2].position.y = dst->y + dst->h;
+        v[2].tex_coord.x = (src->x + src->w) / tex_w;
+        v[2].tex_coord.y = (src->y + src->h) / tex_h;
+        v[3].position.x = dst->x;
+        v[3].position.y = dst->y + dst->h;
+        v[3].tex_coord.x = src->x / tex_w;
+        v[3].tex_coord.y = (src->y + src->h) / tex_h;
+        v[0].color = v[1].color = v[2].color = v[3].color = white;
+
+        idx[0] = i * 4;
+        idx[1] = i * 4 + 1;
+        idx[2] = i * 4 + 2;
+        idx[3] = i * 4;
+        idx[4] = i * 4 + 2;
+        idx[5] = i * 4 + 3;
+    }
+
+    ret = SDL_RenderGeometry(renderer, group->tex, vertices,
+                             group->count * 4, indices, group->count * 6);
+#else
+    for (i = 0; i < group->count; i++)
+        if (SDL_RenderCopy(renderer, group->tex, &sprites[i]->src,
+                           &sprites[i]->dst)) {
+            ret = -1;
+        }
+#endif
+
+    return ret;
+}
+
+static int flushSpriteBatch(void)
+{
+    unsigned int i, first = 0;
+    int ret = 0;
+
+    if (!sprite_batch.count) {
+        return 0;
+    }
+
+    // Sort the sprites by group, keeping their order within each group
+    for (i = 0; i < sprite_batch.group_count; i++) {
+        sprite_batch.groups[i].first = first;
+        first += sprite_batch.groups[i].count;
+        sprite_batch.groups[i].count = 0;
+    }
+
+    for (i = 0; i < sprite_batch.count; i++) {
+        sprite_group_t *group =
+            &sprite_batch.groups[sprite_batch.sprites[i].group];
+        sprite_batch.sorted[group->first + group->count++] =
+            &sprite_batch.sprites[i];
+    }
+
+    for (i = 0; i < sprite_batch.group_count; i++)
+        if (drawSpriteGroup(&sprite_batch.groups[i])) {
+            ret = -1;
+        }
+
+    sprite_batch.count = 0;
+    sprite_batch.group_count = 0;
+
+    return ret;
+}
+
+static int _drawText(char *string, signed short x, signed short y,
+                     float scale_x, float scale_y, unsigned int colour,
+                     font_handle_t font)
+{
+    tum_font_atlas_t *atlas = tumFontGetGlyphAtlas(font);
+    tum_font_glyph_t *glyph;
+    unsigned char prev = 0;
+    SDL_Rect dst;
+    int pen = 0;
+
+    if (atlas == NULL) {
+        return -1;
+    }
+
+    // Atlas textures are lost when the renderer is recreated
+    if (atlas->tex == NULL || atlas->tex_generation != renderer_generation) {
+        atlas->tex = SDL_CreateTextureFromSurface(renderer, atlas->surface);
+        if (atlas->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create glyph atlas texture");
+            return -1;
+        }
+        SDL_SetTextureBlendMode(atlas->tex, SDL_BLENDMODE_BLEND);
+        atlas->tex_generation = renderer_generation;
+    }
+
+    SDL_SetTextureColorMod(atlas->tex, RED_PORTION(colour),
+                           GREEN_PORTION(colour), BLUE_PORTION(colour));
+
+    for (; *string; string++) {
+        glyph = tumFontGetGlyph(atlas, *string);
+        if (glyph == NULL) {
+            continue;
+        }
+
+        if (prev) {
+            pen += tumFontGetKerning(atlas, prev, *string);
+        }
+        prev = *string;
+
+        if (pen == 0 && glyph->x_offset < 0) {
+            pen = -glyph->x_offset;
+        }
+
+        if (glyph->src.w) {
+            dst.x = x + roundf((pen + glyph->x_offset) * scale_x);
+            dst.y = y;
+            dst.w = roundf(glyph->src.w * scale_x);
+            dst.h = roundf(glyph->src.h * scale_y);
+            SDL_RenderCopy(renderer, atlas->tex, &glyph->src, &dst);
+        }
+        pen += glyph->advance;
+    }
+
+    return 0;
+}
+
+static int _getTextSize(char *string, int *width, int *height)
+{
+    font_handle_t font = tumFontGetCurFontHandle();
+    int ret = tumFontGetTextSize(font, string, width, height);
+
+    tumFontPutFontHandle(font);
+
+    return ret;
 }
 
 static int _drawArrow(signed short x1, signed short y1, signed short x2,
@@ -802,175 +1617,889 @@ static int _drawArrow(signed short x1, signed short y1, signed short x2,
     return 0;
 }
 
-static int vHandleDrawJob(draw_job_t *job)
+static int vHandleDrawJob(draw_job_t *job, int x_offset, int y_offset)
 {
     int ret = 0;
-    static int x_offset = 0;
-    static int y_offset = 0;
-    ;
-    if (!pthread_mutex_unlock(&global_offset.lock)) {
-        x_offset = global_offset.x;
-        y_offset = global_offset.y;
-    }
-    else {
-        return -1;
-    }
 
     if (job == NULL) {
         return -1;
     }
 
-    if (job->data == NULL) {
-        return -1;
-    }
+    // Batched sprites must be drawn before anything drawn on top of them
+    if (!isSpriteJob(job->type))
+        if (flushSpriteBatch()) {
+            ret = -1;
+        }
 
     switch (job->type) {
         case DRAW_CLEAR:
-            ret = _clearDisplay(job->data->clear.colour);
+            ret = _clearDisplay(job->data.clear.colour);
             break;
         case DRAW_ARC:
-            ret = _drawArc(job->data->arc.x + x_offset,
-                           job->data->arc.y + y_offset,
-                           job->data->arc.radius, job->data->arc.start,
-                           job->data->arc.end, job->data->arc.colour);
+            ret = _drawArc(job->data.arc.x + x_offset,
+                           job->data.arc.y + y_offset,
+                           job->data.arc.radius, job->data.arc.start,
+                           job->data.arc.end, job->data.arc.colour);
             break;
         case DRAW_ELLIPSE:
-            ret = _drawEllipse(job->data->ellipse.x + x_offset,
-                               job->data->ellipse.y, job->data->ellipse.rx,
-                               job->data->ellipse.ry,
-                               job->data->ellipse.colour);
+            ret = _drawEllipse(job->data.ellipse.x + x_offset,
+                               job->data.ellipse.y + y_offset,
+                               job->data.ellipse.rx,
+                               job->data.ellipse.ry,
+                               job->data.ellipse.colour);
             break;
         case DRAW_TEXT:
-            ret = _drawText(job->data->text.str,
-                            job->data->text.x + x_offset,
-                            job->data->text.y + y_offset,
-                            job->data->text.colour, job->data->text.font);
-            free(job->data->text.str);
+            ret = _drawText((char *)DRAW_JOB_PAYLOAD(job),
+                            job->data.text.x + x_offset,
+                            job->data.text.y + y_offset,
+                            job->data.text.scale_x, job->data.text.scale_y,
+                            job->data.text.colour, job->data.text.font);
             break;
         case DRAW_RECT:
-            ret = _drawRectangle(job->data->rect.x + x_offset,
-                                 job->data->rect.y + y_offset,
-                                 job->data->rect.w, job->data->rect.h,
-                                 job->data->rect.colour);
+            ret = _drawRectangle(job->data.rect.x + x_offset,
+                                 job->data.rect.y + y_offset,
+                                 job->data.rect.w, job->data.rect.h,
+                                 job->data.rect.colour);
             break;
         case DRAW_FILLED_RECT:
-            ret = _drawFilledRectangle(job->data->rect.x + x_offset,
-                                       job->data->rect.y + y_offset,
-                                       job->data->rect.w, job->data->rect.h,
-                                       job->data->rect.colour);
+            ret = _drawFilledRectangle(job->data.rect.x + x_offset,
+                                       job->data.rect.y + y_offset,
+                                       job->data.rect.w, job->data.rect.h,
+                                       job->data.rect.colour);
             break;
         case DRAW_CIRCLE:
-            ret = _drawCircle(job->data->circle.x + x_offset,
-                              job->data->circle.y + y_offset,
-                              job->data->circle.radius,
-                              job->data->circle.colour);
+            ret = _drawCircle(job->data.circle.x + x_offset,
+                              job->data.circle.y + y_offset,
+                              job->data.circle.radius,
+                              job->data.circle.colour);
             break;
         case DRAW_LINE:
-            ret = _drawLine(job->data->line.x1 + x_offset,
-                            job->data->line.y1 + y_offset,
-                            job->data->line.x2 + x_offset,
-                            job->data->line.y2 + y_offset,
-                            job->data->line.thickness,
-                            job->data->line.colour);
+            ret = _drawLine(job->data.line.x1 + x_offset,
+                            job->data.line.y1 + y_offset,
+                            job->data.line.x2 + x_offset,
+                            job->data.line.y2 + y_offset,
+                            job->data.line.thickness,
+                            job->data.line.colour);
             break;
         case DRAW_POLY:
-            ret = _drawPoly(job->data->poly.points, job->data->poly.n,
-                            x_offset, y_offset, job->data->poly.colour);
+            ret = _drawPoly((coord_t *)DRAW_JOB_PAYLOAD(job),
+                            job->data.poly.n,
+                            x_offset, y_offset, job->data.poly.colour);
             break;
         case DRAW_TRIANGLE:
-            ret = _drawTriangle(job->data->triangle.points, x_offset,
-                                y_offset, job->data->triangle.colour);
+            ret = _drawTriangle(job->data.triangle.points, x_offset,
+                                y_offset, job->data.triangle.colour);
+            break;
+        case DRAW_IMAGE:
+            ret = batchLoadedImage(job->data.image.img, NULL,
+                                   job->data.image.x + x_offset,
+                                   job->data.image.y + y_offset,
+                                   job->data.image.w, job->data.image.h);
+            break;
+        case DRAW_LOADED_IMAGE:
+            ret = batchLoadedImage(job->data.loaded_image.img, NULL,
+                                   job->data.loaded_image.x + x_offset,
+                                   job->data.loaded_image.y + y_offset,
+                                   job->data.loaded_image.w,
+                                   job->data.loaded_image.h);
+            break;
+        case DRAW_LOADED_IMAGE_CROP: {
+            SDL_Rect crop = { job->data.loaded_image_crop.c_x,
+                              job->data.loaded_image_crop.c_y,
+                              job->data.loaded_image_crop.c_w,
+                              job->data.loaded_image_crop.c_h
+                            };
+            ret = batchLoadedImage(job->data.loaded_image_crop.image,
+                                   &crop,
+                                   job->data.loaded_image_crop.x + x_offset,
+                                   job->data.loaded_image_crop.y + y_offset,
+                                   job->data.loaded_image_crop.w,
+                                   job->data.loaded_image_crop.h);
+        }
+        break;
+        case DRAW_ARROW:
+            ret = _drawArrow(job->data.arrow.x1 + x_offset,
+                             job->data.arrow.y1 + y_offset,
+                             job->data.arrow.x2 + x_offset,
+                             job->data.arrow.y2 + y_offset,
+                             job->data.arrow.head_length,
+                             job->data.arrow.thickness,
+                             job->data.arrow.colour);
+        default:
+            break;
+    }
+
+    return ret;
+}
+
+/**
+ * Puts the references that were taken when the job was submitted. A job that
+ * was abandoned while it was filled in may not hold them yet, reserved jobs
+ * start out zeroed.
+ */
+static void releaseDrawJob(draw_job_t *job)
+{
+    switch (job->type) {
+        case DRAW_TEXT:
+            tumFontPutFontHandle(job->data.text.font);
             break;
         case DRAW_IMAGE:
-            job->data->image.tex =
-                loadImage(job->data->image.filename, renderer);
-            ret = _drawImage(job->data->image.tex, renderer,
-                             job->data->image.x + x_offset,
-                             job->data->image.y + y_offset);
+            if (job->data.image.img) {
+                vPutLoadedImage(job->data.image.img);
+            }
             break;
         case DRAW_LOADED_IMAGE:
-            ret = xDrawLoadedImage(job->data->loaded_image.img, renderer,
-                                   job->data->loaded_image.x + x_offset,
-                                   job->data->loaded_image.y + y_offset);
-            vPutLoadedImage(job->data->loaded_image.img);
+            if (job->data.loaded_image.img) {
+                vPutLoadedImage(job->data.loaded_image.img);
+            }
             break;
         case DRAW_LOADED_IMAGE_CROP:
-            ret = xDrawLoadedImageCropped(
-                      job->data->loaded_image_crop.image, renderer,
-                      job->data->loaded_image_crop.x + x_offset,
-                      job->data->loaded_image_crop.y + y_offset,
-                      job->data->loaded_image_crop.c_x,
-                      job->data->loaded_image_crop.c_y,
-                      job->data->loaded_image_crop.c_w,
-                      job->data->loaded_image_crop.c_h);
-            vPutLoadedImage(job->data->loaded_image_crop.image);
+            if (job->data.loaded_image_crop.image) {
+                vPutLoadedImage(job->data.loaded_image_crop.image);
+            }
             break;
-        case DRAW_SCALED_IMAGE:
-            job->data->scaled_image.image.tex = loadImage(
-                                                    job->data->scaled_image.image.filename, renderer);
-            ret = _drawScaledImage(
-                      job->data->scaled_image.image.tex, renderer,
-                      job->data->scaled_image.image.x + x_offset,
-                      job->data->scaled_image.image.y + y_offset,
-                      job->data->scaled_image.scale);
-            free(job->data->scaled_image.image.filename);
+        default:
+            break;
+    }
+}
+
+static int growDrawFrame(unsigned long count)
+{
+    unsigned int size = draw_frame.size ? draw_frame.size : 64;
+    frame_job_t *jobs;
+
+    if (count <= draw_frame.size) {
+        return 0;
+    }
+
+    while (size < count) {
+        size *= 2;
+    }
+
+    jobs = realloc(draw_frame.jobs, size * sizeof(frame_job_t));
+    if (jobs == NULL) {
+        PRINT_ERROR("Failed to grow frame to %u jobs", size);
+        return -1;
+    }
+    draw_frame.jobs = jobs;
+    draw_frame.size = size;
+
+    return 0;
+}
+
+static int growFrameHeads(unsigned int count)
+{
+    unsigned int size = draw_frame.head_size ? draw_frame.head_size : 8;
+    frame_head_t *heads;
+
+    if (count <= draw_frame.head_size) {
+        return 0;
+    }
+
+    while (size < count) {
+        size *= 2;
+    }
+
+    heads = realloc(draw_frame.heads, size * sizeof(frame_head_t));
+    if (heads == NULL) {
+        PRINT_ERROR("Failed to grow frame to %u producers", size);
+        return -1;
+    }
+    draw_frame.heads = heads;
+    draw_frame.head_size = size;
+
+    return 0;
+}
+
+static void siftDownFrameHead(unsigned int i)
+{
+    frame_head_t *heads = draw_frame.heads;
+    frame_head_t head = heads[i];
+    unsigned int child;
+
+    while ((child = 2 * i + 1) < draw_frame.head_count) {
+        if (child + 1 < draw_frame.head_count &&
+            heads[child + 1].job->seq < heads[child].job->seq) {
+            child++;
+        }
+        if (head.job->seq <= heads[child].job->seq) {
+            break;
+        }
+        heads[i] = heads[child];
+        i = child;
+    }
+    heads[i] = head;
+}
+
+/**
+ * Screen area that a job draws to, clipped to the screen. Jobs that cannot
+ * be bounded cover the entire screen.
+ */
+static void getDrawJobBounds(draw_job_t *job, int x_offset, int y_offset,
+                             SDL_Rect *bounds)
+{
+    SDL_Rect screen = { 0, 0, screen_width, screen_height };
+    coord_t *points = NULL;
+    unsigned int i, n = 0;
+    int x1, y1, x2, y2, w, h, pad = DAMAGE_PADDING;
+
+    switch (job->type) {
+        case DRAW_ARC:
+            x1 = job->data.arc.x - job->data.arc.radius;
+            y1 = job->data.arc.y - job->data.arc.radius;
+            x2 = job->data.arc.x + job->data.arc.radius;
+            y2 = job->data.arc.y + job->data.arc.radius;
+            break;
+        case DRAW_ELLIPSE:
+            x1 = job->data.ellipse.x - job->data.ellipse.rx;
+            y1 = job->data.ellipse.y - job->data.ellipse.ry;
+            x2 = job->data.ellipse.x + job->data.ellipse.rx;
+            y2 = job->data.ellipse.y + job->data.ellipse.ry;
+            break;
+        case DRAW_TEXT:
+            if (tumFontGetTextSize(job->data.text.font,
+                                   (char *)DRAW_JOB_PAYLOAD(job), &w, &h)) {
+                goto screen;
+            }
+            x1 = job->data.text.x;
+            y1 = job->data.text.y;
+            x2 = x1 + w * job->data.text.scale_x;
+            y2 = y1 + h * job->data.text.scale_y;
+            break;
+        case DRAW_RECT:
+        case DRAW_FILLED_RECT:
+            x1 = SDL_min(job->data.rect.x, job->data.rect.x + job->data.rect.w);
+            y1 = SDL_min(job->data.rect.y, job->data.rect.y + job->data.rect.h);
+            x2 = SDL_max(job->data.rect.x, job->data.rect.x + job->data.rect.w);
+            y2 = SDL_max(job->data.rect.y, job->data.rect.y + job->data.rect.h);
+            break;
+        case DRAW_CIRCLE:
+            x1 = job->data.circle.x - job->data.circle.radius;
+            y1 = job->data.circle.y - job->data.circle.radius;
+            x2 = job->data.circle.x + job->data.circle.radius;
+            y2 = job->data.circle.y + job->data.circle.radius;
+            break;
+        case DRAW_LINE:
+            x1 = SDL_min(job->data.line.x1, job->data.line.x2);
+            y1 = SDL_min(job->data.line.y1, job->data.line.y2);
+            x2 = SDL_max(job->data.line.x1, job->data.line.x2);
+            y2 = SDL_max(job->data.line.y1, job->data.line.y2);
+            pad += job->data.line.thickness;
             break;
         case DRAW_ARROW:
-            ret = _drawArrow(job->data->arrow.x1 + x_offset,
-                             job->data->arrow.y1 + y_offset,
-                             job->data->arrow.x2 + x_offset,
-                             job->data->arrow.y2 + y_offset,
-                             job->data->arrow.head_length,
-                             job->data->arrow.thickness,
-                             job->data->arrow.colour);
-        default:
+            x1 = SDL_min(job->data.arrow.x1, job->data.arrow.x2);
+            y1 = SDL_min(job->data.arrow.y1, job->data.arrow.y2);
+            x2 = SDL_max(job->data.arrow.x1, job->data.arrow.x2);
+            y2 = SDL_max(job->data.arrow.y1, job->data.arrow.y2);
+            pad += job->data.arrow.thickness +
+                   2 * abs(job->data.arrow.head_length);
             break;
+        case DRAW_POLY:
+            points = (coord_t *)DRAW_JOB_PAYLOAD(job);
+            n = job->data.poly.n;
+            break;
+        case DRAW_TRIANGLE:
+            points = job->data.triangle.points;
+            n = 3;
+            break;
+        case DRAW_IMAGE:
+            x1 = job->data.image.x;
+            y1 = job->data.image.y;
+            x2 = x1 + job->data.image.w;
+            y2 = y1 + job->data.image.h;
+            break;
+        case DRAW_LOADED_IMAGE:
+            x1 = job->data.loaded_image.x;
+            y1 = job->data.loaded_image.y;
+            x2 = x1 + job->data.loaded_image.w;
+            y2 = y1 + job->data.loaded_image.h;
+            break;
+        case DRAW_LOADED_IMAGE_CROP:
+            x1 = job->data.loaded_image_crop.x;
+            y1 = job->data.loaded_image_crop.y;
+            x2 = x1 + job->data.loaded_image_crop.w;
+            y2 = y1 + job->data.loaded_image_crop.h;
+            break;
+        case DRAW_NONE:
+            bounds->x = bounds->y = bounds->w = bounds->h = 0;
+            return;
+        default:
+            goto screen;
+    }
+
+    if (points) {
+        if (n == 0) {
+            bounds->x = bounds->y = bounds->w = bounds->h = 0;
+            return;
+        }
+        x1 = x2 = points[0].x;
+        y1 = y2 = points[0].y;
+        for (i = 1; i < n; i++) {
+            x1 = SDL_min(x1, points[i].x);
+            y1 = SDL_min(y1, points[i].y);
+            x2 = SDL_max(x2, points[i].x);
+            y2 = SDL_max(y2, points[i].y);
+        }
+    }
+
+    bounds->x = x1 + x_offset - pad;
+    bounds->y = y1 + y_offset - pad;
+    bounds->w = x2 - x1 + 2 * pad + 1;
+    bounds->h = y2 - y1 + 2 * pad + 1;
+
+    if (!SDL_IntersectRect(bounds, &screen, bounds)) {
+        bounds->w = bounds->h = 0;
+    }
+    return;
+
+screen:
+    *bounds = screen;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+
+    while (len--) {
+        hash = (hash ^ *bytes++) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Hashes everything that affects what the job draws. The job header is
+ * zeroed on submission, so padding within the job's data is always zero.
+ */
+static uint64_t hashDrawJob(draw_job_t *job, SDL_Rect *bounds)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = hashBytes(hash, &job->type, sizeof(job->type));
+    hash = hashBytes(hash, &job->data, sizeof(job->data));
+    hash = hashBytes(hash, bounds, sizeof(SDL_Rect));
+
+    if (job->type == DRAW_TEXT)
+        hash = hashBytes(hash, DRAW_JOB_PAYLOAD(job),
+                         strlen((char *)DRAW_JOB_PAYLOAD(job)));
+    else if (job->type == DRAW_POLY)
+        hash = hashBytes(hash, DRAW_JOB_PAYLOAD(job),
+                         job->data.poly.n * sizeof(coord_t));
+
+    return hash;
+}
+
+static void disableDamageTracking(void)
+{
+    // Textures are destroyed along with their renderer
+    if (damage.target && damage.target_generation == renderer_generation) {
+        SDL_DestroyTexture(damage.target);
+    }
+    damage.target = NULL;
+
+    free(damage.tile_hashes);
+    free(damage.new_hashes);
+    free(damage.rects);
+    damage.tile_hashes = NULL;
+    damage.new_hashes = NULL;
+    damage.rects = NULL;
+}
+
+static int enableDamageTracking(void)
+{
+    damage.tiles_x = (screen_width + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+    damage.tiles_y =
+        (screen_height + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+
+    damage.tile_hashes = calloc(damage.tiles_x * damage.tiles_y,
+                                sizeof(uint64_t));
+    damage.new_hashes = calloc(damage.tiles_x * damage.tiles_y,
+                               sizeof(uint64_t));
+    damage.rects = calloc(damage.tiles_x * damage.tiles_y,
+                          sizeof(SDL_Rect));
+    if (!damage.tile_hashes || !damage.new_hashes || !damage.rects) {
+        PRINT_ERROR("Failed to allocate damage tracking tiles");
+        disableDamageTracking();
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns 1 if the target still holds the previous frame, 0 if the entire
+ * screen must be redrawn and -1 on error
+ */
+static int prepareDamageTarget(void)
+{
+    if (damage.target && damage.target_generation == renderer_generation) {
+        return !atomic_exchange(&damage.invalidated, 0);
+    }
+
+    damage.target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                      SDL_TEXTUREACCESS_TARGET, screen_width,
+                                      screen_height);
+    if (damage.target == NULL) {
+        PRINT_SDL_ERROR("Failed to create damage tracking target");
+        return -1;
+    }
+    SDL_SetTextureBlendMode(damage.target, SDL_BLENDMODE_NONE);
+    damage.target_generation = renderer_generation;
+    atomic_store(&damage.invalidated, 0);
+
+    return 0;
+}
+
+static int drawDamagedFrame(frame_job_t *jobs, unsigned int count)
+{
+    int tile_count = damage.tiles_x * damage.tiles_y;
+    int rect_count = 0, valid, t, tx, ty, tx1, ty1, tx2, ty2, i;
+    uint64_t *hashes;
+    unsigned int j;
+    SDL_Rect rect;
+    int ret = 0;
+
+    valid = prepareDamageTarget();
+    if (valid == -1) {
+        return -1;
+    }
+
+    for (t = 0; t < tile_count; t++) {
+        damage.new_hashes[t] = FNV_OFFSET_BASIS;
+    }
+
+    // Each tile's hash chains the hashes of the jobs touching it in order
+    for (j = 0; j < count; j++) {
+        if (jobs[j].bounds.w == 0 || jobs[j].bounds.h == 0) {
+            continue;
+        }
+        tx1 = jobs[j].bounds.x / DAMAGE_TILE_SIZE;
+        ty1 = jobs[j].bounds.y / DAMAGE_TILE_SIZE;
+        tx2 = (jobs[j].bounds.x + jobs[j].bounds.w - 1) / DAMAGE_TILE_SIZE;
+        ty2 = (jobs[j].bounds.y + jobs[j].bounds.h - 1) / DAMAGE_TILE_SIZE;
+        for (ty = ty1; ty <= ty2; ty++)
+            for (tx = tx1; tx <= tx2; tx++) {
+                t = ty * damage.tiles_x + tx;
+                damage.new_hashes[t] = hashBytes(damage.new_hashes[t],
+                                                 &jobs[j].hash,
+                                                 sizeof(uint64_t));
+            }
+    }
+
+    // Runs of damaged tiles are merged with an equal run in the row above
+    for (ty = 0; ty < damage.tiles_y; ty++)
+        for (tx = 0; tx < damage.tiles_x;) {
+            t = ty * damage.tiles_x + tx;
+            if (valid && damage.new_hashes[t] == damage.tile_hashes[t]) {
+                tx++;
+                continue;
+            }
+
+            rect.x = tx * DAMAGE_TILE_SIZE;
+            rect.y = ty * DAMAGE_TILE_SIZE;
+            rect.h = DAMAGE_TILE_SIZE;
+            for (; tx < damage.tiles_x; tx++, t++)
+                if (valid &&
+                    damage.new_hashes[t] == damage.tile_hashes[t]) {
+                    break;
+                }
+            rect.w = tx * DAMAGE_TILE_SIZE - rect.x;
+
+            for (i = 0; i < rect_count; i++)
+                if (damage.rects[i].x == rect.x &&
+                    damage.rects[i].w == rect.w &&
+                    damage.rects[i].y + damage.rects[i].h == rect.y) {
+                    damage.rects[i].h += rect.h;
+                    break;
+                }
+            if (i == rect_count) {
+                damage.rects[rect_count++] = rect;
+            }
+        }
+
+    hashes = damage.tile_hashes;
+    damage.tile_hashes = damage.new_hashes;
+    damage.new_hashes = hashes;
+
+    if (SDL_SetRenderTarget(renderer, damage.target)) {
+        PRINT_SDL_ERROR("Failed to set damage tracking target");
+        atomic_store(&damage.invalidated, 1);
+        return -1;
+    }
+
+    for (i = 0; i < rect_count; i++) {
+        SDL_RenderSetClipRect(renderer, &damage.rects[i]);
+
+        for (j = 0; j < count; j++)
+            if (SDL_HasIntersection(&jobs[j].bounds, &damage.rects[i]))
+                if (vHandleDrawJob(jobs[j].job, draw_frame.x_offset,
+                                   draw_frame.y_offset) == -1) {
+                    ret = -1;
+                }
+
+        if (flushSpriteBatch()) {
+            ret = -1;
+        }
+    }
+
+    SDL_RenderSetClipRect(renderer, NULL);
+    SDL_SetRenderTarget(renderer, NULL);
+
+    if (SDL_RenderCopy(renderer, damage.target, NULL, NULL)) {
+        PRINT_SDL_ERROR("Failed to copy damage tracking target");
+        ret = -1;
     }
-    free(job->data);
 
     return ret;
 }
 
-#define INIT_JOB(JOB, TYPE)                                                    \
-    draw_job_t *JOB = pushDrawJob();                                       \
-    if (!JOB)                                                              \
-        return -1;                                                     \
-    union data_u *data = calloc(1, sizeof(union data_u));                  \
-    if (data == NULL)                                                      \
-        logCriticalError("job->data alloc");                           \
-    JOB->data = data;                                                      \
-    JOB->type = TYPE;
+static signed short transformX(signed short x)
+{
+    return roundf(x * transforms[transform_depth].scale_x +
+                  transforms[transform_depth].x);
+}
 
-static void logCriticalError(char *msg)
+static signed short transformY(signed short y)
 {
-    printf("[ERROR] %s\n", msg);
-    exit(-1);
+    return roundf(y * transforms[transform_depth].scale_y +
+                  transforms[transform_depth].y);
 }
 
-#define NS_IN_SECOND 1000000000.0
-#define MS_IN_SECOND 1000.0
-#define NS_IN_MS 1000000.0
+static signed short scaleX(float w)
+{
+    return roundf(w * transforms[transform_depth].scale_x);
+}
+
+static signed short scaleY(float h)
+{
+    return roundf(h * transforms[transform_depth].scale_y);
+}
+
+/**
+ * Lengths that cannot be scaled per axis, eg. radii, are scaled by the mean
+ * of both axes' scales
+ */
+static signed short scaleLength(float length)
+{
+    return roundf(length * (fabsf(transforms[transform_depth].scale_x) +
+                            fabsf(transforms[transform_depth].scale_y)) /
+                  2);
+}
+
+#define INIT_JOB_PAYLOAD(JOB, TYPE, PAYLOAD_SIZE)                              \
+    draw_job_t *JOB = pushDrawJob(TYPE, PAYLOAD_SIZE);                     \
+    if (!JOB)                                                              \
+        return -1;
 
+#define INIT_JOB(JOB, TYPE) INIT_JOB_PAYLOAD(JOB, TYPE, 0)
+
+#define NS_IN_SECOND 1000000000ULL
+#define NS_IN_US 1000
+#define US_IN_SECOND 1000000ULL
+
+#ifdef configFPS_LIMIT_RATE
+#define FRAMELIMIT configFPS_LIMIT_RATE
+#else
+#define FRAMELIMIT 50
+#endif //configFPS_LIMIT_RATE
+
+#define DEFAULT_REFRESH_RATE 60
+
+/**
+ * Frames are presented at deadlines on the monotonic clock, one period
+ * apart. The task updating the screen waits for the next deadline using
+ * tumDrawGetFrameDelay(), such that deadlines do not drift. Frames that are
+ * presented more than half a period late miss their deadline, the missed
+ * periods are skipped instead of being made up for.
+ */
+static struct frame_pacer {
+    pthread_mutex_t lock;
+    tum_draw_pacing_t mode;
+    unsigned int rate;
+    int changed; // Period and vsync are updated by the GL thread
+    int vsync;
+    uint64_t period; // All times in ns
+    uint64_t deadline;
+    uint64_t last_present;
+    tum_draw_frame_stats_t stats;
+} frame_pacer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
 #if (configFPS_LIMIT == 1)
-static float timespecDiffMilli(struct timespec *start, struct timespec *stop)
+    .mode = TUM_DRAW_PACING_FIXED,
+    .rate = FRAMELIMIT,
+#else
+    .mode = TUM_DRAW_PACING_VSYNC,
+#endif //configFPS_LIMIT
+    .changed = 1,
+};
+
+static uint64_t getMonotonicTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * NS_IN_SECOND + now.tv_nsec;
+}
+
+/**
+ * Applies a changed pacing mode, must be called from the GL thread
+ */
+static void updateFramePacer(void)
+{
+    SDL_DisplayMode display_mode;
+    int refresh_rate = DEFAULT_REFRESH_RATE;
+
+    pthread_mutex_lock(&frame_pacer.lock);
+
+    if (!frame_pacer.changed) {
+        goto out;
+    }
+    frame_pacer.changed = 0;
+
+    switch (frame_pacer.mode) {
+        case TUM_DRAW_PACING_VSYNC:
+            if (!SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window),
+                                           &display_mode) &&
+                display_mode.refresh_rate) {
+                refresh_rate = display_mode.refresh_rate;
+            }
+            frame_pacer.period = NS_IN_SECOND / refresh_rate;
+            break;
+        case TUM_DRAW_PACING_FIXED:
+            frame_pacer.period = NS_IN_SECOND / frame_pacer.rate;
+            break;
+        default:
+            frame_pacer.period = 0;
+            break;
+    }
+    frame_pacer.deadline = 0;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (frame_pacer.vsync != (frame_pacer.mode == TUM_DRAW_PACING_VSYNC))
+        if (!SDL_RenderSetVSync(renderer, !frame_pacer.vsync)) {
+            frame_pacer.vsync = !frame_pacer.vsync;
+        }
+#endif
+
+out:
+    pthread_mutex_unlock(&frame_pacer.lock);
+}
+
+static void recordFramePresent(unsigned int queue_depth,
+                               unsigned int pending_jobs)
+{
+    tum_draw_frame_stats_t *stats = &frame_pacer.stats;
+    uint64_t now = getMonotonicTime();
+    uint64_t interval, missed;
+    unsigned int bin;
+
+    pthread_mutex_lock(&frame_pacer.lock);
+
+    if (frame_pacer.last_present) {
+        interval = (now - frame_pacer.last_present) / NS_IN_US;
+        bin = interval / FRAME_HISTOGRAM_BIN_WIDTH_US;
+        if (bin >= FRAME_HISTOGRAM_BINS) {
+            bin = FRAME_HISTOGRAM_BINS - 1;
+        }
+        stats->histogram[bin]++;
+        if (!stats->min_interval_us || interval < stats->min_interval_us) {
+            stats->min_interval_us = interval;
+        }
+        if (interval > stats->max_interval_us) {
+            stats->max_interval_us = interval;
+        }
+        stats->total_interval_us += interval;
+    }
+    frame_pacer.last_present = now;
+
+    stats->frames++;
+    stats->queue_depth = queue_depth;
+    if (queue_depth > stats->max_queue_depth) {
+        stats->max_queue_depth = queue_depth;
+    }
+    stats->pending_jobs = pending_jobs;
+
+    if (frame_pacer.period) {
+        if (!frame_pacer.deadline) {
+            frame_pacer.deadline = now;
+        }
+        else if (now > frame_pacer.deadline + frame_pacer.period / 2) {
+            missed = (now - frame_pacer.deadline + frame_pacer.period / 2) /
+                     frame_pacer.period;
+            stats->missed_deadlines += missed;
+            frame_pacer.deadline += missed * frame_pacer.period;
+        }
+        frame_pacer.deadline += frame_pacer.period;
+    }
+
+    pthread_mutex_unlock(&frame_pacer.lock);
+}
+
+int tumDrawSetFramePacing(tum_draw_pacing_t mode, unsigned int rate)
+{
+    if (mode == TUM_DRAW_PACING_FIXED && rate == 0) {
+        PRINT_ERROR("Fixed rate frame pacing requires a rate");
+        return -1;
+    }
+
+    if (mode == TUM_DRAW_PACING_VSYNC && headless_surface) {
+        PRINT_ERROR("Cannot synchronize to the display in headless mode");
+        return -1;
+    }
+
+    pthread_mutex_lock(&frame_pacer.lock);
+    frame_pacer.mode = mode;
+    frame_pacer.rate = rate;
+    frame_pacer.changed = 1;
+    pthread_mutex_unlock(&frame_pacer.lock);
+
+    return 0;
+}
+
+unsigned long tumDrawGetFrameDelay(void)
 {
-    if ((stop->tv_nsec - start->tv_nsec) < 0)
-        return (stop->tv_sec - start->tv_sec - 1) * MS_IN_SECOND +
-               (stop->tv_nsec - start->tv_nsec + NS_IN_SECOND) /
-               NS_IN_MS;
+    unsigned long delay = 0;
+    uint64_t now = getMonotonicTime();
+
+    pthread_mutex_lock(&frame_pacer.lock);
+    if (frame_pacer.deadline > now) {
+        delay = (frame_pacer.deadline - now) / NS_IN_US;
+    }
+    pthread_mutex_unlock(&frame_pacer.lock);
+
+    return delay;
+}
+
+unsigned long tumDrawGetFrameDelayTicks(void)
+{
+    return (tumDrawGetFrameDelay() * configTICK_RATE_HZ + US_IN_SECOND - 1) /
+           US_IN_SECOND + 1;
+}
+
+int tumDrawGetFrameStats(tum_draw_frame_stats_t *stats)
+{
+    if (stats == NULL) {
+        return -1;
+    }
 
-    return (stop->tv_sec - start->tv_sec) * MS_IN_SECOND +
-           (stop->tv_nsec - start->tv_nsec) / NS_IN_MS;
+    pthread_mutex_lock(&frame_pacer.lock);
+    *stats = frame_pacer.stats;
+    pthread_mutex_unlock(&frame_pacer.lock);
+
+    return 0;
+}
+
+void tumDrawResetFrameStats(void)
+{
+    pthread_mutex_lock(&frame_pacer.lock);
+    memset(&frame_pacer.stats, 0, sizeof(frame_pacer.stats));
+    frame_pacer.last_present = 0;
+    pthread_mutex_unlock(&frame_pacer.lock);
+}
+
+static int captureFrame(void)
+{
+    char filename[PATH_MAX];
+    SDL_Surface *surf = headless_surface;
+    FILE *file;
+    int y;
+
+    snprintf(filename, PATH_MAX, "%s%05lu.%s", frame_capture.prefix,
+             frame_capture.frame++ % frame_capture.ring_size,
+             (frame_capture.format == TUM_DRAW_CAPTURE_PNG) ? "png" :
+             "rgba");
+
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+    // Batched commands must reach the headless surface before it is saved
+    if (surf && SDL_RenderFlush(renderer)) {
+        PRINT_SDL_ERROR("Failed to flush renderer");
+        return -1;
+    }
+#endif
+
+    // The window's back buffer must be read before it is presented
+    if (surf == NULL) {
+        if (frame_capture.surf == NULL) {
+            frame_capture.surf = SDL_CreateRGBSurfaceWithFormat(
+                                     0, screen_width, screen_height, 32,
+                                     SDL_PIXELFORMAT_RGBA32);
+            if (frame_capture.surf == NULL) {
+                PRINT_SDL_ERROR("Failed to create capture surface");
+                return -1;
+            }
+        }
+
+        surf = frame_capture.surf;
+
+        if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA32,
+                                 surf->pixels, surf->pitch)) {
+            PRINT_SDL_ERROR("Failed to read frame");
+            return -1;
+        }
+    }
+
+    if (frame_capture.format == TUM_DRAW_CAPTURE_PNG) {
+        if (IMG_SavePNG(surf, filename)) {
+            PRINT_SDL_ERROR("Failed to save frame '%s'", filename);
+            return -1;
+        }
+        return 0;
+    }
+
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        PRINT_ERROR("Failed to open frame file '%s'", filename);
+        return -1;
+    }
+
+    for (y = 0; y < surf->h; y++)
+        if (fwrite((char *)surf->pixels + y * surf->pitch, 4, surf->w,
+                   file) != (size_t)surf->w) {
+            PRINT_ERROR("Failed to write frame '%s'", filename);
+            fclose(file);
+            return -1;
+        }
+
+    fclose(file);
+
+    return 0;
+}
+
+int tumDrawSetFrameCapture(tum_draw_capture_format_t format, char *prefix,
+                           unsigned int ring_size)
+{
+    char *new_prefix = NULL;
+
+    if (format != TUM_DRAW_CAPTURE_NONE) {
+        if (prefix == NULL || ring_size == 0) {
+            PRINT_ERROR("Frame capture requires a prefix and ring size");
+            return -1;
+        }
+
+        new_prefix = strdup(prefix);
+        if (new_prefix == NULL) {
+            PRINT_ERROR("Failed to duplicate frame capture prefix");
+            return -1;
+        }
+    }
+
+    free(frame_capture.prefix);
+    frame_capture.prefix = new_prefix;
+    frame_capture.format = format;
+    frame_capture.ring_size = ring_size;
+    frame_capture.frame = 0;
+
+    return 0;
+}
+
+int tumDrawSetDamageTracking(int enable)
+{
+    atomic_store(&damage.requested, !!enable);
+
+    return 0;
 }
 
-#ifdef configFPS_LIMIT_RATE
-#define FRAMELIMIT configFPS_LIMIT_RATE
-#else
-#define FRAMELIMIT 50
-#endif //configFPS_LIMIT_RATE
-#define FRAMELIMIT_PERIOD 1000.0 / FRAMELIMIT
-#endif //configFPS_LIMIT
-
 int tumDrawUpdateScreen(void)
 {
     if (tumUtilIsCurGLThread()) {
@@ -979,43 +2508,147 @@ int tumDrawUpdateScreen(void)
         goto err;
     }
 
-#if (configFPS_LIMIT == 1)
-    static struct timespec last_time = { 0 }, cur_time = { 0 };
+    draw_producer_t *producer;
+    draw_job_t *job;
+    frame_head_t *head;
+    unsigned long job_count = 0, pending_jobs = 0;
+    unsigned int i, first = 0, producer_count = 0;
+    int ret = 0;
+
+    updateFramePacer();
+
+    freeRetiredImages();
+    tumFontFreeRetiredAtlases(renderer_generation);
+
+    // Jobs published after this point are drawn in the next frame
+    for (producer = atomic_load_explicit(&draw_producers,
+                                         memory_order_acquire);
+         producer; producer = producer->next) {
+        producer->frame_jobs = atomic_load_explicit(
+                                   &producer->published_jobs, memory_order_acquire);
+        job_count += producer->frame_jobs - producer->consumed_jobs;
+        producer_count++;
+    }
 
-    if (clock_gettime(CLOCK_MONOTONIC, &cur_time)) {
-        PRINT_ERROR("Failed to get monotonic clock");
+    if (job_count == 0) {
         goto err;
     }
 
-    if (timespecDiffMilli(&last_time, &cur_time) < (float)FRAMELIMIT_PERIOD) {
+    if (growDrawFrame(job_count) || growFrameHeads(producer_count)) {
         goto err;
     }
 
-    memcpy(&last_time, &cur_time, sizeof(struct timespec));
-#endif //configFPS_LIMIT
+    // Merge the producers' jobs in submission order, taking the lowest
+    // sequence number among the producers' next jobs each time
+    draw_frame.head_count = 0;
+    for (producer = atomic_load_explicit(&draw_producers,
+                                         memory_order_acquire);
+         producer && draw_frame.head_count < producer_count;
+         producer = producer->next) {
+        job = peekDrawJob(producer);
+        if (job) {
+            head = &draw_frame.heads[draw_frame.head_count++];
+            head->job = job;
+            head->producer = producer;
+        }
+    }
 
-    if (job_list_head.next == NULL) {
-        goto err;
+    for (i = draw_frame.head_count / 2; i-- > 0;) {
+        siftDownFrameHead(i);
     }
 
-    draw_job_t *tmp_job;
+    for (draw_frame.count = 0;
+         draw_frame.count < job_count && draw_frame.head_count;
+         draw_frame.count++) {
+        head = &draw_frame.heads[0];
+        job = head->job;
 
-    while ((tmp_job = popDrawJob()) != NULL) {
-        if (!tmp_job->data) {
-            return -1;
+        consumeDrawJob(head->producer, job);
+        draw_frame.jobs[draw_frame.count].job = job;
+
+        // Everything drawn before a clear is hidden by it
+        if (job->type == DRAW_CLEAR) {
+            first = draw_frame.count;
+        }
+
+        head->job = peekDrawJob(head->producer);
+        if (head->job == NULL) {
+            *head = draw_frame.heads[--draw_frame.head_count];
+        }
+        siftDownFrameHead(0);
+    }
+
+    if (atomic_load(&damage.requested) != (damage.tile_hashes != NULL)) {
+        if (damage.tile_hashes) {
+            disableDamageTracking();
+        }
+        else if (enableDamageTracking()) {
+            ret = -1;
+        }
+    }
+
+    // Offsets changed while drawing take effect in the next frame
+    pthread_mutex_lock(&global_offset.lock);
+    draw_frame.x_offset = global_offset.x;
+    draw_frame.y_offset = global_offset.y;
+    pthread_mutex_unlock(&global_offset.lock);
+
+    if (damage.tile_hashes) {
+        for (i = first; i < draw_frame.count; i++) {
+            frame_job_t *frame_job = &draw_frame.jobs[i];
+
+            getDrawJobBounds(frame_job->job, draw_frame.x_offset,
+                             draw_frame.y_offset, &frame_job->bounds);
+            frame_job->hash = hashDrawJob(frame_job->job, &frame_job->bounds);
+        }
+
+        if (drawDamagedFrame(&draw_frame.jobs[first],
+                             draw_frame.count - first)) {
+            ret = -1;
         }
-        if (vHandleDrawJob(tmp_job) == -1) {
-            goto draw_error;
+    }
+    else {
+        for (i = first; i < draw_frame.count; i++)
+            if (vHandleDrawJob(draw_frame.jobs[i].job, draw_frame.x_offset,
+                               draw_frame.y_offset) == -1) {
+                ret = -1;
+            }
+
+        if (flushSpriteBatch()) {
+            ret = -1;
         }
-        free(tmp_job);
     }
 
+    // All jobs are released, even on error, once nothing refers to them
+    for (i = 0; i < draw_frame.count; i++) {
+        releaseDrawJob(draw_frame.jobs[i].job);
+    }
+    draw_frame.count = 0;
+
+    for (producer = atomic_load_explicit(&draw_producers,
+                                         memory_order_acquire);
+         producer; producer = producer->next) {
+        returnDrawJobBlocks(producer);
+    }
+
+    if (frame_capture.format != TUM_DRAW_CAPTURE_NONE)
+        if (captureFrame()) {
+            ret = -1;
+        }
+
+    for (producer = atomic_load_explicit(&draw_producers,
+                                         memory_order_acquire);
+         producer; producer = producer->next)
+        pending_jobs += atomic_load_explicit(&producer->published_jobs,
+                                             memory_order_relaxed) -
+                        producer->frame_jobs;
+
     SDL_RenderPresent(renderer);
 
-    return 0;
+    recordFramePresent(job_count, pending_jobs);
+
+    return ret;
 
-draw_error:
-    free(tmp_job);
 err:
     return -1;
 }
@@ -1025,6 +2658,39 @@ char *tumGetErrorMessage(void)
     return error_message;
 }
 
+static int initBackend(char *path, Uint32 sdl_flags)
+{
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+    // Resources are indexed once, later lookups are served from the index
+    if (tumUtilRescanResources()) {
+        PRINT_ERROR("Failed to index resources");
+    }
+
+    if (SDL_Init(sdl_flags)) {
+        PRINT_SDL_ERROR("SDL_Init failed");
+        goto err_sdl;
+    }
+    if (TTF_Init()) {
+        PRINT_ERROR("TTF_Init failed");
+        goto err_ttf;
+    }
+
+    if (tumFontInit(path)) {
+        PRINT_ERROR("TUM Font init failed");
+        goto err_tum_font;
+    }
+
+    return 0;
+
+err_tum_font:
+    TTF_Quit();
+err_ttf:
+    SDL_Quit();
+err_sdl:
+    return -1;
+}
+
 int tumDrawInit(char *path) // Should be called from the Thread running main()
 {
     /* Relevant for Docker-based toolchain */
@@ -1042,20 +2708,8 @@ int tumDrawInit(char *path) // Should be called from the Thread running main()
 #error "Unexpected value of HOST_OS!"
 #endif /* HOST_OS */
 #endif /* DOCKER */
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
-
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO)) {
-        PRINT_SDL_ERROR("SDL_Init failed");
-        goto err_sdl;
-    }
-    if (TTF_Init()) {
-        PRINT_ERROR("TTF_Init failed");
-        goto err_ttf;
-    }
-
-    if (tumFontInit(path)) {
-        PRINT_ERROR("TUM Font init failed");
-        goto err_tum_font;
+    if (initBackend(path, SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO)) {
+        goto err_init;
     }
 
     window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED,
@@ -1097,36 +2751,84 @@ err_create_context:
     SDL_DestroyWindow(window);
 err_window:
     tumFontExit();
-err_tum_font:
     TTF_Quit();
-err_ttf:
     SDL_Quit();
-err_sdl:
+err_init:
     return -1;
 }
 
-int tumDrawBindThread(void) // Should be called from the Drawing Thread
+int tumDrawInitHeadless(char *path)
 {
-    if (SDL_GL_MakeCurrent(window, context) < 0) {
-        PRINT_SDL_ERROR("Releasing current context failed");
-        goto err_make_current;
+    if (initBackend(path, SDL_INIT_EVENTS)) {
+        goto err_init;
+    }
+
+    // Machines without a display often have no audio either
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        PRINT_SDL_ERROR("Audio is not available");
+    }
+
+    headless_surface = SDL_CreateRGBSurfaceWithFormat(
+                           0, screen_width, screen_height, 32,
+                           SDL_PIXELFORMAT_RGBA32);
+    if (headless_surface == NULL) {
+        PRINT_SDL_ERROR("Failed to create %d x %d headless surface",
+                        screen_width, screen_height);
+        goto err_surface;
     }
 
+    tumDrawSetFramePacing(TUM_DRAW_PACING_NONE, 0);
+
+    tumDrawBindThread();
+
+    atexit(SDL_Quit);
+
+    return 0;
+
+err_surface:
+    tumFontExit();
+    TTF_Quit();
+    SDL_Quit();
+err_init:
+    return -1;
+}
+
+int tumDrawBindThread(void) // Should be called from the Drawing Thread
+{
+    if (headless_surface == NULL)
+        if (SDL_GL_MakeCurrent(window, context) < 0) {
+            PRINT_SDL_ERROR("Releasing current context failed");
+            goto err_make_current;
+        }
+
     if (renderer) {
+        // Retired textures belong to the renderer being replaced
+        freeRetiredImages();
         SDL_DestroyRenderer(renderer);
         renderer = NULL;
     }
 
-    renderer = SDL_CreateRenderer(window, -1,
-                                  SDL_RENDERER_ACCELERATED |
-                                  SDL_RENDERER_TARGETTEXTURE |
-                                  SDL_RENDERER_PRESENTVSYNC);
+    if (headless_surface) {
+        renderer = SDL_CreateSoftwareRenderer(headless_surface);
+    }
+    else {
+        pthread_mutex_lock(&frame_pacer.lock);
+        frame_pacer.vsync = frame_pacer.mode == TUM_DRAW_PACING_VSYNC;
+        renderer = SDL_CreateRenderer(window, -1,
+                                      SDL_RENDERER_ACCELERATED |
+                                      SDL_RENDERER_TARGETTEXTURE |
+                                      (frame_pacer.vsync ?
+                                       SDL_RENDERER_PRESENTVSYNC : 0));
+        pthread_mutex_unlock(&frame_pacer.lock);
+    }
 
     if (renderer == NULL) {
         PRINT_SDL_ERROR("Failed to create renderer");
         goto err_renderer;
     }
 
+    renderer_generation++;
+
     SDL_SetRenderDrawColor(renderer, MAX_8_BIT, MAX_8_BIT, MAX_8_BIT,
                            ALPHA_SOLID);
 
@@ -1149,9 +2851,13 @@ int tumDrawBindThread(void) // Should be called from the Drawing Thread
     return 0;
 
 err_renderer:
-    SDL_DestroyWindow(window);
+    if (window) {
+        SDL_DestroyWindow(window);
+    }
 err_make_current:
-    SDL_GL_DeleteContext(context);
+    if (context) {
+        SDL_GL_DeleteContext(context);
+    }
     TTF_Quit();
     SDL_Quit();
     return -1;
@@ -1167,6 +2873,10 @@ void tumDrawExit(void)
         SDL_DestroyRenderer(renderer);
     }
 
+    if (headless_surface) {
+        SDL_FreeSurface(headless_surface);
+    }
+
     TTF_Quit();
     SDL_Quit();
 
@@ -1179,22 +2889,17 @@ int tumDrawText(char *str, signed short x, signed short y, unsigned int colour)
         return -1;
     }
 
-    INIT_JOB(job, DRAW_TEXT);
-
-    job->data->text.str = (char *)calloc(strlen(str) + 1, sizeof(char));
+    INIT_JOB_PAYLOAD(job, DRAW_TEXT, strlen(str) + 1);
 
-    if (job->data->text.str == NULL) {
-        printf("Error allocating buffer in tumDrawText\n");
-        return -1;
-    }
+    strcpy((char *)DRAW_JOB_PAYLOAD(job), str);
+    job->data.text.font = tumFontGetCurFontHandle();
+    job->data.text.x = transformX(x);
+    job->data.text.y = transformY(y);
+    job->data.text.scale_x = transforms[transform_depth].scale_x;
+    job->data.text.scale_y = transforms[transform_depth].scale_y;
+    job->data.text.colour = colour;
 
-    strcpy(job->data->text.str, str);
-    job->data->text.font = tumFontGetCurFont();
-    job->data->text.x = x;
-    job->data->text.y = y;
-    job->data->text.colour = colour;
-
-    return 0;
+    return commitDrawJob();
 }
 
 int tumGetTextSize(char *str, int *width, int *height)
@@ -1210,13 +2915,13 @@ int tumDrawEllipse(signed short x, signed short y, signed short rx,
 {
     INIT_JOB(job, DRAW_ELLIPSE);
 
-    job->data->ellipse.x = x;
-    job->data->ellipse.y = y;
-    job->data->ellipse.rx = rx;
-    job->data->ellipse.ry = ry;
-    job->data->ellipse.colour = colour;
+    job->data.ellipse.x = transformX(x);
+    job->data.ellipse.y = transformY(y);
+    job->data.ellipse.rx = abs(scaleX(rx));
+    job->data.ellipse.ry = abs(scaleY(ry));
+    job->data.ellipse.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawArc(signed short x, signed short y, signed short radius,
@@ -1224,14 +2929,14 @@ int tumDrawArc(signed short x, signed short y, signed short radius,
 {
     INIT_JOB(job, DRAW_ARC);
 
-    job->data->arc.x = x;
-    job->data->arc.y = y;
-    job->data->arc.radius = radius;
-    job->data->arc.start = start;
-    job->data->arc.end = end;
-    job->data->arc.colour = colour;
+    job->data.arc.x = transformX(x);
+    job->data.arc.y = transformY(y);
+    job->data.arc.radius = scaleLength(radius);
+    job->data.arc.start = start;
+    job->data.arc.end = end;
+    job->data.arc.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawFilledBox(signed short x, signed short y, signed short w,
@@ -1239,13 +2944,13 @@ int tumDrawFilledBox(signed short x, signed short y, signed short w,
 {
     INIT_JOB(job, DRAW_FILLED_RECT);
 
-    job->data->rect.x = x;
-    job->data->rect.y = y;
-    job->data->rect.w = w;
-    job->data->rect.h = h;
-    job->data->rect.colour = colour;
+    job->data.rect.x = transformX(x);
+    job->data.rect.y = transformY(y);
+    job->data.rect.w = scaleX(w);
+    job->data.rect.h = scaleY(h);
+    job->data.rect.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawBox(signed short x, signed short y, signed short w, signed short h,
@@ -1253,13 +2958,13 @@ int tumDrawBox(signed short x, signed short y, signed short w, signed short h,
 {
     INIT_JOB(job, DRAW_RECT);
 
-    job->data->rect.x = x;
-    job->data->rect.y = y;
-    job->data->rect.w = w;
-    job->data->rect.h = h;
-    job->data->rect.colour = colour;
+    job->data.rect.x = transformX(x);
+    job->data.rect.y = transformY(y);
+    job->data.rect.w = scaleX(w);
+    job->data.rect.h = scaleY(h);
+    job->data.rect.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 void tumDrawDuplicateBuffer(void)
@@ -1279,18 +2984,11 @@ void tumDrawDuplicateBuffer(void)
 
 int tumDrawClear(unsigned int colour)
 {
-    /** INIT_JOB(job, DRAW_CLEAR); */
-    draw_job_t *job = pushDrawJob();
-    union data_u *data = calloc(1, sizeof(union data_u));
-    if (data == NULL) {
-        logCriticalError("job->data alloc");
-    }
-    job->data = data;
-    job->type = DRAW_CLEAR;
+    INIT_JOB(job, DRAW_CLEAR);
 
-    job->data->clear.colour = colour;
+    job->data.clear.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawCircle(signed short x, signed short y, signed short radius,
@@ -1298,12 +2996,12 @@ int tumDrawCircle(signed short x, signed short y, signed short radius,
 {
     INIT_JOB(job, DRAW_CIRCLE);
 
-    job->data->circle.x = x;
-    job->data->circle.y = y;
-    job->data->circle.radius = radius;
-    job->data->circle.colour = colour;
+    job->data.circle.x = transformX(x);
+    job->data.circle.y = transformY(y);
+    job->data.circle.radius = scaleLength(radius);
+    job->data.circle.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawLine(signed short x1, signed short y1, signed short x2,
@@ -1311,49 +3009,53 @@ int tumDrawLine(signed short x1, signed short y1, signed short x2,
 {
     INIT_JOB(job, DRAW_LINE);
 
-    job->data->line.x1 = x1;
-    job->data->line.y1 = y1;
-    job->data->line.x2 = x2;
-    job->data->line.y2 = y2;
-    job->data->line.thickness = thickness;
-    job->data->line.colour = colour;
+    job->data.line.x1 = transformX(x1);
+    job->data.line.y1 = transformY(y1);
+    job->data.line.x2 = transformX(x2);
+    job->data.line.y2 = transformY(y2);
+    job->data.line.thickness = scaleLength(thickness);
+    job->data.line.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawPoly(coord_t *points, int n, unsigned int colour)
 {
-    INIT_JOB(job, DRAW_POLY);
+    coord_t *job_points;
+    int i;
 
-    coord_t *points_cpy = (coord_t *)calloc(n, sizeof(coord_t));
-    if (!points_cpy) {
+    if (n <= 0) {
         return -1;
     }
 
-    memcpy(points_cpy, points, sizeof(coord_t) * n);
+    INIT_JOB_PAYLOAD(job, DRAW_POLY, sizeof(coord_t) * n);
 
-    job->data->poly.points = points_cpy;
-    job->data->poly.n = n;
-    job->data->poly.colour = colour;
+    job_points = (coord_t *)DRAW_JOB_PAYLOAD(job);
+    for (i = 0; i < n; i++) {
+        job_points[i].x = transformX(points[i].x);
+        job_points[i].y = transformY(points[i].y);
+    }
 
-    return 0;
+    job->data.poly.n = n;
+    job->data.poly.colour = colour;
+
+    return commitDrawJob();
 }
 
 int tumDrawTriangle(coord_t *points, unsigned int colour)
 {
+    int i;
+
     INIT_JOB(job, DRAW_TRIANGLE);
 
-    coord_t *points_cpy = (coord_t *)calloc(3, sizeof(coord_t));
-    if (!points_cpy) {
-        return -1;
+    for (i = 0; i < 3; i++) {
+        job->data.triangle.points[i].x = transformX(points[i].x);
+        job->data.triangle.points[i].y = transformY(points[i].y);
     }
 
-    memcpy(points_cpy, points, sizeof(coord_t) * 3);
+    job->data.triangle.colour = colour;
 
-    job->data->triangle.points = points_cpy;
-    job->data->triangle.colour = colour;
-
-    return 0;
+    return commitDrawJob();
 }
 
 image_handle_t tumDrawLoadScaledImage(char *filename, float scale)
@@ -1388,18 +3090,30 @@ image_handle_t tumDrawLoadScaledImage(char *filename, float scale)
         goto err_surf;
     }
 
-    ret->tex = SDL_CreateTextureFromSurface(renderer, ret->surf);
-    if (ret->tex == NULL) {
-        PRINT_SDL_ERROR("Failed to create texture from surface");
-        goto err_tex;
-    }
-
-    SDL_QueryTexture(ret->tex, NULL, NULL, &ret->w, &ret->h);
-
+    ret->w = ret->surf->w;
+    ret->h = ret->surf->h;
     ret->scale = scale;
 
     pthread_mutex_lock(&loaded_images_lock);
 
+    if (packAtlasImage(ret)) {
+        pthread_mutex_unlock(&loaded_images_lock);
+
+        // Images that do not fit into an atlas page get their own texture
+        ret->tex = SDL_CreateTextureFromSurface(renderer, ret->surf);
+        if (ret->tex == NULL) {
+            PRINT_SDL_ERROR("Failed to create texture from surface");
+            goto err_tex;
+        }
+
+        pthread_mutex_lock(&loaded_images_lock);
+    }
+    else {
+        // The atlas page holds the only copy needed
+        SDL_FreeSurface(ret->surf);
+        ret->surf = NULL;
+    }
+
     loaded_image_t *iterator = &loaded_images_list;
     for (; iterator->next; iterator = iterator->next)
         ;
@@ -1423,6 +3137,94 @@ err_alloc:
     return NULL;
 }
 
+/**
+ * Returns a referenced image from the image cache, loading the image if it is
+ * not yet cached. The reference must be put using vPutLoadedImage().
+ */
+static loaded_image_t *getCachedImage(char *filename)
+{
+    image_cache_entry_t **iterator, **evict;
+    image_cache_entry_t *entry;
+    char abs_path[PATH_MAX + 1];
+
+    pthread_mutex_lock(&image_cache_lock);
+
+    for (iterator = &image_cache; *iterator;
+         iterator = &(*iterator)->next)
+        if (!strcmp((*iterator)->filename, filename)) {
+            // Move to the front, the list is kept in LRU order
+            entry = *iterator;
+            *iterator = entry->next;
+            goto found;
+        }
+
+    if (realpath(filename, (char *)abs_path) == NULL) {
+        goto err;
+    }
+
+    entry = calloc(1, sizeof(image_cache_entry_t));
+    if (entry == NULL) {
+        PRINT_ERROR("Failed to allocate image cache entry");
+        goto err;
+    }
+
+    entry->filename = strdup(filename);
+    if (entry->filename == NULL) {
+        PRINT_ERROR("Failed to duplicate filename");
+        goto err_filename;
+    }
+
+    entry->img = tumDrawLoadScaledImage(abs_path, 1);
+    if (entry->img == NULL) {
+        goto err_load;
+    }
+
+    image_cache_count++;
+
+found:
+    entry->next = image_cache;
+    image_cache = entry;
+    vGetLoadedImage(entry->img);
+
+    // Evict the least recently used images that are no longer referenced
+    while (image_cache_count > IMAGE_CACHE_SIZE) {
+        evict = NULL;
+
+        pthread_mutex_lock(&loaded_images_lock);
+        for (iterator = &image_cache; *iterator;
+             iterator = &(*iterator)->next)
+            if (!(*iterator)->img->ref_count) {
+                evict = iterator;
+            }
+        pthread_mutex_unlock(&loaded_images_lock);
+
+        if (evict == NULL) {
+            break;
+        }
+
+        entry = *evict;
+        *evict = entry->next;
+        image_cache_count--;
+
+        freeLoadedImage(&entry->img);
+        free(entry->filename);
+        free(entry);
+    }
+
+    entry = image_cache;
+    pthread_mutex_unlock(&image_cache_lock);
+
+    return entry->img;
+
+err_load:
+    free(entry->filename);
+err_filename:
+    free(entry);
+err:
+    pthread_mutex_unlock(&image_cache_lock);
+    return NULL;
+}
+
 image_handle_t tumDrawLoadImage(char *filename)
 {
     return tumDrawLoadScaledImage(filename, 1);
@@ -1432,13 +3234,18 @@ int tumDrawFreeLoadedImage(image_handle_t *img)
 {
     int ret = 0;
     loaded_image_t **loaded_img = (loaded_image_t **)img;
+    int free_img;
 
-    if (!(*loaded_img)->ref_count) {
-        ret = freeLoadedImage(loaded_img);
-    }
-    else {
+    pthread_mutex_lock(&loaded_images_lock);
+    free_img = !(*loaded_img)->ref_count;
+    if (!free_img) {
         (*loaded_img)->pending_free = 1;
     }
+    pthread_mutex_unlock(&loaded_images_lock);
+
+    if (free_img) {
+        ret = freeLoadedImage(loaded_img);
+    }
 
     return ret;
 }
@@ -1451,12 +3258,16 @@ int tumDrawLoadedImage(image_handle_t img, signed short x, signed short y)
 
     INIT_JOB(job, DRAW_LOADED_IMAGE);
 
-    ((loaded_image_t *)img)->ref_count++;
-    job->data->loaded_image.img = img;
-    job->data->loaded_image.x = x;
-    job->data->loaded_image.y = y;
+    vGetLoadedImage(img);
+    job->data.loaded_image.img = img;
+    job->data.loaded_image.x = transformX(x);
+    job->data.loaded_image.y = transformY(y);
+    job->data.loaded_image.w =
+        scaleX(((loaded_image_t *)img)->w * ((loaded_image_t *)img)->scale);
+    job->data.loaded_image.h =
+        scaleY(((loaded_image_t *)img)->h * ((loaded_image_t *)img)->scale);
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawSetLoadedImageScale(image_handle_t img, float scale)
@@ -1516,48 +3327,65 @@ int tumDrawGetLoadedImageSize(image_handle_t img, int *w, int *h)
 int __attribute_deprecated__ tumDrawImage(char *filename, signed short x,
         signed short y)
 {
-    INIT_JOB(job, DRAW_IMAGE);
+    loaded_image_t *img = getCachedImage(filename);
 
-    char abs_path[PATH_MAX + 1];
+    if (img == NULL) {
+        return -1;
+    }
 
-    if (realpath(filename, (char *)abs_path) == NULL) {
+    draw_job_t *job = pushDrawJob(DRAW_IMAGE, 0);
+    if (job == NULL) {
+        vPutLoadedImage(img);
         return -1;
     }
 
-    job->data->image.filename = calloc(strlen(abs_path) + 1, sizeof(char));
-    strcpy(job->data->image.filename, abs_path);
-    job->data->image.x = x;
-    job->data->image.y = y;
+    job->data.image.img = img;
+    job->data.image.x = transformX(x);
+    job->data.image.y = transformY(y);
+    job->data.image.w = scaleX(img->w);
+    job->data.image.h = scaleY(img->h);
 
-    return 0;
+    return commitDrawJob();
 }
 
 int __attribute_deprecated__ tumGetImageSize(char *filename, int *w, int *h)
 {
-    char full_filename[PATH_MAX + 1];
-    realpath(filename, full_filename);
-    return _getImageSize(full_filename, w, h);
+    loaded_image_t *img = getCachedImage(filename);
+
+    if (img == NULL) {
+        return -1;
+    }
+
+    *w = img->w;
+    *h = img->h;
+
+    vPutLoadedImage(img);
+
+    return 0;
 }
 
 int __attribute_deprecated__ tumDrawScaledImage(char *filename, signed short x,
         signed short y, float scale)
 {
-    INIT_JOB(job, DRAW_SCALED_IMAGE);
+    loaded_image_t *img = getCachedImage(filename);
 
-    char abs_path[PATH_MAX + 1];
+    if (img == NULL) {
+        return -1;
+    }
 
-    if (realpath(filename, (char *)abs_path) == NULL) {
+    draw_job_t *job = pushDrawJob(DRAW_IMAGE, 0);
+    if (job == NULL) {
+        vPutLoadedImage(img);
         return -1;
     }
 
-    job->data->scaled_image.image.filename =
-        calloc(strlen(abs_path) + 1, sizeof(char));
-    strcpy(job->data->scaled_image.image.filename, abs_path);
-    job->data->scaled_image.image.x = x;
-    job->data->scaled_image.image.y = y;
-    job->data->scaled_image.scale = scale;
+    job->data.image.img = img;
+    job->data.image.x = transformX(x);
+    job->data.image.y = transformY(y);
+    job->data.image.w = scaleX(img->w * scale);
+    job->data.image.h = scaleY(img->h * scale);
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawArrow(signed short x1, signed short y1, signed short x2,
@@ -1566,15 +3394,15 @@ int tumDrawArrow(signed short x1, signed short y1, signed short x2,
 {
     INIT_JOB(job, DRAW_ARROW);
 
-    job->data->arrow.x1 = x1;
-    job->data->arrow.y1 = y1;
-    job->data->arrow.x2 = x2;
-    job->data->arrow.y2 = y2;
-    job->data->arrow.head_length = head_length;
-    job->data->arrow.thickness = thickness;
-    job->data->arrow.colour = colour;
+    job->data.arrow.x1 = transformX(x1);
+    job->data.arrow.y1 = transformY(y1);
+    job->data.arrow.x2 = transformX(x2);
+    job->data.arrow.y2 = transformY(y2);
+    job->data.arrow.head_length = scaleLength(head_length);
+    job->data.arrow.thickness = scaleLength(thickness);
+    job->data.arrow.colour = colour;
 
-    return 0;
+    return commitDrawJob();
 }
 
 int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
@@ -1604,45 +3432,49 @@ int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
 
     INIT_JOB(job, DRAW_LOADED_IMAGE_CROP);
 
-    anim->image->spritesheet->image->ref_count++;
-    job->data->loaded_image_crop.image = anim->image->spritesheet->image;
-    job->data->loaded_image_crop.x = x;
-    job->data->loaded_image_crop.y = y;
-    job->data->loaded_image_crop.c_w =
+    vGetLoadedImage(anim->image->spritesheet->image);
+    job->data.loaded_image_crop.image = anim->image->spritesheet->image;
+    job->data.loaded_image_crop.x = transformX(x);
+    job->data.loaded_image_crop.y = transformY(y);
+    job->data.loaded_image_crop.c_w =
         anim->image->spritesheet->sprite_width;
-    job->data->loaded_image_crop.c_h =
+    job->data.loaded_image_crop.c_h =
         anim->image->spritesheet->sprite_height;
+    job->data.loaded_image_crop.w =
+        scaleX(anim->image->spritesheet->sprite_width);
+    job->data.loaded_image_crop.h =
+        scaleY(anim->image->spritesheet->sprite_height);
 
     switch (anim->sequence->direction) {
         case SPRITE_SEQUENCE_HORIZONTAL_POS:
-            job->data->loaded_image_crop.c_x =
+            job->data.loaded_image_crop.c_x =
                 (anim->current_frame + anim->sequence->start_col) *
                 anim->image->spritesheet->sprite_width;
-            job->data->loaded_image_crop.c_y =
+            job->data.loaded_image_crop.c_y =
                 anim->sequence->start_row *
                 anim->image->spritesheet->sprite_height;
             break;
         case SPRITE_SEQUENCE_HORIZONTAL_NEG:
-            job->data->loaded_image_crop.c_x =
+            job->data.loaded_image_crop.c_x =
                 (anim->sequence->start_col - anim->current_frame) *
                 anim->image->spritesheet->sprite_width;
-            job->data->loaded_image_crop.c_y =
+            job->data.loaded_image_crop.c_y =
                 anim->sequence->start_row *
                 anim->image->spritesheet->sprite_height;
             break;
         case SPRITE_SEQUENCY_VERTICAL_POS:
-            job->data->loaded_image_crop.c_x =
+            job->data.loaded_image_crop.c_x =
                 anim->sequence->start_col *
                 anim->image->spritesheet->sprite_height;
-            job->data->loaded_image_crop.c_y =
+            job->data.loaded_image_crop.c_y =
                 (anim->current_frame + anim->sequence->start_row) *
                 anim->image->spritesheet->sprite_width;
             break;
         case SPRITE_SEQUENCY_VERTICAL_NEG:
-            job->data->loaded_image_crop.c_x =
+            job->data.loaded_image_crop.c_x =
                 anim->sequence->start_col *
                 anim->image->spritesheet->sprite_height;
-            job->data->loaded_image_crop.c_y =
+            job->data.loaded_image_crop.c_y =
                 (anim->sequence->start_row - anim->current_frame) *
                 anim->image->spritesheet->sprite_width;
             break;
@@ -1650,7 +3482,7 @@ int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
             break;
     }
 
-    return 0;
+    return commitDrawJob();
 
 err:
     return -1;
@@ -1715,3 +3547,44 @@ int tumDrawGetGlobalYOffset(int *offset)
 
     return ret;
 }
+
+int tumDrawPushTransform(void)
+{
+    if (transform_depth + 1 == DRAW_TRANSFORM_STACK_DEPTH) {
+        PRINT_ERROR("Transform stack is full");
+        return -1;
+    }
+
+    transforms[transform_depth + 1] = transforms[transform_depth];
+    transform_depth++;
+
+    return 0;
+}
+
+int tumDrawPopTransform(void)
+{
+    if (transform_depth == 0) {
+        PRINT_ERROR("Transform stack is empty");
+        return -1;
+    }
+
+    transform_depth--;
+
+    return 0;
+}
+
+int tumDrawTranslate(float x, float y)
+{
+    transforms[transform_depth].x += x * transforms[transform_depth].scale_x;
+    transforms[transform_depth].y += y * transforms[transform_depth].scale_y;
+
+    return 0;
+}
+
+int tumDrawScale(float x, float y)
+{
+    transforms[transform_depth].scale_x *= x;
+    transforms[transform_depth].scale_y *= y;
+
+    return 0;
+}
@@ -32,6 +32,8 @@
     PRINT_ERROR("[TTF Error] %s\n" #msg, (char *)TTF_GetError(),           \
                 ##__VA_ARGS__)
 
+#define ATLAS_GLYPH_COUNT (FONT_ATLAS_LAST_GLYPH - FONT_ATLAS_FIRST_GLYPH + 1)
+
 struct tum_font_ref {
     TTF_Font *font;
     unsigned ref_count;
@@ -43,12 +45,20 @@ typedef struct tum_font {
     char *name;
     struct tum_font_ref font;
     unsigned size;
+    tum_font_atlas_t *atlas; // Rendered on first use
+    unsigned long atlas_used; // Value of atlas_clock when last used
     struct tum_font *next;
 } tum_font_t;
 
 pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct tum_font font_list = { 0 };
 
+// Atlases of the fonts in font_list, protected by list_lock
+static unsigned int atlas_count = 0;
+static unsigned long atlas_clock = 0;
+// Freed atlases whose textures are destroyed by the GL thread
+static tum_font_atlas_t *retired_atlases = NULL;
+
 static const char *fonts_dir;
 static struct tum_font *cur_default_font = NULL;
 
@@ -122,8 +132,227 @@ int tumFontInit(char *path)
     return 0;
 }
 
+/**
+ * Records the kerning of every pair of the atlas' glyphs that has any, such
+ * that the font is not needed when drawing text
+ */
+static int tumFontCreateKerning(TTF_Font *font, tum_font_atlas_t *atlas,
+                                unsigned char *has_glyph)
+{
+    tum_font_kerning_t *kerning;
+    unsigned int size = 0;
+    unsigned i, j;
+    int amount;
+
+    if (!TTF_GetFontKerning(font)) {
+        return 0;
+    }
+
+    for (i = 0; i < ATLAS_GLYPH_COUNT; i++) {
+        if (!has_glyph[i]) {
+            continue;
+        }
+
+        for (j = 0; j < ATLAS_GLYPH_COUNT; j++) {
+            if (!has_glyph[j]) {
+                continue;
+            }
+
+            amount = TTF_GetFontKerningSizeGlyphs(
+                         font, FONT_ATLAS_FIRST_GLYPH + i,
+                         FONT_ATLAS_FIRST_GLYPH + j);
+            if (amount == 0) {
+                continue;
+            }
+
+            if (atlas->kerning_count == size) {
+                size = size ? size * 2 : 64;
+                kerning = realloc(atlas->kerning,
+                                  size * sizeof(tum_font_kerning_t));
+                if (kerning == NULL) {
+                    PRINT_ERROR("Failed to allocate kerning pairs");
+                    return -1;
+                }
+                atlas->kerning = kerning;
+            }
+
+            // Pairs are recorded in ascending order
+            atlas->kerning[atlas->kerning_count].pair =
+                i * ATLAS_GLYPH_COUNT + j;
+            atlas->kerning[atlas->kerning_count].amount = amount;
+            atlas->kerning_count++;
+        }
+    }
+
+    return 0;
+}
+
+static tum_font_atlas_t *tumFontCreateAtlas(TTF_Font *font)
+{
+    SDL_Color white = { 255, 255, 255, 255 };
+    SDL_Surface *glyph_surfaces[ATLAS_GLYPH_COUNT] = { 0 };
+    unsigned char has_glyph[ATLAS_GLYPH_COUNT] = { 0 };
+    tum_font_atlas_t *atlas;
+    tum_font_glyph_t *glyph;
+    SDL_Rect dst;
+    int minx, maxx, miny, maxy, advance;
+    int x = 0, y = 0, row_height = 0;
+    unsigned i;
+
+    atlas = calloc(1, sizeof(tum_font_atlas_t));
+    if (atlas == NULL) {
+        goto err_alloc;
+    }
+
+    atlas->height = TTF_FontHeight(font);
+
+    // Render each glyph and pack it into rows of FONT_ATLAS_WIDTH pixels
+    for (i = 0; i < ATLAS_GLYPH_COUNT; i++) {
+        glyph = &atlas->glyphs[i];
+
+        if (TTF_GlyphMetrics(font, FONT_ATLAS_FIRST_GLYPH + i, &minx,
+                             &maxx, &miny, &maxy, &advance)) {
+            continue;
+        }
+
+        has_glyph[i] = 1;
+        glyph->advance = advance;
+        glyph->x_offset = (minx < 0) ? minx : 0;
+
+        glyph_surfaces[i] = TTF_RenderGlyph_Blended(
+                                font, FONT_ATLAS_FIRST_GLYPH + i, white);
+        if (glyph_surfaces[i] == NULL) {
+            continue;
+        }
+
+        if (glyph_surfaces[i]->w > FONT_ATLAS_WIDTH) {
+            SDL_FreeSurface(glyph_surfaces[i]);
+            glyph_surfaces[i] = NULL;
+            continue;
+        }
+
+        if (x + glyph_surfaces[i]->w > FONT_ATLAS_WIDTH) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+
+        glyph->src.x = x;
+        glyph->src.y = y;
+        glyph->src.w = glyph_surfaces[i]->w;
+        glyph->src.h = glyph_surfaces[i]->h;
+
+        x += glyph->src.w;
+        if (glyph->src.h > row_height) {
+            row_height = glyph->src.h;
+        }
+    }
+
+    if (tumFontCreateKerning(font, atlas, has_glyph)) {
+        goto err_kerning;
+    }
+
+    atlas->surface =
+        SDL_CreateRGBSurfaceWithFormat(0, FONT_ATLAS_WIDTH, y + row_height,
+                                       32, SDL_PIXELFORMAT_ARGB8888);
+    if (atlas->surface == NULL) {
+        PRINT_ERROR("Failed to create glyph atlas surface");
+        goto err_surface;
+    }
+
+    for (i = 0; i < ATLAS_GLYPH_COUNT; i++)
+        if (glyph_surfaces[i]) {
+            // Copy the glyph's alpha instead of blending it
+            SDL_SetSurfaceBlendMode(glyph_surfaces[i], SDL_BLENDMODE_NONE);
+            dst = atlas->glyphs[i].src;
+            SDL_BlitSurface(glyph_surfaces[i], NULL, atlas->surface, &dst);
+            SDL_FreeSurface(glyph_surfaces[i]);
+        }
+
+    return atlas;
+
+err_surface:
+err_kerning:
+    for (i = 0; i < ATLAS_GLYPH_COUNT; i++)
+        if (glyph_surfaces[i]) {
+            SDL_FreeSurface(glyph_surfaces[i]);
+        }
+    free(atlas->kerning);
+    free(atlas);
+err_alloc:
+    return NULL;
+}
+
+static void tumFontFreeAtlas(tum_font_atlas_t *atlas)
+{
+    SDL_FreeSurface(atlas->surface);
+    free(atlas->kerning);
+    free(atlas);
+}
+
+/**
+ * Must be called with list_lock held, the atlas is freed by the GL thread
+ */
+static void tumFontRetireAtlas(struct tum_font *font)
+{
+    if (font->atlas == NULL) {
+        return;
+    }
+
+    font->atlas->next = retired_atlases;
+    retired_atlases = font->atlas;
+    font->atlas = NULL;
+    atlas_count--;
+}
+
+/**
+ * Must be called with list_lock held, atlases of referenced fonts may be in
+ * use and are kept
+ */
+static void tumFontEvictAtlases(void)
+{
+    struct tum_font *iterator, *lru;
+
+    while (atlas_count >= FONT_ATLAS_CACHE_SIZE) {
+        lru = NULL;
+
+        for (iterator = font_list.next; iterator; iterator = iterator->next)
+            if (iterator->atlas && !iterator->font.ref_count &&
+                (!lru || iterator->atlas_used < lru->atlas_used)) {
+                lru = iterator;
+            }
+
+        if (lru == NULL) {
+            break;
+        }
+
+        tumFontRetireAtlas(lru);
+    }
+}
+
+void tumFontFreeRetiredAtlases(unsigned int tex_generation)
+{
+    tum_font_atlas_t *atlas;
+
+    pthread_mutex_lock(&list_lock);
+    atlas = retired_atlases;
+    retired_atlases = NULL;
+    pthread_mutex_unlock(&list_lock);
+
+    while (atlas) {
+        tum_font_atlas_t *next = atlas->next;
+
+        if (atlas->tex && atlas->tex_generation == tex_generation) {
+            SDL_DestroyTexture(atlas->tex);
+        }
+        tumFontFreeAtlas(atlas);
+        atlas = next;
+    }
+}
+
 void tumFontDeleteFont(struct tum_font *font)
 {
+    tumFontRetireAtlas(font);
     free(font->path);
     TTF_CloseFont(font->font.font);
     free(font);
@@ -142,6 +371,14 @@ void tumFontExit(void)
         tumFontDeleteFont(delete);
     }
 
+    // The atlas' textures are destroyed along with the renderer
+    while (retired_atlases) {
+        tum_font_atlas_t *atlas = retired_atlases;
+
+        retired_atlases = atlas->next;
+        tumFontFreeAtlas(atlas);
+    }
+
     pthread_mutex_unlock(&list_lock);
 }
 
@@ -234,6 +471,101 @@ char *tumFontGetCurFontName(void)
     return ret;
 }
 
+tum_font_atlas_t *tumFontGetGlyphAtlas(font_handle_t font)
+{
+    struct tum_font *tum_font = (struct tum_font *)font;
+    tum_font_atlas_t *ret;
+
+    pthread_mutex_lock(&list_lock);
+
+    if (tum_font->atlas == NULL) {
+        tumFontEvictAtlases();
+        tum_font->atlas = tumFontCreateAtlas(tum_font->font.font);
+        if (tum_font->atlas) {
+            atlas_count++;
+        }
+    }
+    tum_font->atlas_used = ++atlas_clock;
+    ret = tum_font->atlas;
+
+    pthread_mutex_unlock(&list_lock);
+
+    return ret;
+}
+
+int tumFontGetKerning(tum_font_atlas_t *atlas, unsigned char prev,
+                      unsigned char c)
+{
+    unsigned int low = 0, high = atlas->kerning_count, mid;
+    unsigned short pair;
+
+    if (!tumFontGetGlyph(atlas, prev) || !tumFontGetGlyph(atlas, c)) {
+        return 0;
+    }
+
+    pair = (prev - FONT_ATLAS_FIRST_GLYPH) * ATLAS_GLYPH_COUNT +
+           (c - FONT_ATLAS_FIRST_GLYPH);
+
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (atlas->kerning[mid].pair < pair) {
+            low = mid + 1;
+        }
+        else if (atlas->kerning[mid].pair > pair) {
+            high = mid;
+        }
+        else {
+            return atlas->kerning[mid].amount;
+        }
+    }
+
+    return 0;
+}
+
+int tumFontGetTextSize(font_handle_t font, char *str, int *width,
+                       int *height)
+{
+    tum_font_atlas_t *atlas = tumFontGetGlyphAtlas(font);
+    tum_font_glyph_t *glyph;
+    unsigned char prev = 0;
+    int pen = 0, right = 0;
+
+    if (atlas == NULL) {
+        return -1;
+    }
+
+    for (; *str; str++) {
+        glyph = tumFontGetGlyph(atlas, *str);
+        if (glyph == NULL) {
+            continue;
+        }
+
+        if (prev) {
+            pen += tumFontGetKerning(atlas, prev, *str);
+        }
+        prev = *str;
+
+        // A leading negative offset widens the string to the left
+        if (pen == 0 && glyph->x_offset < 0) {
+            pen = -glyph->x_offset;
+        }
+
+        if (pen + glyph->x_offset + glyph->src.w > right) {
+            right = pen + glyph->x_offset + glyph->src.w;
+        }
+        pen += glyph->advance;
+    }
+
+    if (width) {
+        *width = (pen > right) ? pen : right;
+    }
+    if (height) {
+        *height = atlas->height;
+    }
+
+    return 0;
+}
+
 font_handle_t tumFontGetCurFontHandle(void)
 {
     pthread_mutex_lock(&list_lock);
@@ -311,42 +643,40 @@ int tumFontSelectFontFromHandle(font_handle_t font_handle)
 
 int tumFontSetSize(ssize_t font_size)
 {
+    struct tum_font *iterator;
+
     if (cur_default_font == NULL) {
-        goto err_;
+        goto err;
     }
 
     pthread_mutex_lock(&list_lock);
 
     if (cur_default_font->size == font_size) {
-        pthread_mutex_unlock(&list_lock);
-        return 0;
+        goto out;
     }
 
-    if (!cur_default_font->font.ref_count) {
-        TTF_CloseFont(cur_default_font->font.font);
-        TTF_Font *new_font =
-            TTF_OpenFont(cur_default_font->path, font_size);
-
-        if (new_font == NULL) {
-            goto err_;
+    // Reuse the font and its glyph atlas if the size is already loaded
+    for (iterator = font_list.next; iterator; iterator = iterator->next)
+        if (iterator->size == font_size && !iterator->font.pending_free &&
+            !strcmp(iterator->path, cur_default_font->path)) {
+            cur_default_font = iterator;
+            goto out;
         }
 
-        cur_default_font->font.font = new_font;
-        cur_default_font->size = font_size;
-    }
-    else {
-        cur_default_font->font.pending_free = 1;
-        cur_default_font =
-            tumFontAppendFont(cur_default_font->name, font_size);
-        if (!cur_default_font) {
-            goto err_;
-        }
+    iterator = tumFontAppendFont(cur_default_font->name, font_size);
+    if (iterator == NULL) {
+        goto err_unlock;
     }
 
+    cur_default_font = iterator;
+
+out:
     pthread_mutex_unlock(&list_lock);
 
     return 0;
-err_:
+
+err_unlock:
     pthread_mutex_unlock(&list_lock);
+err:
     return -1;
 }
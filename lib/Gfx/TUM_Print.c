@@ -40,15 +40,10 @@ struct error_print_msg {
     char msg[SAFE_PRINT_MAX_MSG_LEN];
 };
 
-char rbuf_buffer[sizeof(struct error_print_msg) *
-                               SAFE_PRINT_INPUT_BUFFER_COUNT] = { 0 };
-
 #ifdef SAFE_PRINT_DEBUG
 xSemaphoreHandle input_debug_count = NULL;
 #endif // SAFE_PRINT_DEBUG
 
-rbuf_handle_t input_rbuf = NULL;
-
 xQueueHandle safePrintQueue = NULL;
 xTaskHandle safePrintTaskHandle = NULL;
 
@@ -68,7 +63,13 @@ static void vfprints(FILE *__restrict __stream, const char *__format,
         return;
     }
 
-    tmp_msg = (struct error_print_msg *)rbuf_get_buffer(input_rbuf);
+    // Messages are formatted straight into a buffer of the queue's pool
+    tmp_msg = (struct error_print_msg *)pvQueueLoanBufferFromISR(
+                  safePrintQueue, &xHigherPriorityTaskWoken);
+
+    if (tmp_msg == NULL) {
+        return;
+    }
 
 #ifdef SAFE_PRINT_DEBUG
     if (xSemaphoreGive(input_debug_count) == pdTRUE) {
@@ -79,16 +80,14 @@ static void vfprints(FILE *__restrict __stream, const char *__format,
     }
 #endif // SAFE_PRINT_DEBUG
 
-    if (tmp_msg == NULL) {
-        return;
-    }
-
     tmp_msg->stream = __stream;
     vsnprintf((char *)tmp_msg->msg, SAFE_PRINT_MAX_MSG_LEN, __format, args);
 
-    xQueueSendFromISR(safePrintQueue, tmp_msg, &xHigherPriorityTaskWoken);
-
-    rbuf_put_buffer(input_rbuf);
+    if (xQueueSendLoanFromISR(safePrintQueue, tmp_msg,
+                              &xHigherPriorityTaskWoken) != pdTRUE) {
+        vQueueReturnBufferFromISR(safePrintQueue, tmp_msg,
+                                  &xHigherPriorityTaskWoken);
+    }
 
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
@@ -111,22 +110,30 @@ void prints(const char *__format, ...)
 
 static void safePrintTask(void *pvParameters)
 {
-    struct error_print_msg msgToPrint = { 0 };
+    struct error_print_msg *msgsToPrint[SAFE_PRINT_QUEUE_LEN];
+    UBaseType_t count, i;
 
     while (1) {
-        if (safePrintQueue)
-            if (xQueueReceive(safePrintQueue, &msgToPrint,
-                              portMAX_DELAY) == pdTRUE) {
-                fprintf(msgToPrint.stream, "%s",
-                        msgToPrint.msg);
+        if (safePrintQueue) {
+            // Drain a whole burst of messages per wake up
+            count = xQueueReceiveMultiple(safePrintQueue, msgsToPrint,
+                                          SAFE_PRINT_QUEUE_LEN,
+                                          portMAX_DELAY);
+            for (i = 0; i < count; i++) {
+                fprintf(msgsToPrint[i]->stream, "%s",
+                        msgsToPrint[i]->msg);
+                vQueueReturnBuffer(safePrintQueue, msgsToPrint[i]);
             }
+        }
     }
 }
 
 int safePrintInit(void)
 {
-    safePrintQueue =
-        xQueueCreate(SAFE_PRINT_QUEUE_LEN, SAFE_PRINT_MAX_MSG_LEN);
+    // The pool also covers the messages being formatted or printed
+    safePrintQueue = xQueueCreateZeroCopy(
+                         SAFE_PRINT_QUEUE_LEN, sizeof(struct error_print_msg),
+                         SAFE_PRINT_QUEUE_LEN + SAFE_PRINT_INPUT_BUFFER_COUNT);
 
     if (safePrintQueue == NULL) {
         return -1;
@@ -139,13 +146,6 @@ int safePrintInit(void)
         return -1;
     }
 
-    input_rbuf = rbuf_init_static(sizeof(struct error_print_msg),
-                                  SAFE_PRINT_INPUT_BUFFER_COUNT, (void *)rbuf_buffer);
-
-    if (input_rbuf == NULL) {
-        return -1;
-    }
-
 #ifdef SAFE_PRINT_DEBUG
     input_debug_count = xQueueCreateCountingSemaphore(0xFFFF, 0);
 
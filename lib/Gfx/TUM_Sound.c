@@ -45,6 +45,7 @@ int tumSoundInit(char *bin_dir_str)
 
     char *fullWaveFileNames[NUM_WAVEFORMS] = { 0 };
 
+    char *path;
     int ret;
     size_t bin_dir_len = strlen(bin_dir_str);
     unsigned int i, j;
@@ -75,7 +76,9 @@ int tumSoundInit(char *bin_dir_str)
     }
 
     for (i = 0; i < NUM_WAVEFORMS; i++) {
-        samples[i] = Mix_LoadWAV(tumUtilFindResourcePath(fullWaveFileNames[i]));
+        path = tumUtilFindResourcePath(fullWaveFileNames[i]);
+        samples[i] = path ? Mix_LoadWAV(path) : NULL;
+        free(path);
         if (!samples[i]) {
             PRINT_ERROR("Failed to load WAV: %s",
                         fullWaveFileNames[i]);
@@ -25,6 +25,7 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <pthread.h>
 #include <regex.h>
 #include <stdlib.h>
@@ -33,6 +34,7 @@
 #include <libgen.h>
 #include <assert.h>
 #include <dirent.h>
+#include <limits.h>
 
 #include "TUM_Utils.h"
 #include "EmulatorConfig.h"
@@ -105,118 +107,295 @@ char *tumUtilGetBinFolderPath(char *bin_path)
 #define INCLUDE_DIR_NAMES 0b1
 
 /**
- * @brief Finds and returns the full path of a file searched for in a target
- * directory and its sub-directories
- *
- * The found filename is stored in a statically allocated buffer and can be
- * overwritten by subsequent calls to the functions
+ * @brief Finds the full path of a file searched for in a target directory and
+ * its sub-directories
  *
  * @param dir_name Target root directory to be searched
  * @param filename The file that is to be searched for
- * @return A reference to the statically allocated buffer where the filename
- * is being stored, else NULL
+ * @param flags INCLUDE_DIR_NAMES if directories should also be matched
+ * @param path Buffer of PATH_MAX bytes into which the found path is stored
+ * @return path if the file was found, else NULL
  */
-static char *recurseDirName(char *dir_name, char *filename, char flags)
+static char *recurseDirName(const char *dir_name, const char *filename,
+                            char flags, char *path)
 {
     char *ret = NULL;
     struct dirent *dirp;
     DIR *dp;
-    static char wdir[PATH_MAX];
+
     dp = opendir(dir_name);
+    if (dp == NULL) {
+        PRINT_ERROR("Could not open directory '%s'", dir_name);
+        return NULL;
+    }
+
+    while (!ret && (dirp = readdir(dp)) != NULL) {
+        if (dirp->d_type != DT_DIR ||
+            !strcmp(dirp->d_name, ".") || !strcmp(dirp->d_name, "..")) {
+            continue;
+        }
+
+        snprintf(path, PATH_MAX, "%s/%s", dir_name, dirp->d_name);
+
+        if ((flags & INCLUDE_DIR_NAMES) && !strcmp(filename, dirp->d_name)) {
+            ret = path;
+        }
+        else {
+            char sub_dir[PATH_MAX];
+
+            strcpy(sub_dir, path);
+            ret = recurseDirName(sub_dir, filename, flags, path);
+        }
+    }
+
+    closedir(dp);
+
+    return ret;
+}
+
+/**
+ * Resources are indexed by their basename, the index is built by scanning
+ * the resources directory once, subsequent lookups only hash the name
+ */
+#define RESOURCE_INDEX_BUCKETS 256
+
+struct resource_entry {
+    char *name; // Points into path
+    char *path;
+    struct resource_entry *next;
+};
+
+static pthread_rwlock_t resource_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct resource_entry *resource_index[RESOURCE_INDEX_BUCKETS];
+static unsigned char resource_index_valid = 0;
+
+static unsigned int hashResourceName(const char *name)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
 
+    return hash % RESOURCE_INDEX_BUCKETS;
+}
+
+static void freeResourceIndex(void)
+{
+    struct resource_entry *entry;
+    unsigned int i;
+
+    for (i = 0; i < RESOURCE_INDEX_BUCKETS; i++)
+        while (resource_index[i]) {
+            entry = resource_index[i];
+            resource_index[i] = entry->next;
+            free(entry->path);
+            free(entry);
+        }
+
+    resource_index_valid = 0;
+}
+
+static int indexResource(const char *dir_name, const char *filename)
+{
+    struct resource_entry *entry, **iterator;
+    unsigned int hash = hashResourceName(filename);
+
+    // The first file found with a given name is used
+    for (iterator = &resource_index[hash]; *iterator;
+         iterator = &(*iterator)->next)
+        if (!strcmp((*iterator)->name, filename)) {
+            return 0;
+        }
+
+    entry = calloc(1, sizeof(struct resource_entry));
+    if (entry == NULL) {
+        goto err_entry;
+    }
+
+    entry->path = malloc(strlen(dir_name) + strlen(filename) + 2);
+    if (entry->path == NULL) {
+        goto err_path;
+    }
+
+    sprintf(entry->path, "%s/%s", dir_name, filename);
+    entry->name = entry->path + strlen(dir_name) + 1;
+
+    *iterator = entry;
+
+    return 0;
+
+err_path:
+    free(entry);
+err_entry:
+    PRINT_ERROR("Failed to allocate resource index entry");
+    return -1;
+}
+
+static int indexResourceDirectory(const char *dir_name)
+{
+    char path[PATH_MAX];
+    struct dirent *dirp;
+    struct stat st;
+    unsigned char type;
+    int ret = 0;
+    DIR *dp;
+
+    dp = opendir(dir_name);
     if (dp == NULL) {
-        PRINT_ERROR("Could not open resource directory '%s'",
-                    RESOURCES_DIRECTORY);
-        goto err;
+        PRINT_ERROR("Could not open resource directory '%s'", dir_name);
+        return -1;
     }
 
-    while ((dirp = readdir(dp)) != NULL) {
-        switch (dirp->d_type) {
+    while (!ret && (dirp = readdir(dp)) != NULL) {
+        if (!strcmp(dirp->d_name, ".") || !strcmp(dirp->d_name, "..")) {
+            continue;
+        }
+
+        snprintf(path, PATH_MAX, "%s/%s", dir_name, dirp->d_name);
+
+        type = dirp->d_type;
+        if (type == DT_UNKNOWN && !stat(path, &st)) {
+            type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+        }
+
+        switch (type) {
             case DT_DIR:
-                if (!strcmp(dirp->d_name, ".") ||
-                    !strcmp(dirp->d_name, "..")) {
-                    continue;
-                }
-                if (flags & INCLUDE_DIR_NAMES)
-                    if (!strcmp(filename, dirp->d_name)) {
-                        goto found;
-                    }
-                strcpy(wdir, dir_name);
-                strcat(wdir, "/");
-                strcat(wdir, dirp->d_name);
-                ret = recurseDirName(wdir, filename, flags);
-                if (ret) {
-                    return ret;
-                }
+                ret = indexResourceDirectory(path);
                 break;
             case DT_REG:
-                if (!strcmp(filename, dirp->d_name)) {
-found:
-                    strcpy(wdir, dir_name);
-                    strcat(wdir, "/");
-                    strcat(wdir, filename);
-                    return wdir;
-                }
+                ret = indexResource(dir_name, dirp->d_name);
                 break;
             default:
-                printf("Found file of type %d", dirp->d_type);
                 break;
         }
     }
+
+    closedir(dp);
+
     return ret;
+}
 
-err:
-    return NULL;
+static int buildResourceIndex(void)
+{
+    char dir_name[PATH_MAX], path[PATH_MAX];
+    char *resource_dir = RESOURCES_DIRECTORY;
+
+    freeResourceIndex();
+
+    if (access(RESOURCES_DIRECTORY, F_OK) == -1) {
+        strcpy(dir_name, RESOURCES_DIRECTORY);
+        resource_dir = recurseDirName(".", basename(dir_name),
+                                      INCLUDE_DIR_NAMES, path);
+        if (resource_dir == NULL) {
+            PRINT_ERROR("Could not find resource directory '%s'",
+                        RESOURCES_DIRECTORY);
+            return -1;
+        }
+    }
+
+    if (indexResourceDirectory(resource_dir)) {
+        freeResourceIndex();
+        return -1;
+    }
+
+    resource_index_valid = 1;
+
+    return 0;
 }
 
-static FILE *recurseDirFile(char *dir_name, char *filename, const char *mode)
+int tumUtilRescanResources(void)
+{
+    int ret;
+
+    pthread_rwlock_wrlock(&resource_index_lock);
+    ret = buildResourceIndex();
+    pthread_rwlock_unlock(&resource_index_lock);
+
+    return ret;
+}
+
+/**
+ * Copies the indexed path of resource_name into path while the index is
+ * locked, a rescan frees the entries
+ */
+static int lookupResourcePath(char *resource_name, char *path, size_t size)
 {
-    return fopen(recurseDirName(dir_name, filename, 0), mode);
+    struct resource_entry *entry;
+    char *name = strrchr(resource_name, '/');
+    int ret = -1;
+
+    name = name ? name + 1 : resource_name;
+
+    pthread_rwlock_rdlock(&resource_index_lock);
+
+    // The index is built by the first lookup
+    while (!resource_index_valid) {
+        pthread_rwlock_unlock(&resource_index_lock);
+        pthread_rwlock_wrlock(&resource_index_lock);
+        if (!resource_index_valid && buildResourceIndex()) {
+            goto out;
+        }
+        pthread_rwlock_unlock(&resource_index_lock);
+        pthread_rwlock_rdlock(&resource_index_lock);
+    }
+
+    for (entry = resource_index[hashResourceName(name)]; entry;
+         entry = entry->next)
+        if (!strcmp(entry->name, name)) {
+            if (strlen(entry->path) < size) {
+                strcpy(path, entry->path);
+                ret = 0;
+            }
+            break;
+        }
+
+out:
+    pthread_rwlock_unlock(&resource_index_lock);
+
+    return ret;
 }
 
-static char *tumUtilFindResourceDirectory(void)
+static int findResourcePath(char *resource_name, char *path, size_t size)
 {
-    static char ret_dir[PATH_MAX];
+    if (!resource_name) {
+        PRINT_ERROR("Cannot find invalid resource name");
+        return -1;
+    }
 
-    if (access(RESOURCES_DIRECTORY, F_OK) != -1) {
-        strcpy(ret_dir, RESOURCES_DIRECTORY);
-        return ret_dir;
+    if (access(resource_name, F_OK) != -1) {
+        if (strlen(resource_name) >= size) {
+            return -1;
+        }
+        strcpy(path, resource_name);
+        return 0;
     }
     else {
-        strcpy(ret_dir,
-               recurseDirName(".", basename(RESOURCES_DIRECTORY),
-                              INCLUDE_DIR_NAMES));
-        return ret_dir;
+        return lookupResourcePath(resource_name, path, size);
     }
 }
 
 FILE *tumUtilFindResource(char *resource_name, const char *mode)
 {
-    if (!resource_name) {
-        PRINT_ERROR("Cannot find invalid resource name");
+    char path[PATH_MAX];
+
+    if (findResourcePath(resource_name, path, sizeof(path))) {
         return NULL;
     }
-    if (access(resource_name, F_OK) != -1) {
-        return fopen(resource_name, mode);
-    }
-    else
-        return recurseDirFile(tumUtilFindResourceDirectory(),
-                              basename(resource_name), mode);
+
+    return fopen(path, mode);
 }
 
 char *tumUtilFindResourcePath(char *resource_name)
 {
-    if (!resource_name) {
-        PRINT_ERROR("Cannot find invalid resource name");
+    char path[PATH_MAX];
+
+    if (findResourcePath(resource_name, path, sizeof(path))) {
         return NULL;
     }
 
-    if (access(resource_name, F_OK) != -1) {
-        return resource_name;
-    }
-    else
-        return recurseDirName(tumUtilFindResourceDirectory(),
-                              basename(resource_name), 0);
+    return strdup(path);
 }
 
 static void inc_buf(rbuf_handle_t rbuf)
@@ -72,6 +72,50 @@
 #define SCREEN_HEIGHT 480
 #endif //SCREEN_HEIGHT
 
+/**
+ * Number of images drawn using tumDrawImage() or tumDrawScaledImage() that are
+ * kept loaded, the least recently used unreferenced image is freed once the
+ * number is exceeded
+ */
+#ifndef IMAGE_CACHE_SIZE
+#define IMAGE_CACHE_SIZE 32
+#endif //IMAGE_CACHE_SIZE
+
+/**
+ * Width and height (in pixels) of the texture atlas pages into which loaded
+ * images are packed. Images larger than a page get their own texture.
+ */
+#ifndef IMAGE_ATLAS_PAGE_SIZE
+#define IMAGE_ATLAS_PAGE_SIZE 1024
+#endif //IMAGE_ATLAS_PAGE_SIZE
+
+/**
+ * Width and height (in pixels) of the screen tiles used to track which parts
+ * of the screen changed between frames, see tumDrawSetDamageTracking()
+ */
+#ifndef DAMAGE_TILE_SIZE
+#define DAMAGE_TILE_SIZE 32
+#endif //DAMAGE_TILE_SIZE
+
+/**
+ * Maximum number of transforms each thread can push using
+ * tumDrawPushTransform()
+ */
+#ifndef DRAW_TRANSFORM_STACK_DEPTH
+#define DRAW_TRANSFORM_STACK_DEPTH 16
+#endif //DRAW_TRANSFORM_STACK_DEPTH
+
+/**
+ * Number of bins and width of each bin (in microseconds) of the
+ * present-to-present histogram, see tumDrawGetFrameStats()
+ */
+#ifndef FRAME_HISTOGRAM_BINS
+#define FRAME_HISTOGRAM_BINS 64
+#endif //FRAME_HISTOGRAM_BINS
+#ifndef FRAME_HISTOGRAM_BIN_WIDTH_US
+#define FRAME_HISTOGRAM_BIN_WIDTH_US 1000
+#endif //FRAME_HISTOGRAM_BIN_WIDTH_US
+
 /**
  * @name Hex RGB colours
  *
@@ -165,6 +209,151 @@ char *tumGetErrorMessage(void);
  */
 int tumDrawInit(char *path);
 
+/**
+ * @brief Initializes the TUM Draw backend without a window or GL context
+ *
+ * All drawing is done by SDL's software renderer into an offscreen surface,
+ * allowing the emulator to run on machines without a display, eg. for
+ * automated tests. Frames are not paced by default in headless mode. Frames
+ * can be saved to files using tumDrawSetFrameCapture().
+ *
+ * @param path Path to the folder's location where the program's binary is
+ * located
+ * @return 0 on success
+ */
+int tumDrawInitHeadless(char *path);
+
+/**
+ * @brief Formats in which drawn frames can be captured
+ */
+typedef enum {
+    TUM_DRAW_CAPTURE_NONE = 0, /**< Frames are not captured */
+    TUM_DRAW_CAPTURE_RGBA, /**< Raw pixels, 8 bit per channel in RGBA order */
+    TUM_DRAW_CAPTURE_PNG, /**< PNG image files */
+} tum_draw_capture_format_t;
+
+/**
+ * @brief Saves each frame drawn by tumDrawUpdateScreen() to a file
+ *
+ * Frames are written into a ring of ring_size files, named using the given
+ * prefix followed by the frame's index in the ring and the format's suffix,
+ * eg. "frames/frame_00003.png". Once the ring is full the oldest file is
+ * overwritten. Raw RGBA files contain SCREEN_HEIGHT rows of SCREEN_WIDTH
+ * pixels without any header.
+ *
+ * @param format Format in which frames are saved, TUM_DRAW_CAPTURE_NONE stops
+ * capturing frames
+ * @param prefix Path and filename prefix of the captured frame files
+ * @param ring_size Number of files that are written before the first file is
+ * overwritten
+ * @return 0 on success
+ */
+int tumDrawSetFrameCapture(tum_draw_capture_format_t format, char *prefix,
+                           unsigned int ring_size);
+
+/**
+ * @brief Only redraws the parts of the screen that changed since the last frame
+ *
+ * The screen is split into tiles of DAMAGE_TILE_SIZE pixels. Each frame the
+ * jobs touching a tile are compared to those of the previous frame, only the
+ * jobs touching changed tiles are drawn, clipped to those tiles, into a
+ * persistent render target. Mostly static screens, such as menus, thus cost
+ * next to nothing to draw while still being redrawn completely every frame.
+ *
+ * @param enable 1 to enable damage tracking, 0 to redraw the entire screen
+ * every frame
+ * @return 0 on success
+ */
+int tumDrawSetDamageTracking(int enable);
+
+/**
+ * @brief Rates at which frames can be presented
+ */
+typedef enum {
+    TUM_DRAW_PACING_NONE = 0, /**< Frames are presented as soon as they are
+                                drawn, default in headless mode */
+    TUM_DRAW_PACING_VSYNC, /**< Frames are presented at the display's refresh
+                             rate, synchronized to its vertical blank */
+    TUM_DRAW_PACING_FIXED, /**< Frames are presented at a fixed rate, default
+                             at configFPS_LIMIT_RATE if configFPS_LIMIT is 1 */
+} tum_draw_pacing_t;
+
+/**
+ * @brief Sets the rate at which frames are presented
+ *
+ * Frame deadlines are kept on the monotonic clock. The task that calls
+ * tumDrawUpdateScreen() should wait for the next deadline before updating the
+ * screen again, eg.
+ *
+ * @code
+ * while (1) {
+ *     tumDrawUpdateScreen();
+ *     vTaskDelay(tumDrawGetFrameDelayTicks());
+ * }
+ * @endcode
+ *
+ * Without SDL 2.0.18 a change to or from TUM_DRAW_PACING_VSYNC only
+ * changes the renderer's vsync once tumDrawBindThread() is called.
+ *
+ * @param mode Pacing mode
+ * @param rate Frames per second, only used for TUM_DRAW_PACING_FIXED
+ * @return 0 on success
+ */
+int tumDrawSetFramePacing(tum_draw_pacing_t mode, unsigned int rate);
+
+/**
+ * @brief Returns the time until the next frame should be presented
+ *
+ * @return Microseconds until the next frame deadline, 0 if the deadline has
+ * already passed or frames are not paced
+ */
+unsigned long tumDrawGetFrameDelay(void);
+
+/**
+ * @brief Returns the number of ticks to pass to vTaskDelay() such that the
+ * next frame is not presented before its deadline
+ *
+ * vTaskDelay() counts the tick that is already in progress, so the delay is
+ * rounded up to whole ticks plus one. A late or unpaced frame thus still
+ * waits one tick, which lets lower priority tasks run.
+ *
+ * @return Ticks until the next frame deadline, at least 1
+ */
+unsigned long tumDrawGetFrameDelayTicks(void);
+
+/**
+ * @brief Frame timing statistics, gathered each time a frame is presented
+ */
+typedef struct tum_draw_frame_stats {
+    unsigned long frames; /**< Frames presented */
+    unsigned long missed_deadlines; /**< Frame deadlines passed without a
+                                      frame being presented */
+    unsigned long min_interval_us; /**< Shortest present-to-present time */
+    unsigned long max_interval_us; /**< Longest present-to-present time */
+    unsigned long long total_interval_us; /**< Sum of all present-to-present
+                                            times, frames - 1 intervals */
+    unsigned long histogram[FRAME_HISTOGRAM_BINS]; /**< Present-to-present
+        times in bins of FRAME_HISTOGRAM_BIN_WIDTH_US, the last bin also
+        counts all longer times */
+    unsigned int queue_depth; /**< Jobs drawn in the last frame */
+    unsigned int max_queue_depth; /**< Most jobs drawn in a single frame */
+    unsigned int pending_jobs; /**< Jobs already submitted for the next
+                                 frame when the last frame was presented */
+} tum_draw_frame_stats_t;
+
+/**
+ * @brief Retrieves a copy of the frame timing statistics
+ *
+ * @param stats Reference to where the statistics should be copied
+ * @return 0 on success
+ */
+int tumDrawGetFrameStats(tum_draw_frame_stats_t *stats);
+
+/**
+ * @brief Resets all frame timing statistics to zero
+ */
+void tumDrawResetFrameStats(void);
+
 /**
  * @brief Transfers the drawing ability to the calling thread/taskd
  *
@@ -196,10 +385,31 @@ void tumDrawExit(void);
  * dependent calls, such as tumDrawUpdateScreen() will fail if the calling
  * thread does not hold the GL context.
  *
+ * Draw jobs from different threads are drawn in the order in which they were
+ * submitted. Jobs submitted while the screen is being updated are drawn in
+ * the following frame.
+ *
  * @returns 0 on success
  */
 int tumDrawUpdateScreen(void);
 
+/**
+ * @brief Groups the calling thread's following draw jobs into one batch
+ *
+ * Draw jobs are submitted without any locking, such that multiple threads
+ * can draw concurrently. Jobs submitted between tumDrawBeginBatch() and
+ * tumDrawEndBatch() are only made visible to tumDrawUpdateScreen() once
+ * the batch is ended, guaranteeing that they are all drawn in the same
+ * frame. Batches may be nested, only the outermost tumDrawEndBatch()
+ * publishes the batch.
+ */
+void tumDrawBeginBatch(void);
+
+/**
+ * @brief Ends a batch of draw jobs started with tumDrawBeginBatch()
+ */
+void tumDrawEndBatch(void);
+
 /**
  * @brief Sets the screen to a solid colour
  *
@@ -557,6 +767,9 @@ int tumDrawAnimationDrawFrame(sequence_handle_t sequence, unsigned ms_timestep,
 /**
  * @brief Sets the global draw position offset's X axis value
  *
+ * The global offset is captured once per frame by tumDrawUpdateScreen() and
+ * applied to all jobs drawn in that frame.
+ *
  * @param offset Value in pixels that all drawing should be offset on the X axis
  * @return 0 on success
  */
@@ -586,5 +799,54 @@ int tumDrawGetGlobalXOffset(int *offset);
  */
 int tumDrawGetGlobalYOffset(int *offset);
 
+/**
+ * @brief Saves the calling thread's current transform on its transform stack
+ *
+ * Each thread has its own transform, which is applied to the positions and
+ * sizes of everything the thread draws. Transforms are applied when a draw
+ * function is called, changing the transform afterwards does not affect
+ * previous calls. A scope of draw calls is wrapped by tumDrawPushTransform()
+ * and tumDrawPopTransform(), eg.
+ *
+ * @code
+ * tumDrawPushTransform();
+ * tumDrawTranslate(100, 50);
+ * tumDrawScale(2, 2);
+ * tumDrawFilledBox(0, 0, 10, 10, Red); // Drawn at 100,50 with size 20x20
+ * tumDrawPopTransform();
+ * @endcode
+ *
+ * Radii and line thicknesses are scaled by the mean of the X and Y scales.
+ *
+ * @return 0 on success, -1 if DRAW_TRANSFORM_STACK_DEPTH transforms are
+ * already pushed
+ */
+int tumDrawPushTransform(void);
+
+/**
+ * @brief Restores the transform saved by the matching tumDrawPushTransform()
+ *
+ * @return 0 on success, -1 if no transform was pushed
+ */
+int tumDrawPopTransform(void);
+
+/**
+ * @brief Moves the origin of the calling thread's current transform
+ *
+ * @param x Offset along the X axis, in the current transform's scale
+ * @param y Offset along the Y axis, in the current transform's scale
+ * @return 0 on success
+ */
+int tumDrawTranslate(float x, float y);
+
+/**
+ * @brief Scales the calling thread's current transform
+ *
+ * @param x Factor by which the X axis is scaled
+ * @param y Factor by which the Y axis is scaled
+ * @return 0 on success
+ */
+int tumDrawScale(float x, float y);
+
 /** @} */
 #endif
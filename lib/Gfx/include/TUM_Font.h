@@ -74,6 +74,67 @@
  */
 #define MAX_FONT_NAME_LENGTH 256
 
+/**
+ * First character rendered into a font's glyph atlas
+ */
+#define FONT_ATLAS_FIRST_GLYPH 32
+
+/**
+ * Last character rendered into a font's glyph atlas, strings are rendered as
+ * Latin-1 as is done by TTF_RenderText_*
+ */
+#define FONT_ATLAS_LAST_GLYPH 255
+
+/**
+ * Width in pixels of a font's glyph atlas surface, the height depends on the
+ * font's size
+ */
+#ifndef FONT_ATLAS_WIDTH
+#define FONT_ATLAS_WIDTH 512
+#endif //FONT_ATLAS_WIDTH
+
+/**
+ * Maximum number of glyph atlases kept, the least recently used atlas of an
+ * unreferenced font is freed to make room for a new one
+ */
+#ifndef FONT_ATLAS_CACHE_SIZE
+#define FONT_ATLAS_CACHE_SIZE 8
+#endif //FONT_ATLAS_CACHE_SIZE
+
+/**
+ * @brief Location and metrics of a single glyph within a glyph atlas
+ */
+typedef struct tum_font_glyph {
+    SDL_Rect src; /**< Glyph's area within the atlas */
+    int x_offset; /**< Horizontal offset of the glyph from the pen position */
+    int advance; /**< Horizontal distance to the next glyph's pen position */
+} tum_font_glyph_t;
+
+/**
+ * @brief Kerning applied between two consecutive glyphs of an atlas
+ */
+typedef struct tum_font_kerning {
+    unsigned short pair; /**< Index of the first glyph times the glyph count
+                              plus the index of the second glyph */
+    short amount; /**< Pixels added to the pen position */
+} tum_font_kerning_t;
+
+/**
+ * @brief Pre-rendered glyphs of a font, the glyphs are rendered in white such
+ * that they can be coloured using texture colour modulation
+ */
+typedef struct tum_font_atlas {
+    SDL_Surface *surface; /**< All glyphs, packed into rows */
+    SDL_Texture *tex; /**< Texture created from surface by the renderer */
+    unsigned int tex_generation; /**< Renderer generation tex belongs to */
+    int height; /**< Height of a line of text */
+    tum_font_glyph_t glyphs[FONT_ATLAS_LAST_GLYPH - FONT_ATLAS_FIRST_GLYPH +
+                                                  1];
+    tum_font_kerning_t *kerning; /**< Non-zero kerning pairs, sorted */
+    unsigned int kerning_count;
+    struct tum_font_atlas *next; /**< Next atlas waiting to be freed */
+} tum_font_atlas_t;
+
 /**
  * @brief Handle used to reference a specific font/size configuration when
  * restoring a font using tumFontSelectFontFromHandle(), current font can be
@@ -141,6 +202,68 @@ void tumFontPutFont(TTF_Font *font);
  */
 void tumFontPutFontHandle(font_handle_t font);
 
+/**
+ * @brief Returns the glyph atlas of a font, rendering the atlas if it has not
+ * yet been rendered. The atlas is valid while a reference to the font handle
+ * is held, afterwards it may be freed to keep at most FONT_ATLAS_CACHE_SIZE
+ * atlases.
+ *
+ * @param font Font handle, retrieved using tumFontGetCurFontHandle()
+ * @return Pointer to the font's glyph atlas, NULL on error
+ */
+tum_font_atlas_t *tumFontGetGlyphAtlas(font_handle_t font);
+
+/**
+ * @brief Returns the glyph used to draw the given character
+ *
+ * @param atlas Glyph atlas, retrieved using tumFontGetGlyphAtlas()
+ * @param c Character to be drawn
+ * @return Pointer to the character's glyph, NULL if the character has no glyph
+ */
+static inline tum_font_glyph_t *tumFontGetGlyph(tum_font_atlas_t *atlas,
+        unsigned char c)
+{
+    if (c < FONT_ATLAS_FIRST_GLYPH || c > FONT_ATLAS_LAST_GLYPH) {
+        return NULL;
+    }
+
+    return &atlas->glyphs[c - FONT_ATLAS_FIRST_GLYPH];
+}
+
+/**
+ * @brief Returns the kerning between two consecutive characters
+ *
+ * @param atlas Glyph atlas, retrieved using tumFontGetGlyphAtlas()
+ * @param prev Character drawn before c
+ * @param c Character to be drawn
+ * @return Pixels to be added to the pen position before drawing c
+ */
+int tumFontGetKerning(tum_font_atlas_t *atlas, unsigned char prev,
+                      unsigned char c);
+
+/**
+ * @brief Frees the glyph atlases of deleted fonts and atlases evicted from
+ * the cache. Atlas textures belong to the renderer, so this must be called
+ * from the thread holding the GL context, tumDrawUpdateScreen() does so.
+ *
+ * @param tex_generation Generation of the current renderer, textures of an
+ * earlier renderer were destroyed along with it
+ */
+void tumFontFreeRetiredAtlases(unsigned int tex_generation);
+
+/**
+ * @brief Calculates the size of a string drawn using the given font, using
+ * only the cached glyph metrics of the font's atlas
+ *
+ * @param font Font handle, retrieved using tumFontGetCurFontHandle()
+ * @param str String to be measured
+ * @param width Returns the width of the string in pixels
+ * @param height Returns the height of the string in pixels
+ * @return 0 on success
+ */
+int tumFontGetTextSize(font_handle_t font, char *str, int *width,
+                       int *height);
+
 /**
  * @brief Retrieved a handle to the current font, unlike tumFontGetCurFont()
  * the handle contains the TUM_Font's metadata structure for the font instance
@@ -185,9 +308,9 @@ int tumFontSelectFontFromName(char *font_name);
 int tumFontSelectFontFromHandle(font_handle_t font_handle);
 
 /**
- * @brief Sets the size of the current font to be used. The font is set by making
- * a copy of the current font if the current font's configuration (font + size)
- * is being referenced by pending draw jobs. All subsequent text draw jobs
+ * @brief Sets the size of the current font to be used. Each font and size
+ * configuration is only loaded once, a configuration that has already been
+ * loaded is reused, along with its glyph atlas. All subsequent text draw jobs
  * will use the currently active font and the specified size until the size
  * and/or font are changed again.
  *
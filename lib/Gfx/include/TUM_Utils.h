@@ -66,6 +66,10 @@ char *tumUtilGetBinFolderPath(char *bin_path);
  * @brief Searches for a file in the RESOURCES_DIRECTORY and returns
  * a FILE * if found
  *
+ * Resources are looked up by their basename in an index of the
+ * RESOURCES_DIRECTORY that is built on the first lookup, see
+ * tumUtilRescanResources().
+ *
  * @param resource_name Name of the file to be found
  * @param mode The reading mode to be used when opening the file, eg. "rw"
  * @return FILE reference if found, otherwise NULL
@@ -76,14 +80,23 @@ FILE *tumUtilFindResource(char *resource_name, const char *mode);
  * @brief Similar to tumUtilFindResource() only returning the file's path instead
  * of the opened FILE's reference.
  *
- * The found filename is stored in a statically allocated buffer and can be
- * overwritten by subsequent calls to the functions
+ * The returned path is a copy that the caller must free(), it stays valid
+ * when the resources are rescanned using tumUtilRescanResources(). If
+ * resource_name is an existing path then a copy of it is returned.
  *
  * @param resource_name Name of the file to be found
- * @return Reference to the statically allocated filename, else NULL
+ * @return Allocated copy of the found filename, else NULL
  */
 char *tumUtilFindResourcePath(char *resource_name);
 
+/**
+ * @brief Rebuilds the index of files found in the RESOURCES_DIRECTORY and its
+ * sub-directories, required if resources are added or removed while running.
+ *
+ * @return 0 on success
+ */
+int tumUtilRescanResources(void);
+
 /**
  * @brief A handle to a ring buffer object, created using rbuf_init()
  */
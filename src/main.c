@@ -1,10 +1,12 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <SDL2/SDL_scancode.h>
 
 #include "FreeRTOS.h"
+#include "message_buffer.h"
 #include "queue.h"
 #include "semphr.h"
 #include "task.h"
@@ -36,6 +38,8 @@
 
 #define STATE_DEBOUNCE_DELAY 300
 
+#define TICKS_TO_MS(TICKS) ((TICKS) * 1000 / configTICK_RATE_HZ)
+
 #define KEYCODE(CHAR) SDL_SCANCODE_##CHAR
 #define CAVE_SIZE_X SCREEN_WIDTH / 2
 #define CAVE_SIZE_Y SCREEN_HEIGHT / 2
@@ -46,6 +50,7 @@
 #define UDP_BUFFER_SIZE 2000
 #define UDP_TEST_PORT_1 1234
 #define UDP_TEST_PORT_2 4321
+#define UDP_MSG_BUFFER_SIZE (8 * UDP_BUFFER_SIZE)
 #define MSG_QUEUE_BUFFER_SIZE 1000
 #define MSG_QUEUE_MAX_MSG_COUNT 10
 #define TCP_BUFFER_SIZE 2000
@@ -61,6 +66,8 @@ aIO_handle_t mq_one = NULL;
 aIO_handle_t mq_two = NULL;
 aIO_handle_t udp_soc_one = NULL;
 aIO_handle_t udp_soc_two = NULL;
+MessageBufferHandle_t udp_msgs = NULL;
+static const char *udp_names[] = { "first", "second" };
 aIO_handle_t tcp_soc = NULL;
 
 const unsigned char next_state_signal = NEXT_TASK;
@@ -77,7 +84,6 @@ static TaskHandle_t DemoSendTask = NULL;
 
 static QueueHandle_t StateQueue = NULL;
 static SemaphoreHandle_t DrawSignal = NULL;
-static SemaphoreHandle_t ScreenLock = NULL;
 
 static image_handle_t logo_image = NULL;
 
@@ -137,7 +143,8 @@ void basicSequentialStateMachine(void *pvParameters)
         1; // Only re-evaluate state if it has changed
     unsigned char input = 0;
 
-    const int state_change_period = STATE_DEBOUNCE_DELAY;
+    const TickType_t state_change_period =
+        pdMS_TO_TICKS(STATE_DEBOUNCE_DELAY);
 
     TickType_t last_change = xTaskGetTickCount();
 
@@ -187,21 +194,14 @@ initial_state:
 
 void vSwapBuffers(void *pvParameters)
 {
-    TickType_t xLastWakeTime;
-    xLastWakeTime = xTaskGetTickCount();
-    const TickType_t frameratePeriod = 20;
-
     tumDrawBindThread(); // Setup Rendering handle with correct GL context
 
     while (1) {
-        if (xSemaphoreTake(ScreenLock, portMAX_DELAY) == pdTRUE) {
-            tumDrawUpdateScreen();
-            tumEventFetchEvents(FETCH_EVENT_BLOCK);
-            xSemaphoreGive(ScreenLock);
-            xSemaphoreGive(DrawSignal);
-            vTaskDelayUntil(&xLastWakeTime,
-                            pdMS_TO_TICKS(frameratePeriod));
-        }
+        tumDrawUpdateScreen();
+        tumEventFetchEvents(FETCH_EVENT_BLOCK);
+        xSemaphoreGive(DrawSignal);
+
+        vTaskDelay((TickType_t)tumDrawGetFrameDelayTicks());
     }
 }
 
@@ -393,23 +393,38 @@ static int vCheckStateInput(void)
     return 0;
 }
 
-void UDPHandlerOne(size_t read_size, char *buffer, void *args)
+void UDPHandler(size_t read_size, char *buffer, void *args)
 {
-    prints("UDP Recv in first handler: %s\n", buffer);
-}
+    // Runs on the AsyncIO reactor thread, only hand the datagram over.
+    // Both sockets' handlers run there one at a time, so they share one
+    // buffer, each message starts with the index of its socket. Datagrams
+    // that find the buffer full are dropped.
+    char msg[UDP_BUFFER_SIZE + 1];
 
-void UDPHandlerTwo(size_t read_size, char *buffer, void *args)
-{
-    prints("UDP Recv in second handler: %s\n", buffer);
+    if (read_size > UDP_BUFFER_SIZE) {
+        read_size = UDP_BUFFER_SIZE;
+    }
+
+    msg[0] = (char)(uintptr_t)args;
+    memcpy(msg + 1, buffer, read_size);
+    (void)xMessageBufferSendFromISR(udp_msgs, msg, read_size + 1, NULL);
 }
 
 void vUDPDemoTask(void *pvParameters)
 {
+    static char buffer[UDP_BUFFER_SIZE + 2];
     char *addr = NULL; // Loopback
     in_port_t port = UDP_TEST_PORT_1;
+    size_t len;
+
+    udp_msgs = xMessageBufferCreate(UDP_MSG_BUFFER_SIZE);
+    if (!udp_msgs) {
+        fprints(stderr, "Failed to create UDP message buffer\n");
+        vTaskDelete(NULL);
+    }
 
     udp_soc_one = aIOOpenUDPSocket(addr, port, UDP_BUFFER_SIZE,
-                                   UDPHandlerOne, NULL);
+                                   UDPHandler, (void *)0);
 
     prints("UDP socket opened on port %d\n", port);
     prints("Demo UDP Socket can be tested using\n");
@@ -418,14 +433,21 @@ void vUDPDemoTask(void *pvParameters)
     port = UDP_TEST_PORT_2;
 
     udp_soc_two = aIOOpenUDPSocket(addr, port, UDP_BUFFER_SIZE,
-                                   UDPHandlerTwo, NULL);
+                                   UDPHandler, (void *)1);
 
     prints("UDP socket opened on port %d\n", port);
     prints("Demo UDP Socket can be tested using\n");
     prints("*** netcat -vv localhost %d -u ***\n", port);
 
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Wakes for a datagram on either socket
+        len = xMessageBufferReceive(udp_msgs, buffer, UDP_BUFFER_SIZE + 1,
+                                    portMAX_DELAY);
+        if (len) {
+            buffer[len] = '\0';
+            prints("UDP Recv in %s handler: %s\n", udp_names[(unsigned char)buffer[0]],
+                   buffer + 1);
+        }
     }
 }
 
@@ -500,7 +522,7 @@ void vTCPDemoTask(void *pvParameters)
     prints("*** netcat -vv localhost %d ***\n", port);
 
     while (1) {
-        vTaskDelay(10);
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
@@ -530,7 +552,7 @@ void vDemoTask1(void *pvParameters)
                                     FETCH_EVENT_NO_GL_CHECK);
                 xGetButtonInput(); // Update global input
 
-                xSemaphoreTake(ScreenLock, portMAX_DELAY);
+                tumDrawBeginBatch();
 
                 // Clear screen
                 checkDraw(tumDrawClear(White), __FUNCTION__);
@@ -538,19 +560,19 @@ void vDemoTask1(void *pvParameters)
                 vDrawCave(tumEventGetMouseLeft());
                 vDrawButtonText();
                 tumDrawAnimationDrawFrame(forward_sequence,
-                                          xTaskGetTickCount() -
-                                          xLastFrameTime,
+                                          TICKS_TO_MS(xTaskGetTickCount() -
+                                                      xLastFrameTime),
                                           SCREEN_WIDTH - 50, SCREEN_HEIGHT - 60);
                 tumDrawAnimationDrawFrame(reverse_sequence,
-                                          xTaskGetTickCount() -
-                                          xLastFrameTime,
+                                          TICKS_TO_MS(xTaskGetTickCount() -
+                                                      xLastFrameTime),
                                           SCREEN_WIDTH - 50 - 40, SCREEN_HEIGHT - 60);
                 xLastFrameTime = xTaskGetTickCount();
 
                 // Draw FPS in lower right corner
                 vDrawFPS();
 
-                xSemaphoreGive(ScreenLock);
+                tumDrawEndBatch();
 
                 // Get input and check for state change
                 vCheckStateInput();
@@ -603,7 +625,7 @@ void vDemoTask2(void *pvParameters)
 
                 xGetButtonInput(); // Update global button data
 
-                xSemaphoreTake(ScreenLock, portMAX_DELAY);
+                tumDrawBeginBatch();
                 // Clear screen
                 checkDraw(tumDrawClear(White), __FUNCTION__);
 
@@ -654,7 +676,7 @@ void vDemoTask2(void *pvParameters)
                 // Draw FPS in lower right corner
                 vDrawFPS();
 
-                xSemaphoreGive(ScreenLock);
+                tumDrawEndBatch();
 
                 // Check for state change
                 vCheckStateInput();
@@ -681,7 +703,10 @@ int main(int argc, char *argv[])
     //  `printf` and `fprintf`. So you can read the documentation on these
     //  functions to understand the functionality.
 
-    if (tumDrawInit(bin_folder_path)) {
+    // Without a display the emulator can be run headless, eg. for testing
+    if ((argc > 1 && !strcmp(argv[1], "--headless")) ?
+        tumDrawInitHeadless(bin_folder_path) :
+        tumDrawInit(bin_folder_path)) {
         PRINT_ERROR("Failed to intialize drawing");
         goto err_init_drawing;
     }
@@ -728,11 +753,6 @@ int main(int argc, char *argv[])
         PRINT_ERROR("Failed to create draw signal");
         goto err_draw_signal;
     }
-    ScreenLock = xSemaphoreCreateMutex();
-    if (!ScreenLock) {
-        PRINT_ERROR("Failed to create screen lock");
-        goto err_screen_lock;
-    }
 
     // Message sending
     StateQueue = xQueueCreate(STATE_QUEUE_LENGTH, sizeof(unsigned char));
@@ -794,8 +814,6 @@ err_bufferswap:
 err_statemachine:
     vQueueDelete(StateQueue);
 err_state_queue:
-    vSemaphoreDelete(ScreenLock);
-err_screen_lock:
     vSemaphoreDelete(DrawSignal);
 err_draw_signal:
     vSemaphoreDelete(buttons.lock);